@@ -0,0 +1,421 @@
+#include "vglobal.h"
+#include "vdht.h"
+
+/*
+ * benchmark of dht msg codecs. each msg of schema is encoded and decoded
+ * through method sets of both bencode and binary codecs, with payloads of
+ * a busy node: 4 addresses per node and 8 nodes per find_closest_nodes_rsp.
+ * time, heap allocations and bytes are reported per msg.
+ *
+ * with a corpus given, msgs recorded in it are replayed through decoders
+ * instead. corpus is either log of vdhtd, where each received bencoded msg
+ * is logged after "[dht msg]->", or trace of datagrams captured by vdhtd
+ * with "dht.trace" configured (see vtrace.h).
+ *
+ * usage: vdht_codec_bench [corpus] [ops]
+ */
+
+#define BENCH_OPS        ((int)200000)
+#define BENCH_MAX_MSGS   ((int)65536)
+#define BENCH_MSG_SZ     ((int)(8*BUF_SZ))
+#define BENCH_LOG_TAG    "[dht msg]->"
+#define BENCH_NODES      ((int)8)
+#define BENCH_ADDRS      ((int)4)
+
+/*
+ * heap allocations are counted by wrapping allocators at link time, so
+ * that those inside libvdht are counted too.
+ */
+static long bench_allocs = 0;
+
+void* __real_malloc (size_t);
+void* __real_calloc (size_t, size_t);
+void* __real_realloc(void*, size_t);
+
+void* __wrap_malloc(size_t sz)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(sz);
+}
+
+void* __wrap_calloc(size_t num, size_t sz)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(num, sz);
+}
+
+void* __wrap_realloc(void* ptr, size_t sz)
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, sz);
+}
+
+/*
+ * payloads to encode, and slots to decode into.
+ */
+struct bench_args {
+    vtoken   token;
+    vnodeId  srcId;
+    vnodeId  targetId;
+    vnodeInfo_relax nodei[BENCH_NODES];
+    struct varray   nodes;
+    struct sockaddr_in addr;
+    vsrvcInfo_relax srvci;
+
+    vtoken   dec_token;
+    vnodeId  dec_srcId;
+    vnodeId  dec_targetId;
+    vnodeInfo_relax dec_nodei;
+    struct varray   dec_nodes;
+    struct sockaddr_in dec_addr;
+    vsrvcInfo_relax dec_srvci;
+};
+
+static struct bench_args bench;
+
+#define BENCH_ENC_ARG_NONE
+#define BENCH_ENC_ARG_ID    , &bench.targetId
+#define BENCH_ENC_ARG_NODE  , (vnodeInfo*)&bench.nodei[0]
+#define BENCH_ENC_ARG_NODES , &bench.nodes
+#define BENCH_ENC_ARG_ADDR  , &bench.addr
+#define BENCH_ENC_ARG_SRVC  , (vsrvcInfo*)&bench.srvci
+
+#define BENCH_DEC_ARG_NONE
+#define BENCH_DEC_ARG_ID    , &bench.dec_targetId
+#define BENCH_DEC_ARG_NODE  , (vnodeInfo*)&bench.dec_nodei
+#define BENCH_DEC_ARG_NODES , &bench.dec_nodes
+#define BENCH_DEC_ARG_ADDR  , &bench.dec_addr
+#define BENCH_DEC_ARG_SRVC  , (vsrvcInfo*)&bench.dec_srvci
+
+typedef int (*bench_enc_t)(struct vdht_enc_ops*, void*, int);
+typedef int (*bench_dec_t)(struct vdht_dec_ops*, void*);
+
+#define BENCH_CODEC(id, name, y, len, desc, kind) \
+static \
+int _aux_bench_enc_##name(struct vdht_enc_ops* ops, void* buf, int sz) \
+{ \
+    return ops->name(&bench.token, &bench.srcId BENCH_ENC_ARG_##kind, buf, sz); \
+} \
+static \
+int _aux_bench_dec_##name(struct vdht_dec_ops* ops, void* ctxt) \
+{ \
+    return ops->name(ctxt, &bench.dec_token, &bench.dec_srcId BENCH_DEC_ARG_##kind); \
+}
+
+VDHT_MSG_SCHEMA(BENCH_CODEC)
+
+#define BENCH_ENC_ENTRY(id, name, y, len, desc, kind) [id] = _aux_bench_enc_##name,
+#define BENCH_DEC_ENTRY(id, name, y, len, desc, kind) [id] = _aux_bench_dec_##name,
+
+static bench_enc_t bench_encs[VDHT_UNKNOWN] = { VDHT_MSG_SCHEMA(BENCH_ENC_ENTRY) };
+static bench_dec_t bench_decs[VDHT_UNKNOWN] = { VDHT_MSG_SCHEMA(BENCH_DEC_ENTRY) };
+
+struct bench_codec {
+    const char* name;
+    int msgId;
+    uint32_t magic;
+    struct vdht_enc_ops* enc_ops;
+    struct vdht_dec_ops* dec_ops;
+};
+
+static struct bench_codec bench_codecs[] = {
+    {"bencode", VMSG_DHT,     DHT_MAGIC,     &dht_enc_ops,     &dht_dec_ops    },
+    {"binary",  VMSG_DHT_BIN, DHT_BIN_MAGIC, &dht_bin_enc_ops, &dht_bin_dec_ops},
+    {NULL, 0, 0, NULL, NULL}
+};
+
+static
+void _aux_bench_args_init(void)
+{
+    struct sockaddr_in addr;
+    vnodeInfo* nodei = NULL;
+    vsrvcInfo* srvci = NULL;
+    vnodeVer ver;
+    vnodeId  id;
+    int i = 0;
+    int k = 0;
+
+    vnodeVer_unstrlize(VDHT_BIN_VER, &ver);
+    vtoken_make(&bench.token);
+    vtoken_make(&bench.srcId);
+    vtoken_make(&bench.targetId);
+
+    varray_init(&bench.nodes, BENCH_NODES);
+    for (i = 0; i < BENCH_NODES; i++) {
+        vtoken_make(&id);
+        vnodeInfo_relax_init(&bench.nodei[i], &id, &ver, i);
+        nodei = (vnodeInfo*)&bench.nodei[i];
+        for (k = 0; k < BENCH_ADDRS; k++) {
+            vsockaddr_convert("192.168.104.125", 12300 + i * BENCH_ADDRS + k, &addr);
+            vnodeInfo_add_addr(&nodei, &addr);
+        }
+        varray_add_tail(&bench.nodes, nodei);
+    }
+    vsockaddr_convert("27.115.62.114", 15300, &bench.addr);
+
+    vtoken_make(&id);
+    vsrvcInfo_relax_init(&bench.srvci, &id, &bench.srcId, 5);
+    srvci = (vsrvcInfo*)&bench.srvci;
+    for (k = 0; k < BENCH_ADDRS; k++) {
+        vsockaddr_convert("10.0.0.12", 13500 + k, &addr);
+        vsrvcInfo_add_addr(&srvci, &addr);
+    }
+    varray_init(&bench.dec_nodes, BENCH_NODES);
+    return ;
+}
+
+static
+double _aux_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * to decode @buf of @len through @codec, as route does for received msg.
+ * nodes decoded are owned by decoder, so only dropped from array.
+ */
+static
+int _aux_bench_decode(struct bench_codec* codec, void* buf, int len)
+{
+    void* ctxt = NULL;
+    int dhtId = 0;
+    int ret = 0;
+
+    dhtId = codec->dec_ops->dec_begin(buf, len, &ctxt);
+    if ((dhtId < 0) || (dhtId >= VDHT_UNKNOWN)) {
+        return -1;
+    }
+    ret = bench_decs[dhtId](codec->dec_ops, ctxt);
+    codec->dec_ops->dec_done(ctxt);
+    while (varray_size(&bench.dec_nodes) > 0) {
+        varray_pop_tail(&bench.dec_nodes);
+    }
+    return (ret < 0) ? -1 : dhtId;
+}
+
+static
+void _aux_bench_codecs(int ops)
+{
+    struct bench_codec* codec = NULL;
+    char buf[BENCH_MSG_SZ];
+    double begin = 0;
+    double enc_ns = 0;
+    double dec_ns = 0;
+    long enc_allocs = 0;
+    long dec_allocs = 0;
+    int nerrs = 0;
+    int len = 0;
+    int id = 0;
+    int i = 0;
+
+    printf("%-8s %-24s %8s %10s %10s %10s %10s\n", "codec", "msg", "bytes",
+            "enc ns", "enc alloc", "dec ns", "dec alloc");
+    for (codec = bench_codecs; codec->name; codec++) {
+        for (id = 0; id < VDHT_UNKNOWN; id++) {
+            len = bench_encs[id](codec->enc_ops, buf, sizeof(buf));
+            if (len < 0) {
+                printf("%-8s %-24s failed to encode\n", codec->name, vdht_get_desc(id));
+                continue;
+            }
+
+            enc_allocs = bench_allocs;
+            begin = _aux_bench_now();
+            for (i = 0; i < ops; i++) {
+                (void)bench_encs[id](codec->enc_ops, buf, sizeof(buf));
+            }
+            enc_ns = (_aux_bench_now() - begin) * 1e9 / ops;
+            enc_allocs = bench_allocs - enc_allocs;
+
+            nerrs = 0;
+            dec_allocs = bench_allocs;
+            begin = _aux_bench_now();
+            for (i = 0; i < ops; i++) {
+                nerrs += (_aux_bench_decode(codec, buf, len) != id);
+            }
+            dec_ns = (_aux_bench_now() - begin) * 1e9 / ops;
+            dec_allocs = bench_allocs - dec_allocs;
+
+            printf("%-8s %-24s %8d %10.1f %10.2f %10.1f %10.2f", codec->name, vdht_get_desc(id), len,
+                    enc_ns, (double)enc_allocs / ops, dec_ns, (double)dec_allocs / ops);
+            printf(nerrs ? "  (errs:%d)\n" : "\n", nerrs);
+        }
+    }
+    return ;
+}
+
+/*
+ * for replaying corpus.
+ */
+struct bench_msg {
+    struct bench_codec* codec;
+    char* data;
+    int   len;
+};
+
+static struct bench_msg bench_msgs[BENCH_MAX_MSGS];
+static int bench_nmsgs = 0;
+
+static
+void _aux_bench_add(struct bench_codec* codec, const char* data, int len)
+{
+    struct bench_msg* msg = NULL;
+
+    if ((bench_nmsgs >= BENCH_MAX_MSGS) || (len <= 0) || (len > BENCH_MSG_SZ)) {
+        return ;
+    }
+    msg = &bench_msgs[bench_nmsgs++];
+    msg->codec = codec;
+    msg->data  = (char*)malloc(len + 1);
+    memcpy(msg->data, data, len);
+    msg->data[len] = '\0';
+    msg->len = len;
+    return ;
+}
+
+/*
+ * to add datagram as received from wire: magic, msgId and then dht msg.
+ */
+static
+void _aux_bench_add_dgram(char* data, int len)
+{
+    struct bench_codec* codec = NULL;
+    uint32_t magic = 0;
+    int hdr = sizeof(uint32_t) + sizeof(int32_t);
+
+    if (len <= hdr) {
+        return ;
+    }
+    magic = get_uint32(data);
+    for (codec = bench_codecs; codec->name; codec++) {
+        if ((codec->magic == magic) && (codec->msgId == get_int32(offset_addr(data, sizeof(uint32_t))))) {
+            _aux_bench_add(codec, offset_addr(data, hdr), len - hdr);
+            break;
+        }
+    }
+    return ;
+}
+
+static
+int _aux_bench_load(const char* path)
+{
+    char  line[BENCH_MSG_SZ + 128];
+    char* s = NULL;
+    FILE* fp = NULL;
+    struct vtrace trace;
+    struct vmsg_sys sm;
+    uint32_t magic = 0;
+    int ret = 0;
+
+    fp = fopen(path, "r");
+    retE((!fp));
+
+    // datagrams captured by vdhtd, if it starts with trace magic.
+    if ((fread(&magic, sizeof(magic), 1, fp) == 1) && (magic == VTRACE_MAGIC)) {
+        fclose(fp);
+        ret = vtrace_open(&trace, path, 0);
+        retE((ret < 0));
+        while ((ret = vtrace_read(&trace, &sm, line, sizeof(line))) > 0) {
+            _aux_bench_add_dgram(line, ret);
+        }
+        vtrace_close(&trace);
+        return 0;
+    }
+
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp)) {
+        s = strstr(line, BENCH_LOG_TAG);
+        if (!s) {
+            continue;
+        }
+        s += strlen(BENCH_LOG_TAG);
+        _aux_bench_add(&bench_codecs[0], s, strcspn(s, "\r\n"));
+    }
+    fclose(fp);
+    return 0;
+}
+
+static
+void _aux_bench_replay(const char* path, int ops)
+{
+    int counts[VDHT_UNKNOWN + 1];
+    double begin = 0;
+    double secs = 0;
+    long allocs = 0;
+    long bytes = 0;
+    int rounds = 0;
+    int nerrs = 0;
+    int ret = 0;
+    int i = 0;
+    int k = 0;
+
+    for (i = 0; i < bench_nmsgs; i++) {
+        bytes += bench_msgs[i].len;
+    }
+    rounds = (ops + bench_nmsgs - 1) / bench_nmsgs;
+
+    memset(counts, 0, sizeof(counts));
+    allocs = bench_allocs;
+    begin  = _aux_bench_now();
+    for (k = 0; k < rounds; k++) {
+        for (i = 0; i < bench_nmsgs; i++) {
+            ret = _aux_bench_decode(bench_msgs[i].codec, bench_msgs[i].data, bench_msgs[i].len);
+            nerrs += (ret < 0);
+            if (!k) {
+                counts[(ret < 0) ? VDHT_UNKNOWN : ret]++;
+            }
+        }
+    }
+    secs   = _aux_bench_now() - begin;
+    allocs = bench_allocs - allocs;
+
+    printf("corpus %s: %d msgs, %ld bytes, %d rounds\n", path, bench_nmsgs, bytes, rounds);
+    for (i = 0; i < VDHT_UNKNOWN; i++) {
+        if (counts[i]) {
+            printf("  %-24s %8d\n", vdht_get_desc(i), counts[i]);
+        }
+    }
+    if (counts[VDHT_UNKNOWN]) {
+        printf("  %-24s %8d\n", "undecodable", counts[VDHT_UNKNOWN]);
+    }
+    printf("decode %10.1f ns/msg %10.2f allocs/msg %10.1f bytes/msg %10.0f msgs/s (errs:%d)\n",
+            secs * 1e9 / ((double)rounds * bench_nmsgs),
+            (double)allocs / ((double)rounds * bench_nmsgs),
+            (double)bytes / bench_nmsgs,
+            (double)rounds * bench_nmsgs / secs, nerrs);
+    return ;
+}
+
+int main(int argc, char** argv)
+{
+    int ops = BENCH_OPS;
+    int i = 0;
+
+    if (argc > 2) {
+        ops = atoi(argv[2]);
+    }
+    if (ops <= 0) {
+        printf("usage: %s [corpus] [ops]\n", argv[0]);
+        return -1;
+    }
+    _aux_bench_args_init();
+
+    if (argc < 2) {
+        _aux_bench_codecs(ops);
+        return 0;
+    }
+    if (_aux_bench_load(argv[1]) < 0) {
+        printf("failed to open %s\n", argv[1]);
+        return -1;
+    }
+    if (!bench_nmsgs) {
+        printf("no dht msg found in %s\n", argv[1]);
+        return -1;
+    }
+    _aux_bench_replay(argv[1], ops);
+    for (i = 0; i < bench_nmsgs; i++) {
+        free(bench_msgs[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "vglobal.h"
+#include "vdht.h"
+#include "vdht_core.h"
+
+/*
+ * throughput benchmark of decoding dht msgs, into spans with all tokens
+ * unpacked, with each hex decoder, scalar, sse2 and avx2. traffic is either
+ * taken from log of vdhtd, where each received msg is logged after
+ * "[dht msg]->", or made up of a mix of pings and lookups if no log given.
+ *
+ * usage: vdht_dec_bench [vdhtd log] [msgs]
+ */
+
+#define BENCH_MSGS       ((int)1000000)
+#define BENCH_MAX_MSGS   ((int)4096)
+#define BENCH_MSG_SZ     ((int)(8*BUF_SZ))
+#define BENCH_LOG_TAG    "[dht msg]->"
+
+struct bench_msg {
+    char* data;
+    int   len;
+};
+
+static struct bench_msg bench_msgs[BENCH_MAX_MSGS];
+static int bench_nmsgs = 0;
+static struct be_spans bench_spans;
+
+static
+void _aux_bench_add(const char* data, int len)
+{
+    struct bench_msg* msg = NULL;
+
+    if ((bench_nmsgs >= BENCH_MAX_MSGS) || (len <= 0) || (len > BENCH_MSG_SZ)) {
+        return ;
+    }
+    msg = &bench_msgs[bench_nmsgs++];
+    msg->data = (char*)malloc(len + 1);
+    memcpy(msg->data, data, len);
+    msg->data[len] = '\0';
+    msg->len = len;
+    return ;
+}
+
+static
+int _aux_bench_load(const char* path)
+{
+    char  line[BENCH_MSG_SZ + 128];
+    char* s = NULL;
+    FILE* fp = NULL;
+    int len = 0;
+
+    fp = fopen(path, "r");
+    retE((!fp));
+    while (fgets(line, sizeof(line), fp)) {
+        s = strstr(line, BENCH_LOG_TAG);
+        if (!s) {
+            continue;
+        }
+        s  += strlen(BENCH_LOG_TAG);
+        len = strcspn(s, "\r\n");
+        _aux_bench_add(s, len);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * to make up traffic of a node doing lookups: pings and queries, and
+ * responses carrying 8 or 16 closest nodes, which dominate in bytes.
+ */
+static
+void _aux_bench_make(void)
+{
+    char buf[BENCH_MSG_SZ];
+    struct varray nodes;
+    struct sockaddr_in addr;
+    vnodeInfo_relax nodei[16];
+    vnodeInfo* pnodei = NULL;
+    vnodeVer ver;
+    vtoken token;
+    vnodeId srcId;
+    vnodeId targetId;
+    int i = 0;
+    int k = 0;
+    int ret = 0;
+
+    vnodeVer_unstrlize(VDHT_BIN_VER, &ver);
+    vtoken_make(&token);
+    vtoken_make(&srcId);
+    vtoken_make(&targetId);
+    varray_init(&nodes, 16);
+    for (i = 0; i < 16; i++) {
+        vnodeId id;
+        vtoken_make(&id);
+        vnodeInfo_relax_init(&nodei[i], &id, &ver, i);
+        pnodei = (vnodeInfo*)&nodei[i];
+        for (k = 0; k < 2; k++) {
+            vsockaddr_convert("192.168.4.125", 12300 + i * 2 + k, &addr);
+            vnodeInfo_add_addr(&pnodei, &addr);
+        }
+    }
+
+    for (i = 0; i < 64; i++) {
+        ret = dht_enc_ops.ping(&token, &srcId, buf, sizeof(buf));
+        _aux_bench_add(buf, ret);
+        ret = dht_enc_ops.ping_rsp(&token, &srcId, (vnodeInfo*)&nodei[0], buf, sizeof(buf));
+        _aux_bench_add(buf, ret);
+        ret = dht_enc_ops.find_closest_nodes(&token, &srcId, &targetId, buf, sizeof(buf));
+        _aux_bench_add(buf, ret);
+
+        while (varray_size(&nodes) > 0) {
+            varray_pop_tail(&nodes);
+        }
+        for (k = 0; k < ((i % 2) ? 16 : 8); k++) {
+            varray_add_tail(&nodes, &nodei[k]);
+        }
+        ret = dht_enc_ops.find_closest_nodes_rsp(&token, &srcId, &nodes, buf, sizeof(buf));
+        _aux_bench_add(buf, ret);
+    }
+    varray_deinit(&nodes);
+    return ;
+}
+
+/*
+ * to decode @msg, and unpack each token in it as dht decoders do.
+ */
+static
+int _aux_bench_decode(struct bench_msg* msg)
+{
+    struct be_spans* sps = &bench_spans;
+    vtoken token;
+    int ret = 0;
+    int i = 0;
+
+    ret = be_span_decode(sps, msg->data, msg->len);
+    retE((ret < 0));
+    for (i = 0; i < sps->num; i++) {
+        if ((sps->spans[i].type == BE_STR) && (sps->spans[i].val.len == VTOKEN_LEN * 2)) {
+            ret = be_span_unpack_token(sps, i, &token);
+            retE((ret < 0));
+        }
+    }
+    return 0;
+}
+
+static
+double _aux_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    static const char* names[BE_SIMD_BUTT] = {"scalar", "sse2", "avx2"};
+    double begin = 0;
+    double secs = 0;
+    long bytes = 0;
+    int rounds = 0;
+    int nmsgs  = 0;
+    int nerrs  = 0;
+    int level = 0;
+    int i = 0;
+    int k = 0;
+
+    nmsgs = (argc > 2) ? atoi(argv[2]) : BENCH_MSGS;
+    if ((argc > 1) && (_aux_bench_load(argv[1]) < 0)) {
+        printf("failed to open %s\n", argv[1]);
+        return -1;
+    }
+    if (!bench_nmsgs) {
+        _aux_bench_make();
+    }
+    if (!bench_nmsgs || (nmsgs <= 0)) {
+        printf("usage: %s [vdhtd log] [msgs]\n", argv[0]);
+        return -1;
+    }
+    for (i = 0; i < bench_nmsgs; i++) {
+        bytes += bench_msgs[i].len;
+    }
+    rounds = (nmsgs + bench_nmsgs - 1) / bench_nmsgs;
+    printf("%d msgs (%s), %ld bytes, %d rounds\n", bench_nmsgs,
+            (argc > 1) ? argv[1] : "made up", bytes, rounds);
+
+    for (level = 0; level < BE_SIMD_BUTT; level++) {
+        if (be_simd_select(level) < 0) {
+            printf("%-8s unsupported\n", names[level]);
+            continue;
+        }
+        nerrs = 0;
+        begin = _aux_bench_now();
+        for (k = 0; k < rounds; k++) {
+            for (i = 0; i < bench_nmsgs; i++) {
+                nerrs += (_aux_bench_decode(&bench_msgs[i]) < 0);
+            }
+        }
+        secs = _aux_bench_now() - begin;
+        printf("%-8s %8.3f s  %10.0f msgs/s  %8.1f MB/s  (errs:%d)\n", names[level], secs,
+                (double)rounds * bench_nmsgs / secs, (double)rounds * bytes / secs / 1e6, nerrs);
+    }
+
+    for (i = 0; i < bench_nmsgs; i++) {
+        free(bench_msgs[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,345 @@
+#include "vglobal.h"
+#include "vdht.h"
+
+/*
+ * replay of dht msgs captured by vdhtd with "dht.trace" configured (see
+ * vtrace.h). with network disabled, each msg of trace is dispatched by
+ * msger to route as if it were received by rpc, so that it's decoded,
+ * handled by route, and its response encoded and pushed. pushed msgs are
+ * taken by a sink instead of being sent. it tells end-to-end throughput
+ * of one core on real traffic.
+ *
+ * responses in trace are decoded, but dropped by route for no query being
+ * recorded for them, so the workload of queries is what's measured.
+ *
+ * usage: vdht_replay <trace> [rounds] [conf]
+ * @conf: config of node captured, to serve same protocols with routing
+ *        table loaded from its db file. only ping is served without it.
+ */
+
+#define BENCH_ROUNDS     ((int)1000)
+#define BENCH_MAX_MSGS   ((int)65536)
+#define BENCH_MSG_SZ     ((int)(8*BUF_SZ))
+
+struct bench_msg {
+    struct vmsg_sys sm;
+    int dhtId;
+};
+
+static struct bench_msg bench_msgs[BENCH_MAX_MSGS];
+static int bench_nmsgs = 0;
+
+static struct vconfig bench_cfg;
+static struct vhost   bench_host;
+
+/*
+ * sink of msgs pushed by route.
+ */
+struct bench_sink {
+    int  classify;  // to count pushed msgs by dhtId.
+    long nmsgs;
+    long bytes;
+    int  counts[VDHT_UNKNOWN + 1];
+};
+static struct bench_sink bench_sink;
+
+static
+double _aux_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * to silence stdout while replaying, where "$${where}" of each msg being
+ * dropped goes, as vdhtd running as daemon does.
+ */
+static
+void _aux_bench_quiet(int on)
+{
+    static int fd = -1;
+    int null = -1;
+
+    fflush(stdout);
+    if (on && (fd < 0)) {
+        null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            fd = dup(STDOUT_FILENO);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+    } else if (!on && (fd >= 0)) {
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        fd = -1;
+    }
+    return ;
+}
+
+/*
+ * to tell dhtId of datagram as on wire: magic, msgId and then dht msg.
+ */
+static
+int _aux_bench_dhtId(void* data, int len)
+{
+    struct vdht_dec_ops* ops = NULL;
+    uint32_t magic = 0;
+    void* ctxt = NULL;
+    int hdr = sizeof(uint32_t) + sizeof(int32_t);
+    int ret = 0;
+
+    if (len <= hdr) {
+        return VDHT_UNKNOWN;
+    }
+    magic = get_uint32(data);
+    if (IS_DHT_MSG(magic)) {
+        ops = &dht_dec_ops;
+    } else if (IS_DHT_BIN_MSG(magic)) {
+        ops = &dht_bin_dec_ops;
+    } else {
+        return VDHT_UNKNOWN;
+    }
+    ret = ops->dec_begin(offset_addr(data, hdr), len - hdr, &ctxt);
+    if ((ret < 0) || (ret >= VDHT_UNKNOWN)) {
+        return VDHT_UNKNOWN;
+    }
+    ops->dec_done(ctxt);
+    return ret;
+}
+
+/*
+ * same as pack callback of host: msgId and magic are put before dht msg,
+ * in room reserved by vdht_buf_alloc.
+ */
+static
+int _aux_bench_pack_cb(void* cookie, struct vmsg_usr* um, struct vmsg_sys* sm)
+{
+    char* data = NULL;
+    int sz = 0;
+
+    retE((!VDHT_MSG(um->msgId)));
+
+    sz += sizeof(int32_t);
+    data = unoff_addr(um->data, sz);
+    set_int32(data, um->msgId);
+
+    sz += sizeof(uint32_t);
+    data = unoff_addr(um->data, sz);
+    set_uint32(data, (um->msgId == VMSG_DHT_BIN) ? DHT_BIN_MAGIC : DHT_MAGIC);
+
+    vmsg_sys_init(sm, um->addr, um->spec, um->len + sz, data);
+    return 0;
+}
+
+/*
+ * same as unpack callback of host, except no capture.
+ */
+static
+int _aux_bench_unpack_cb(void* cookie, struct vmsg_sys* sm, struct vmsg_usr* um)
+{
+    void* data = sm->data;
+    uint32_t magic = 0;
+    int msgId = 0;
+    int sz = sizeof(uint32_t) + sizeof(int32_t);
+
+    retE((sm->len <= sz));
+    magic = get_uint32(data);
+    msgId = get_int32(offset_addr(data, sizeof(uint32_t)));
+
+    if (IS_DHT_MSG(magic) || IS_DHT_BIN_MSG(magic)) {
+        retE((IS_DHT_BIN_MSG(magic) != (msgId == VMSG_DHT_BIN)));
+        vmsg_usr_init(um, msgId, &sm->addr, &sm->spec, sm->len - sz, offset_addr(data, sz));
+        return 0;
+    }
+    return 0;
+}
+
+/*
+ * to drain msgs pushed by route, as rpc does before sending them.
+ */
+static
+void _aux_bench_drain(struct vmsger* msger)
+{
+    struct vmsg_sys* sm = NULL;
+
+    while (msger->ops->popable(msger)) {
+        if (msger->ops->pop(msger, &sm) < 0) {
+            break;
+        }
+        bench_sink.nmsgs++;
+        bench_sink.bytes += sm->len;
+        if (bench_sink.classify) {
+            bench_sink.counts[_aux_bench_dhtId(sm->data, sm->len)]++;
+        }
+        vmsg_sys_free(sm);
+    }
+    return ;
+}
+
+static
+int _aux_bench_load(const char* path)
+{
+    struct bench_msg* msg = NULL;
+    struct vtrace trace;
+    struct vmsg_sys sm;
+    char* buf = NULL;
+    int ret = 0;
+
+    ret = vtrace_open(&trace, path, 0);
+    retE((ret < 0));
+
+    buf = (char*)malloc(BENCH_MSG_SZ);
+    ret1E((!buf), vtrace_close(&trace));
+
+    while ((bench_nmsgs < BENCH_MAX_MSGS) && ((ret = vtrace_read(&trace, &sm, buf, BENCH_MSG_SZ)) > 0)) {
+        msg = &bench_msgs[bench_nmsgs];
+        msg->dhtId = _aux_bench_dhtId(buf, ret);
+        sm.data = malloc(ret);
+        if (!sm.data) {
+            break;
+        }
+        memcpy(sm.data, buf, ret);
+        memcpy(&msg->sm, &sm, sizeof(sm));
+        bench_nmsgs++;
+    }
+    free(buf);
+    vtrace_close(&trace);
+    return 0;
+}
+
+/*
+ * to setup host with msger, route and node only. no rpc nor waiter is
+ * created, so nothing goes to network.
+ */
+static
+int _aux_bench_host_init(const char* conf)
+{
+    struct vhost* host = &bench_host;
+    int ret = 0;
+
+    vconfig_init(&bench_cfg);
+    if (conf) {
+        ret = bench_cfg.ops->parse(&bench_cfg, conf);
+        retE((ret < 0));
+    }
+
+    memset(host, 0, sizeof(*host));
+    host->cfg = &bench_cfg;
+    vtoken_make(&host->myid);
+
+    ret = vmsger_init(&host->msger);
+    retE((ret < 0));
+    vmsger_reg_pack_cb  (&host->msger, _aux_bench_pack_cb,   host);
+    vmsger_reg_unpack_cb(&host->msger, _aux_bench_unpack_cb, host);
+
+    ret  = vroute_init(&host->route, &bench_cfg, host, &host->myid);
+    ret += vnode_init (&host->node,  &bench_cfg, host, &host->myid);
+    retE((ret < 0));
+    if (conf) {
+        host->route.ops->load(&host->route);
+    }
+    return 0;
+}
+
+static
+void _aux_bench_host_deinit(void)
+{
+    struct vhost* host = &bench_host;
+
+    vnode_deinit (&host->node);
+    vroute_deinit(&host->route);
+    vmsger_deinit(&host->msger);
+    vconfig_deinit(&bench_cfg);
+    return ;
+}
+
+static
+void _aux_bench_replay(const char* path, int rounds)
+{
+    struct vmsger* msger = &bench_host.msger;
+    int counts[VDHT_UNKNOWN + 1];
+    double begin = 0;
+    double secs = 0;
+    long nmsgs = 0;
+    long bytes = 0;
+    int nerrs = 0;
+    int i = 0;
+    int k = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < bench_nmsgs; i++) {
+        counts[bench_msgs[i].dhtId]++;
+        bytes += bench_msgs[i].sm.len;
+    }
+
+    _aux_bench_quiet(1);
+
+    // first round warms route up and tells mix of responses, untimed.
+    bench_sink.classify = 1;
+    for (i = 0; i < bench_nmsgs; i++) {
+        nerrs += (msger->ops->dsptch(msger, &bench_msgs[i].sm) < 0);
+        _aux_bench_drain(msger);
+    }
+    bench_sink.classify = 0;
+    nmsgs = bench_sink.nmsgs;
+
+    begin = _aux_bench_now();
+    for (k = 0; k < rounds; k++) {
+        for (i = 0; i < bench_nmsgs; i++) {
+            msger->ops->dsptch(msger, &bench_msgs[i].sm);
+            _aux_bench_drain(msger);
+        }
+    }
+    secs = _aux_bench_now() - begin;
+    _aux_bench_quiet(0);
+
+    printf("trace %s: %d msgs, %ld bytes, %d rounds\n", path, bench_nmsgs, bytes, rounds);
+    printf("  %-24s %8s %8s\n", "", "in", "out");
+    for (i = 0; i < VDHT_UNKNOWN; i++) {
+        if (counts[i] || bench_sink.counts[i]) {
+            printf("  %-24s %8d %8d\n", vdht_get_desc(i), counts[i], bench_sink.counts[i]);
+        }
+    }
+    if (counts[VDHT_UNKNOWN]) {
+        printf("  %-24s %8d\n", "undecodable", counts[VDHT_UNKNOWN]);
+    }
+    printf("replay %10.1f ns/msg %10.0f msgs/s %10.2f pushed/msg %10.1f bytes/push (errs:%d)\n",
+            secs * 1e9 / ((double)rounds * bench_nmsgs),
+            (double)rounds * bench_nmsgs / secs,
+            (double)nmsgs / bench_nmsgs,
+            nmsgs ? (double)bench_sink.bytes / bench_sink.nmsgs : 0.0, nerrs);
+    return ;
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = BENCH_ROUNDS;
+    int i = 0;
+
+    if (argc > 2) {
+        rounds = atoi(argv[2]);
+    }
+    if ((argc < 2) || (rounds <= 0)) {
+        printf("usage: %s <trace> [rounds] [conf]\n", argv[0]);
+        return -1;
+    }
+    if (_aux_bench_load(argv[1]) < 0) {
+        printf("failed to open trace %s\n", argv[1]);
+        return -1;
+    }
+    if (!bench_nmsgs) {
+        printf("no dht msg found in %s\n", argv[1]);
+        return -1;
+    }
+    if (_aux_bench_host_init((argc > 3) ? argv[3] : NULL) < 0) {
+        printf("failed to setup host\n");
+        return -1;
+    }
+    _aux_bench_replay(argv[1], rounds);
+    _aux_bench_host_deinit();
+    for (i = 0; i < bench_nmsgs; i++) {
+        free(bench_msgs[i].sm.data);
+    }
+    return 0;
+}
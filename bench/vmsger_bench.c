@@ -0,0 +1,188 @@
+#include "vglobal.h"
+#include "vmsger.h"
+
+/*
+ * microbenchmark of msger outbound queue, which compares the bounded
+ * MPSC ring used by vmsger with a mutex guarded list (the former queue),
+ * with several producers pushing and one consumer popping.
+ *
+ * usage: vmsger_bench [producers] [msgs per producer]
+ */
+
+#define BENCH_PRODUCERS  ((int)4)
+#define BENCH_MSGS       ((int)200000)
+#define BENCH_MAX_PRODS  ((int)64)
+
+/*
+ * the former queue: vlist guarded by a recursive lock.
+ */
+struct locked_queue {
+    struct vlist msgs;
+    struct vlock lock;
+};
+
+static
+int locked_push(struct locked_queue* queue, struct vmsg_sys* ms)
+{
+    vlock_enter(&queue->lock);
+    vlist_add_tail(&queue->msgs, &ms->list);
+    vlock_leave(&queue->lock);
+    return 0;
+}
+
+static
+int locked_pop(struct locked_queue* queue, struct vmsg_sys** ms)
+{
+    struct vlist* node = NULL;
+
+    *ms = NULL;
+    vlock_enter(&queue->lock);
+    if (!vlist_is_empty(&queue->msgs)) {
+        node = vlist_pop_head(&queue->msgs);
+        *ms  = vlist_entry(node, struct vmsg_sys, list);
+    }
+    vlock_leave(&queue->lock);
+    return (*ms) ? 0 : -1;
+}
+
+struct bench {
+    int  ring;      // 1 for vmsger ring, 0 for locked list.
+    int  nprods;
+    int  nmsgs;
+    volatile int go;
+    volatile int nretries;
+    struct vmsger msger;
+    struct locked_queue locked;
+};
+
+static char bench_payload[64];
+
+static
+int _aux_bench_pack_cb(void* cookie, struct vmsg_usr* mu, struct vmsg_sys* ms)
+{
+    void* buf = NULL;
+
+    // same as dht pack callback, payload is copied into a new buffer.
+    buf = malloc(mu->len);
+    retE((!buf));
+    memcpy(buf, mu->data, mu->len);
+    vmsg_sys_init(ms, mu->addr, mu->spec, mu->len, buf);
+    return 0;
+}
+
+static
+void* _aux_bench_producer(void* argv)
+{
+    struct bench* bench = (struct bench*)argv;
+    struct vsockaddr addr;
+    struct vmsg_usr mu;
+    int i = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    vmsg_usr_init(&mu, VMSG_DHT, &addr, &addr, sizeof(bench_payload), bench_payload);
+    while (!bench->go);
+
+    for (i = 0; i < bench->nmsgs; i++) {
+        if (bench->ring) {
+            // ring is bounded, back off while it's nearly full, leaving
+            // one cell for each producer so that no msg gets dropped.
+            struct vmsger* msger = &bench->msger;
+            while (msger->ops->size(msger) > VMSGER_QUEUE_CAPC - bench->nprods) {
+                __sync_fetch_and_add(&bench->nretries, 1);
+                sched_yield();
+            }
+            while (bench->msger.ops->push(&bench->msger, &mu) < 0) {
+                sched_yield();
+            }
+        } else {
+            struct vmsg_sys* ms = vmsg_sys_alloc(0);
+            _aux_bench_pack_cb(NULL, &mu, ms);
+            locked_push(&bench->locked, ms);
+        }
+    }
+    return NULL;
+}
+
+static
+double _aux_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static
+double _aux_bench_run(struct bench* bench)
+{
+    pthread_t prods[BENCH_MAX_PRODS];
+    struct vmsg_sys* ms = NULL;
+    int total = bench->nprods * bench->nmsgs;
+    int npops = 0;
+    double begin = 0;
+    double end = 0;
+    int ret = 0;
+    int i = 0;
+
+    bench->go = 0;
+    bench->nretries = 0;
+    for (i = 0; i < bench->nprods; i++) {
+        pthread_create(&prods[i], NULL, _aux_bench_producer, bench);
+    }
+
+    begin = _aux_bench_now();
+    bench->go = 1;
+    while (npops < total) {
+        if (bench->ring) {
+            ret = bench->msger.ops->pop(&bench->msger, &ms);
+        } else {
+            ret = locked_pop(&bench->locked, &ms);
+        }
+        if (ret < 0) {
+            continue;
+        }
+        vmsg_sys_free(ms);
+        npops++;
+    }
+    end = _aux_bench_now();
+
+    for (i = 0; i < bench->nprods; i++) {
+        pthread_join(prods[i], NULL);
+    }
+    return (end - begin);
+}
+
+int main(int argc, char** argv)
+{
+    struct bench bench;
+    double secs = 0;
+    int total = 0;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.nprods = (argc > 1) ? atoi(argv[1]) : BENCH_PRODUCERS;
+    bench.nmsgs  = (argc > 2) ? atoi(argv[2]) : BENCH_MSGS;
+    if ((bench.nprods <= 0) || (bench.nprods > BENCH_MAX_PRODS) || (bench.nmsgs <= 0)) {
+        printf("usage: %s [producers(1-%d)] [msgs per producer]\n", argv[0], BENCH_MAX_PRODS);
+        return -1;
+    }
+    total = bench.nprods * bench.nmsgs;
+
+    vlist_init(&bench.locked.msgs);
+    vlock_init(&bench.locked.lock);
+    vmsger_init(&bench.msger);
+    vmsger_reg_pack_cb(&bench.msger, _aux_bench_pack_cb, &bench);
+
+    printf("%d producers x %d msgs, 1 consumer\n", bench.nprods, bench.nmsgs);
+
+    bench.ring = 0;
+    secs = _aux_bench_run(&bench);
+    printf("%-12s %8.3f s  %10.0f msgs/s\n", "locked list", secs, total / secs);
+
+    bench.ring = 1;
+    secs = _aux_bench_run(&bench);
+    printf("%-12s %8.3f s  %10.0f msgs/s  (backoffs:%d, drops:%d)\n", "mpsc ring",
+            secs, total / secs, bench.nretries, bench.msger.msgs.ndrops);
+
+    vmsger_deinit(&bench.msger);
+    vlock_deinit(&bench.locked.lock);
+    return 0;
+}
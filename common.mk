@@ -18,6 +18,12 @@ include_dirs := $(ROOT_PATH) \
 library_dirs := $(ROOT_PATH)/3rdparties/miniupnpc
 
 CFLAGS  := -g -Wall -D_DEBUG -std=gnu99 -D_GNU_SOURCE $(addprefix -I , $(include_dirs))
+ifeq ($(URING),1)
+CFLAGS  += -D_VRPC_URING
+endif
+ifdef OPT
+CFLAGS  += -O$(OPT)
+endif
 LDFLAGS := -lpthread -lsqlite3 -lrt $(addprefix -L, $(library_dirs)) -lminiupnpc
 
 $(libraries): $(objects)
@@ -0,0 +1,79 @@
+#include "vglobal.h"
+#include "varena.h"
+
+struct varena_spill {
+    struct vlist list;
+    char data[] __attribute__((aligned(VARENA_ALIGN)));
+};
+
+/*
+ * @arena:
+ * @buf: first block, which must outlive arena.
+ * @sz:  size of first block.
+ */
+void varena_init(struct varena* arena, void* buf, int sz)
+{
+    vassert(arena);
+    vassert(buf);
+    vassert(sz > 0);
+
+    arena->buf  = (char*)buf;
+    arena->sz   = sz;
+    arena->off  = 0;
+    arena->used = 0;
+    arena->hwm  = 0;
+    vlist_init(&arena->spills);
+    return ;
+}
+
+void* varena_alloc(struct varena* arena, int sz)
+{
+    struct varena_spill* spill = NULL;
+    void* obj = NULL;
+    vassert(arena);
+    vassert(sz > 0);
+
+    sz = (sz + VARENA_ALIGN - 1) & ~(VARENA_ALIGN - 1);
+    if (sz <= arena->sz - arena->off) {
+        obj = arena->buf + arena->off;
+        arena->off += sz;
+    } else {
+        spill = (struct varena_spill*)malloc(sizeof(*spill) + sz);
+        vlogEv((!spill), elog_malloc);
+        retE_p((!spill));
+        vlist_add_tail(&arena->spills, &spill->list);
+        obj = spill->data;
+    }
+    arena->used += sz;
+    if (arena->used > arena->hwm) {
+        arena->hwm = arena->used;
+    }
+    return obj;
+}
+
+/*
+ * to release all objects taken from arena.
+ */
+void varena_reset(struct varena* arena)
+{
+    struct vlist* node = NULL;
+    vassert(arena);
+
+    while (!vlist_is_empty(&arena->spills)) {
+        node = vlist_pop_head(&arena->spills);
+        free(vlist_entry(node, struct varena_spill, list));
+    }
+    arena->off  = 0;
+    arena->used = 0;
+    return ;
+}
+
+void varena_deinit(struct varena* arena)
+{
+    vassert(arena);
+
+    varena_reset(arena);
+    arena->buf = NULL;
+    arena->sz  = 0;
+    return ;
+}
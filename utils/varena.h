@@ -0,0 +1,27 @@
+#ifndef __VARENA_H__
+#define __VARENA_H__
+
+#include "vlist.h"
+
+#define VARENA_ALIGN ((int)16)
+
+/*
+ * for bump-pointer arena, from which all objects of a message are taken
+ * and released at once by reset. first block is given by owner, and blocks
+ * are taken from heap only if it runs out, which are freed on reset.
+ */
+struct varena {
+    char* buf;
+    int   sz;
+    int   off;   // offset into first block.
+    int   used;  // bytes taken since last reset, spilled ones included.
+    int   hwm;   // high-water mark of @used.
+    struct vlist spills;
+};
+
+void  varena_init  (struct varena*, void*, int);
+void* varena_alloc (struct varena*, int);
+void  varena_reset (struct varena*);
+void  varena_deinit(struct varena*);
+
+#endif
@@ -82,7 +82,7 @@ void* _aux_thread_entry(void* argv)
     pthread_mutex_lock(&thread->mutex);
     pthread_mutex_unlock(&thread->mutex);
 
-    thread->entry_cb(thread->cookie);
+    thread->quit_code = thread->entry_cb(thread->cookie);
     thread->quited = 1;
     return thread;
 }
@@ -100,6 +100,7 @@ int vthread_init(struct vthread* thread, vthread_entry_t entry, void* argv)
     thread->cookie = argv;
     thread->quited  = 0;
     thread->started = 0;
+    thread->quit_code = 0;
 
     pthread_mutex_lock(&thread->mutex);
     res = pthread_create(&thread->thread, 0, _aux_thread_entry, thread);
@@ -125,13 +126,16 @@ int vthread_start(struct vthread* thread)
 
 int vthread_join(struct vthread* thread, int* quit_code)
 {
+    void* quit = NULL;
     int ret = 0;
 
     vassert(thread);
     vassert(quit_code);
 
-    ret = pthread_join(thread->thread, (void**)quit_code);
+    // thread returns itself, not a code fitting in @quit_code.
+    ret = pthread_join(thread->thread, &quit);
     retE((ret < 0));
+    *quit_code = thread->quit_code;
     return 0;
 }
 
@@ -247,6 +251,17 @@ void vtimer_deinit(struct vtimer* timer)
     return ;
 }
 
+/*
+ * for vtime
+ */
+uint64_t vtime_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 int vsys_get_cpu_ratio(int* ratio)
 {
     static int prev_idle = 0;
@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <sys/types.h>
+#include <stdint.h>
 #include <time.h>
 #include <signal.h>
 
@@ -51,6 +52,7 @@ struct vthread {
 
     int started;
     int quited;
+    int quit_code;  // returned by @entry_cb.
 };
 
 extern int  vthread_init  (struct vthread*, vthread_entry_t, void*);
@@ -74,6 +76,11 @@ int  vtimer_restart(struct vtimer*, int timeout);
 int  vtimer_stop   (struct vtimer*);
 void vtimer_deinit (struct vtimer*);
 
+/*
+ * vtime
+ */
+uint64_t vtime_now_us(void);
+
 /*
  * vsys
  */
@@ -1131,6 +1131,83 @@ int _vcfg_get_dht_port(struct vconfig* cfg)
     return port;
 }
 
+static
+int _vcfg_get_dht_workers(struct vconfig* cfg)
+{
+    int workers = 0;
+    vassert(cfg);
+
+    workers = cfg->ops->get_int_val(cfg, "dht.workers");
+    if (workers <= 0) {
+        workers = 1;
+    }
+    return workers;
+}
+
+/*
+ * whether to send messages too large for datagram over tcp, which is
+ * enabled unless being switched off explicitly.
+ */
+static
+int _vcfg_get_dht_tcp(struct vconfig* cfg)
+{
+    int tcp = 0;
+    vassert(cfg);
+
+    tcp = cfg->ops->get_int_val(cfg, "dht.tcp");
+    if (tcp < 0) {
+        tcp = 1;
+    }
+    return tcp;
+}
+
+/*
+ * whether to send compact binary messages to nodes that speak it, which
+ * is enabled unless being switched off explicitly. binary messages are
+ * always accepted.
+ */
+static
+int _vcfg_get_dht_bin(struct vconfig* cfg)
+{
+    int bin = 0;
+    vassert(cfg);
+
+    bin = cfg->ops->get_int_val(cfg, "dht.bin");
+    if (bin < 0) {
+        bin = 1;
+    }
+    return bin;
+}
+
+/*
+ * file to capture dht msgs received into, for being replayed offline.
+ * no capture unless it's configured.
+ */
+static
+const char* _vcfg_get_dht_trace(struct vconfig* cfg)
+{
+    vassert(cfg);
+    return cfg->ops->get_str_val(cfg, "dht.trace");
+}
+
+/*
+ * whether to make tokens of dht queries as mac of peer, dhtId and time,
+ * so that responses are checked without any query being recorded. it's
+ * disabled unless being switched on explicitly.
+ */
+static
+int _vcfg_get_dht_mac_token(struct vconfig* cfg)
+{
+    int mac = 0;
+    vassert(cfg);
+
+    mac = cfg->ops->get_int_val(cfg, "dht.mac_token");
+    if (mac < 0) {
+        mac = 0;
+    }
+    return mac;
+}
+
 static
 struct vconfig_ext_ops cfg_ext_ops = {
     .get_pid_filename       = _vcfg_get_pid_filename,
@@ -1145,7 +1222,12 @@ struct vconfig_ext_ops cfg_ext_ops = {
     .get_route_bucket_sz    = _vcfg_get_route_bucket_sz,
     .get_route_max_snd_tms  = _vcfg_get_route_max_snd_tms,
     .get_route_max_rcv_tmo  = _vcfg_get_route_max_rcv_tmo,
-    .get_dht_port           = _vcfg_get_dht_port
+    .get_dht_port           = _vcfg_get_dht_port,
+    .get_dht_workers        = _vcfg_get_dht_workers,
+    .get_dht_tcp            = _vcfg_get_dht_tcp,
+    .get_dht_bin            = _vcfg_get_dht_bin,
+    .get_dht_trace          = _vcfg_get_dht_trace,
+    .get_dht_mac_token      = _vcfg_get_dht_mac_token
 };
 
 int vconfig_init(struct vconfig* cfg)
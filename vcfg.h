@@ -53,6 +53,11 @@ struct vconfig_ext_ops {
     int (*get_route_max_rcv_tmo)   (struct vconfig*);
 
     int (*get_dht_port)            (struct vconfig*);
+    int (*get_dht_workers)         (struct vconfig*);
+    int (*get_dht_tcp)             (struct vconfig*);
+    int (*get_dht_bin)             (struct vconfig*);
+    const char* (*get_dht_trace)   (struct vconfig*);
+    int (*get_dht_mac_token)       (struct vconfig*);
 
 
 };
@@ -68,10 +68,24 @@
 #define elog_ioctl          strerror(errno)
 #define elog_setsockopt     strerror(errno)
 #define elog_pselect        strerror(errno)
+#define elog_eventfd        strerror(errno)
+#define elog_write          strerror(errno)
+#define elog_epoll_create1  strerror(errno)
+#define elog_epoll_ctl      strerror(errno)
+#define elog_epoll_wait     strerror(errno)
 #define elog_recvfrom       strerror(errno)
 #define elog_recvmsg        strerror(errno)
+#define elog_recvmmsg       strerror(errno)
 #define elog_sendto         strerror(errno)
 #define elog_sendmsg        strerror(errno)
+#define elog_sendmmsg       strerror(errno)
+#define elog_listen         strerror(errno)
+#define elog_accept4        strerror(errno)
+#define elog_timerfd_create strerror(errno)
+#define elog_mmap           strerror(errno)
+#define elog_io_uring_setup strerror(errno)
+#define elog_io_uring_enter strerror(errno)
+#define elog_io_uring_register strerror(errno)
 #define elog_timer_create   strerror(errno)
 #define elog_timer_settime  strerror(errno)
 #define elog_timer_delete   strerror(errno)
@@ -83,6 +97,7 @@
 #define elog_sscanf         "{sscanf} error"
 #define elog_malloc         "{malloc} error"
 #define elog_realloc        "{realloc} error"
+#define elog_posix_memalign "{posix_memalign} error"
 #define elog_inet_aton      "{inet_aton} error"
 #define elog_inet_ntoa      "{inet_ntoa} error"
 #define elog_gethostname    "{gethostname} error"
@@ -6,44 +6,29 @@ struct vdhtId_desc {
     char* desc;
 };
 
+#define VDHT_DESC_NAME(id, name, y, len, desc, kind) {id, #name},
+#define VDHT_DESC_QUERY(id, name, y, len, desc, kind) VDHT_QUERY_##y(id, desc)
+#define VDHT_DESC_RSP(id, name, y, len, desc, kind)   VDHT_RSP_##y(id, desc)
+#define VDHT_QUERY_q(id, desc) {id, #desc},
+#define VDHT_QUERY_r(id, desc)
+#define VDHT_RSP_q(id, desc)
+#define VDHT_RSP_r(id, desc)   {id, #desc},
+
 static
 struct vdhtId_desc dhtId_global_desc[] = {
-    {VDHT_PING,                 "ping"                  },
-    {VDHT_PING_R,               "ping_rsp"              },
-    {VDHT_FIND_NODE,            "find_node"             },
-    {VDHT_FIND_NODE_R,          "find_node_rsp"         },
-    {VDHT_FIND_CLOSEST_NODES,   "find_closest_nodes"    },
-    {VDHT_FIND_CLOSEST_NODES_R, "find_closest_nodes_rsp"},
-    {VDHT_REFLEX,               "reflex"                },
-    {VDHT_REFLEX_R,             "reflex_rsp"            },
-    {VDHT_PROBE,                "probe"                 },
-    {VDHT_PROBE_R,              "probe_rsp"             },
-    {VDHT_POST_SERVICE,         "post_service"          },
-    {VDHT_FIND_SERVICE,         "find_service"          },
-    {VDHT_FIND_SERVICE_R,       "find_service_rsp"      },
+    VDHT_MSG_SCHEMA(VDHT_DESC_NAME)
     {VDHT_UNKNOWN, NULL}
 };
 
 static
 struct vdhtId_desc dhtId_query_desc[] = {
-    {VDHT_PING,                 "ping"                  },
-    {VDHT_FIND_NODE,            "find_node"             },
-    {VDHT_FIND_CLOSEST_NODES,   "find_closest_nodes"    },
-    {VDHT_REFLEX,               "reflex"                },
-    {VDHT_PROBE,                "probe"                 },
-    {VDHT_POST_SERVICE,         "post_service"          },
-    {VDHT_FIND_SERVICE,         "find_service"          },
+    VDHT_MSG_SCHEMA(VDHT_DESC_QUERY)
     {VDHT_UNKNOWN, NULL }
 };
 
 static
 struct vdhtId_desc dhtId_rsp_desc[] = {
-    {VDHT_PING_R,               "ping"                  },
-    {VDHT_FIND_NODE_R,          "find_node"             },
-    {VDHT_FIND_CLOSEST_NODES_R, "find_closest_nodes"    },
-    {VDHT_REFLEX_R,             "reflex"                },
-    {VDHT_PROBE_R,              "probe"                 },
-    {VDHT_FIND_SERVICE_R,       "find_service"          },
+    VDHT_MSG_SCHEMA(VDHT_DESC_RSP)
     {VDHT_UNKNOWN, NULL }
 };
 
@@ -81,40 +66,6 @@ int vdht_get_dhtId_by_desc(const char* dht_str)
     return dhtId;
 }
 
-static
-int vdht_get_queryId(char* desc)
-{
-    struct vdhtId_desc* id_desc = dhtId_query_desc;
-    int qId = VDHT_UNKNOWN;
-    vassert(desc);
-
-    for (; id_desc->desc;) {
-        if (!strcmp(id_desc->desc, desc)) {
-            qId = id_desc->id;
-            break;
-        }
-        id_desc++;
-    }
-    return qId;
-}
-
-static
-int vdht_get_rspId(char* desc)
-{
-    struct vdhtId_desc* id_desc = dhtId_rsp_desc;
-    int rspId = VDHT_UNKNOWN;
-    vassert(desc);
-
-    for (; id_desc->desc;) {
-        if (!strcmp(id_desc->desc, desc)) {
-            rspId = id_desc->id;
-            break;
-        }
-        id_desc++;
-    }
-    return rspId;
-}
-
 void* vdht_buf_alloc(void)
 {
     void* buf = NULL;
@@ -139,1460 +90,447 @@ void vdht_buf_free(void* buf)
     return ;
 }
 
+static __thread struct varena dht_dec_arena;
+static __thread char dht_dec_arena_buf[VDHT_DEC_ARENA_SZ] __attribute__((aligned(VARENA_ALIGN)));
+static __thread int  dht_dec_arena_hwm = 0;
+static pthread_key_t  dht_dec_arena_key;
+static pthread_once_t dht_dec_arena_once = PTHREAD_ONCE_INIT;
+
+/*
+ * spill blocks of arena would be leaked when decoding thread exits with
+ * some still taken, so they are released by key destructor.
+ */
 static
-struct be_node* _aux_create_vnodeInfo(vnodeInfo* nodei)
+void _aux_dec_arena_free(void* arena)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* addr = NULL;
-    int i = 0;
-    vassert(nodei);
-
-    dict = be_create_dict();
-    retE_p((!dict));
-
-    node = be_create_vtoken(&nodei->id);
-    be_add_keypair(dict, "id", node);
-    node = be_create_ver(&nodei->ver);
-    be_add_keypair(dict, "v", node);
-    node = be_create_int(nodei->weight);
-    be_add_keypair(dict, "w", node);
-
-    node = be_create_list();
-    for (i = 0; i < nodei->naddrs; i++) {
-        addr = be_create_addr(&nodei->addrs[i]);
-        be_add_list(node, addr);
-    }
-    be_add_keypair(dict, "m", node);
-    return dict;
+    varena_deinit((struct varena*)arena);
+    return ;
 }
 
 static
-struct be_node* _aux_create_vsrvcInfo(vsrvcInfo* srvci)
+void _aux_dec_arena_key_init(void)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* addr = NULL;
-    int i = 0;
-    vassert(srvci);
-
-    dict = be_create_dict();
-    retE_p((!dict));
+    int ret = 0;
 
-    node = be_create_vtoken(&srvci->hash);
-    be_add_keypair(dict, "hash", node);
-    node = be_create_vtoken(&srvci->hostid);
-    be_add_keypair(dict, "id", node);
-    node = be_create_int(srvci->nice);
-    be_add_keypair(dict, "n", node);
+    ret = pthread_key_create(&dht_dec_arena_key, _aux_dec_arena_free);
+    vlogEv((ret), "pthread_key_create: %s", strerror(ret));
+    return ;
+}
 
-    node = be_create_list();
-    for (i = 0; i < srvci->naddrs; i++) {
-        addr = be_create_addr(&srvci->addrs[i]);
-        be_add_list(node, addr);
+void* vdht_dec_alloc(int sz)
+{
+    if (!dht_dec_arena.buf) {
+        varena_init(&dht_dec_arena, dht_dec_arena_buf, sizeof(dht_dec_arena_buf));
+        pthread_once(&dht_dec_arena_once, _aux_dec_arena_key_init);
+        pthread_setspecific(dht_dec_arena_key, &dht_dec_arena);
     }
-    be_add_keypair(dict, "m", node);
-
-    return dict;
+    return varena_alloc(&dht_dec_arena, sz);
 }
 
-/*
- * @token:
- * @srcId: Id of node sending query.
- * @buf:
- * @len:
- *
- * ping Query = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *               "y":"q",
- *               "q":"ping",
- *               "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391"}
- *              }
- * encoded = d1:t40:deafc137da918b8cd9b95e72fef379a5b54c3f361:y1:q1:q4:ping1:a
- *           d2:id40:dbfcc5576ca7f742c802930892de9a1fb521f391ee
- */
-static
-int _vdht_enc_ping(vtoken* token, vnodeId* srcId, void* buf, int sz)
+void vdht_dec_reset(void)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* id   = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("ping");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    id   = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", id);
-    be_add_keypair(dict, "a", node);
-
-    ret  = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    if (!dht_dec_arena.buf) {
+        return ;
+    }
+    // report each new high-water mark beyond first block, for sizing it.
+    if ((dht_dec_arena.hwm > dht_dec_arena.sz) && (dht_dec_arena.hwm > dht_dec_arena_hwm)) {
+        vlogI("dht decode arena spilled, high-water mark: %d bytes", dht_dec_arena.hwm);
+        dht_dec_arena_hwm = dht_dec_arena.hwm;
+    }
+    varena_reset(&dht_dec_arena);
+    return ;
 }
 
-/*
- * @token:
- * @srcId:  Id of node replying query.
- * @result: queried result
- * @buf:
- * @len:
- * response = {"t":"06d5613f3f43631c539db6f10fbd04b651a21844",
- *             "y":"r",
- *             "r":"ping",
- *             "a": {"id": "dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                   node" :{"id": "dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                            "v": "0.0.0.1.0",
- *                            "ml": "192.168.4.125:12300",
- *                            "w": "0"
- *                          }
- *                 }
- *            }
- * encoded = d1:t40:06d5613f3f43631c539db6f10fbd04b651a218441:y1:r1:rd4:noded
- *           2:id40:dbfcc5576ca7f742c802930892de9a1fb521f3911:v9:0.0.0.1.0
- *           2:ml19:192.168.4.125:123001:wi0eeee
- *
- */
 static
-int _vdht_enc_ping_rsp(vtoken* token, vnodeId* srcId, vnodeInfo* result, void* buf, int sz)
+void _aux_write_vnodeInfo(struct be_writer* wr, vnodeInfo* nodei)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(result);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("ping");
-    be_add_keypair(dict, "r", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    temp = _aux_create_vnodeInfo(result);
-    be_add_keypair(node, "node", temp);
-    be_add_keypair(dict, "a", node);
+    int i = 0;
+    vassert(wr);
+    vassert(nodei);
 
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    be_wr_lit  (wr, "d2:id");
+    be_wr_token(wr, &nodei->id);
+    be_wr_lit  (wr, "1:v");
+    be_wr_ver  (wr, &nodei->ver);
+    be_wr_lit  (wr, "1:w");
+    be_wr_int  (wr, nodei->weight);
+    be_wr_lit  (wr, "1:ml");
+    for (i = 0; i < nodei->naddrs; i++) {
+        be_wr_addr(wr, &nodei->addrs[i]);
+    }
+    be_wr_lit  (wr, "ee");
+    return ;
 }
 
-/*
- * @token:
- * @srcId:  Id of node sending query.
- * @target: Id of queried node.
- * @buf:
- * @len:
- *
- * find_node Query = {"t":"9948eb5973da8f3c3c0a",
- *                    "y":"q",
- *                    "q":"find_node",
- *                    "a": {"id":"7ba29c1b9215a2e7621e",
- *                          "target":"7ba29c1b9215a2e7621"
- *                         }
- *                   }
- * bencoded =  d1:t20:9948eb5973da8f3c3c0a1:y1:q1:q9:find_node1:ad2:id20:7ba29c
- *             1b9215a2e7621e6:target20:7ba29c1b9215a2e7621eee
- */
 static
-int _vdht_enc_find_node(
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* targetId,
-        void* buf,
-        int sz)
+void _aux_write_vsrvcInfo(struct be_writer* wr, vsrvcInfo* srvci)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* tmp  = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(targetId);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("find_node");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    tmp  = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", tmp);
-    tmp  = be_create_vtoken(targetId);
-    be_add_keypair(node, "target", tmp);
-    be_add_keypair(dict, "a", node);
+    int i = 0;
+    vassert(wr);
+    vassert(srvci);
 
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    be_wr_lit  (wr, "d4:hash");
+    be_wr_token(wr, &srvci->hash);
+    be_wr_lit  (wr, "2:id");
+    be_wr_token(wr, &srvci->hostid);
+    be_wr_lit  (wr, "1:n");
+    be_wr_int  (wr, srvci->nice);
+    be_wr_lit  (wr, "1:ml");
+    for (i = 0; i < srvci->naddrs; i++) {
+        be_wr_addr(wr, &srvci->addrs[i]);
+    }
+    be_wr_lit  (wr, "ee");
+    return ;
 }
 
-/*
- * @token:
- * @srcId: Id of node replying query
- * @result: queried result.
- * @buf:
- * @sz:
- *
- *  response = {"t":"9948eb5973da8f3c3c0a",
- *              "y":"r",
- *              "r":"find_node",
- *              "a":{"id":"ce3dbcf618862baf69e8",
- *                  "node" :{"id": "7ba29c1b9215a2e7621e",
- *                            "m": "192.168.4.46:12300",
- *                            "v": "0.0.0.1.0",
- *                            "f": "0"
- *                          }
- *                 }
- *            }
- * bencoded = d1:t20:9948eb5973da8f3c3c0a1:y1:r1:rd2:id20:ce3dbcf618862baf69e84
- *            :noded2:id20:7ba29c1b9215a2e7621e1:m18:192.168.4.46:123001:v9:0.0
- *            .0.0.01:fi0eeee
- */
-static
-int _vdht_enc_find_node_rsp(
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeInfo* result,
-        void* buf,
-        int sz)
+static inline
+void _aux_be_put_arg_NONE(struct be_writer* wr)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(result);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("find_node");
-    be_add_keypair(dict, "r", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    temp = _aux_create_vnodeInfo(result);
-    be_add_keypair(node, "node", temp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    return ;
 }
 
-/*
- * @token:
- * @srcId: Id of node sending query.
- * @target: Id of queried node.
- * @buf:
- * @len:
- *
- * find_node Query = {"t":"971ee80a808da2eb7fb2",
- *                    "y":"q",
- *                    "q":"find_closest_nodes",
- *                    "a": {"id":"7ba29c1b9215a2e7621e",
- *                          "target":"7ba29c1b9215a2e7621"
- *                         }
- *                   }
- * bencoded = :d1:t20:971ee80a808da2eb7fb21:y1:q1:q18:find_closest_nodes1:ad2:i
- *            d20:7ba29c1b9215a2e7621e6:target20:7ba29c1b9215a2e7621eee
- */
-static
-int _vdht_enc_find_closest_nodes(
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* targetId,
-        void* buf,
-        int sz)
+static inline
+void _aux_be_put_arg_ID(struct be_writer* wr, vnodeId* targetId)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* tmp  = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
     vassert(targetId);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("find_closest_nodes");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    tmp  = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", tmp);
-    tmp  = be_create_vtoken(targetId);
-    be_add_keypair(node, "target", tmp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    be_wr_lit  (wr, "6:target");
+    be_wr_token(wr, targetId);
+    return ;
 }
 
-/*
- * @token:
- * @srcId: Id of node replying query
- * @result: queried result.
- * @buf:
- * @sz:
- *
- *  response = {"t":"30c6443e29cc307571e3",
- *              "y":"r",
- *              "r":"find_closest_nodes",
- *              "a":{"id":"ce3dbcf618862baf69e8",
- *                  "nodes" :["id": "5a7f5578eace25999477",
- *                            "m":  "192.168.4.46:12300",
- *                            "v":  "0.0.0.0.01",
- *                            "f": "00000001"
- *                           ],
- *                           ...
- *                 }
- *            }
- */
-static
-int _vdht_enc_find_closest_nodes_rsp(
-        vtoken* token,
-        vnodeId* srcId,
-        struct varray* closest,
-        void* buf,
-        int sz)
+static inline
+void _aux_be_put_arg_NODE(struct be_writer* wr, vnodeInfo* nodei)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* rslt = NULL;
-    struct be_node* list = NULL;
-    int ret = 0;
-    int i   = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(closest);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-    node = be_create_str("find_closest_nodes");
-    be_add_keypair(dict, "r", node);
+    vassert(nodei);
+    be_wr_lit  (wr, "4:node");
+    _aux_write_vnodeInfo(wr, nodei);
+    return ;
+}
 
-    rslt = be_create_dict();
-    node = be_create_vtoken(srcId);
-    be_add_keypair(rslt, "id", node);
-    list = be_create_list();
-    for (; i < varray_size(closest); i++) {
-        vnodeInfo* info = NULL;
+static inline
+void _aux_be_put_arg_NODES(struct be_writer* wr, struct varray* nodes)
+{
+    int i = 0;
+    vassert(nodes);
 
-        info = (vnodeInfo*)varray_get(closest, i);
-        node = _aux_create_vnodeInfo(info);
-        be_add_list(list, node);
+    be_wr_lit  (wr, "5:nodesl");
+    for (i = 0; i < varray_size(nodes); i++) {
+        _aux_write_vnodeInfo(wr, (vnodeInfo*)varray_get(nodes, i));
     }
-    be_add_keypair(rslt, "nodes", list);
-    be_add_keypair(dict, "a", rslt);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    be_wr_lit  (wr, "e");
+    return ;
 }
 
-/*
- * @token:
- * @srcId: Id of node sending query.
- * @buf:
- * @len:
- * reflect Query = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *                  "y":"q",
- *                  "q":"reflex",
- *                  "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391"}
- *              }
- * encoded = d1:t40:deafc137da918b8cd9b95e72fef379a5b54c3f361:y1:q1:q4:reflect
- *           1:ad2:id40:dbfcc5576ca7f742c802930892de9a1fb521f391ee
- */
-static
-int _vdht_enc_reflex(vtoken* token, vnodeId* srcId, void* buf, int sz)
+static inline
+void _aux_be_put_arg_ADDR(struct be_writer* wr, struct sockaddr_in* addr)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* id   = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("reflex");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    id   = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", id);
-    be_add_keypair(dict, "a", node);
-
-    ret  = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    vassert(addr);
+    be_wr_lit  (wr, "2:me");
+    be_wr_addr (wr, addr);
+    return ;
 }
 
-/*
- * @token:
- * @srcId: Id of node replying query
- * @result: queried result.
- * @buf:
- * @sz:
- *
- *  response = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *              "y":"r",
- *              "r":"reflex",
- *              "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                   "me" :"10.34.2.45:12300",
- *                 }
- *            }
- */
-static
-int _vdht_enc_reflex_rsp(
-        vtoken* token,
-        vnodeId* srcId,
-        struct sockaddr_in* reflective_addr,
-        void* buf,
-        int sz)
+static inline
+void _aux_be_put_arg_SRVC(struct be_writer* wr, vsrvcInfo* srvci)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* rslt = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(reflective_addr);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-    node = be_create_str("reflex");
-    be_add_keypair(dict, "r", node);
-
-    rslt = be_create_dict();
-    node = be_create_vtoken(srcId);
-    be_add_keypair(rslt, "id", node);
-    node = be_create_addr(reflective_addr);
-    be_add_keypair(rslt, "me", node);
-    be_add_keypair(dict, "a", rslt);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    vassert(srvci);
+    be_wr_lit  (wr, "7:service");
+    _aux_write_vsrvcInfo(wr, srvci);
+    return ;
 }
 
 /*
+ * encoders generated from schema, each of which emits msg as:
+ *
+ * d1:t<token>1:y1:<y>1:<y><len>:<desc>1:ad2:id<srcId>[<arg>]ee
  *
- * reflect Query = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *                  "y":"q",
- *                  "q":"probe",
- *                  "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                       "target": }
+ * ping Query = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
+ *               "y":"q",
+ *               "q":"ping",
+ *               "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391"}
  *              }
+ * encoded = d1:t40:deafc137da918b8cd9b95e72fef379a5b54c3f361:y1:q1:q4:ping1:a
+ *           d2:id40:dbfcc5576ca7f742c802930892de9a1fb521f391ee
+ *
+ * everything but token, Id and argument is one literal, so that each msg
+ * costs only a few copies into @buf, and a single check at be_wr_done.
  */
-static
-int _vdht_enc_probe(
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* destId,
-        void* buf,
-        int sz)
-{
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(destId);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("probe");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    temp = be_create_vtoken(destId);
-    be_add_keypair(node, "target", temp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
-}
+#define VDHT_BE_ENCODER(id, name, y, len, desc, kind) \
+static \
+int _vdht_enc_##name(vtoken* token, vnodeId* srcId VDHT_ARG_##kind, void* buf, int sz) \
+{ \
+    struct be_writer wr; \
+    _Static_assert(sizeof(#desc) - 1 == len, "bad length of " #desc); \
+    \
+    vassert(token); \
+    vassert(srcId); \
+    vassert(buf); \
+    vassert(sz > 0); \
+    \
+    be_wr_init (&wr, buf, sz); \
+    be_wr_lit  (&wr, "d1:t"); \
+    be_wr_token(&wr, token); \
+    be_wr_lit  (&wr, "1:y1:" #y "1:" #y #len ":" #desc "1:ad2:id"); \
+    be_wr_token(&wr, srcId); \
+    _aux_be_put_arg_##kind(&wr VDHT_PASS_##kind); \
+    be_wr_lit  (&wr, "ee"); \
+    return be_wr_done(&wr); \
+}
+
+VDHT_MSG_SCHEMA(VDHT_BE_ENCODER)
 
 /*
- *  response = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *              "y":"r",
- *              "r":"probe",
- *              "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391"}
- *            }
+ * token is always the first value of msg, as "d1:t40:<token>".
  */
 static
-int _vdht_enc_probe_rsp(
-        vtoken* token,
-        vnodeId* srcId,
-        void* buf,
-        int sz)
+int _vdht_set_token(void* buf, int len, vtoken* token)
 {
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
+    struct be_writer wr;
 
-    vassert(token);
-    vassert(srcId);
     vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-    node = be_create_str("probe");
-    be_add_keypair(dict, "r", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
-}
-
-/*
- * @token:
- * @srcId: Id of node sending query.
- * @target: Id of queried node.
- * @buf:
- * @len:
- *
- * Query = {"t":"7cf80a63748208c08ba5b97401d52fb3baf45cbe",",
- *          "y":"q",
- *          "q":"post_service",
- *          "a": {"id":"b790b74d9726c859c64cd54835d693b6019bcc73",
- *                "service" :{"id": "84d26f1cbea5d67d731a67c1b7ec427e40e948f9"
- *                            "m" : ["192.168.4.46:13500", "10.0.0.12:13500"]
- *                            "n" : "5"
- *                           }
- *               }
- *         }
- * encoded = d1:t40:7cf80a63748208c08ba5b97401d52fb3baf45cbe1:y1:q1:q12:post_service
- *           1:ad2:id40:b790b74d9726c859c64cd54835d693b6019bcc737:serviced2:id40:
- *           84d26f1cbea5d67d731a67c1b7ec427e40e948f91:ml18:192.168.4.46:1350015:
- *           10.0.0.12:13500e1:ni5eeee
- *
- */
-static
-int _vdht_enc_post_service(
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcInfo* srvci,
-        void* buf,
-        int sz)
-{
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* rslt = NULL;
-    int ret = 0;
-
     vassert(token);
-    vassert(srvci);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
 
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-
-    node = be_create_str("post_service");
-    be_add_keypair(dict, "q", node);
-
-    rslt = be_create_dict();
-    node = be_create_vtoken(srcId);
-    be_add_keypair(rslt, "id", node);
-
-    node = _aux_create_vsrvcInfo(srvci);
-    be_add_keypair(rslt, "service", node);
-    be_add_keypair(dict, "a", rslt);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
-}
-
-static
-int _vdht_enc_find_service(
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcHash* srvcHash,
-        void* buf,
-        int sz)
-{
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(srvcHash);
-    vassert(buf);
-    vassert(sz > 0);
+    retE((len < (int)sizeof("d1:t40:")));
+    retE((memcmp(buf, "d1:t40:", sizeof("d1:t40:") - 1)));
 
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("q");
-    be_add_keypair(dict, "y", node);
-    node = be_create_str("find_service");
-    be_add_keypair(dict, "q", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    temp = be_create_vtoken(srvcHash);
-    be_add_keypair(node, "target", temp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
+    // overwrite in place, without terminating null of be_wr_done.
+    be_wr_init (&wr, (char*)buf + 4, len - 4);
+    be_wr_token(&wr, token);
+    retE((wr.err));
+    return 0;
 }
 
-static
-int _vdht_enc_find_service_rsp(
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcInfo* result,
-        void* buf,
-        int sz)
-{
-    struct be_node* dict = NULL;
-    struct be_node* node = NULL;
-    struct be_node* temp = NULL;
-    int ret = 0;
-
-    vassert(token);
-    vassert(srcId);
-    vassert(result);
-    vassert(buf);
-    vassert(sz > 0);
-
-    dict = be_create_dict();
-    retE((!dict));
-
-    node = be_create_vtoken(token);
-    be_add_keypair(dict, "t", node);
-
-    node = be_create_str("r");
-    be_add_keypair(dict, "y", node);
-    node = be_create_str("find_service");
-    be_add_keypair(dict, "r", node);
-
-    node = be_create_dict();
-    temp = be_create_vtoken(srcId);
-    be_add_keypair(node, "id", temp);
-    temp = _aux_create_vsrvcInfo(result);
-    be_add_keypair(node, "service", temp);
-    be_add_keypair(dict, "a", node);
-
-    ret = be_encode(dict, buf, sz);
-    be_free(dict);
-    retE((ret < 0));
-    return ret;
-}
+#define VDHT_BE_ENC_OP(id, name, y, len, desc, kind) .name = _vdht_enc_##name,
 
 struct vdht_enc_ops dht_enc_ops = {
-    .ping                   = _vdht_enc_ping,
-    .ping_rsp               = _vdht_enc_ping_rsp,
-    .find_node              = _vdht_enc_find_node,
-    .find_node_rsp          = _vdht_enc_find_node_rsp,
-    .find_closest_nodes     = _vdht_enc_find_closest_nodes,
-    .find_closest_nodes_rsp = _vdht_enc_find_closest_nodes_rsp,
-    .reflex                 = _vdht_enc_reflex,
-    .reflex_rsp             = _vdht_enc_reflex_rsp,
-    .probe                  = _vdht_enc_probe,
-    .probe_rsp              = _vdht_enc_probe_rsp,
-    .post_service           = _vdht_enc_post_service,
-    .find_service           = _vdht_enc_find_service,
-    .find_service_rsp       = _vdht_enc_find_service_rsp
+    VDHT_MSG_SCHEMA(VDHT_BE_ENC_OP)
+    .set_token = _vdht_set_token
 };
 
 static
-int _aux_unpack_vtoken(struct be_node* dict, vtoken* token)
+int _aux_unpack_vtoken(struct be_spans* sps, vtoken* token)
 {
-    struct be_node* node = NULL;
+    int node = 0;
     int ret = 0;
-    vassert(dict);
+    vassert(sps);
     vassert(token);
 
-    ret = be_node_by_key(dict, "t", &node);
-    retE((ret < 0));
-    retE((BE_STR != node->type));
-
-    ret  = be_unpack_token(node, token);
-    retE((ret < 0));
-    return 0;
-}
-
-
-static
-int _aux_unpack_vnodeId(struct be_node* dict, char* key1, char* key2, vnodeId* id)
-{
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(key1);
-    vassert(key2);
-    vassert(id);
+    node = be_span_by_key(sps, 0, BE_KEY_T);
+    retE((node < 0));
 
-    ret = be_node_by_2keys(dict, key1, key2, &node);
-    if ((ret < 0) || (BE_STR != node->type)) {
-        return -1;
-    }
-    ret = be_unpack_token(node, id);
+    ret  = be_span_unpack_token(sps, node, token);
     retE((ret < 0));
     return 0;
 }
 
 static
-int _aux_unpack_vnodeInfo(struct be_node* dict, vnodeInfo* nodei)
+int _aux_unpack_vnodeInfo(struct be_spans* sps, int dict, vnodeInfo* nodei)
 {
-    struct be_node* node = NULL;
     vnodeId  id;
     vnodeVer ver;
     int weight = 0;
-    int i = 0;
+    int addrs = 0;
+    int idx = 0;
+    int ret = 0;
+    int n = 0;
 
-    vassert(dict);
+    vassert(sps);
     vassert(nodei);
-    retE((BE_DICT != dict->type));
+    retE((dict < 0));
+    retE((BE_DICT != sps->spans[dict].type));
 
-    be_node_by_key(dict, "id", &node);
-    be_unpack_token(node, &id);
-    be_node_by_key(dict, "v", &node);
-    be_unpack_ver(node, &ver);
-    be_node_by_key(dict, "w", &node);
-    be_unpack_int(node, &weight);
-    be_node_by_key(dict, "m", &node);
-    vassert(node->type == BE_LIST);
+    ret  = be_span_unpack_token(sps, be_span_by_key(sps, dict, BE_KEY_ID), &id);
+    ret |= be_span_unpack_ver  (sps, be_span_by_key(sps, dict, BE_KEY_V), &ver);
+    ret |= be_span_unpack_int  (sps, be_span_by_key(sps, dict, BE_KEY_W), &weight);
+    retE((ret < 0));
+    addrs = be_span_by_key(sps, dict, BE_KEY_M);
+    retE((addrs < 0));
+    retE((BE_LIST != sps->spans[addrs].type));
 
     vnodeInfo_relax_init((vnodeInfo_relax*)nodei, &id, &ver, weight);
-    for (i = 0; node->val.l[i]; i++) {
+    be_span_for_each(sps, addrs, idx, n) {
         struct sockaddr_in addr;
-        struct be_node* an = node->val.l[i];
-        be_unpack_addr(an, &addr);
+        if (be_span_unpack_addr(sps, idx, &addr) < 0) {
+            continue;
+        }
         vnodeInfo_add_addr(&nodei, &addr);
     }
     return 0;
 }
 
 static
-int _aux_unpack_vsrvcInfo(struct be_node* dict, vsrvcInfo* srvci)
+int _aux_unpack_vsrvcInfo(struct be_spans* sps, int dict, vsrvcInfo* srvci)
 {
-    struct be_node* node = NULL;
     vsrvcHash hash;
     vnodeId id;
     int nice = 0;
-    int i = 0;
+    int addrs = 0;
+    int idx = 0;
+    int ret = 0;
+    int n = 0;
 
-    vassert(dict);
+    vassert(sps);
     vassert(srvci);
-    retE((BE_DICT != dict->type));
+    retE((dict < 0));
+    retE((BE_DICT != sps->spans[dict].type));
 
-    be_node_by_key(dict, "hash", &node);
-    be_unpack_token(node, &hash);
-    be_node_by_key(dict, "id", &node);
-    be_unpack_token(node, &id);
-    be_node_by_key(dict, "n", &node);
-    be_unpack_int(node, &nice);
-    be_node_by_key(dict, "m", &node);
-    vassert(node->type == BE_LIST);
+    ret  = be_span_unpack_token(sps, be_span_by_key(sps, dict, BE_KEY_HASH), &hash);
+    ret |= be_span_unpack_token(sps, be_span_by_key(sps, dict, BE_KEY_ID), &id);
+    ret |= be_span_unpack_int  (sps, be_span_by_key(sps, dict, BE_KEY_N), &nice);
+    retE((ret < 0));
+    addrs = be_span_by_key(sps, dict, BE_KEY_M);
+    retE((addrs < 0));
+    retE((BE_LIST != sps->spans[addrs].type));
 
     vsrvcInfo_relax_init((vsrvcInfo_relax*)srvci, &hash, &id, nice);
-    for (i = 0; node->val.l[i]; i++) {
+    be_span_for_each(sps, addrs, idx, n) {
         struct sockaddr_in addr;
-        struct be_node* addr_node = node->val.l[i];
-        be_unpack_addr(addr_node, &addr);
+        if (be_span_unpack_addr(sps, idx, &addr) < 0) {
+            continue;
+        }
         vsrvcInfo_add_addr(&srvci, &addr);
     }
     return 0;
 }
 
 static
-int _aux_unpack_dhtId(struct be_node* dict)
+int _aux_unpack_dhtId(struct be_spans* sps)
 {
-    struct be_node* node = NULL;
-    int ret = 0;
+    struct vdhtId_desc* desc = NULL;
+    int node = 0;
 
-    vassert(dict);
-    retE((BE_DICT != dict->type));
+    vassert(sps);
+    retE((BE_DICT != sps->spans[0].type));
 
-    ret = be_node_by_key(dict, "y", &node);
-    retE((ret < 0));
-    retE((BE_STR != node->type));
+    node = be_span_by_key(sps, 0, BE_KEY_Y);
+    retE((node < 0));
+    retE((BE_STR != sps->spans[node].type));
 
-    if (!strcmp(node->val.s, "q")) {
-        ret = be_node_by_key(dict, "q", &node);
-        retE((ret < 0));
-        retE((BE_STR != node->type));
-        return vdht_get_queryId(node->val.s);
+    if (be_span_str_eq(sps, node, "q")) {
+        desc = dhtId_query_desc;
+        node = be_span_by_key(sps, 0, BE_KEY_Q);
+    } else if (be_span_str_eq(sps, node, "r")) {
+        desc = dhtId_rsp_desc;
+        node = be_span_by_key(sps, 0, BE_KEY_R);
+    } else {
+        return VDHT_UNKNOWN;
     }
-    if (!strcmp(node->val.s, "r")) {
-        ret = be_node_by_key(dict, "r", &node);
-        retE((ret < 0));
-        retE((BE_STR != node->type));
-        return vdht_get_rspId(node->val.s);
+    retE((node < 0));
+    retE((BE_STR != sps->spans[node].type));
+
+    for (; desc->desc; desc++) {
+        if (be_span_str_eq(sps, node, desc->desc)) {
+            return desc->id;
+        }
     }
     return VDHT_UNKNOWN;
 }
 
-/*
- * @ctxt:  decoder context
- * @token:
- * @srcId: source nodeId
- *
- * ping Query = {"t":"deafc137da918b8cd9b95e72fef379a5b54c3f36",
- *               "y":"q",
- *               "q":"ping",
- *               "a":{"id":"dbfcc5576ca7f742c802930892de9a1fb521f391"}
- *              }
- * encoded = d1:t40:deafc137da918b8cd9b95e72fef379a5b54c3f361:y1:q1:q4:ping1:a
- *           d2:id40:dbfcc5576ca7f742c802930892de9a1fb521f391ee
- */
-static
-int _vdht_dec_ping(void* ctxt, vtoken* token, vnodeId* srcId)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    return 0;
-}
-
-/*
- * @ctxt:  decoder context
- * @token:
- * @result: node infos of destination node.
- *
- * response = {"t":"06d5613f3f43631c539db6f10fbd04b651a21844",
- *             "y":"r",
- *             "r":"ping",
- *             "a":{"id": "dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                  "node" :{"id": "dbfcc5576ca7f742c802930892de9a1fb521f391",
- *                            "v": "0.0.0.1.0",
- *                            "ml": "192.168.4.125:12300",
- *                            "w": "0"
- *                          }
- *                 }
- *            }
- * encoded = d1:t40:06d5613f3f43631c539db6f10fbd04b651a218441:y1:r1:rd4:noded
- *           2:id40:dbfcc5576ca7f742c802930892de9a1fb521f3911:v9:0.0.0.1.0
- *           2:ml19:192.168.4.125:123001:wi0eeee
- */
-static
-int _vdht_dec_ping_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeInfo* result)
+static inline
+int _aux_be_get_arg_NONE(struct be_spans* sps, int args)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(result);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = be_node_by_2keys(dict, "a", "node", &node);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeInfo(node, result);
-    retE((ret < 0));
-
     return 0;
 }
 
-/*
- * @ctxt: decoder context
- * @token:
- * @srcId: source nodeId
- * @targetId: target node Id
- *
- * find_node Query = {"t":"9948eb5973da8f3c3c0a",
- *                    "y":"q",
- *                    "q":"find_node",
- *                    "a": {"id":"7ba29c1b9215a2e7621e",
- *                          "target":"7ba29c1b9215a2e7621"
- *                         }
- *                   }
- * bencoded =  d1:t20:9948eb5973da8f3c3c0a1:y1:q1:q9:find_node1:ad2:id20:7ba29c
- *             1b9215a2e7621e6:target20:7ba29c1b9215a2e7621eee
- */
-static
-int _vdht_dec_find_node(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* targetId)
+static inline
+int _aux_be_get_arg_ID(struct be_spans* sps, int args, vnodeId* targetId)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
     vassert(targetId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeId(dict, "a", "target", targetId);
-    retE((ret < 0));
-
-    return 0;
+    return be_span_unpack_token(sps, be_span_by_key(sps, args, BE_KEY_TARGET), targetId);
 }
 
-/*
- * @ctxt:
- * @token:
- * @srcId:
- * @result:
- *
-  *  response = {"t":"9948eb5973da8f3c3c0a",
- *              "y":"r",
- *              "r":"find_node",
- *              "a":{"id":"ce3dbcf618862baf69e8",
- *                  "node" :{"id": "7ba29c1b9215a2e7621e",
- *                            "m": "192.168.4.46:12300",
- *                            "v": "0.0.0.1.0",
- *                            "f": "0"
- *                          }
- *                 }
- *            }
- * bencoded = d1:t20:9948eb5973da8f3c3c0a1:y1:r1:rd2:id20:ce3dbcf618862baf69e84
- *            :noded2:id20:7ba29c1b9215a2e7621e1:m18:192.168.4.46:123001:v9:0.0
- *            .0.0.01:fi0eeee
- */
-static
-int _vdht_dec_find_node_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeInfo* result)
+static inline
+int _aux_be_get_arg_NODE(struct be_spans* sps, int args, vnodeInfo* nodei)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-    vassert(result);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = be_node_by_2keys(dict, "a", "node", &node);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeInfo(node, result);
-    retE((ret < 0));
-
-    return 0;
-}
-
-/*
- * @ctxt:
- * @token:
- * @srcId:
- * @closest:
- *
- * find_node Query = {"t":"971ee80a808da2eb7fb2",
- *                    "y":"q",
- *                    "q":"find_closest_nodes",
- *                    "a": {"id":"7ba29c1b9215a2e7621e",
- *                          "target":"7ba29c1b9215a2e7621"
- *                         }
- *                   }
- * bencoded = :d1:t20:971ee80a808da2eb7fb21:y1:q1:q18:find_closest_nodes1:ad2:i
- *            d20:7ba29c1b9215a2e7621e6:target20:7ba29c1b9215a2e7621eee
- */
-static
-int _vdht_dec_find_closest_nodes(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* targetId)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-    vassert(targetId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeId(dict, "a", "target", targetId);
-    retE((ret < 0));
-
-    return 0;
+    vassert(nodei);
+    return _aux_unpack_vnodeInfo(sps, be_span_by_key(sps, args, BE_KEY_NODE), nodei);
 }
 
 /*
- * @ctxt:  decoder context
- * @token: msg token;
- * @srcId: source vnodeId
- * @closest: array of nodes that close to current node.
- *
- * response = {"t":"30c6443e29cc307571e3",
- *              "y":"r",
- *              "r":"find_closest_nodes",
- *              "a":{"id":"ce3dbcf618862baf69e8",
- *                  "nodes" :["id": "5a7f5578eace25999477",
- *                            "m":  "192.168.4.46:12300",
- *                            "v":  "0.0.0.0.01",
- *                            "f": "00000001"
- *                           ],
- *                           ...
- *                 }
- *            }
- * bencoded = d1:t20:30c6443e29cc307571e31:y1:r1:rd2:id20:ce3dbcf618862baf69e8\
- *            5:nodesld2:id20:5a7f5578eace259994771:m18:192.168.4.46:123001:v\
- *            9:0.0.0.0.01:fi1417421748eeeee
+ * nodes are taken from decode arena, and those failed to decode are skipped.
  */
-static
-int _vdht_dec_find_closest_nodes_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        struct varray* closest)
+static inline
+int _aux_be_get_arg_NODES(struct be_spans* sps, int args, struct varray* nodes)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* list = NULL;
-    struct be_node* node = NULL;
-    int ret = 0;
-    int i = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-    vassert(closest);
+    vnodeInfo* nodei = NULL;
+    int list = 0;
+    int node = 0;
+    int n = 0;
 
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
+    vassert(nodes);
 
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = be_node_by_2keys(dict, "a", "nodes", &list);
-    retE((ret < 0));
-    retE((BE_LIST != list->type));
+    list = be_span_by_key(sps, args, BE_KEY_NODES);
+    retE((list < 0));
+    retE((BE_LIST != sps->spans[list].type));
 
-    for (i = 0; list->val.l[i]; i++) {
-        vnodeInfo* nodei = NULL;
-        node = list->val.l[i];
-        retE((BE_DICT != node->type));
+    be_span_for_each(sps, list, node, n) {
+        retE((BE_DICT != sps->spans[node].type));
 
-        nodei = (vnodeInfo*)vnodeInfo_relax_alloc();
+        nodei = (vnodeInfo*)vdht_dec_alloc(sizeof(vnodeInfo_relax));
         if (!nodei) {
             break;
         }
-        _aux_unpack_vnodeInfo(node, nodei);
-        varray_add_tail(closest, nodei);
+        if (_aux_unpack_vnodeInfo(sps, node, nodei) < 0) {
+            continue;
+        }
+        varray_add_tail(nodes, nodei);
     }
-
-    return 0;
-}
-
-/*
- * the routine to decode @reflex query.
- * @ctxt:  deocde context.
- * @token: transaction token
- * @srcId: id of query node.
- * @addr : local address to get it's reflexive address.
- */
-static
-int _vdht_dec_reflex(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(ctxt);
-    vassert(token);
-    vassert(srcId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    return 0;
-}
-
-/*
- * the routine to decode response msg to @reflex query.
- * @ctxt:  deocde context.
- * @token: transaction token
- * @srcId: id of node where response came from.
- * @reflexive_addr: reflexive address to query node.
- */
-static
-int _vdht_dec_reflex_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        struct sockaddr_in* reflexive_addr)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-    vassert(reflexive_addr);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = be_node_by_2keys(dict, "a", "me", &node);
-    retE((ret < 0));
-    ret = be_unpack_addr(node, reflexive_addr);
-    retE((ret < 0));
-
-    return 0;
-}
-
-/*
- * the routine to decode @probe query.
- * @ctxt:  deocde context.
- * @token: transaction token
- * @srcId: id of query node.
- * @destId: id of destination node.
- */
-static
-int _vdht_dec_probe(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vnodeId* destId)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(ctxt);
-    vassert(token);
-    vassert(srcId);
-    vassert(destId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeId(dict, "a", "target", destId);
-    retE((ret < 0));
-
     return 0;
 }
 
-/*
- * the routine to decode response msg to @probe query.
- * @ctxt:  deocde context.
- * @token: transaction token
- * @srcId: id of node where response came from.
- */
-static
-int _vdht_dec_probe_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId)
+static inline
+int _aux_be_get_arg_ADDR(struct be_spans* sps, int args, struct sockaddr_in* addr)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(ctxt);
-    vassert(token);
-    vassert(srcId);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    return 0;
+    vassert(addr);
+    return be_span_unpack_addr(sps, be_span_by_key(sps, args, BE_KEY_ME), addr);
 }
 
-/* the routine to decode @post_service indication.
- * @ctxt: decode context
- * @token: trans token
- * @srcId: Id of source node where the indcation was from.
- * @service:
- *
- * Query = {"t":"b6e0855abbf93b8e6754",",
- *          "y":"q",
- *          "q":"post_service",
- *          "a": {"id":"7ba29c1b9215a2e7621e",
- *                "service" :{"id": "e532d7c80cf02e8652d3"
- *                            "m" : ["192.168.4.46:14444",
- *                                   "27.115.62.114:15300"
- *                                  ]
- *                            "f" : "0"
- *                           }
- *               }
- *         }
- * bencoded = d1:t20:b6e0855abbf93b8e67541:y1:q1:q12:post_service1:ad2:id20:
- *            7ba29c1b9215a2e7621e7:serviced2:id20:e532d7c80cf02e8652d31:m17:
- *            192.168.4.46:144441:fi0eeee
- */
-static
-int _vdht_dec_post_service(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcInfo* result)
+static inline
+int _aux_be_get_arg_SRVC(struct be_spans* sps, int args, vsrvcInfo* srvci)
 {
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(dict);
-    vassert(token);
-    vassert(srcId);
-    vassert(result);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = be_node_by_2keys(dict, "a", "service", &node);
-    retE((ret < 0));
-    ret = _aux_unpack_vsrvcInfo(node, result);
-    retE((ret < 0));
-
-    return 0;
+    vassert(srvci);
+    return _aux_unpack_vsrvcInfo(sps, be_span_by_key(sps, args, BE_KEY_SERVICE), srvci);
 }
 
 /*
- * the routine to decode @find_service query.
- * @ctxt:
- * @token:
- * @srcId:
- * @srvcId:
+ * decoders generated from schema, each of which picks token, Id and the
+ * argument out of spans by interned keys.
  */
-static
-int _vdht_dec_find_service(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcHash* srvcHash)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    int ret = 0;
-
-    vassert(ctxt);
-    vassert(token);
-    vassert(srcId);
-    vassert(srvcHash);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = _aux_unpack_vnodeId(dict, "a", "target", srvcHash);
-    retE((ret < 0));
-
-    return 0;
-}
+#define VDHT_BE_DECODER(id, name, y, len, desc, kind) \
+static \
+int _vdht_dec_##name(void* ctxt, vtoken* token, vnodeId* srcId VDHT_ARG_##kind) \
+{ \
+    struct be_spans* sps = (struct be_spans*)ctxt; \
+    int args = 0; \
+    int ret = 0; \
+    \
+    vassert(sps); \
+    vassert(token); \
+    vassert(srcId); \
+    \
+    ret = _aux_unpack_vtoken(sps, token); \
+    retE((ret < 0)); \
+    \
+    args = be_span_by_key(sps, 0, BE_KEY_A); \
+    ret = be_span_unpack_token(sps, be_span_by_key(sps, args, BE_KEY_ID), srcId); \
+    retE((ret < 0)); \
+    ret = _aux_be_get_arg_##kind(sps, args VDHT_PASS_##kind); \
+    retE((ret < 0)); \
+    return 0; \
+}
+
+VDHT_MSG_SCHEMA(VDHT_BE_DECODER)
 
 /*
- * the routine to decode response msg to @find_servcie query.
- * @ctxt:
- * @token:
- * @srcId:
- * @result:
+ * spans of msg being decoded, which are views into receiving buffer, and
+ * valid until dec_done. msgs are decoded one at a time by each thread.
  */
-static
-int _vdht_dec_find_service_rsp(
-        void* ctxt,
-        vtoken* token,
-        vnodeId* srcId,
-        vsrvcInfo* result)
-{
-    struct be_node* dict = (struct be_node*)ctxt;
-    struct be_node* node = NULL;
-    int ret = 0;
-
-    vassert(ctxt);
-    vassert(token);
-    vassert(srcId);
-    vassert(result);
-
-    ret = _aux_unpack_vtoken(dict, token);
-    retE((ret < 0));
-
-    ret = _aux_unpack_vnodeId(dict, "a", "id", srcId);
-    retE((ret < 0));
-    ret = be_node_by_2keys(dict, "a", "service", &node);
-    retE((ret < 0));
-    ret = _aux_unpack_vsrvcInfo(node, result);
-    retE((ret < 0));
-
-    return 0;
-}
+static __thread struct be_spans dht_dec_spans;
 
 static
 int _vdht_dec_begin(void* buf, int len, void** ctxt)
 {
-    struct be_node* dict = NULL;
+    struct be_spans* sps = &dht_dec_spans;
     int ret = 0;
 
     vassert(buf);
@@ -1600,15 +538,15 @@ int _vdht_dec_begin(void* buf, int len, void** ctxt)
     vassert(ctxt);
 
     vlogI("[dht msg]->%s", (char*)buf);
-    dict = be_decode(buf, len);
-    vlogEv((!dict), elog_be_decode);
-    retE((!dict));
+    ret = be_span_decode(sps, (char*)buf, len);
+    vlogEv((ret < 0), elog_be_decode);
+    retE((ret < 0));
 
-    ret = _aux_unpack_dhtId(dict);
-    ret1E((ret < 0), be_free(dict));
-    ret1E((ret >= VDHT_UNKNOWN), be_free(dict));
+    ret = _aux_unpack_dhtId(sps);
+    retE((ret < 0));
+    retE((ret >= VDHT_UNKNOWN));
 
-    *ctxt = (void*)dict;
+    *ctxt = (void*)sps;
     return ret;
 }
 
@@ -1616,26 +554,17 @@ static
 int _vdht_dec_done(void* ctxt)
 {
     vassert(ctxt);
-    be_free((struct be_node*)ctxt);
+    // spans are reused by next msg, only nodes decoded are released.
+    vdht_dec_reset();
     return 0;
 }
 
+#define VDHT_BE_DEC_OP(id, name, y, len, desc, kind) .name = _vdht_dec_##name,
+
 struct vdht_dec_ops dht_dec_ops = {
     .dec_begin              = _vdht_dec_begin,
     .dec_done               = _vdht_dec_done,
 
-    .ping                   = _vdht_dec_ping,
-    .ping_rsp               = _vdht_dec_ping_rsp,
-    .find_node              = _vdht_dec_find_node,
-    .find_node_rsp          = _vdht_dec_find_node_rsp,
-    .find_closest_nodes     = _vdht_dec_find_closest_nodes,
-    .find_closest_nodes_rsp = _vdht_dec_find_closest_nodes_rsp,
-    .reflex                 = _vdht_dec_reflex,
-    .reflex_rsp             = _vdht_dec_reflex_rsp,
-    .probe                  = _vdht_dec_probe,
-    .probe_rsp              = _vdht_dec_probe_rsp,
-    .post_service           = _vdht_dec_post_service,
-    .find_service           = _vdht_dec_find_service,
-    .find_service_rsp       = _vdht_dec_find_service_rsp
+    VDHT_MSG_SCHEMA(VDHT_BE_DEC_OP)
 };
 
@@ -7,118 +7,98 @@
 #define DHT_MAGIC ((uint32_t)0x58681506)
 #define IS_DHT_MSG(magic) (magic == DHT_MAGIC)
 
-enum {
-    VDHT_PING,
-    VDHT_PING_R,
-    VDHT_FIND_NODE,
-    VDHT_FIND_NODE_R,
-    VDHT_FIND_CLOSEST_NODES,
-    VDHT_FIND_CLOSEST_NODES_R,
-    VDHT_REFLEX,
-    VDHT_REFLEX_R,
-    VDHT_PROBE,
-    VDHT_PROBE_R,
-    VDHT_POST_SERVICE,
-    VDHT_FIND_SERVICE,
-    VDHT_FIND_SERVICE_R,
-    VDHT_UNKNOWN
-};
-
 /*
- * method set for dht msg encoder
+ * compact binary dht msg, which nodes of VDHT_BIN_VER or later speak.
  */
-struct vdht_enc_ops {
-    int (*ping)(
-            vtoken* token,  // transaction Id.
-            vnodeId* srcId, // node Id querying
-            void* buf,
-            int   sz);
-
-    int (*ping_rsp)(
-            vtoken* token,  // trans Id.
-            vnodeId* srcId,
-            vnodeInfo* result, // query result. nomally info of current dht node
-            void* buf,
-            int   sz);
-
-    int (*find_node)(
-            vtoken* token,
-            vnodeId* srcId, // node Id querying.
-            vnodeId* targetId,  // Id of queried target
-            void* buf,
-            int   sz);
+#define DHT_BIN_MAGIC ((uint32_t)0x58681507)
+#define IS_DHT_BIN_MSG(magic) (magic == DHT_BIN_MAGIC)
+#define VDHT_BIN_VER  "0.0.0.2.0"
 
-    int (*find_node_rsp)(
-            vtoken* token,
-            vnodeId* srcId, // node Id replying query.
-            vnodeInfo* result, // query result, normally info the target dht node.
-            void* buf,
-            int   sz);
-
-    int (*find_closest_nodes)(
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeId* targetId,
-            void* buf,
-            int   sz);
-    int (*find_closest_nodes_rsp)(
-            vtoken* token,
-            vnodeId* srcId,
-            struct varray* result,
-            void* buf,
-            int   sz);
-
-    int (*reflex)(
-            vtoken* token,
-            vnodeId* srcId,
-            void* buf,
-            int   sz);
-
-    int (*reflex_rsp)(
-            vtoken* token,
-            vnodeId* srcId,
-            struct sockaddr_in* reflexive_addr,
-            void* buf,
-            int   sz);
+/*
+ * schema of dht msgs, which enum of dhtId, method sets and both codecs are
+ * generated from. each msg carries token and Id of sending node, followed
+ * by at most one argument:
+ *
+ * X(dhtId, name, y, len, desc, arg)
+ * @name: name of msg, and of methods for it.
+ * @y:    q for query, or r for response.
+ * @len:  length of @desc, for bencoded literal.
+ * @desc: value of "q" or "r" in bencoded msg.
+ * @arg:  kind of argument, see VDHT_ARG_xxx.
+ *
+ * dhtId goes onto wire with binary format, so only append to it.
+ */
+#define VDHT_MSG_SCHEMA(X) \
+    X(VDHT_PING,                 ping,                   q, 4,  ping,               NONE ) \
+    X(VDHT_PING_R,               ping_rsp,               r, 4,  ping,               NODE ) \
+    X(VDHT_FIND_NODE,            find_node,              q, 9,  find_node,          ID   ) \
+    X(VDHT_FIND_NODE_R,          find_node_rsp,          r, 9,  find_node,          NODE ) \
+    X(VDHT_FIND_CLOSEST_NODES,   find_closest_nodes,     q, 18, find_closest_nodes, ID   ) \
+    X(VDHT_FIND_CLOSEST_NODES_R, find_closest_nodes_rsp, r, 18, find_closest_nodes, NODES) \
+    X(VDHT_REFLEX,               reflex,                 q, 6,  reflex,             NONE ) \
+    X(VDHT_REFLEX_R,             reflex_rsp,             r, 6,  reflex,             ADDR ) \
+    X(VDHT_PROBE,                probe,                  q, 5,  probe,              ID   ) \
+    X(VDHT_PROBE_R,              probe_rsp,              r, 5,  probe,              NONE ) \
+    X(VDHT_POST_SERVICE,         post_service,           q, 12, post_service,       SRVC ) \
+    X(VDHT_FIND_SERVICE,         find_service,           q, 12, find_service,       ID   ) \
+    X(VDHT_FIND_SERVICE_R,       find_service_rsp,       r, 12, find_service,       SRVC )
 
-    int (*probe)(
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeId* destId,
-            void* buf,
-            int   sz);
+/*
+ * kinds of argument, as parameter declared by methods and as argument
+ * passed on by them:
+ * NONE : no argument.
+ * ID   : target Id, "target" in bencode.
+ * NODE : node info, "node" in bencode.
+ * NODES: array of node infos, "nodes" in bencode.
+ * ADDR : address, "me" in bencode.
+ * SRVC : service info, "service" in bencode.
+ */
+#define VDHT_ARG_NONE
+#define VDHT_ARG_ID    , vnodeId* arg
+#define VDHT_ARG_NODE  , vnodeInfo* arg
+#define VDHT_ARG_NODES , struct varray* arg
+#define VDHT_ARG_ADDR  , struct sockaddr_in* arg
+#define VDHT_ARG_SRVC  , vsrvcInfo* arg
+
+#define VDHT_PASS_NONE
+#define VDHT_PASS_ID    , arg
+#define VDHT_PASS_NODE  , arg
+#define VDHT_PASS_NODES , arg
+#define VDHT_PASS_ADDR  , arg
+#define VDHT_PASS_SRVC  , arg
+
+#define VDHT_MSG_ENUM(id, name, y, len, desc, kind) id,
 
-    int (*probe_rsp)(
-            vtoken* token,
-            vnodeId* srcId,
-            void* buf,
-            int   sz);
+enum {
+    VDHT_MSG_SCHEMA(VDHT_MSG_ENUM)
+    VDHT_UNKNOWN
+};
 
-    int (*post_service)(
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcInfo* srvc,
-            void* buf,
-            int   sz);
+/*
+ * method set for dht msg encoder, each of which encodes msg into @buf
+ * and returns length of it:
+ * int (*name)(vtoken* token, vnodeId* srcId, [arg,] void* buf, int sz);
+ */
+#define VDHT_ENC_METHOD(id, name, y, len, desc, kind) \
+    int (*name)(vtoken* token, vnodeId* srcId VDHT_ARG_##kind, void* buf, int sz);
 
-    int (*find_service)(
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcHash* hash,
-            void* buf,
-            int   sz);
+struct vdht_enc_ops {
+    VDHT_MSG_SCHEMA(VDHT_ENC_METHOD)
 
-    int (*find_service_rsp)(
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcInfo* srvc,
-            void* buf,
-            int   sz);
+    /*
+     * writes @token into msg encoded before, so that msg encoded once can
+     * be used as template for msgs of other tokens.
+     */
+    int (*set_token)(void* buf, int len, vtoken* token);
 };
 
 /*
- * method set for dht msg decoder
+ * method set for dht msg decoder, each of which decodes msg in @ctxt
+ * begun by dec_begin:
+ * int (*name)(void* ctxt, vtoken* token, vnodeId* srcId, [arg]);
  */
+#define VDHT_DEC_METHOD(id, name, y, len, desc, kind) \
+    int (*name)(void* ctxt, vtoken* token, vnodeId* srcId VDHT_ARG_##kind);
 
 struct vdht_dec_ops {
     int (*dec_begin) (
@@ -129,79 +109,7 @@ struct vdht_dec_ops {
     int (*dec_done)(
             void* ctxt);
 
-    int (*ping)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId);
-
-    int (*ping_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeInfo* result);
-
-    int (*find_node)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeId* targetId); // queried vnode Id.
-
-    int (*find_node_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeInfo* result);
-
-    int (*find_closest_nodes)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeId* targetId);
-
-    int (*find_closest_nodes_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            struct varray* result);
-
-    int (*reflex)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId);
-
-    int (*reflex_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            struct sockaddr_in* reflexive_addr);
-
-    int (*probe)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vnodeId* destId);
-
-    int (*probe_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId);
-
-    int (*post_service) (
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcInfo* srvci);
-
-    int (*find_service)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcHash* target_hash);
-
-    int (*find_service_rsp)(
-            void* ctxt,
-            vtoken* token,
-            vnodeId* srcId,
-            vsrvcInfo* srvci);
+    VDHT_MSG_SCHEMA(VDHT_DEC_METHOD)
 };
 
 char* vdht_get_desc(int);
@@ -210,4 +118,13 @@ void* vdht_buf_alloc(void);
 int   vdht_buf_len(void);
 void  vdht_buf_free(void*);
 
+/*
+ * for objects decoded out of msg, say nodes of @find_closest_nodes_rsp,
+ * which are taken from arena of current thread and valid until dec_done.
+ */
+#define VDHT_DEC_ARENA_SZ ((int)(4*BUF_SZ))
+
+void* vdht_dec_alloc(int);
+void  vdht_dec_reset(void);
+
 #endif
@@ -0,0 +1,478 @@
+#include "vglobal.h"
+#include "vdht.h"
+
+/*
+ * compact binary format of dht msg, spoken by nodes of VDHT_BIN_VER or
+ * later, with fixed-width fields instead of hex/text strings:
+ *
+ * ---------------------------------------------------------
+ * |<- dhtId(1) ->|<- token(20) ->|<- srcId(20) ->|<- args -|
+ * ---------------------------------------------------------
+ *
+ * nodeInfo: id(20), ver(5), weight(varint), naddrs(varint), addr(6)...
+ * srvcInfo: hash(20), hostid(20), nice(varint), naddrs(varint), addr(6)...
+ * addr    : ipv4(4), port(2), both in network order.
+ *
+ * integers are zigzag encoded varints, counts are plain varints.
+ */
+#define VDHT_BIN_HDR_SZ   ((int)(1 + 2 * VTOKEN_LEN))
+
+struct vdht_bin_buf {
+    uint8_t* data;
+    int sz;
+    int off;
+    int err;
+};
+
+static
+void _aux_bin_put(struct vdht_bin_buf* bb, const void* data, int len)
+{
+    if (bb->err || (len > bb->sz - bb->off)) {
+        bb->err = 1;
+        return ;
+    }
+    memcpy(bb->data + bb->off, data, len);
+    bb->off += len;
+    return ;
+}
+
+static
+void _aux_bin_put_varint(struct vdht_bin_buf* bb, uint32_t val)
+{
+    uint8_t buf[5];
+    int len = 0;
+
+    while (val >= 0x80) {
+        buf[len++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    buf[len++] = (uint8_t)val;
+    _aux_bin_put(bb, buf, len);
+    return ;
+}
+
+static
+void _aux_bin_put_int(struct vdht_bin_buf* bb, int32_t val)
+{
+    _aux_bin_put_varint(bb, ((uint32_t)val << 1) ^ (uint32_t)(val >> 31));
+    return ;
+}
+
+static
+void _aux_bin_put_addr(struct vdht_bin_buf* bb, struct sockaddr_in* addr)
+{
+    _aux_bin_put(bb, &addr->sin_addr.s_addr, 4);
+    _aux_bin_put(bb, &addr->sin_port, 2);
+    return ;
+}
+
+static
+void _aux_bin_put_hdr(struct vdht_bin_buf* bb, void* buf, int sz, int dhtId, vtoken* token, vnodeId* srcId)
+{
+    uint8_t id = (uint8_t)dhtId;
+
+    bb->data = (uint8_t*)buf;
+    bb->sz   = sz;
+    bb->off  = 0;
+    bb->err  = 0;
+
+    _aux_bin_put(bb, &id, 1);
+    _aux_bin_put(bb, token->data, VTOKEN_LEN);
+    _aux_bin_put(bb, srcId->data, VTOKEN_LEN);
+    return ;
+}
+
+static
+void _aux_bin_put_nodei(struct vdht_bin_buf* bb, vnodeInfo* nodei)
+{
+    int i = 0;
+
+    _aux_bin_put(bb, nodei->id.data, VTOKEN_LEN);
+    _aux_bin_put(bb, nodei->ver.data, VTOKEN_INTLEN);
+    _aux_bin_put_int(bb, nodei->weight);
+    _aux_bin_put_varint(bb, nodei->naddrs);
+    for (i = 0; i < nodei->naddrs; i++) {
+        _aux_bin_put_addr(bb, &nodei->addrs[i]);
+    }
+    return ;
+}
+
+static
+void _aux_bin_put_srvci(struct vdht_bin_buf* bb, vsrvcInfo* srvci)
+{
+    int i = 0;
+
+    _aux_bin_put(bb, srvci->hash.data, VTOKEN_LEN);
+    _aux_bin_put(bb, srvci->hostid.data, VTOKEN_LEN);
+    _aux_bin_put_int(bb, srvci->nice);
+    _aux_bin_put_varint(bb, srvci->naddrs);
+    for (i = 0; i < srvci->naddrs; i++) {
+        _aux_bin_put_addr(bb, &srvci->addrs[i]);
+    }
+    return ;
+}
+
+static
+int _aux_bin_put_done(struct vdht_bin_buf* bb)
+{
+    retE((bb->err));
+    return bb->off;
+}
+
+static inline
+void _aux_bin_put_arg_NONE(struct vdht_bin_buf* bb)
+{
+    return ;
+}
+
+static inline
+void _aux_bin_put_arg_ID(struct vdht_bin_buf* bb, vnodeId* targetId)
+{
+    vassert(targetId);
+    _aux_bin_put(bb, targetId->data, VTOKEN_LEN);
+    return ;
+}
+
+static inline
+void _aux_bin_put_arg_NODE(struct vdht_bin_buf* bb, vnodeInfo* nodei)
+{
+    vassert(nodei);
+    _aux_bin_put_nodei(bb, nodei);
+    return ;
+}
+
+static inline
+void _aux_bin_put_arg_NODES(struct vdht_bin_buf* bb, struct varray* nodes)
+{
+    int i = 0;
+    vassert(nodes);
+
+    _aux_bin_put_varint(bb, varray_size(nodes));
+    for (i = 0; i < varray_size(nodes); i++) {
+        _aux_bin_put_nodei(bb, (vnodeInfo*)varray_get(nodes, i));
+    }
+    return ;
+}
+
+static inline
+void _aux_bin_put_arg_ADDR(struct vdht_bin_buf* bb, struct sockaddr_in* addr)
+{
+    vassert(addr);
+    _aux_bin_put_addr(bb, addr);
+    return ;
+}
+
+static inline
+void _aux_bin_put_arg_SRVC(struct vdht_bin_buf* bb, vsrvcInfo* srvci)
+{
+    vassert(srvci);
+    _aux_bin_put_srvci(bb, srvci);
+    return ;
+}
+
+/*
+ * encoders generated from schema, each of which emits header followed by
+ * the argument.
+ */
+#define VDHT_BIN_ENCODER(id, name, y, len, desc, kind) \
+static \
+int _vdht_bin_enc_##name(vtoken* token, vnodeId* srcId VDHT_ARG_##kind, void* buf, int sz) \
+{ \
+    struct vdht_bin_buf bb; \
+    \
+    vassert(token); \
+    vassert(srcId); \
+    vassert(buf); \
+    vassert(sz > 0); \
+    \
+    _aux_bin_put_hdr(&bb, buf, sz, id, token, srcId); \
+    _aux_bin_put_arg_##kind(&bb VDHT_PASS_##kind); \
+    return _aux_bin_put_done(&bb); \
+}
+
+VDHT_MSG_SCHEMA(VDHT_BIN_ENCODER)
+
+static
+int _vdht_bin_set_token(void* buf, int len, vtoken* token)
+{
+    vassert(buf);
+    vassert(token);
+
+    retE((len < VDHT_BIN_HDR_SZ));
+    memcpy((uint8_t*)buf + 1, token->data, VTOKEN_LEN);
+    return 0;
+}
+
+#define VDHT_BIN_ENC_OP(id, name, y, len, desc, kind) .name = _vdht_bin_enc_##name,
+
+struct vdht_enc_ops dht_bin_enc_ops = {
+    VDHT_MSG_SCHEMA(VDHT_BIN_ENC_OP)
+    .set_token = _vdht_bin_set_token
+};
+
+/*
+ * for decoding. each decode routine reads msg from the beginning, and
+ * fails if any field is truncated or any byte is left over.
+ */
+static
+void _aux_bin_get(struct vdht_bin_buf* bb, void* data, int len)
+{
+    if (bb->err || (len > bb->sz - bb->off)) {
+        bb->err = 1;
+        return ;
+    }
+    memcpy(data, bb->data + bb->off, len);
+    bb->off += len;
+    return ;
+}
+
+static
+uint32_t _aux_bin_get_varint(struct vdht_bin_buf* bb)
+{
+    uint32_t val = 0;
+    uint8_t  byte = 0;
+    int shift = 0;
+
+    do {
+        _aux_bin_get(bb, &byte, 1);
+        if (bb->err || (shift > 28)) {
+            bb->err = 1;
+            return 0;
+        }
+        val |= (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return val;
+}
+
+static
+int32_t _aux_bin_get_int(struct vdht_bin_buf* bb)
+{
+    uint32_t val = _aux_bin_get_varint(bb);
+    return (int32_t)((val >> 1) ^ -(val & 1));
+}
+
+static
+void _aux_bin_get_addr(struct vdht_bin_buf* bb, struct sockaddr_in* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    _aux_bin_get(bb, &addr->sin_addr.s_addr, 4);
+    _aux_bin_get(bb, &addr->sin_port, 2);
+    return ;
+}
+
+static
+void _aux_bin_get_hdr(struct vdht_bin_buf* bb, void* ctxt, vtoken* token, vnodeId* srcId)
+{
+    struct vdht_bin_buf* msg = (struct vdht_bin_buf*)ctxt;
+
+    bb->data = msg->data;
+    bb->sz   = msg->sz;
+    bb->off  = 1;
+    bb->err  = 0;
+
+    _aux_bin_get(bb, token->data, VTOKEN_LEN);
+    _aux_bin_get(bb, srcId->data, VTOKEN_LEN);
+    return ;
+}
+
+static
+void _aux_bin_get_nodei(struct vdht_bin_buf* bb, vnodeInfo* nodei)
+{
+    struct sockaddr_in addr;
+    vnodeId  id;
+    vnodeVer ver;
+    int weight = 0;
+    int naddrs = 0;
+    int i = 0;
+
+    memset(&ver, 0, sizeof(ver));
+    _aux_bin_get(bb, id.data, VTOKEN_LEN);
+    _aux_bin_get(bb, ver.data, VTOKEN_INTLEN);
+    weight = _aux_bin_get_int(bb);
+    naddrs = (int)_aux_bin_get_varint(bb);
+    if (bb->err || (weight < 0) || (naddrs > VNODEINFO_MAX_ADDRS)) {
+        bb->err = 1;
+        return ;
+    }
+
+    vnodeInfo_relax_init((vnodeInfo_relax*)nodei, &id, &ver, weight);
+    for (i = 0; i < naddrs; i++) {
+        _aux_bin_get_addr(bb, &addr);
+        if (bb->err) {
+            return ;
+        }
+        vnodeInfo_add_addr(&nodei, &addr);
+    }
+    return ;
+}
+
+static
+void _aux_bin_get_srvci(struct vdht_bin_buf* bb, vsrvcInfo* srvci)
+{
+    struct sockaddr_in addr;
+    vsrvcHash hash;
+    vnodeId hostid;
+    int nice = 0;
+    int naddrs = 0;
+    int i = 0;
+
+    _aux_bin_get(bb, hash.data, VTOKEN_LEN);
+    _aux_bin_get(bb, hostid.data, VTOKEN_LEN);
+    nice   = _aux_bin_get_int(bb);
+    naddrs = (int)_aux_bin_get_varint(bb);
+    if (bb->err || (naddrs > VSRVCINFO_MAX_ADDRS)) {
+        bb->err = 1;
+        return ;
+    }
+
+    vsrvcInfo_relax_init((vsrvcInfo_relax*)srvci, &hash, &hostid, nice);
+    for (i = 0; i < naddrs; i++) {
+        _aux_bin_get_addr(bb, &addr);
+        if (bb->err) {
+            return ;
+        }
+        vsrvcInfo_add_addr(&srvci, &addr);
+    }
+    return ;
+}
+
+static
+int _aux_bin_get_done(struct vdht_bin_buf* bb)
+{
+    retE((bb->err));
+    retE((bb->off != bb->sz));
+    return 0;
+}
+
+static inline
+void _aux_bin_get_arg_NONE(struct vdht_bin_buf* bb)
+{
+    return ;
+}
+
+static inline
+void _aux_bin_get_arg_ID(struct vdht_bin_buf* bb, vnodeId* targetId)
+{
+    vassert(targetId);
+    _aux_bin_get(bb, targetId->data, VTOKEN_LEN);
+    return ;
+}
+
+static inline
+void _aux_bin_get_arg_NODE(struct vdht_bin_buf* bb, vnodeInfo* nodei)
+{
+    vassert(nodei);
+    _aux_bin_get_nodei(bb, nodei);
+    return ;
+}
+
+/*
+ * nodes are taken from decode arena.
+ */
+static inline
+void _aux_bin_get_arg_NODES(struct vdht_bin_buf* bb, struct varray* nodes)
+{
+    vnodeInfo* nodei = NULL;
+    int num = 0;
+    int i = 0;
+
+    vassert(nodes);
+
+    num = (int)_aux_bin_get_varint(bb);
+    for (i = 0; (i < num) && !bb->err; i++) {
+        nodei = (vnodeInfo*)vdht_dec_alloc(sizeof(vnodeInfo_relax));
+        if (!nodei) {
+            break;
+        }
+        _aux_bin_get_nodei(bb, nodei);
+        if (bb->err) {
+            break;
+        }
+        varray_add_tail(nodes, nodei);
+    }
+    return ;
+}
+
+static inline
+void _aux_bin_get_arg_ADDR(struct vdht_bin_buf* bb, struct sockaddr_in* addr)
+{
+    vassert(addr);
+    _aux_bin_get_addr(bb, addr);
+    return ;
+}
+
+static inline
+void _aux_bin_get_arg_SRVC(struct vdht_bin_buf* bb, vsrvcInfo* srvci)
+{
+    vassert(srvci);
+    _aux_bin_get_srvci(bb, srvci);
+    return ;
+}
+
+/*
+ * decoders generated from schema, each of which reads header and the
+ * argument, and then checks nothing is left over.
+ */
+#define VDHT_BIN_DECODER(id, name, y, len, desc, kind) \
+static \
+int _vdht_bin_dec_##name(void* ctxt, vtoken* token, vnodeId* srcId VDHT_ARG_##kind) \
+{ \
+    struct vdht_bin_buf bb; \
+    \
+    vassert(ctxt); \
+    vassert(token); \
+    vassert(srcId); \
+    \
+    _aux_bin_get_hdr(&bb, ctxt, token, srcId); \
+    _aux_bin_get_arg_##kind(&bb VDHT_PASS_##kind); \
+    return _aux_bin_get_done(&bb); \
+}
+
+VDHT_MSG_SCHEMA(VDHT_BIN_DECODER)
+
+/*
+ * msg being decoded, a view into receiving buffer till dec_done.
+ */
+static __thread struct vdht_bin_buf dht_bin_dec_msg;
+
+static
+int _vdht_bin_dec_begin(void* buf, int len, void** ctxt)
+{
+    struct vdht_bin_buf* msg = &dht_bin_dec_msg;
+    int dhtId = 0;
+
+    vassert(buf);
+    vassert(len);
+    vassert(ctxt);
+
+    retE((len < VDHT_BIN_HDR_SZ));
+    dhtId = *(uint8_t*)buf;
+    retE((dhtId >= VDHT_UNKNOWN));
+
+    msg->data = (uint8_t*)buf;
+    msg->sz   = len;
+    msg->off  = 0;
+    msg->err  = 0;
+
+    *ctxt = (void*)msg;
+    return dhtId;
+}
+
+static
+int _vdht_bin_dec_done(void* ctxt)
+{
+    vassert(ctxt);
+    vdht_dec_reset();
+    return 0;
+}
+
+#define VDHT_BIN_DEC_OP(id, name, y, len, desc, kind) .name = _vdht_bin_dec_##name,
+
+struct vdht_dec_ops dht_bin_dec_ops = {
+    .dec_begin              = _vdht_bin_dec_begin,
+    .dec_done               = _vdht_bin_dec_done,
+
+    VDHT_MSG_SCHEMA(VDHT_BIN_DEC_OP)
+};
@@ -1,530 +1,646 @@
 #include "vglobal.h"
 #include "vdht_core.h"
 
-static MEM_AUX_INIT(be_cache, sizeof(struct be_node), 16);
-struct be_node* be_alloc(int type)
+void be_wr_init(struct be_writer* wr, void* buf, int sz)
 {
-    struct be_node* node = NULL;
-    vassert(type >= BE_STR);
-    vassert(type <  BE_BUT);
-
-    node = (struct be_node*)vmem_aux_alloc(&be_cache);
-    vlogEv((!node), elog_vmem_aux_alloc);
-    retE_p((!node));
+    vassert(wr);
+    vassert(buf);
+    vassert(sz > 0);
 
-    memset(node, 0, sizeof(*node));
-    node->type = type;
-    return node;
+    wr->buf = (char*)buf;
+    wr->sz  = sz;
+    wr->off = 0;
+    wr->err = 0;
+    return ;
 }
 
-void be_free(struct be_node* node)
+void be_wr_raw(struct be_writer* wr, const char* data, int len)
 {
-    vassert(node);
-    switch(node->type) {
-    case BE_STR:
-        free(unoff_addr(node->val.s, sizeof(int32_t)));
-        break;
-    case BE_INT:
-        break;
-    case BE_LIST: {
-        int i = 0;
+    vassert(wr);
+    vassert(data);
 
-        for (; node->val.l[i]; ++i) {
-            be_free(node->val.l[i]);
-        }
-        free(node->val.l);
-        break;
-    }
-    case BE_DICT: {
-        int i = 0;
-        for (; node->val.d[i].val; ++i) {
-            free(unoff_addr(node->val.d[i].key, sizeof(int32_t)));
-            be_free(node->val.d[i].val);
-        }
-        free(node->val.d);
-        break;
-    }
-    default:
-        vassert(0);
+    // one byte is always left for the terminating null.
+    if (wr->err || (len >= wr->sz - wr->off)) {
+        wr->err = 1;
+        return ;
     }
-    vmem_aux_free(&be_cache, node);
+    memcpy(wr->buf + wr->off, data, len);
+    wr->off += len;
+    return ;
 }
 
+/*
+ * to format @num in decimal at end of @end, returning where it starts.
+ */
 static
-int _be_decode_int(char** data, int* data_len, int32_t* int_val)
+char* _be_wr_fmt_uint(char* end, uint32_t num)
 {
-    char *endp = NULL;
-
-    errno = 0;
-    *int_val = (int32_t)strtol(*data, &endp, 10);
-    retE((errno));
-    *data_len -= (endp - *data);
-    *data = endp;
-    return 0;
+    do {
+        *--end = '0' + (num % 10);
+        num /= 10;
+    } while (num);
+    return end;
 }
 
-static
-char* _be_decode_str(char** data, int* data_len)
+void be_wr_str(struct be_writer* wr, const char* str, int len)
 {
+    char  num[16];
     char* s = NULL;
-    int32_t len = 0;
-    int ret = 0;
+    vassert(wr);
+    vassert(str);
 
-    ret = _be_decode_int(data, data_len, &len);
-    retE_p((ret < 0));
-    retE_p((len > *data_len - 1));
+    num[sizeof(num) - 1] = ':';
+    s = _be_wr_fmt_uint(num + sizeof(num) - 1, (uint32_t)len);
+    be_wr_raw(wr, s, num + sizeof(num) - s);
+    be_wr_raw(wr, str, len);
+    return ;
+}
 
-    if (**data == ':') {
-        *data += 1;
-        *data_len -= 1;
+void be_wr_int(struct be_writer* wr, int32_t val)
+{
+    char  num[16];
+    char* s = NULL;
+    vassert(wr);
+
+    num[sizeof(num) - 1] = 'e';
+    if (val < 0) {
+        s = _be_wr_fmt_uint(num + sizeof(num) - 1, -(uint32_t)val);
+        *--s = '-';
+    } else {
+        s = _be_wr_fmt_uint(num + sizeof(num) - 1, (uint32_t)val);
+    }
+    *--s = 'i';
+    be_wr_raw(wr, s, num + sizeof(num) - s);
+    return ;
+}
 
-        s = (char*)malloc(sizeof(len) + len + 1);
-        vlogEv((!s), elog_malloc);
-        retE_p((!s));
-        memset(s, 0, sizeof(len) + len + 1);
+void be_wr_token(struct be_writer* wr, vtoken* token)
+{
+    static const char hex[] = "0123456789abcdef";
+    char buf[VTOKEN_LEN * 2];
+    int i = 0;
 
-        set_int32(s, len);
-        s = offset_addr(s, sizeof(int32_t));
-        strncpy(s, *data, len);
+    vassert(wr);
+    vassert(token);
 
-        *data += len;
-        *data_len -= len;
+    for (i = 0; i < VTOKEN_LEN; i++) {
+        buf[2*i]     = hex[token->data[i] >> 4];
+        buf[2*i + 1] = hex[token->data[i] & 0x0f];
     }
-    return s;
+    be_wr_str(wr, buf, sizeof(buf));
+    return ;
 }
 
-static
-struct be_node *_be_decode(char **data, int *data_len)
+void be_wr_addr(struct be_writer* wr, struct sockaddr_in* addr)
 {
-    struct be_node* node = NULL;
-
-    vassert(*data);
-    vassert(data_len);
-    vassert(*data_len > 0);
-
-    switch (**data) {
-    case 'l': { //list
-        int i = 0;
-        node = be_alloc(BE_LIST);
-        vlogEv((!node), elog_be_alloc);
-        retE_p((!node));
-
-        --(*data_len);
-        ++(*data);
-        while (**data != 'e') {
-            struct be_node** l = NULL;
-            l = (struct be_node**)realloc(node->val.l, (i+2)*sizeof(struct be_node**));
-            vlogEv((!l), elog_realloc);
-            ret1E_p((!l), be_free(node));
-            node->val.l = l;
-
-            node->val.l[i] = _be_decode(data, data_len);
-            ret1E_p((!node->val.l[i]), be_free(node));
-            ++i;
-        }
-        --(*data_len);
-        ++(*data);
-
-        /* empty list case. */
-        if (i == 0){
-            struct be_node** l = NULL;
-            l = (struct be_node**)realloc(node->val.l, sizeof(struct be_node**));
-            vlogEv((!l), elog_realloc);
-            ret1E_p((!l), be_free(node));
-            node->val.l = l;
-        }
-        node->val.l[i] = NULL;
-        break;
-    }
-    case 'd': { /* dictionaries */
-        int i = 0;
-        node = be_alloc(BE_DICT);
-        vlogEv((!node), elog_be_alloc);
-        retE_p((!node));
-
-        --(*data_len);
-        ++(*data);
-        while(**data != 'e') {
-            struct be_dict* d = NULL;
-            d = (struct be_dict*)realloc(node->val.d, (i+2)*sizeof(struct be_dict));
-            vlogEv((!d), elog_realloc);
-            ret1E_p((!d), be_free(node));
-            node->val.d = d;
-
-            node->val.d[i].key = _be_decode_str(data, data_len);
-            ret1E_p((!node->val.d[i].key), be_free(node));
-            node->val.d[i].val = _be_decode(data, data_len);
-            ret1E_p((!node->val.d[i].val), be_free(node));
-            ++i;
-        }
-        --(*data_len);
-        ++(*data);
-
-        if (i == 0) {
-            struct be_dict* d = NULL;
-            d = (struct be_dict*)realloc(node->val.d, sizeof(struct be_dict));
-            vlogEv((!d), elog_realloc);
-            ret1E_p((!d), be_free(node));
-            node->val.d = d;
+    char  buf[32];
+    char* s = NULL;
+    uint32_t ip = 0;
+    int i = 0;
+
+    vassert(wr);
+    vassert(addr);
+
+    // same as vsockaddr_strlize, as "192.168.4.46:12300".
+    ip = ntohl(addr->sin_addr.s_addr);
+    s  = _be_wr_fmt_uint(buf + sizeof(buf), ntohs(addr->sin_port));
+    *--s = ':';
+    for (i = 0; i < 4; i++, ip >>= 8) {
+        s = _be_wr_fmt_uint(s, ip & 0xff);
+        if (i < 3) {
+            *--s = '.';
         }
-        node->val.d[i].val = NULL;
-        break;
     }
-    case 'i': { /* integers */
-        int ret = 0;
-        node = be_alloc(BE_INT);
-        vlogEv((!node), elog_be_alloc);
-        retE_p((!node));
-
-        --(*data_len);
-        ++(*data);
-        ret = _be_decode_int(data, data_len, &node->val.i);
-        ret1E_p((ret < 0), be_free(node));
-        ret1E_p((**data != 'e'), be_free(node));
-        --(*data_len);
-        ++(*data);
-        break;
-    }
-    case '0'...'9': { /* byte strings */
-        node = be_alloc(BE_STR);
-        vlogEv((!node), elog_be_alloc);
-        retE_p((!node));
+    be_wr_str(wr, s, buf + sizeof(buf) - s);
+    return ;
+}
 
-        node->val.s = _be_decode_str(data, data_len);
-        ret1E_p((!node->val.s), be_free(node));
-        break;
-    }
-    default: /* invalid*/
-        break;
+void be_wr_ver(struct be_writer* wr, vnodeVer* ver)
+{
+    char  buf[32];
+    char* s = buf + sizeof(buf);
+    int i = 0;
+
+    vassert(wr);
+    vassert(ver);
+
+    // same as vnodeVer_strlize, as "0.0.0.1.0".
+    for (i = VTOKEN_INTLEN - 1; i >= 0; i--) {
+        s = _be_wr_fmt_uint(s, ver->data[i]);
+        if (i > 0) {
+            *--s = '.';
+        }
     }
-    return node;
+    be_wr_str(wr, s, buf + sizeof(buf) - s);
+    return ;
 }
 
-struct be_node *be_decode(char *data, int len)
+/*
+ * to terminate encoded msg with null, returning its length.
+ */
+int be_wr_done(struct be_writer* wr)
 {
-    return _be_decode(&data, &len);
+    vassert(wr);
+
+    vlogEv((wr->err), elog_snprintf);
+    retE((wr->err));
+    wr->buf[wr->off] = '\0';
+    return wr->off;
 }
 
-struct be_node *be_decode_str(char *data)
+/*
+ * to parse decimal digits in [*off, sps->len) till @delim, with optional
+ * minus sign if @sign.
+ */
+static
+int _be_span_decode_num(struct be_spans* sps, int* off, char delim, int sign, int32_t* val)
 {
-    return be_decode(data, strlen(data));
+    const char* p = sps->data;
+    int64_t num = 0;
+    int neg = 0;
+    int pos = *off;
+
+    if (sign && (pos < sps->len) && (p[pos] == '-')) {
+        neg = 1;
+        pos++;
+    }
+    retE((pos >= sps->len));
+    retE(((p[pos] < '0') || (p[pos] > '9')));
+    for (; (pos < sps->len) && (p[pos] >= '0') && (p[pos] <= '9'); pos++) {
+        num = num * 10 + (p[pos] - '0');
+        retE((num > INT32_MAX));
+    }
+    retE((pos >= sps->len));
+    retE((p[pos] != delim));
+
+    *val = (int32_t)(neg ? -num : num);
+    *off = pos + 1;
+    return 0;
 }
 
-struct be_node *be_create_dict(void)
+/*
+ * perfect hash of protocol keys by length, first and last char, into 32
+ * slots. slots must be kept distinct when adding keys.
+ */
+#define BE_KEY_SLOT(len, first, last) ((int)(((first) + ((last) << 3) + (len) * 3) & 31))
+
+static const char* be_keys[BE_KEY_BUTT] = {
+    [BE_KEY_T]       = "t",
+    [BE_KEY_Y]       = "y",
+    [BE_KEY_Q]       = "q",
+    [BE_KEY_R]       = "r",
+    [BE_KEY_A]       = "a",
+    [BE_KEY_ID]      = "id",
+    [BE_KEY_NODE]    = "node",
+    [BE_KEY_NODES]   = "nodes",
+    [BE_KEY_TARGET]  = "target",
+    [BE_KEY_ME]      = "me",
+    [BE_KEY_SERVICE] = "service",
+    [BE_KEY_HASH]    = "hash",
+    [BE_KEY_V]       = "v",
+    [BE_KEY_W]       = "w",
+    [BE_KEY_N]       = "n",
+    [BE_KEY_M]       = "m"
+};
+
+static const int8_t be_key_slots[32] = {
+    [0 ... 31] = -1,
+    [BE_KEY_SLOT(1, 't', 't')] = BE_KEY_T,
+    [BE_KEY_SLOT(1, 'y', 'y')] = BE_KEY_Y,
+    [BE_KEY_SLOT(1, 'q', 'q')] = BE_KEY_Q,
+    [BE_KEY_SLOT(1, 'r', 'r')] = BE_KEY_R,
+    [BE_KEY_SLOT(1, 'a', 'a')] = BE_KEY_A,
+    [BE_KEY_SLOT(2, 'i', 'd')] = BE_KEY_ID,
+    [BE_KEY_SLOT(4, 'n', 'e')] = BE_KEY_NODE,
+    [BE_KEY_SLOT(5, 'n', 's')] = BE_KEY_NODES,
+    [BE_KEY_SLOT(6, 't', 't')] = BE_KEY_TARGET,
+    [BE_KEY_SLOT(2, 'm', 'e')] = BE_KEY_ME,
+    [BE_KEY_SLOT(7, 's', 'e')] = BE_KEY_SERVICE,
+    [BE_KEY_SLOT(4, 'h', 'h')] = BE_KEY_HASH,
+    [BE_KEY_SLOT(1, 'v', 'v')] = BE_KEY_V,
+    [BE_KEY_SLOT(1, 'w', 'w')] = BE_KEY_W,
+    [BE_KEY_SLOT(1, 'n', 'n')] = BE_KEY_N,
+    [BE_KEY_SLOT(1, 'm', 'm')] = BE_KEY_M
+};
+
+/*
+ * to intern key span @idx, returning one of BE_KEY_XXX, or -1 if unknown.
+ */
+static
+int _be_key_intern(struct be_spans* sps, int idx)
 {
-    return be_decode_str("de");
+    struct be_span* sp = &sps->spans[idx];
+    const uint8_t* s = (const uint8_t*)sps->data + sp->off;
+    const char* k = NULL;
+    int key = 0;
+    int i = 0;
+
+    if ((sp->val.len <= 0) || (sp->val.len > 7)) {
+        return -1;
+    }
+    key = be_key_slots[BE_KEY_SLOT(sp->val.len, s[0], s[sp->val.len - 1])];
+    if (key < 0) {
+        return -1;
+    }
+    // keys are short, cheaper to compare in place than to call memcmp.
+    k = be_keys[key];
+    for (i = 0; (i < sp->val.len) && (k[i] == (char)s[i]); i++);
+    return ((i == sp->val.len) && !k[i]) ? key : -1;
 }
 
-struct be_node *be_create_list(void)
+static
+int _be_span_decode(struct be_spans* sps, int* off, int depth)
 {
-    return be_decode_str("le");
+    struct be_span* sp = NULL;
+    const char* p = sps->data;
+    int key = 0;
+    int ret = 0;
+
+    retE((depth > BE_SPAN_MAX_DEPTH));
+    retE((sps->num >= BE_SPAN_MAX));
+    retE((*off >= sps->len));
+
+    sp = &sps->spans[sps->num++];
+    sp->off = *off;
+    sp->fields = -1;
+
+    switch (p[*off]) {
+    case 'l':
+    case 'd':
+        sp->type = (p[*off] == 'l') ? BE_LIST : BE_DICT;
+        sp->val.num = 0;
+        if (sp->type == BE_DICT) {
+            retE((sps->ndicts >= BE_DICT_MAX));
+            sp->fields = sps->ndicts++;
+            memset(sps->fields[sp->fields], 0xff, sizeof(sps->fields[0]));
+        }
+        (*off)++;
+        while ((*off < sps->len) && (p[*off] != 'e')) {
+            key = -1;
+            if (sp->type == BE_DICT) {
+                // key of dict must be a string.
+                retE(((p[*off] < '0') || (p[*off] > '9')));
+                ret = _be_span_decode(sps, off, depth + 1);
+                retE((ret < 0));
+                key = _be_key_intern(sps, sps->num - 1);
+            }
+            // first one wins if a key repeats.
+            if ((key >= 0) && (sps->fields[sp->fields][key] < 0)) {
+                sps->fields[sp->fields][key] = sps->num;
+            }
+            ret = _be_span_decode(sps, off, depth + 1);
+            retE((ret < 0));
+            sp->val.num++;
+        }
+        retE((*off >= sps->len));
+        (*off)++;
+        break;
+    case 'i':
+        sp->type = BE_INT;
+        (*off)++;
+        ret = _be_span_decode_num(sps, off, 'e', 1, &sp->val.i);
+        retE((ret < 0));
+        break;
+    case '0'...'9':
+        sp->type = BE_STR;
+        ret = _be_span_decode_num(sps, off, ':', 0, &sp->val.len);
+        retE((ret < 0));
+        retE((sp->val.len > sps->len - *off));
+        sp->off = *off;
+        *off += sp->val.len;
+        break;
+    default:
+        retE((1));
+    }
+    sp->end = sps->num;
+    return 0;
 }
 
-struct be_node* be_create_str(char* str)
+/*
+ * to decode packet into spans, with root span at index 0.
+ * @sps:
+ * @data: packet, which must outlive the spans.
+ * @len:
+ */
+int be_span_decode(struct be_spans* sps, const char* data, int len)
 {
-    struct be_node* node = NULL;
-    char* s = NULL;
-    int len = strlen(str);
-    vassert(str);
-
-    node = be_alloc(BE_STR);
-    vlogEv((!node), elog_be_alloc);
-    retE_p((!node));
+    int off = 0;
+    int ret = 0;
 
-    s = (char*)malloc(sizeof(int32_t) + len + 1);
-    vlogEv((!s), elog_malloc);
-    ret1E_p((!s), be_free(node));
+    vassert(sps);
+    vassert(data);
+    vassert(len > 0);
 
-    set_int32(s, len);
-    s = offset_addr(s, sizeof(int32_t));
-    strcpy(s, str);
+    sps->data = data;
+    sps->len  = len;
+    sps->num  = 0;
+    sps->ndicts = 0;
 
-    node->val.s = s;
-    return node;
+    ret = _be_span_decode(sps, &off, 0);
+    retE((ret < 0));
+    return 0;
 }
 
-struct be_node* be_create_int(int num)
+int be_span_str_eq(struct be_spans* sps, int idx, const char* str)
 {
-    struct be_node* node = NULL;
-
-    node = be_alloc(BE_INT);
-    vlogEv((!node), elog_be_alloc);
-    retE_p((!node));
+    struct be_span* sp = NULL;
+    vassert(sps);
+    vassert(str);
 
-    node->val.i = num;
-    return node;
+    if ((idx < 0) || (sps->spans[idx].type != BE_STR)) {
+        return 0;
+    }
+    sp = &sps->spans[idx];
+    return (!strncmp(sps->data + sp->off, str, sp->val.len) && (str[sp->val.len] == '\0'));
 }
 
-struct be_node* be_create_vtoken(vtoken* token)
+/*
+ * to get index of value span by key in dict span, or -1 if not found.
+ * @sps:
+ * @dict:
+ * @key: one of BE_KEY_XXX.
+ */
+int be_span_by_key(struct be_spans* sps, int dict, int key)
 {
-    struct be_node* node = NULL;
-    char buf[64];
-    vassert(token);
+    vassert(sps);
+    vassert((key >= 0) && (key < BE_KEY_BUTT));
 
-    memset(buf, 0, 64);
-    vtoken_strlize(token, buf, 64);
-    node = be_create_str(buf);
-    retE_p((!node));
-    return node;
+    if ((dict < 0) || (sps->spans[dict].type != BE_DICT)) {
+        return -1;
+    }
+    return sps->fields[sps->spans[dict].fields][key];
 }
 
-struct be_node* be_create_addr(struct sockaddr_in* addr)
+int be_span_by_2keys(struct be_spans* sps, int dict, int key1, int key2)
 {
-    struct be_node* node = NULL;
-    char buf[64];
-    vassert(addr);
+    vassert(sps);
 
-    memset(buf, 0, 64);
-    vsockaddr_strlize(addr, buf, 64);
-    node = be_create_str(buf);
-    retE_p((!node));
-    return node;
+    return be_span_by_key(sps, be_span_by_key(sps, dict, key1), key2);
 }
 
-struct be_node* be_create_ver(vnodeVer* ver)
+int be_span_unpack_int(struct be_spans* sps, int idx, int* val)
 {
-    struct be_node* node = NULL;
-    char buf[64];
-    vassert(ver);
+    vassert(sps);
+    vassert(val);
 
-    memset(buf, 0, 64);
-    vnodeVer_strlize(ver, buf, 64);
-    node = be_create_str(buf);
-    retE_p((!node));
-    return node;
+    retE((idx < 0));
+    retE((BE_INT != sps->spans[idx].type));
+    *val = sps->spans[idx].val.i;
+    return 0;
 }
 
-int be_add_keypair(struct be_node *dict, char *str, struct be_node *node)
+/*
+ * hex decoders of token, from VTOKEN_LEN * 2 chars, each of which returns
+ * -1 if any char is not hex.
+ */
+typedef int (*be_hex_t)(const char*, uint8_t*);
+
+static const int8_t be_hex_vals[256] = {
+    [0 ... 255] = -1,
+    ['0'] = 0,  ['1'] = 1,  ['2'] = 2,  ['3'] = 3,  ['4'] = 4,
+    ['5'] = 5,  ['6'] = 6,  ['7'] = 7,  ['8'] = 8,  ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15
+};
+
+static
+int _be_hex_scalar(const char* s, uint8_t* data)
 {
-    struct be_dict* d = NULL;
-    int len = strlen(str);
-    char* s = NULL;
+    const uint8_t* p = (const uint8_t*)s;
+    int bad = 0;
     int i = 0;
 
-    vassert(dict);
-    vassert(str);
-    vassert(dict->type == BE_DICT);
-
-    s = (char*)malloc(sizeof(int32_t) + len + 1);
-    vlogEv((!s), elog_malloc);
-    retE((!s));
-
-    set_int32(s, len);
-    s = offset_addr(s, sizeof(int32_t));
-    memcpy(s, str, len);
-    s[len] = '\0';
-
-    for (; dict->val.d[i].val; i++);
-    d = (struct be_dict*)realloc(dict->val.d, (i+2)*sizeof(*d));
-    vlogEv((!d), elog_realloc);
-    ret1E((!d), free(unoff_addr(s, sizeof(int32_t))));
-
-    dict->val.d = d;
-    dict->val.d[i].key = s;
-    dict->val.d[i].val = node;
-    i++;
-    dict->val.d[i].val = NULL;
-    return 0;
+    for (i = 0; i < VTOKEN_LEN; i++) {
+        int high = be_hex_vals[p[2*i]];
+        int low  = be_hex_vals[p[2*i + 1]];
+        bad |= (high | low);
+        data[i] = (uint8_t)(((uint32_t)high << 4) | (uint32_t)low);
+    }
+    return (bad < 0) ? -1 : 0;
 }
 
-int be_add_list(struct be_node *list, struct be_node *node)
+#if defined(__x86_64__) || defined(__i386__)
+#define BE_SIMD_X86
+#endif
+
+#ifdef BE_SIMD_X86
+#include <immintrin.h>
+
+/*
+ * intrinsics get spilled to stack on each step unless optimized, which is
+ * slower than scalar. so kernels are always optimized, whatever level the
+ * rest is built at.
+ */
+#define BE_SIMD_FN(isa) __attribute__((target(isa), optimize("O2")))
+#define BE_SIMD_INLINE(isa) inline __attribute__((always_inline, target(isa), optimize("O2")))
+
+/*
+ * 16 chars into 8 bytes. as tokens are 40 chars, the last block overlaps
+ * the one ahead of it, instead of falling back to scalar for tail.
+ */
+static BE_SIMD_INLINE("sse2")
+int _be_hex16_sse2(const char* s, uint8_t* data)
 {
-    struct be_node** l = NULL;
-    int i = 0;
+    __m128i v = _mm_loadu_si128((const __m128i*)s);
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i a = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i is_a = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(5)), a);
+    __m128i w = _mm_or_si128(_mm_and_si128(is_d, d),
+                    _mm_andnot_si128(is_d, _mm_add_epi8(a, _mm_set1_epi8(10))));
+
+    // pairs of nibbles in 16 bits, high nibble at lower address.
+    w = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(w, _mm_set1_epi16(0xff)), 4), _mm_srli_epi16(w, 8));
+    _mm_storel_epi64((__m128i*)data, _mm_packus_epi16(w, w));
+    return (_mm_movemask_epi8(_mm_or_si128(is_d, is_a)) == 0xffff) ? 0 : -1;
+}
 
-    vassert(list);
-    vassert(node);
-    vassert(list->type == BE_LIST);
+static BE_SIMD_FN("sse2")
+int _be_hex_sse2(const char* s, uint8_t* data)
+{
+    int ret = 0;
 
-    for (; list->val.l[i]; i++);
-    l = (struct be_node**)realloc(list->val.l, (i + 2)*sizeof(struct be_node**));
-    vlogEv((!l), elog_realloc);
-    retE((!l));
-    list->val.l = l;
+    ret |= _be_hex16_sse2(s, data);
+    ret |= _be_hex16_sse2(s + 16, data + 8);
+    ret |= _be_hex16_sse2(s + VTOKEN_LEN * 2 - 16, data + VTOKEN_LEN - 8);
+    return ret;
+}
 
-    list->val.l[i] = node;
-    i++;
-    list->val.l[i] = NULL;
-    return 0;
+/*
+ * 32 chars into 16 bytes, with overlapping blocks as sse2.
+ */
+static BE_SIMD_INLINE("avx2")
+int _be_hex32_avx2(const char* s, uint8_t* data)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)s);
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i a = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_d = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+    __m256i is_a = _mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(5)), a);
+    __m256i w = _mm256_blendv_epi8(_mm256_add_epi8(a, _mm256_set1_epi8(10)), d, is_d);
+
+    w = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(w, _mm256_set1_epi16(0xff)), 4), _mm256_srli_epi16(w, 8));
+    // packing works in 128 bits lanes, to gather low 64 bits of each lane.
+    w = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0x08);
+    _mm_storeu_si128((__m128i*)data, _mm256_castsi256_si128(w));
+    return ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_d, is_a)) == 0xffffffff) ? 0 : -1;
 }
 
-int be_encode(struct be_node *node, char *buf, int len)
+static BE_SIMD_FN("avx2")
+int _be_hex_avx2(const char* s, uint8_t* data)
 {
-    int off = 0;
     int ret = 0;
 
-    vassert(node);
-    vassert(buf);
-    vassert(len > 0);
+    ret |= _be_hex32_avx2(s, data);
+    ret |= _be_hex32_avx2(s + VTOKEN_LEN * 2 - 32, data + VTOKEN_LEN - 16);
+    return ret;
+}
+#endif
 
-    switch(node->type) {
-    case BE_STR: {
-        int _len = get_int32(unoff_addr(node->val.s, sizeof(int32_t)));
-        ret = snprintf(buf+off, len-off, "%i:", _len);
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        ret = snprintf(buf+off, len-off, "%s", node->val.s);
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        break;
-    }
-    case BE_INT:
-        ret = snprintf(buf+off, len-off, "i%ie", node->val.i);
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        break;
-    case BE_LIST: {
-        int i = 0;
-        ret = snprintf(buf+off, len-off, "l");
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        for (; node->val.l[i]; i++) {
-            ret = be_encode(node->val.l[i], buf+off, len-off);
-            retE((ret < 0));
-            off += ret;
-        }
-        ret = snprintf(buf+off, len-off, "e");
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        break;
+static be_hex_t be_hex_decoders[BE_SIMD_BUTT] = {
+    _be_hex_scalar,
+#ifdef BE_SIMD_X86
+    _be_hex_sse2,
+    _be_hex_avx2
+#else
+    NULL,
+    NULL
+#endif
+};
+
+static be_hex_t be_hex_decoder = NULL;
+
+static
+int _be_simd_supported(int level)
+{
+    if (!be_hex_decoders[level]) {
+        return 0;
     }
-    case BE_DICT: {
-        int i = 0;
-        ret = snprintf(buf+off, len-off, "d");
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        for (i = 0; node->val.d[i].val; i++) {
-            char* _key = node->val.d[i].key;
-            int   _len = get_int32(unoff_addr(_key, sizeof(int32_t)));
-            ret = snprintf(buf + off, len - off, "%i:%s", _len, _key);
-            vlogEv((ret >= len-off), elog_snprintf);
-            retE((ret >= len-off));
-            off += ret;
-
-            ret = be_encode(node->val.d[i].val, buf+off, len-off);
-            retE((ret < 0));
-            off += ret;
-        }
-        ret = snprintf(buf+off, len-off, "e");
-        vlogEv((ret >= len-off), elog_snprintf);
-        retE((ret >= len-off));
-        off += ret;
-        break;
+#ifdef BE_SIMD_X86
+    __builtin_cpu_init();
+    if (level == BE_SIMD_SSE2) {
+        return __builtin_cpu_supports("sse2");
     }
-    default:
-        return -1;
-        break;
+    if (level == BE_SIMD_AVX2) {
+        return __builtin_cpu_supports("avx2");
     }
-    return off;
+#endif
+    return 1;
 }
 
-int be_unpack_int(struct be_node* node, int* val)
+/*
+ * to select hex decoder.
+ * @level: one of BE_SIMD_XXX, or -1 for the best one supported by cpu.
+ */
+int be_simd_select(int level)
 {
-    vassert(node);
-    vassert(val);
+    retE((level >= BE_SIMD_BUTT));
 
-    retE((BE_INT != node->type));
-    *val = node->val.i;
-    return 0;
+    if (level < 0) {
+        for (level = BE_SIMD_BUTT - 1; !_be_simd_supported(level); level--);
+    }
+    retE((!_be_simd_supported(level)));
+    __atomic_store_n(&be_hex_decoder, be_hex_decoders[level], __ATOMIC_RELAXED);
+    return level;
 }
 
-int be_unpack_token(struct be_node* node, vtoken* token)
+int be_span_unpack_token(struct be_spans* sps, int idx, vtoken* token)
 {
-    char* s = NULL;
+    be_hex_t hex = NULL;
     int ret = 0;
 
-    vassert(node);
+    vassert(sps);
     vassert(token);
 
-    retE((BE_STR != node->type));
+    retE((idx < 0));
+    retE((BE_STR != sps->spans[idx].type));
+    retE((sps->spans[idx].val.len != VTOKEN_LEN * 2));
 
-    s = unoff_addr(node->val.s, sizeof(int32_t));
-    ret = get_int32(s);
-    retE((ret != strlen(node->val.s)));
-
-    ret = vtoken_unstrlize(node->val.s, token);
+    hex = __atomic_load_n(&be_hex_decoder, __ATOMIC_RELAXED);
+    if (!hex) {
+        be_simd_select(-1);
+        hex = __atomic_load_n(&be_hex_decoder, __ATOMIC_RELAXED);
+    }
+    ret = hex(sps->data + sps->spans[idx].off, token->data);
     retE((ret < 0));
     return 0;
 }
 
-int be_unpack_ver(struct be_node* node, vnodeVer* ver)
+int be_span_unpack_ver(struct be_spans* sps, int idx, vnodeVer* ver)
 {
-    char* s = NULL;
-    int ret = 0;
+    struct be_span* sp = NULL;
+    const char* s = NULL;
+    const char* e = NULL;
+    int num = 0;
+    int i = 0;
 
-    vassert(node);
+    vassert(sps);
     vassert(ver);
 
-    retE((BE_STR != node->type));
-
-    s = unoff_addr(node->val.s, sizeof(int32_t));
-    ret = get_int32(s);
-    retE((ret != strlen(node->val.s)));
-
-    ret = vnodeVer_unstrlize(node->val.s, ver);
-    retE((ret < 0));
+    retE((idx < 0));
+    retE((BE_STR != sps->spans[idx].type));
+
+    sp = &sps->spans[idx];
+    s  = sps->data + sp->off;
+    e  = s + sp->val.len;
+    memset(ver, 0, sizeof(*ver));
+    while (1) {
+        retE(((s >= e) || (*s < '0') || (*s > '9')));
+        retE((i >= VTOKEN_LEN));
+        for (num = 0; (s < e) && (*s >= '0') && (*s <= '9'); s++) {
+            num = num * 10 + (*s - '0');
+            retE((num > INT16_MAX));
+        }
+        ver->data[i++] = num;
+        if (s == e) {
+            break;
+        }
+        retE((*s != '.'));
+        s++;
+    }
     return 0;
 }
 
-int be_unpack_addr(struct be_node* node, struct sockaddr_in* addr)
+int be_span_unpack_addr(struct be_spans* sps, int idx, struct sockaddr_in* addr)
 {
-    char* s = NULL;
-    int ret = 0;
+    struct be_span* sp = NULL;
+    const char* s = NULL;
+    const char* e = NULL;
+    uint32_t ip = 0;
+    int num = 0;
+    int i = 0;
 
-    vassert(node);
+    vassert(sps);
     vassert(addr);
 
-    retE((BE_STR != node->type));
-
-    s = unoff_addr(node->val.s, sizeof(int32_t));
-    ret = get_int32(s);
-    retE((ret != strlen(node->val.s)));
-
-    ret = vsockaddr_unstrlize(node->val.s, addr);
-    retE((ret < 0));
-    return 0;
-}
-
-int be_node_by_key(struct be_node* dict, char* key, struct be_node** node)
-{
-    int i = 0;
-    vassert(dict);
-    vassert(key);
-    vassert(node);
-
-    retE((BE_DICT != dict->type));
-    for(; dict->val.d[i].val; i++) {
-        if (!strcmp(key, dict->val.d[i].key)) {
-            *node = dict->val.d[i].val;
-            return 0;
+    retE((idx < 0));
+    retE((BE_STR != sps->spans[idx].type));
+
+    // dotted quad followed by port, as "192.168.4.46:12300".
+    sp = &sps->spans[idx];
+    s  = sps->data + sp->off;
+    e  = s + sp->val.len;
+    for (i = 0; i < 5; i++) {
+        retE(((s >= e) || (*s < '0') || (*s > '9')));
+        for (num = 0; (s < e) && (*s >= '0') && (*s <= '9'); s++) {
+            num = num * 10 + (*s - '0');
+            retE((num > 65535));
         }
+        if (i == 4) {
+            break;
+        }
+        retE((num > 255));
+        ip = (ip << 8) | num;
+        retE((s >= e));
+        retE((*s != ((i < 3) ? '.' : ':')));
+        s++;
     }
-    return -1;
-}
-
-int be_node_by_2keys(struct be_node* dict, char* key1, char* key2, struct be_node** node)
-{
-    struct be_node* tmp = NULL;
-    int ret = 0;
-    vassert(dict);
-    vassert(key1);
-    vassert(key2);
-    vassert(node);
+    retE((s != e));
+    retE((num <= 0));
 
-    ret = be_node_by_key(dict, key1, &tmp);
-    if ((ret < 0) || (BE_DICT != tmp->type)) {
-        return -1;
-    }
-    ret = be_node_by_key(tmp, key2, node);
-    if (ret < 0) {
-        return -1;
-    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)num);
+    addr->sin_addr.s_addr = htonl(ip);
     return 0;
 }
-
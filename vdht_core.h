@@ -11,49 +11,111 @@ enum {
     BE_BUT
 };
 
-struct be_node;
-struct be_dict {
-    char* key;
-    struct be_node* val;
+/*
+ * for streaming encoding. bencode is emitted straight into caller's buffer,
+ * and any error sticks to writer until be_wr_done, so that callers check
+ * only once.
+ */
+struct be_writer {
+    char* buf;
+    int   sz;
+    int   off;
+    int   err;
 };
 
-struct be_node {
-    int type;
-    union {
-        char* s;
-        int32_t i;
-        struct be_node **l;
-        struct be_dict *d;
-    }val;
-};
+#define be_wr_lit(wr, lit) be_wr_raw((wr), (lit), sizeof(lit) - 1)
 
+void be_wr_init (struct be_writer*, void*, int);
+void be_wr_raw  (struct be_writer*, const char*, int);
+void be_wr_str  (struct be_writer*, const char*, int);
+void be_wr_int  (struct be_writer*, int32_t);
+void be_wr_token(struct be_writer*, vtoken*);
+void be_wr_addr (struct be_writer*, struct sockaddr_in*);
+void be_wr_ver  (struct be_writer*, vnodeVer*);
+int  be_wr_done (struct be_writer*);
 
-struct be_node* be_alloc(int);
-void be_free(struct be_node*);
+/*
+ * for zero-copy decoding. packet is validated once and flattened into a
+ * fixed table of spans in pre-order, each of which is a view into packet,
+ * so neither node nor string is allocated.
+ */
+#define BE_SPAN_MAX       ((int)1024)
+#define BE_SPAN_MAX_DEPTH ((int)16)
+#define BE_DICT_MAX       ((int)128)
 
-struct be_node* be_decode(char*, int);
-struct be_node* be_decode_str(char*);
+/*
+ * keys of dht protocol, which are interned while decoding. each dict gets
+ * a table of fields indexed by key, so that looking up a field is array
+ * indexing instead of string compares. keys out of this set are skipped.
+ */
+enum {
+    BE_KEY_T,
+    BE_KEY_Y,
+    BE_KEY_Q,
+    BE_KEY_R,
+    BE_KEY_A,
+    BE_KEY_ID,
+    BE_KEY_NODE,
+    BE_KEY_NODES,
+    BE_KEY_TARGET,
+    BE_KEY_ME,
+    BE_KEY_SERVICE,
+    BE_KEY_HASH,
+    BE_KEY_V,
+    BE_KEY_W,
+    BE_KEY_N,
+    BE_KEY_M,
+    BE_KEY_BUTT
+};
 
-struct be_node* be_create_dict(void);
-struct be_node* be_create_list(void);
-struct be_node* be_create_str (char*);
-struct be_node* be_create_int (int);
-struct be_node* be_create_vtoken(vtoken*);
-struct be_node* be_create_addr(struct sockaddr_in*);
-struct be_node* be_create_ver (vnodeVer*);
+struct be_span {
+    int16_t type;
+    int16_t end;     // index next to last span of its subtree.
+    int32_t off;     // offset into packet, where string bytes start.
+    union {
+        int32_t len; // length of string.
+        int32_t i;   // value of integer.
+        int32_t num; // number of elements of list, or pairs of dict.
+    } val;
+    int16_t fields;  // index of field table, only for dict.
+};
 
-int be_add_keypair (struct be_node*, char*, struct be_node*);
-int be_add_list    (struct be_node*, struct be_node*);
+struct be_spans {
+    const char* data;
+    int len;
+    int num;
+    int ndicts;
+    struct be_span spans[BE_SPAN_MAX];
+    int16_t fields[BE_DICT_MAX][BE_KEY_BUTT]; // index of value span, or -1.
+};
+
+#define be_span_for_each(sps, parent, idx, n) \
+    for ((n) = 0, (idx) = (parent) + 1; \
+         (n) < (sps)->spans[(parent)].val.num; \
+         (n)++, (idx) = (sps)->spans[(idx)].end)
+
+/*
+ * for hex decoding of tokens, which is the only per byte work left on
+ * decoding node lists. decoder is picked by cpu at first use.
+ */
+enum {
+    BE_SIMD_SCALAR,
+    BE_SIMD_SSE2,
+    BE_SIMD_AVX2,
+    BE_SIMD_BUTT
+};
 
-int be_encode      (struct be_node*, char*, int);
+int be_simd_select   (int);
 
-int be_unpack_int  (struct be_node*, int*);
-int be_unpack_token(struct be_node*, vtoken*);
-int be_unpack_addr (struct be_node*, struct sockaddr_in*);
-int be_unpack_ver  (struct be_node*, vnodeVer*);
+int be_span_decode   (struct be_spans*, const char*, int);
+int be_span_by_key   (struct be_spans*, int, int);
+int be_span_by_2keys (struct be_spans*, int, int, int);
+int be_span_str_eq   (struct be_spans*, int, const char*);
 
-int be_node_by_key (struct be_node*, char*, struct be_node**);
-int be_node_by_2keys(struct be_node*, char*, char*, struct be_node**);
+int be_span_unpack_int  (struct be_spans*, int, int*);
+int be_span_unpack_token(struct be_spans*, int, vtoken*);
+int be_span_unpack_addr (struct be_spans*, int, struct sockaddr_in*);
+int be_span_unpack_ver  (struct be_spans*, int, vnodeVer*);
 
 #endif
 
@@ -33,6 +33,7 @@
 #include "utils/varray.h"
 #include "utils/vdict.h"
 #include "utils/vmem.h"
+#include "utils/varena.h"
 #include "utils/vsys.h"
 #include "utils/vmisc.h"
 
@@ -52,6 +53,7 @@
 #include "vupnpc.h"
 #include "vnodeId.h"
 #include "vticker.h"
+#include "vtrace.h"
 
 #if 0
 #define timer_t
@@ -158,6 +160,8 @@
 
 extern struct vdht_enc_ops dht_enc_ops;
 extern struct vdht_dec_ops dht_dec_ops;
+extern struct vdht_enc_ops dht_bin_enc_ops;
+extern struct vdht_dec_ops dht_bin_dec_ops;
 
 static
 inline uint8_t get_uint8(void* addr)
@@ -88,12 +88,22 @@ int _vhost_stabilize(struct vhost* host)
 static
 void _vhost_dump(struct vhost* host)
 {
+    int i = 0;
     vassert(host);
 
     vdump(printf("-> HOST"));
     host->node.ops->dump(&host->node);
     host->route.ops->dump(&host->route);
     host->waiter.ops->dump(&host->waiter);
+    host->msger.ops->dump(&host->msger);
+    if (host->tcp_on) {
+        host->tcp_msger.ops->dump(&host->tcp_msger);
+    }
+    for (i = 1; i < host->nworkers; i++) {
+        struct vhost_worker* worker = &host->workers[i-1];
+        worker->waiter.ops->dump(&worker->waiter);
+        worker->msger.ops->dump(&worker->msger);
+    }
     vdump(printf("<- HOST"));
 
     return;
@@ -120,25 +130,60 @@ int _vhost_exit(struct vhost* host)
 }
 
 /*
- * todo:
+ * the laundry loop of extra worker, which runs on its own thread.
+ * @argv: worker.
+ */
+static
+int _aux_vhost_worker_entry(void* argv)
+{
+    struct vhost_worker* worker = (struct vhost_worker*)argv;
+    struct vwaiter* wt = &worker->waiter;
+    vassert(worker);
+
+    while(!worker->host->to_quit) {
+        wt->ops->laundry(wt);
+    }
+    return 0;
+}
+
+/*
+ * the routine to run laundry loop of worker 0 on current thread, and
+ * loops of extra workers on their own threads.
  * @host:
  */
 static
 int _vhost_run(struct vhost* host)
 {
     struct vwaiter* wt = &host->waiter;
+    int nstarted = 1;
+    int exit_code = 0;
     int ret = 0;
+    int i = 0;
     vassert(host);
 
     host->to_quit = 0;
 
-    vlogI("host laundrying");
+    for (i = 1; i < host->nworkers; i++) {
+        struct vhost_worker* worker = &host->workers[i-1];
+        ret = vthread_init(&worker->thread, _aux_vhost_worker_entry, worker);
+        vlogEv((ret < 0), elog_vthread_init);
+        if (ret < 0) {
+            break;
+        }
+        vthread_start(&worker->thread);
+        nstarted++;
+    }
+
+    vlogI("host laundrying (%d workers)", nstarted);
     while(!host->to_quit) {
         ret = wt->ops->laundry(wt);
         if (ret < 0) {
             continue;
         }
     }
+    for (i = 1; i < nstarted; i++) {
+        vthread_join(&host->workers[i-1].thread, &exit_code);
+    }
     vlogI("host quited from laundrying");
     return 0;
 }
@@ -179,7 +224,7 @@ int _vhost_bogus_query(struct vhost* host, int what, struct sockaddr_in* remote_
         ret = route->dht_ops->ping(route, &conn);
         break;
     case VDHT_FIND_NODE:
-        ret = route->dht_ops->find_node(route, &conn, &host->myid);
+        ret = route->dht_ops->find_node(route, &conn, &host->myid, NULL);
         break;
     case VDHT_FIND_CLOSEST_NODES:
         ret = route->dht_ops->find_closest_nodes(route, &conn, &host->myid);
@@ -209,6 +254,104 @@ struct vhost_ops host_ops = {
     .bogus_query   = _vhost_bogus_query
 };
 
+static
+int _aux_vhost_pack_msg_cb  (void*, struct vmsg_usr*, struct vmsg_sys*);
+static
+int _aux_vhost_unpack_msg_cb(void*, struct vmsg_sys*, struct vmsg_usr*);
+
+/*
+ * the routine to setup an extra worker with its own socket bound to
+ * the dht port and register it as route shard.
+ * @worker:
+ * @host:
+ * @mode: rpc mode.
+ */
+static
+int _aux_vhost_worker_init(struct vhost_worker* worker, struct vhost* host, int mode)
+{
+    struct vroute* route = &host->route;
+    int ret = 0;
+
+    vassert(worker);
+    vassert(host);
+
+    memset(worker, 0, sizeof(*worker));
+    worker->host = host;
+
+    ret = vwaiter_init(&worker->waiter, VWAITER_EPOLL);
+    retE((ret < 0));
+    ret = vmsger_init(&worker->msger);
+    ret1E((ret < 0), vwaiter_deinit(&worker->waiter));
+    ret = vrpc_init(&worker->rpc, &worker->msger, mode, to_vsockaddr_from_sin(&host->zaddr));
+    ret2E((ret < 0), vmsger_deinit(&worker->msger), vwaiter_deinit(&worker->waiter));
+
+    ret = route->ops->add_shard(route, &worker->msger);
+    if (ret < 0) {
+        vrpc_deinit   (&worker->rpc);
+        vmsger_deinit (&worker->msger);
+        vwaiter_deinit(&worker->waiter);
+        retE((1));
+    }
+    vmsger_reg_pack_cb  (&worker->msger, _aux_vhost_pack_msg_cb  , host);
+    vmsger_reg_unpack_cb(&worker->msger, _aux_vhost_unpack_msg_cb, host);
+    worker->waiter.ops->add(&worker->waiter, &worker->rpc);
+    return 0;
+}
+
+static
+void _aux_vhost_worker_deinit(struct vhost_worker* worker)
+{
+    vassert(worker);
+
+    worker->waiter.ops->remove(&worker->waiter, &worker->rpc);
+    vrpc_deinit   (&worker->rpc);
+    vwaiter_deinit(&worker->waiter);
+    vmsger_deinit (&worker->msger);
+    return ;
+}
+
+/*
+ * the routine to setup tcp rpc listening on the dht port, through which
+ * messages too large for datagram are sent. it's run by host waiter.
+ * @host:
+ */
+static
+int _aux_vhost_tcp_init(struct vhost* host)
+{
+    struct vroute* route = &host->route;
+    int ret = 0;
+
+    vassert(host);
+
+    ret = vmsger_init(&host->tcp_msger);
+    retE((ret < 0));
+    ret = vrpc_init(&host->tcp_rpc, &host->tcp_msger, VRPC_TCP, to_vsockaddr_from_sin(&host->zaddr));
+    ret1E((ret < 0), vmsger_deinit(&host->tcp_msger));
+
+    ret = route->ops->add_tcp(route, &host->tcp_msger);
+    if (ret < 0) {
+        vrpc_deinit  (&host->tcp_rpc);
+        vmsger_deinit(&host->tcp_msger);
+        retE((1));
+    }
+    vmsger_reg_pack_cb  (&host->tcp_msger, _aux_vhost_pack_msg_cb  , host);
+    vmsger_reg_unpack_cb(&host->tcp_msger, _aux_vhost_unpack_msg_cb, host);
+    vrpc_reg_fallback(&host->tcp_rpc, &host->msger);
+    host->waiter.ops->add(&host->waiter, &host->tcp_rpc);
+    return 0;
+}
+
+static
+void _aux_vhost_tcp_deinit(struct vhost* host)
+{
+    vassert(host);
+
+    host->waiter.ops->remove(&host->waiter, &host->tcp_rpc);
+    vrpc_deinit  (&host->tcp_rpc);
+    vmsger_deinit(&host->tcp_msger);
+    return ;
+}
+
 /*
  * @cookie
  * @um: [in]  usr msg format
@@ -239,7 +382,7 @@ int _aux_vhost_pack_msg_cb(void* cookie, struct vmsg_usr* um, struct vmsg_sys* s
 
         sz += sizeof(uint32_t);
         data = unoff_addr(um->data, sz);
-        set_uint32(data, DHT_MAGIC);
+        set_uint32(data, (um->msgId == VMSG_DHT_BIN) ? DHT_BIN_MAGIC : DHT_MAGIC);
 
         vmsg_sys_init(sm, um->addr, um->spec, um->len + sz, data);
         return 0;
@@ -258,6 +401,7 @@ int _aux_vhost_pack_msg_cb(void* cookie, struct vmsg_usr* um, struct vmsg_sys* s
 static
 int _aux_vhost_unpack_msg_cb(void* cookie, struct vmsg_sys* sm, struct vmsg_usr* um)
 {
+    struct vhost* host = (struct vhost*)cookie;
     void* data = sm->data;
     uint32_t magic = 0;
     int msgId = 0;
@@ -275,7 +419,11 @@ int _aux_vhost_unpack_msg_cb(void* cookie, struct vmsg_sys* sm, struct vmsg_usr*
     sz += sizeof(int32_t);
 
     data = offset_addr(sm->data, sz);
-    if (IS_DHT_MSG(magic)) {
+    if (IS_DHT_MSG(magic) || IS_DHT_BIN_MSG(magic)) {
+        retE((IS_DHT_BIN_MSG(magic) != (msgId == VMSG_DHT_BIN)));
+        if (host->trace.fp) {
+            vtrace_write(&host->trace, sm);
+        }
         vmsg_usr_init(um, msgId, &sm->addr, &sm->spec, sm->len -sz, data);
         return 0;
     }
@@ -284,15 +432,33 @@ int _aux_vhost_unpack_msg_cb(void* cookie, struct vmsg_sys* sm, struct vmsg_usr*
     return 0;
 }
 
+/*
+ * the routine to write out msgs captured periodically.
+ */
+static
+int _aux_vhost_trace_tick_cb(void* cookie)
+{
+    struct vhost* host = (struct vhost*)cookie;
+    vassert(host);
+
+    vtrace_flush(&host->trace);
+    return 0;
+}
+
 int vhost_init(struct vhost* host, struct vconfig* cfg, struct vlsctl* lsctl)
 {
+    const char* trace = NULL;
+    int mode = VRPC_UDP;
     int ret = 0;
+    int i = 0;
 
     vassert(host);
     vassert(cfg);
     memset(host, 0, sizeof(*host));
 
     host->tick_tmo = cfg->ext_ops->get_host_tick_tmo(cfg);
+    host->nworkers = cfg->ext_ops->get_dht_workers(cfg);
+    host->tcp_on   = cfg->ext_ops->get_dht_tcp(cfg);
     host->to_quit  = 0;
     host->cfg      = cfg;
     host->lsctl    = lsctl;
@@ -301,10 +467,17 @@ int vhost_init(struct vhost* host, struct vconfig* cfg, struct vlsctl* lsctl)
     vsockaddr_convert2(INADDR_ANY, cfg->ext_ops->get_dht_port(cfg), &host->zaddr);
     vtoken_make(&host->myid);
 
+    if (host->nworkers > VHOST_MAX_WORKERS) {
+        host->nworkers = VHOST_MAX_WORKERS;
+    }
+    if (host->nworkers > 1) {
+        mode = VRPC_UDP_SHARD;
+    }
+
     ret += vticker_init(&host->ticker);
-    ret += vwaiter_init(&host->waiter);
+    ret += vwaiter_init(&host->waiter, VWAITER_EPOLL);
     ret += vmsger_init (&host->msger);
-    ret += vrpc_init   (&host->rpc,  &host->msger, VRPC_UDP, to_vsockaddr_from_sin(&host->zaddr));
+    ret += vrpc_init   (&host->rpc,  &host->msger, mode, to_vsockaddr_from_sin(&host->zaddr));
     ret += vroute_init (&host->route, cfg, host, &host->myid);
     ret += vnode_init  (&host->node,  cfg, host, &host->myid);
     if (ret < 0) {
@@ -314,21 +487,62 @@ int vhost_init(struct vhost* host, struct vconfig* cfg, struct vlsctl* lsctl)
         vmsger_deinit  (&host->msger);
         vwaiter_deinit (&host->waiter);
         vticker_deinit (&host->ticker);
+        host->nworkers = 1;
         return -1;
     }
 
     host->waiter.ops->add(&host->waiter, &host->rpc);
     host->waiter.ops->add(&host->waiter, &lsctl->rpc);
+    trace = cfg->ext_ops->get_dht_trace(cfg);
+    if (trace) {
+        ret = vtrace_open(&host->trace, trace, 1);
+        vlogEv((ret < 0), "dht msgs not to be captured");
+        if (ret >= 0) {
+            host->ticker.ops->add_cb(&host->ticker, _aux_vhost_trace_tick_cb, host);
+        }
+    }
     vmsger_reg_pack_cb  (&host->msger, _aux_vhost_pack_msg_cb  , host);
     vmsger_reg_unpack_cb(&host->msger, _aux_vhost_unpack_msg_cb, host);
 
+    if (host->tcp_on) {
+        ret = _aux_vhost_tcp_init(host);
+        vlogEv((ret < 0), "tcp unavailable, large msgs go by udp");
+        host->tcp_on = (ret >= 0);
+    }
+    if (host->nworkers > 1) {
+        host->workers = (struct vhost_worker*)malloc((host->nworkers - 1) * sizeof(struct vhost_worker));
+        vlogEv((!host->workers), elog_malloc);
+        if (!host->workers) {
+            host->nworkers = 1;
+        }
+    }
+    for (i = 1; i < host->nworkers; i++) {
+        ret = _aux_vhost_worker_init(&host->workers[i-1], host, mode);
+        if (ret < 0) {
+            vlogE("only %d of %d dht workers available", i, host->nworkers);
+            host->nworkers = i;
+            break;
+        }
+    }
     return 0;
 }
 
 void vhost_deinit(struct vhost* host)
 {
+    int i = 0;
     vassert(host);
 
+    for (i = 1; i < host->nworkers; i++) {
+        _aux_vhost_worker_deinit(&host->workers[i-1]);
+    }
+    if (host->workers) {
+        free(host->workers);
+        host->workers = NULL;
+    }
+    if (host->tcp_on) {
+        _aux_vhost_tcp_deinit(host);
+    }
+
     host->waiter.ops->remove(&host->waiter, &host->lsctl->rpc);
     host->waiter.ops->remove(&host->waiter, &host->rpc);
 
@@ -338,6 +552,7 @@ void vhost_deinit(struct vhost* host)
     vwaiter_deinit(&host->waiter);
     vticker_deinit(&host->ticker);
     vmsger_deinit (&host->msger);
+    vtrace_close  (&host->trace);
 
     return;
 }
@@ -352,7 +567,7 @@ const char* vhost_get_version(void)
      * d: demo(candidate)
      * e: skipped.
      */
-    const char* version = "0.0.0.1.0";
+    const char* version = VDHT_BIN_VER;
     return (const char*)version;
 }
 
@@ -6,6 +6,7 @@
 #include "vlsctl.h"
 #include "vmsger.h"
 #include "vticker.h"
+#include "vtrace.h"
 
 struct vhost;
 struct vhost_ops {
@@ -20,9 +21,24 @@ struct vhost_ops {
     int   (*bogus_query)(struct vhost*, int, struct sockaddr_in*);
 };
 
+/*
+ * extra worker owning a udp socket bound to dht port (SO_REUSEPORT) with
+ * its own msger and waiter thread. worker 0 is the host itself.
+ */
+#define VHOST_MAX_WORKERS ((int)16)
+struct vhost_worker {
+    struct vthread  thread;
+    struct vmsger   msger;
+    struct vrpc     rpc;
+    struct vwaiter  waiter;
+    struct vhost*   host;
+};
+
 struct vhost {
     int  to_quit;
     int  tick_tmo;
+    int  nworkers;
+    int  tcp_on;
     vnodeId myid;
     struct sockaddr_in zaddr;
 
@@ -30,9 +46,13 @@ struct vhost {
     struct vmsger   msger;
     struct vrpc     rpc;
     struct vwaiter  waiter;
+    struct vmsger   tcp_msger;  // for msgs too large for datagram.
+    struct vrpc     tcp_rpc;
     struct vticker  ticker;
     struct vroute   route;
     struct vnode    node;
+    struct vhost_worker* workers;
+    struct vtrace   trace;      // capture of dht msgs received, if configured.
 
     struct vconfig*   cfg;
     struct vlsctl*    lsctl;
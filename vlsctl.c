@@ -326,8 +326,7 @@ void _aux_vlsctl_number_addr_cb2(vsrvcHash* hash, int naddrs, int proto, void* c
         ret1E_v((!buf), free(args));
 
         ret = lsctl->ops->pack_cmd(lsctl, buf, BUF_SZ, cookie);
-        free(args);
-        ret1E_v((ret < 0), free(buf));
+        ret2E_v((ret < 0), free(buf), free(args));
         {
             struct vmsg_usr msg = {
                 .addr  = &args->probe_service_rsp_args.from,
@@ -337,6 +336,7 @@ void _aux_vlsctl_number_addr_cb2(vsrvcHash* hash, int naddrs, int proto, void* c
                 .len   = ret
             };
             ret = lsctl->msger.ops->push(&lsctl->msger, &msg);
+            free(args);
             ret1E_v((ret < 0), free(buf));
         }
     }
@@ -359,8 +359,7 @@ void _aux_vlsctl_iterate_addr_cb2(vsrvcHash* hash, struct sockaddr_in* addr, int
         ret1E_v((!buf), free(args));
 
         ret = lsctl->ops->pack_cmd(lsctl, buf, BUF_SZ, cookie);
-        free(args);
-        ret1E_v((ret < 0), free(buf));
+        ret2E_v((ret < 0), free(buf), free(args));
         {
             struct vmsg_usr msg = {
                 .addr  = &args->probe_service_rsp_args.from,
@@ -370,6 +369,7 @@ void _aux_vlsctl_iterate_addr_cb2(vsrvcHash* hash, struct sockaddr_in* addr, int
                 .len   = ret
             };
             ret = lsctl->msger.ops->push(&lsctl->msger, &msg);
+            free(args);
             ret1E_v((ret < 0), free(buf));
         }
     }
@@ -404,6 +404,7 @@ int _vlsctl_exec_cmd_probe_service(struct vlsctl* lsctl, void* buf, int len, str
     args->probe_service_rsp_args.total = 0;
     args->probe_service_rsp_args.index = 0;
     args->probe_service_rsp_args.pack_cb = lsctl->pack_cmd_ops->probe_service_rsp;
+    args->probe_service_rsp_args.lsctl = lsctl;
     vtoken_copy(&args->probe_service_rsp_args.hash, &hash);
     memcpy(&args->probe_service_rsp_args.from, from, sizeof(*from));
 
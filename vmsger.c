@@ -166,33 +166,39 @@ static
 int _vmsger_dsptch(struct vmsger* msger, struct vmsg_sys* msg)
 {
     struct vmsg_usr usr_msg;
-    struct vmsg_cb* mcb = NULL;
-    struct vlist* node = NULL;
+    struct vmsg_cbs* cbs = NULL;
+    struct vmsg_cb*  mcb = NULL;
     int ret = 0;
+    int i = 0;
 
     vassert(msger);
     vassert(msg);
     vassert(msger->unpack_cb);
     vassert(msger->cookie2);
 
+    memset(&usr_msg, 0, sizeof(usr_msg));
     ret = msger->unpack_cb(msger->cookie2, msg, &usr_msg);
     retE((ret < 0));
+    if ((usr_msg.msgId <= VMSG_RSRVD) || (usr_msg.msgId >= VMSG_BUTT)) {
+        return 0; // unknown msg, just drop it.
+    }
 
-    vlock_enter(&msger->lock_cbs);
-    __vlist_for_each(node, &msger->cbs) {
-        mcb = vlist_entry(node, struct vmsg_cb, list);
-        if (mcb->msgId == usr_msg.msgId) {
-            mcb->cb(mcb->cookie, &usr_msg);
-        }
+    cbs = __atomic_load_n(&msger->dsptch_tbl[usr_msg.msgId], __ATOMIC_ACQUIRE);
+    if (!cbs) {
+        return 0;
+    }
+    for (i = 0; i < cbs->num; i++) {
+        mcb = cbs->mcbs[i];
+        mcb->cb(mcb->cookie, &usr_msg);
     }
-    vlock_leave(&msger->lock_cbs);
     return 0;
 }
 
 /*
  * each user msg has it's own routine(or callback) to deal with.
  * so, before recoginizing msg, it's certain callback need to be
- * registered.
+ * registered. more than one callback can be registered for same msgId,
+ * and they are called in registration order.
  *
  * @msger:
  * @cookie: cookie for cb
@@ -202,34 +208,111 @@ int _vmsger_dsptch(struct vmsger* msger, struct vmsg_sys* msg)
 static
 int _vmsger_add_cb(struct vmsger* msger, void* cookie, vmsg_cb_t cb, int id)
 {
-    struct vmsg_cb* mcb = NULL;
-    struct vlist* node = NULL;
-    int found = 0;
+    struct vmsg_cbs* old_cbs = NULL;
+    struct vmsg_cbs* cbs = NULL;
+    struct vmsg_cb*  mcb = NULL;
+    int num = 0;
+    int i = 0;
 
     vassert(msger);
     vassert(cb);
-    vassert(id > 0);
+    vassert(id > VMSG_RSRVD);
+    vassert(id < VMSG_BUTT);
     vassert(cookie);
 
     vlock_enter(&msger->lock_cbs);
-    __vlist_for_each(node, &msger->cbs) {
-        mcb = vlist_entry(node, struct vmsg_cb, list);
-        if (mcb->msgId == id) {
-            found = 1;
-            break;
+    old_cbs = msger->dsptch_tbl[id];
+    num = old_cbs ? old_cbs->num : 0;
+    for (i = 0; i < num; i++) {
+        mcb = old_cbs->mcbs[i];
+        if ((mcb->cb == cb) && (mcb->cookie == cookie)) {
+            vlock_leave(&msger->lock_cbs);
+            return 0;
         }
     }
-    if (!found) {
-        mcb = vmsg_cb_alloc();
-        vlogEv((!mcb), elog_vmsg_cb_alloc);
-        ret1E((!mcb), vlock_leave(&msger->lock_cbs));
-        vmsg_cb_init(mcb, id, cb, cookie);
-        vlist_add_tail(&msger->cbs, &mcb->list);
+
+    cbs = (struct vmsg_cbs*)malloc(sizeof(*cbs) + (num + 1) * sizeof(struct vmsg_cb*));
+    vlogEv((!cbs), elog_malloc);
+    ret1E((!cbs), vlock_leave(&msger->lock_cbs));
+    mcb = vmsg_cb_alloc();
+    vlogEv((!mcb), elog_vmsg_cb_alloc);
+    ret2E((!mcb), free(cbs), vlock_leave(&msger->lock_cbs));
+    vmsg_cb_init(mcb, id, cb, cookie);
+    vlist_add_tail(&msger->cbs, &mcb->list);
+
+    vlist_init(&cbs->list);
+    for (i = 0; i < num; i++) {
+        cbs->mcbs[i] = old_cbs->mcbs[i];
+    }
+    cbs->mcbs[num] = mcb;
+    cbs->num = num + 1;
+
+    // receive path may still be walking old one, so just retire it.
+    __atomic_store_n(&msger->dsptch_tbl[id], cbs, __ATOMIC_RELEASE);
+    if (old_cbs) {
+        vlist_add_tail(&msger->retired, &old_cbs->list);
     }
     vlock_leave(&msger->lock_cbs);
     return 0;
 }
 
+/*
+ * to enqueue a msg. it only takes one CAS on head when not contended, and
+ * fails immediately rather than waiting when queue is full.
+ *
+ * @queue:
+ * @ms:
+ * @pos: [out] position where the msg is placed.
+ */
+static
+int _aux_queue_push(struct vmsger_queue* queue, struct vmsg_sys* ms, unsigned int* pos)
+{
+    struct vmsger_cell* cell = NULL;
+    unsigned int at = queue->head;
+    int dif = 0;
+
+    while (1) {
+        cell = &queue->cells[at & queue->mask];
+        dif  = (int)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - at);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&queue->head, &at, at + 1, 0,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            // @at was reloaded with current head by failed CAS.
+        } else if (dif < 0) {
+            __sync_fetch_and_add(&queue->ndrops, 1);
+            return -1; // full.
+        } else {
+            at = queue->head;
+        }
+    }
+    cell->ms = ms;
+    __atomic_store_n(&cell->seq, at + 1, __ATOMIC_RELEASE);
+    *pos = at;
+    return 0;
+}
+
+/*
+ * to check whether the cell at @tail has been published. before reporting
+ * empty, it re-checks after a full barrier, which pairs with the barrier in
+ * push, so that either consumer sees the msg, or producer sees consumer
+ * parking at that position and notifies it.
+ *
+ * @queue:
+ */
+static
+int _aux_queue_ready(struct vmsger_queue* queue)
+{
+    struct vmsger_cell* cell = &queue->cells[queue->tail & queue->mask];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == queue->tail + 1) {
+        return 1;
+    }
+    __sync_synchronize();
+    return (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == queue->tail + 1);
+}
+
 /*
  *  when msg is about to send, it need to be put in msg queue in
  *  mapping msger. Then the msger mechanism take over the msg sending
@@ -254,35 +337,93 @@ int _vmsger_push(struct vmsger* msger, struct vmsg_usr* mu)
     ret = msger->pack_cb(msger->cookie1, mu, ms);
     ret1E((ret < 0), vmsg_sys_free(ms));
 
-    vlock_enter(&msger->lock_msgs);
-    vlist_add_tail(&msger->msgs, &ms->list);
-    vlock_leave(&msger->lock_msgs);
+    return msger->ops->push_sys(msger, ms);
+}
+
+/*
+ *  to wake up all waiters registered.
+ *
+ *  @msger:
+ */
+static
+void _aux_msger_notify(struct vmsger* msger)
+{
+    struct vmsger_notify* notify = NULL;
+    vmsger_notify_t cb = NULL;
+    int i = 0;
+
+    for (i = 0; i < VMSGER_MAX_NOTIFIES; i++) {
+        notify = &msger->notifies[i];
+        cb = __atomic_load_n(&notify->cb, __ATOMIC_ACQUIRE);
+        if (cb) {
+            cb(notify->cookie);
+        }
+    }
+    return ;
+}
+
+/*
+ *  to put a msg already packed in msg queue, say the one handed back by
+ *  another rpc failing to deliver it. the msg is taken over even if it
+ *  fails.
+ *
+ *  @msger:
+ *  @ms:
+ */
+static
+int _vmsger_push_sys(struct vmsger* msger, struct vmsg_sys* ms)
+{
+    struct vmsger_queue* queue = &msger->msgs;
+    unsigned int pos = 0;
+    int ret = 0;
+
+    vassert(msger);
+    vassert(ms);
+
+    ret = _aux_queue_push(queue, ms, &pos);
+    vlogEv((ret < 0), "msger queue full, msg dropped");
+    ret1E((ret < 0), vmsg_sys_free(ms));
 
+    // only notify when consumer has drained up to this msg, and might
+    // be parking for no msg to send.
+    __sync_synchronize();
+    if (queue->tail == pos) {
+        _aux_msger_notify(msger);
+    }
     return 0;
 }
 
 /*
- *  to check whether msger has msg to send.
+ *  to check whether msger has msg to send. it must be called on
+ *  the consumer thread.
  *
  * @msger:
  */
 static
 int _vmsger_popable(struct vmsger* msger)
 {
-    int ret = 0;
     vassert(msger);
+    return _aux_queue_ready(&msger->msgs);
+}
 
-    vlock_enter(&msger->lock_msgs);
-    ret = !vlist_is_empty(&msger->msgs);
-    vlock_leave(&msger->lock_msgs);
-
-    return ret;
+/*
+ *  to get number of msgs in queue, which is only a snapshot when called
+ *  on producer threads, say to back off before queue is full.
+ *
+ * @msger:
+ */
+static
+int _vmsger_size(struct vmsger* msger)
+{
+    struct vmsger_queue* queue = &msger->msgs;
+    vassert(msger);
+    return (int)(queue->head - queue->tail);
 }
 
 /*
  *  msg will be send by rpc as soon as rpc turns to be writeable.
  *  rpc fetch a msg from mapping msger to send.
- *  fecth policy: FIFO
+ *  fecth policy: FIFO. only one consumer thread is allowed.
  *
  * @msger:
  * @msg:  [out] msg to send, which is fetched from msger queue.
@@ -290,20 +431,25 @@ int _vmsger_popable(struct vmsger* msger)
 static
 int _vmsger_pop(struct vmsger* msger, struct vmsg_sys** ms)
 {
-    struct vlist* node = NULL;
+    struct vmsger_queue* queue = &msger->msgs;
+    struct vmsger_cell* cell = NULL;
+    unsigned int at = queue->tail;
+
     vassert(msger);
     vassert(ms);
 
-    vlock_enter(&msger->lock_msgs);
-    if (!vlist_is_empty(&msger->msgs)) {
-        node = vlist_pop_head(&msger->msgs);
-        *ms = vlist_entry(node, struct vmsg_sys, list);
-    } else {
-        *ms = NULL;
+    *ms = NULL;
+    if (!_aux_queue_ready(queue)) {
+        return -1;
     }
-    vlock_leave(&msger->lock_msgs);
 
-    return (*ms) ? 0 : -1;
+    cell = &queue->cells[at & queue->mask];
+    *ms  = cell->ms;
+    cell->ms = NULL;
+    // hand the cell back to producers for next round.
+    __atomic_store_n(&cell->seq, at + queue->mask + 1, __ATOMIC_RELEASE);
+    queue->tail = at + 1;
+    return 0;
 }
 
 /*
@@ -313,12 +459,26 @@ int _vmsger_pop(struct vmsger* msger, struct vmsg_sys** ms)
 static
 int _vmsger_clear(struct vmsger* msger)
 {
+    struct vmsg_cbs* cbs = NULL;
     struct vmsg_cb*  mcb = NULL;
     struct vmsg_sys* ms  = NULL;
     struct vlist*   node = NULL;
+    int i = 0;
     vassert(msger);
 
     vlock_enter(&msger->lock_cbs);
+    for (i = 0; i < VMSG_BUTT; i++) {
+        cbs = msger->dsptch_tbl[i];
+        __atomic_store_n(&msger->dsptch_tbl[i], NULL, __ATOMIC_RELEASE);
+        if (cbs) {
+            free(cbs);
+        }
+    }
+    while(!vlist_is_empty(&msger->retired)) {
+        node = vlist_pop_head(&msger->retired);
+        cbs  = vlist_entry(node, struct vmsg_cbs, list);
+        free(cbs);
+    }
     while(!vlist_is_empty(&msger->cbs)) {
         node = vlist_pop_head(&msger->cbs);
         mcb  = vlist_entry(node, struct vmsg_cb, list);
@@ -326,13 +486,9 @@ int _vmsger_clear(struct vmsger* msger)
     }
     vlock_leave(&msger->lock_cbs);
 
-    vlock_enter(&msger->lock_msgs);
-    while(!vlist_is_empty(&msger->msgs)) {
-        node = vlist_pop_head(&msger->msgs);
-        ms   = vlist_entry(node, struct vmsg_sys, list);
+    while (msger->ops->pop(msger, &ms) >= 0) {
         vmsg_sys_free(ms);
     }
-    vlock_leave(&msger->lock_msgs);
     return 0;
 }
 
@@ -342,8 +498,13 @@ int _vmsger_clear(struct vmsger* msger)
 static
 int _vmsger_dump(struct vmsger* msger)
 {
+    struct vmsger_queue* queue = &msger->msgs;
     vassert(msger);
-    //todo;
+
+    printf("msger queue: {capc:%u, pending:%u, drops:%d}\n",
+            queue->mask + 1,
+            queue->head - queue->tail,
+            queue->ndrops);
     return 0;
 }
 
@@ -352,7 +513,9 @@ struct vmsger_ops msger_ops = {
     .dsptch  = _vmsger_dsptch,
     .add_cb  = _vmsger_add_cb,
     .push    = _vmsger_push,
+    .push_sys= _vmsger_push_sys,
     .popable = _vmsger_popable,
+    .size    = _vmsger_size,
     .pop     = _vmsger_pop,
     .clear   = _vmsger_clear,
     .dump    = _vmsger_dump
@@ -360,13 +523,26 @@ struct vmsger_ops msger_ops = {
 
 int vmsger_init(struct vmsger* msger)
 {
+    struct vmsger_queue* queue = &msger->msgs;
+    int i = 0;
     vassert(msger);
 
     memset(msger, 0, sizeof(*msger));
+    queue->cells = (struct vmsger_cell*)malloc(VMSGER_QUEUE_CAPC * sizeof(struct vmsger_cell));
+    vlogEv((!queue->cells), elog_malloc);
+    retE((!queue->cells));
+    for (i = 0; i < VMSGER_QUEUE_CAPC; i++) {
+        queue->cells[i].seq = (unsigned int)i;
+        queue->cells[i].ms  = NULL;
+    }
+    queue->mask   = VMSGER_QUEUE_CAPC - 1;
+    queue->head   = 0;
+    queue->tail   = 0;
+    queue->ndrops = 0;
+
     vlist_init(&msger->cbs);
-    vlist_init(&msger->msgs);
+    vlist_init(&msger->retired);
     vlock_init(&msger->lock_cbs);
-    vlock_init(&msger->lock_msgs);
 
     msger->ops = &msger_ops;
     return 0;
@@ -378,7 +554,8 @@ void vmsger_deinit(struct vmsger* msger)
 
     msger->ops->clear(msger);
     vlock_deinit(&msger->lock_cbs);
-    vlock_deinit(&msger->lock_msgs);
+    free(msger->msgs.cells);
+    msger->msgs.cells = NULL;
     return ;
 }
 
@@ -402,3 +579,43 @@ void vmsger_reg_unpack_cb(struct vmsger* msger, vmsger_unpack_t cb, void* cookie
     return;
 }
 
+/*
+ * the notify callbacks are invoked whenever msg queue turns to be non-empty
+ * from empty, which gives rpc waiters a chance to arm writable interest.
+ * each waiter registers its own, keyed by @cookie.
+ * @msger:
+ * @cb:  NULL to unregister the one of @cookie.
+ * @cookie:
+ */
+void vmsger_reg_notify_cb(struct vmsger* msger, vmsger_notify_t cb, void* cookie)
+{
+    struct vmsger_notify* empty = NULL;
+    struct vmsger_notify* notify = NULL;
+    int i = 0;
+    vassert(msger);
+
+    for (i = 0; i < VMSGER_MAX_NOTIFIES; i++) {
+        notify = &msger->notifies[i];
+        if (notify->cb && (notify->cookie == cookie)) {
+            break;
+        }
+        if (!notify->cb && !empty) {
+            empty = notify;
+        }
+    }
+    if (i >= VMSGER_MAX_NOTIFIES) {
+        notify = empty;
+    }
+    if (!cb) {
+        if (i < VMSGER_MAX_NOTIFIES) {
+            __atomic_store_n(&notify->cb, NULL, __ATOMIC_RELEASE);
+        }
+        return ;
+    }
+    vlogEv((!notify), "too many waiters on msger");
+    retE_v((!notify));
+    notify->cookie = cookie;
+    __atomic_store_n(&notify->cb, cb, __ATOMIC_RELEASE);
+    return;
+}
+
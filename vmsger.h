@@ -7,13 +7,14 @@
 enum {
     VMSG_RSRVD = 0,
     VMSG_DHT   = 0x01,
+    VMSG_DHT_BIN = 0x02,
 
     VMSG_LSCTL = 0x45,
 
     VMSG_BUTT
 };
 
-#define VDHT_MSG(msgId)  (msgId == VMSG_DHT)
+#define VDHT_MSG(msgId)  ((msgId == VMSG_DHT) || (msgId == VMSG_DHT_BIN))
 
 /*
  * for message buffer
@@ -79,6 +80,17 @@ struct vmsg_cb* vmsg_cb_alloc(void);
 void  vmsg_cb_free(struct vmsg_cb*);
 void  vmsg_cb_init(struct vmsg_cb*, int, vmsg_cb_t, void*);
 
+/*
+ * handlers of one msgId, dispatched in registration order. once published
+ * to dispatch table, it's never changed, but replaced by a new copy when
+ * handler is added, so that receive path reads it without lock.
+ */
+struct vmsg_cbs {
+    struct vlist list;      // to retired list after being replaced.
+    int num;
+    struct vmsg_cb* mcbs[];
+};
+
 
 /*
  * for vmsger
@@ -88,7 +100,9 @@ struct vmsger_ops {
     int (*dsptch) (struct vmsger*, struct vmsg_sys*);
     int (*add_cb) (struct vmsger*, void*, vmsg_cb_t, int);
     int (*push)   (struct vmsger*, struct vmsg_usr* );
+    int (*push_sys)(struct vmsger*, struct vmsg_sys*);
     int (*popable)(struct vmsger*);
+    int (*size)   (struct vmsger*);
     int (*pop )   (struct vmsger*, struct vmsg_sys**);
     int (*clear)  (struct vmsger*);
     int (*dump)   (struct vmsger*);
@@ -96,17 +110,49 @@ struct vmsger_ops {
 
 typedef int (*vmsger_pack_t  )(void*, struct vmsg_usr*, struct vmsg_sys*);
 typedef int (*vmsger_unpack_t)(void*, struct vmsg_sys*, struct vmsg_usr*);
+typedef void (*vmsger_notify_t)(void*);
+
+/*
+ * bounded multi-producer single-consumer queue for outbound msgs. each
+ * cell carries a sequence number telling whether it's ready for producer
+ * (seq == pos) or consumer (seq == pos + 1). capacity must be power of 2.
+ */
+#define VMSGER_QUEUE_CAPC   ((int)1024)
+#define VMSGER_CACHELINE    ((int)64)
+#define VMSGER_MAX_NOTIFIES ((int)4)
+
+struct vmsger_cell {
+    volatile unsigned int seq;
+    struct vmsg_sys* ms;
+};
+
+struct vmsger_queue {
+    struct vmsger_cell* cells;
+    unsigned int mask;
+    char pad0[VMSGER_CACHELINE];
+    volatile unsigned int head;     // next position to push, by producers.
+    char pad1[VMSGER_CACHELINE];
+    volatile unsigned int tail;     // next position to pop, by consumer only.
+    char pad2[VMSGER_CACHELINE];
+    volatile int ndrops;            // msgs dropped for queue being full.
+};
 
 struct vmsger {
     struct vlist  cbs;
+    struct vlist  retired;
     struct vlock  lock_cbs;
-    struct vlist  msgs;
-    struct vlock  lock_msgs;
+    struct vmsg_cbs* volatile dsptch_tbl[VMSG_BUTT];
+    struct vmsger_queue msgs;
 
     vmsger_pack_t pack_cb;
     void* cookie1;
     vmsger_unpack_t unpack_cb;
     void* cookie2;
+    // one for each waiter of rpc taking msgs from this msger.
+    struct vmsger_notify {
+        vmsger_notify_t cb;
+        void* cookie;
+    } notifies[VMSGER_MAX_NOTIFIES];
 
     struct vmsger_ops* ops;
 };
@@ -115,5 +161,6 @@ int  vmsger_init  (struct vmsger*);
 void vmsger_deinit(struct vmsger*);
 void vmsger_reg_pack_cb  (struct vmsger*, vmsger_pack_t,   void*);
 void vmsger_reg_unpack_cb(struct vmsger*, vmsger_unpack_t, void*);
+void vmsger_reg_notify_cb(struct vmsger*, vmsger_notify_t, void*);
 
 #endif
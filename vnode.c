@@ -81,6 +81,23 @@ int _vnode_wait_for_stop(struct vnode* node)
     return 0;
 }
 
+/*
+ * to tell caches of encoded node info, say response templates of route,
+ * that @nodei changed. it's only an atomic bump of generation, so it takes
+ * no lock of its own; callers call it right after changing @nodei, under
+ * the same node->lock that guards the change.
+ */
+static
+void _aux_node_nodei_changed(struct vnode* node)
+{
+    __atomic_add_fetch(&node->nodei_gen, 1, __ATOMIC_RELEASE);
+    return ;
+}
+
+/*
+ * to add addresses mapped by upnp to @nodei. called by tick with
+ * node->lock held.
+ */
 static
 int _aux_node_get_uaddrs(struct vnode* node)
 {
@@ -98,6 +115,7 @@ int _aux_node_get_uaddrs(struct vnode* node)
             continue;
         }
         vnodeInfo_add_addr(&nodei, &uaddr);
+        _aux_node_nodei_changed(node);
     }
     return 0;
 }
@@ -348,6 +366,7 @@ int _vnode_reflex_addr(struct vnode* node, struct sockaddr_in* laddr, struct soc
         }
         vnodeInfo_add_addr(&nodei, eaddr);
         reflexive_mask_set(helper->mask, i);
+        _aux_node_nodei_changed(node);
         break;
     }
     vlock_leave(&node->lock);
@@ -428,6 +447,7 @@ int _vnode_srvc_post(struct vnode* node, vsrvcHash* hash, struct sockaddr_in* ad
         vsrvcInfo_add_addr(&srvci, addr);
         varray_add_tail(&node->services, srvci);
         node->nodei.weight++;
+        _aux_node_nodei_changed(node);
     }
     vlock_leave(&node->lock);
     return 0;
@@ -465,6 +485,7 @@ int _vnode_srvc_unpost(struct vnode* node, vsrvcHash* hash, struct sockaddr_in*
         srvci = (vsrvcInfo*)varray_del(&node->services, i);
         vsrvcInfo_free(srvci);
         node->nodei.weight--;
+        _aux_node_nodei_changed(node);
     }
     vlock_leave(&node->lock);
     return 0;
@@ -492,6 +513,7 @@ int _vnode_srvc_unpost_ext(struct vnode* node, vsrvcHash* hash)
         srvci = (vsrvcInfo*)varray_del(&node->services, i);
         vsrvcInfo_free(srvci);
         node->nodei.weight--;
+        _aux_node_nodei_changed(node);
     }
     vlock_leave(&node->lock);
     return 0;
@@ -643,6 +665,7 @@ int vnode_init(struct vnode* node, struct vconfig* cfg, struct vhost* host, vnod
     retE((ret < 0));
     ret = _aux_node_get_nodeinfo(&node->nodei, myid, &node->addr_helper);
     retE((ret < 0));
+    node->nodei_gen = 0;
 
     vlock_init(&node->lock);
     node->mode  = VDHT_OFF;
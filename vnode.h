@@ -82,6 +82,7 @@ struct vnode {
     struct varray services;
     struct vnode_addr_helper addr_helper;
     vnodeInfo_relax nodei;
+    uint32_t nodei_gen; // bumped each time @nodei changes.
 
     struct vnode_nice node_nice;
     struct vupnpc upnpc;
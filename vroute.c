@@ -3,6 +3,147 @@
 
 #define MAX_CAPC ((int)8)
 
+struct vroute_shard {
+    struct vroute* route;
+    struct vmsger* msger;
+};
+
+/*
+ * msger of the shard whose waiter thread is dispatching a dht message,
+ * NULL for threads that are not dispatching (ticker, lsctl, etc).
+ */
+static __thread struct vmsger* route_shard_msger = NULL;
+
+/*
+ * codec of the dht message being dispatched by current thread.
+ */
+static __thread struct vroute_codec* route_rcv_codec = NULL;
+
+static
+uint64_t _aux_route_bin_key(struct sockaddr_in* addr)
+{
+    // never zero, which marks an empty slot.
+    return ((uint64_t)1 << 48) | ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+}
+
+static
+int _aux_route_bin_live(struct vroute* route, int at, uint32_t now)
+{
+    uint32_t seen = __atomic_load_n(&route->bin_seen[at], __ATOMIC_RELAXED);
+    return (seen && (now - seen < (uint32_t)VROUTE_BIN_TMO));
+}
+
+/*
+ * to remember whether peer with @addr speaks binary msgs, which is only
+ * learned from verified responses. an entry not refreshed for a while is
+ * taken as gone, and its slot is reused by other peers.
+ * @route:
+ * @addr:
+ * @on: 0 if peer turns out not to speak binary.
+ */
+static
+void _aux_route_learn_bin(struct vroute* route, struct sockaddr_in* addr, int on)
+{
+    uint64_t key = _aux_route_bin_key(addr);
+    uint64_t cur = 0;
+    uint32_t now = (uint32_t)time(NULL);
+    int slot = (int)((key * 0x9e3779b97f4a7c15ULL) >> 54);
+    int reuse = -1;
+    int at = 0;
+    int i = 0;
+
+    for (i = 0; i < VROUTE_BIN_PROBES; i++) {
+        at  = (slot + i) & (VROUTE_BIN_PEERS - 1);
+        cur = __atomic_load_n(&route->bin_peers[at], __ATOMIC_RELAXED);
+        if (cur == key) {
+            __atomic_store_n(&route->bin_seen[at], on ? now : 0, __ATOMIC_RELAXED);
+            return ;
+        }
+        if ((reuse < 0) && (!cur || !_aux_route_bin_live(route, at, now))) {
+            reuse = at;
+        }
+        if (!cur) {
+            break;
+        }
+    }
+    if (!on || (reuse < 0)) {
+        return ; // full of live peers, this one stays bencode.
+    }
+    cur = __atomic_load_n(&route->bin_peers[reuse], __ATOMIC_RELAXED);
+    if ((cur != key) && !__atomic_compare_exchange_n(&route->bin_peers[reuse], &cur, key,
+                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return ; // taken by another shard at the same time.
+    }
+    __atomic_store_n(&route->bin_seen[reuse], now, __ATOMIC_RELAXED);
+    return ;
+}
+
+static
+int _aux_route_is_bin(struct vroute* route, struct sockaddr_in* addr)
+{
+    uint64_t key = _aux_route_bin_key(addr);
+    uint64_t cur = 0;
+    uint32_t now = (uint32_t)time(NULL);
+    int slot = (int)((key * 0x9e3779b97f4a7c15ULL) >> 54);
+    int at = 0;
+    int i = 0;
+
+    for (i = 0; i < VROUTE_BIN_PROBES; i++) {
+        at  = (slot + i) & (VROUTE_BIN_PEERS - 1);
+        cur = __atomic_load_n(&route->bin_peers[at], __ATOMIC_RELAXED);
+        if (cur == key) {
+            return _aux_route_bin_live(route, at, now);
+        }
+        if (!cur) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * to get codec for msgs to peer with @addr, falling back to bencode unless
+ * the peer is known to speak binary.
+ * @route:
+ * @addr:
+ */
+static
+struct vroute_codec* _aux_route_codec(struct vroute* route, struct sockaddr_in* addr)
+{
+    if (route->bin_on && _aux_route_is_bin(route, addr)) {
+        return &route->bin_codec;
+    }
+    return &route->codec;
+}
+
+static
+int _aux_route_ver_bin(struct vroute* route, vnodeVer* ver)
+{
+    int i = 0;
+
+    for (i = 0; i < VTOKEN_INTLEN; i++) {
+        if (ver->data[i] != route->bin_ver.data[i]) {
+            return (ver->data[i] > route->bin_ver.data[i]);
+        }
+    }
+    return 1;
+}
+
+static
+int _aux_route_push(struct vroute* route, struct vmsg_usr* msg)
+{
+    struct vmsger* msger = route_shard_msger ? route_shard_msger : route->msger;
+    int ret = 0;
+
+    // large datagram is prone to be fragmented or dropped on the path.
+    // tcp rpc hands it back to udp if peer takes no tcp.
+    if ((msg->len > VRPC_DGRAM_SZ) && route->tcp_msger) {
+        ret = route->tcp_msger->ops->push(route->tcp_msger, msg);
+        retS((ret >= 0));
+    }
+    return msger->ops->push(msger, msg);
+}
+
 /*
  * the routine to join a node with well known address into routing table,
  * whose ID usually is fake and trivial.
@@ -27,9 +168,7 @@ int _vroute_join_node(struct vroute* route, struct sockaddr_in* addr)
     vnodeInfo_relax_init(&nodei_relax, &id, vnodeVer_unknown(), 0);
     vnodeInfo_add_addr(&nodei, addr);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->add_node(node_space, nodei, 0);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -59,9 +198,7 @@ int _vroute_find_service(struct vroute* route, vsrvcHash* hash, vsrvcInfo_number
     memset(&srvci, 0, sizeof(srvci));
     srvci.capc = VSRVCINFO_MAX_ADDRS;
 
-    vlock_enter(&route->lock);
     ret = srvc_space->ops->get_service(srvc_space, hash, (vsrvcInfo*)&srvci);
-    vlock_leave(&route->lock);
     retE((ret < 0));
 
     if (!ret) {
@@ -76,11 +213,39 @@ int _vroute_find_service(struct vroute* route, vsrvcHash* hash, vsrvcInfo_number
     return 0;
 }
 
+/*
+ * the routine to call when lookup for service ends, which passes service
+ * found, or none, to all probers of that service.
+ */
+static
+void _aux_route_probe_service_cb(struct vroute* route, vtoken* hash, void* result, void* cookie)
+{
+    struct vroute_srvc_probe_helper* probe_helper = &route->probe_helper;
+    vsrvcInfo_relax none;
+
+    if (!result) {
+        vsrvcInfo_relax_init(&none, hash, &route->myid, 0);
+        result = &none;
+    }
+    probe_helper->ops->invoke(probe_helper, hash, (vsrvcInfo*)result);
+    return ;
+}
+
+/*
+ * the routine to probe service from other nodes by iterative lookup, whose
+ * result is passed to @ncb and @icb.
+ *
+ * @route:
+ * @hash:
+ * @ncb:
+ * @icb:
+ * @cookie:
+ */
 static
 int _vroute_probe_service(struct vroute* route, vsrvcHash* hash, vsrvcInfo_number_addr_t ncb, vsrvcInfo_iterate_addr_t icb, void* cookie)
 {
     struct vroute_srvc_probe_helper* probe_helper = &route->probe_helper;
-    struct vroute_node_space* node_space = &route->node_space;
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     int ret = 0;
 
     vassert(route);
@@ -88,14 +253,10 @@ int _vroute_probe_service(struct vroute* route, vsrvcHash* hash, vsrvcInfo_numbe
     vassert(ncb);
     vassert(icb);
 
-    vlock_enter(&route->lock);
-    ret = node_space->ops->probe_service(node_space, hash);
-    if (ret < 0) {
-        vlock_leave(&route->lock);
-        retE((1));
-    }
-    probe_helper->ops->add(probe_helper, hash, ncb, icb, cookie);
-    vlock_leave(&route->lock);
+    ret = probe_helper->ops->add(probe_helper, hash, ncb, icb, cookie);
+    retE((ret < 0));
+    ret = lookup_space->ops->start(lookup_space, VLOOKUP_SRVC, hash, _aux_route_probe_service_cb, NULL);
+    retE((ret < 0));
     return 0;
 }
 
@@ -107,9 +268,7 @@ int _vroute_air_service(struct vroute* route, vsrvcInfo* srvci)
     vassert(route);
     vassert(srvci);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->air_service(node_space, srvci);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -122,9 +281,7 @@ int _vroute_reflex_addr(struct vroute* route, struct sockaddr_in* addr)
     vassert(route);
     vassert(addr);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->reflex_addr(node_space, addr);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -137,9 +294,7 @@ int _vroute_probe_connectivity(struct vroute* route, struct sockaddr_in* laddr)
     vassert(route);
     vassert(laddr);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->probe_connectivity(node_space, laddr);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -159,14 +314,20 @@ void _vroute_set_inspect_cb(struct vroute* route, vroute_inspect_t cb, void* coo
 
 void _vroute_inspect(struct vroute* route, vtoken* token, uint32_t insp_id)
 {
+    vroute_inspect_t cb = NULL;
+    void* cookie = NULL;
+
     vassert(route);
     vassert(token);
 
     vlock_enter(&route->lock);
-    if (route->insp_cb) {
-        route->insp_cb(route, route->insp_cookie, token, insp_id);
-    }
+    cb = route->insp_cb;
+    cookie = route->insp_cookie;
     vlock_leave(&route->lock);
+
+    if (cb) {
+        cb(route, cookie, token, insp_id);
+    }
     return ;
 }
 
@@ -183,9 +344,7 @@ int _vroute_load(struct vroute* route)
     int ret = 0;
     vassert(route);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->load(node_space);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -203,9 +362,7 @@ int _vroute_store(struct vroute* route)
     int ret = 0;
     vassert(route);
 
-    vlock_enter(&route->lock);
     ret = node_space->ops->store(node_space);
-    vlock_leave(&route->lock);
     retE((ret < 0));
     return 0;
 }
@@ -218,17 +375,107 @@ int _vroute_store(struct vroute* route)
 static
 int _vroute_tick(struct vroute* route)
 {
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     struct vroute_node_space* node_space = &route->node_space;
     vassert(route);
 
-    vlock_enter(&route->lock);
     node_space->ops->tick(node_space);
     recr_space->ops->timed_reap(recr_space);// reap all timeout records.
+    lookup_space->ops->timed_reap(lookup_space);
+    return 0;
+}
+
+static
+int _aux_route_msg_cb(void*, struct vmsg_usr*);
+
+/*
+ * the routine to attach a msger of another rpc shard, so that dht messages
+ * received by that shard are dispatched to route as well. responses to those
+ * messages go out through the same shard.
+ *
+ * @route:
+ * @msger:
+ */
+static
+int _vroute_add_shard(struct vroute* route, struct vmsger* msger)
+{
+    struct vroute_shard* shard = NULL;
+    int ret = 0;
+
+    vassert(route);
+    vassert(msger);
+
+    shard = (struct vroute_shard*)malloc(sizeof(*shard));
+    vlogEv((!shard), elog_malloc);
+    retE((!shard));
+    shard->route = route;
+    shard->msger = msger;
+
+    ret = msger->ops->add_cb(msger, shard, _aux_route_msg_cb, VMSG_DHT);
+    ret1E((ret < 0), free(shard));
+
+    // shard is referenced by msger from now on, and released with route.
+    vlock_enter(&route->lock);
+    varray_add_tail(&route->shards, shard);
     vlock_leave(&route->lock);
+
+    ret = msger->ops->add_cb(msger, shard, _aux_route_msg_cb, VMSG_DHT_BIN);
+    retE((ret < 0));
     return 0;
 }
 
+/*
+ * the routine to attach msger of tcp rpc, through which the messages too
+ * large for datagram are sent. dht messages received by tcp rpc are
+ * dispatched to route as shard.
+ *
+ * @route:
+ * @msger:
+ */
+static
+int _vroute_add_tcp(struct vroute* route, struct vmsger* msger)
+{
+    int ret = 0;
+
+    vassert(route);
+    vassert(msger);
+
+    ret = route->ops->add_shard(route, msger);
+    retE((ret < 0));
+    route->tcp_msger = msger;
+    return 0;
+}
+
+/*
+ * the routine to have rto thread woken up no later than @due, which is
+ * deadline of a query just sent.
+ *
+ * @route:
+ * @due: monotonic time in microseconds.
+ */
+static
+void _vroute_arm_rto(struct vroute* route, uint64_t due)
+{
+    struct itimerspec its;
+    int ret = 0;
+
+    vassert(route);
+    vassert(due);
+
+    vlock_enter(&route->rto_lock);
+    if ((route->rto_fd >= 0) && (!route->rto_due || (due < route->rto_due))) {
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec  = due / 1000000;
+        its.it_value.tv_nsec = (due % 1000000) * 1000;
+        ret = timerfd_settime(route->rto_fd, TFD_TIMER_ABSTIME, &its, NULL);
+        vlogEv((ret < 0), "timerfd_settime: %s", strerror(errno));
+        route->rto_due = (ret < 0) ? route->rto_due : due;
+    }
+    vlock_leave(&route->rto_lock);
+    return ;
+}
+
 /*
  * the routine to clean routing table
  *
@@ -238,17 +485,17 @@ static
 void _vroute_clear(struct vroute* route)
 {
     struct vroute_srvc_probe_helper* probe_helper = &route->probe_helper;
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     struct vroute_node_space* node_space = &route->node_space;
     struct vroute_srvc_space* srvc_space = &route->srvc_space;
     vassert(route);
 
-    vlock_enter(&route->lock);
     node_space->ops->clear(node_space);
     srvc_space->ops->clear(srvc_space);
     recr_space->ops->clear(recr_space);
+    lookup_space->ops->clear(lookup_space);
     probe_helper->ops->clear(probe_helper);
-    vlock_leave(&route->lock);
 
     return;
 }
@@ -262,13 +509,15 @@ void _vroute_dump(struct vroute* route)
 {
     struct vroute_node_space* node_space = &route->node_space;
     struct vroute_srvc_space* srvc_space = &route->srvc_space;
+    struct vroute_recr_space* recr_space = &route->recr_space;
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     vassert(route);
 
     vdump(printf("-> ROUTE"));
-    vlock_enter(&route->lock);
     node_space->ops->dump(node_space);
     srvc_space->ops->dump(srvc_space);
-    vlock_leave(&route->lock);
+    recr_space->ops->dump(recr_space);
+    lookup_space->ops->dump(lookup_space);
     vdump(printf("<- ROUTE"));
     return;
 }
@@ -286,6 +535,9 @@ struct vroute_ops route_ops = {
     .load          = _vroute_load,
     .store         = _vroute_store,
     .tick          = _vroute_tick,
+    .add_shard     = _vroute_add_shard,
+    .add_tcp       = _vroute_add_tcp,
+    .arm_rto       = _vroute_arm_rto,
     .clear         = _vroute_clear,
     .dump          = _vroute_dump
 };
@@ -300,6 +552,7 @@ struct vroute_ops route_ops = {
 static
 int _vroute_dht_ping(struct vroute* route, vnodeConn* conn)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -309,33 +562,88 @@ int _vroute_dht_ping(struct vroute* route, vnodeConn* conn)
     vassert(conn);
     retS((!(route->props & PROP_PING))); //ping disabled.
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->ping(&token, &route->myid, buf, vdht_buf_len());
+    // make token of query, with a record of it in case to check invality
+    // of response msg. it's made ahead of pushing since response might be
+    // received on another shard before push returns.
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_PING);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->ping(&token, &route->myid, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
     route->ops->inspect(route, &token, VROUTE_INSP_SND_PING);
-
-    // make a record according to the query, which will be used to
-    // check invality of response msg.
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @ping");
     return 0;
 }
 
 
+typedef int (*vroute_enc_nodei_t)(vtoken*, vnodeId*, vnodeInfo*, void*, int);
+
+/*
+ * the routine to encode response carrying info of local node from template,
+ * which is rebuilt first if node info changed since it was built.
+ *
+ * @route:
+ * @codec:
+ * @tmpl : template of response.
+ * @enc  : encoder of response.
+ * @token:
+ * @buf  :
+ * @sz   :
+ */
+static
+int _aux_route_enc_myself(
+        struct vroute* route,
+        struct vroute_codec* codec,
+        struct vroute_tmpl* tmpl,
+        vroute_enc_nodei_t enc,
+        vtoken* token,
+        void* buf,
+        int sz)
+{
+    struct vnode* node = route->node;
+    vnodeInfo_relax nodei;
+    uint32_t gen = 0;
+    int ret = 0;
+
+    vassert(route);
+    vassert(tmpl);
+    vassert(token);
+    vassert(buf);
+
+    // gen is read before node info, so any later change rebuilds it again.
+    gen = __atomic_load_n(&node->nodei_gen, __ATOMIC_ACQUIRE);
+    vlock_enter(&tmpl->lock);
+    if (!tmpl->len || (tmpl->gen != gen)) {
+        ret = node->ops->myself(node, &nodei);
+        ret1E((ret < 0), vlock_leave(&tmpl->lock));
+        ret = enc(token, &route->myid, (vnodeInfo*)&nodei, tmpl->data, VROUTE_TMPL_SZ);
+        ret1E((ret < 0), vlock_leave(&tmpl->lock));
+        tmpl->len = ret;
+        tmpl->gen = gen;
+    }
+    ret = tmpl->len;
+    ret1E((ret > sz), vlock_leave(&tmpl->lock));
+    memcpy(buf, tmpl->data, ret);
+    vlock_leave(&tmpl->lock);
+
+    retE((codec->enc_ops->set_token(buf, ret, token) < 0));
+    return ret;
+}
+
 /*
  * the routine to pack and send a response to @ping query back to source node
  * where the ping query was from.
@@ -347,6 +655,7 @@ int _vroute_dht_ping(struct vroute* route, vnodeConn* conn)
 static
 int _vroute_dht_ping_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, vnodeInfo* nodei)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -356,20 +665,25 @@ int _vroute_dht_ping_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, v
     vassert(nodei);
     retS((!(route->props & PROP_PING_R)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->ping_rsp(token, &route->myid, nodei, buf, vdht_buf_len());
+    if (nodei == (vnodeInfo*)&route->node->nodei) {
+        ret = _aux_route_enc_myself(route, codec, &codec->ping_rsp, codec->enc_ops->ping_rsp, token, buf, vdht_buf_len());
+    } else {
+        ret = codec->enc_ops->ping_rsp(token, &route->myid, nodei, buf, vdht_buf_len());
+    }
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @ping_rsp");
@@ -382,10 +696,12 @@ int _vroute_dht_ping_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, v
  * @route:
  * @conn:
  * @target
+ * @out: [out] token of query, if not NULL.
  */
 static
-int _vroute_dht_find_node(struct vroute* route, vnodeConn* conn, vnodeId* targetId)
+int _vroute_dht_find_node(struct vroute* route, vnodeConn* conn, vnodeId* targetId, vtoken* out)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -396,25 +712,29 @@ int _vroute_dht_find_node(struct vroute* route, vnodeConn* conn, vnodeId* target
     vassert(targetId);
     retS((!(route->props & PROP_FIND_NODE)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->find_node(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_FIND_NODE);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->find_node(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
+    if (out) {
+        vtoken_copy(out, &token);
+    }
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
     route->ops->inspect(route, &token, VROUTE_INSP_SND_FIND_NODE);
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @find_node");
     return 0;
 }
@@ -429,6 +749,7 @@ int _vroute_dht_find_node(struct vroute* route, vnodeConn* conn, vnodeId* target
 static
 int _vroute_dht_find_node_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, vnodeInfo* nodei)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -438,20 +759,25 @@ int _vroute_dht_find_node_rsp(struct vroute* route, vnodeConn* conn, vtoken* tok
     vassert(nodei);
     retS((!(route->props & PROP_FIND_NODE_R)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->find_node_rsp(token, &route->myid, nodei, buf, vdht_buf_len());
+    if (nodei == (vnodeInfo*)&route->node->nodei) {
+        ret = _aux_route_enc_myself(route, codec, &codec->find_node_rsp, codec->enc_ops->find_node_rsp, token, buf, vdht_buf_len());
+    } else {
+        ret = codec->enc_ops->find_node_rsp(token, &route->myid, nodei, buf, vdht_buf_len());
+    }
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @find_node_rsp");
@@ -467,6 +793,7 @@ int _vroute_dht_find_node_rsp(struct vroute* route, vnodeConn* conn, vtoken* tok
 static
 int _vroute_dht_find_closest_nodes(struct vroute* route, vnodeConn* conn, vnodeId* targetId)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -477,25 +804,26 @@ int _vroute_dht_find_closest_nodes(struct vroute* route, vnodeConn* conn, vnodeI
     vassert(targetId);
     retS((!(route->props & PROP_FIND_CLOSEST_NODES)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->find_closest_nodes(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_FIND_CLOSEST_NODES);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->find_closest_nodes(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
     route->ops->inspect(route, &token, VROUTE_INSP_SND_FIND_CLOSEST_NODES);
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @find_closest_nodes");
     return 0;
 }
@@ -510,6 +838,7 @@ int _vroute_dht_find_closest_nodes(struct vroute* route, vnodeConn* conn, vnodeI
 static
 int _vroute_dht_find_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, struct varray* closest)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -519,20 +848,21 @@ int _vroute_dht_find_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, vt
     vassert(closest);
     retS((!(route->props & PROP_FIND_CLOSEST_NODES_R)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->find_closest_nodes_rsp(token, &route->myid, closest, buf, vdht_buf_len());
+    ret = codec->enc_ops->find_closest_nodes_rsp(token, &route->myid, closest, buf, vdht_buf_len());
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @find_closest_nodes_rsp");
@@ -547,6 +877,7 @@ int _vroute_dht_find_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, vt
 static
 int _vroute_dht_reflex(struct vroute* route, vnodeConn* conn)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -555,25 +886,26 @@ int _vroute_dht_reflex(struct vroute* route, vnodeConn* conn)
     vassert(route);
     vassert(conn);
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->reflex(&token, &route->myid, buf, vdht_buf_len());
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_REFLEX);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->reflex(&token, &route->myid, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
     route->ops->inspect(route, &token, VROUTE_INSP_SND_REFLEX);
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @reflex");
     return 0;
 }
@@ -588,6 +920,7 @@ int _vroute_dht_reflex(struct vroute* route, vnodeConn* conn)
 static
 int _vroute_dht_reflex_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, struct sockaddr_in* reflexive_addr)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -596,20 +929,21 @@ int _vroute_dht_reflex_rsp(struct vroute* route, vnodeConn* conn, vtoken* token,
     vassert(token);
     vassert(reflexive_addr);
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->reflex_rsp(token, &route->myid, reflexive_addr, buf, vdht_buf_len());
+    ret = codec->enc_ops->reflex_rsp(token, &route->myid, reflexive_addr, buf, vdht_buf_len());
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @reflex_rsp");
@@ -625,6 +959,7 @@ int _vroute_dht_reflex_rsp(struct vroute* route, vnodeConn* conn, vtoken* token,
 static
 int _vroute_dht_probe(struct vroute* route, vnodeConn* conn, vnodeId* targetId)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -634,25 +969,26 @@ int _vroute_dht_probe(struct vroute* route, vnodeConn* conn, vnodeId* targetId)
     vassert(conn);
     vassert(targetId);
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->probe(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_PROBE);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->probe(&token, &route->myid, targetId, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
     route->ops->inspect(route, &token, VROUTE_INSP_SND_PROBE);
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @probe");
     return 0;
 }
@@ -666,6 +1002,7 @@ int _vroute_dht_probe(struct vroute* route, vnodeConn* conn, vnodeId* targetId)
 static
 int _vroute_dht_probe_rsp(struct vroute* route, vnodeConn* conn, vtoken* token)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -673,20 +1010,21 @@ int _vroute_dht_probe_rsp(struct vroute* route, vnodeConn* conn, vtoken* token)
     vassert(conn);
     vassert(token);
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->probe_rsp(token, &route->myid, buf, vdht_buf_len());
+    ret = codec->enc_ops->probe_rsp(token, &route->myid, buf, vdht_buf_len());
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @probe_rsp");
@@ -702,6 +1040,7 @@ int _vroute_dht_probe_rsp(struct vroute* route, vnodeConn* conn, vtoken* token)
 static
 int _vroute_dht_post_service(struct vroute* route, vnodeConn* conn, vsrvcInfo* srvci)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     vtoken token;
     int ret = 0;
@@ -711,21 +1050,22 @@ int _vroute_dht_post_service(struct vroute* route, vnodeConn* conn, vsrvcInfo* s
     vassert(srvci);
     retS((!(route->props & PROP_POST_SERVICE)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
     vtoken_make(&token);
-    ret = route->enc_ops->post_service(&token, &route->myid, srvci, buf, vdht_buf_len());
+    ret = codec->enc_ops->post_service(&token, &route->myid, srvci, buf, vdht_buf_len());
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @post_service");
@@ -737,10 +1077,12 @@ int _vroute_dht_post_service(struct vroute* route, vnodeConn* conn, vsrvcInfo* s
  * @route:
  * @conn:
  * @srvcId:
+ * @out: [out] token of query, if not NULL.
  */
 static
-int _vroute_dht_find_service(struct vroute* route, vnodeConn* conn, vsrvcHash* hash)
+int _vroute_dht_find_service(struct vroute* route, vnodeConn* conn, vsrvcHash* hash, vtoken* out)
 {
+    struct vroute_codec* codec = NULL;
     struct vroute_recr_space* recr_space = &route->recr_space;
     void* buf = NULL;
     vtoken token;
@@ -751,26 +1093,30 @@ int _vroute_dht_find_service(struct vroute* route, vnodeConn* conn, vsrvcHash* h
     vassert(hash);
     retS((!(route->props & PROP_FIND_SERVICE)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    vtoken_make(&token);
-    ret = route->enc_ops->find_service(&token, &route->myid, hash, buf, vdht_buf_len());
+    ret = recr_space->ops->make(recr_space, &token, &conn->remote, VDHT_FIND_SERVICE);
     ret1E((ret < 0), vdht_buf_free(buf));
+    ret = codec->enc_ops->find_service(&token, &route->myid, hash, buf, vdht_buf_len());
+    ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
+    if (out) {
+        vtoken_copy(out, &token);
+    }
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
-        ret1E((ret < 0), vdht_buf_free(buf));
+        ret = _aux_route_push(route, &msg);
+        ret2E((ret < 0), vdht_buf_free(buf), recr_space->ops->drop(recr_space, &token));
     }
 
     route->ops->inspect(route, &token, VROUTE_INSP_SND_FIND_SERVICE);
-    recr_space->ops->make(recr_space, &token);
     vlogD("send @find_service");
     return 0;
 }
@@ -785,6 +1131,7 @@ int _vroute_dht_find_service(struct vroute* route, vnodeConn* conn, vsrvcHash* h
 static
 int _vroute_dht_find_service_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, vsrvcInfo* srvc)
 {
+    struct vroute_codec* codec = NULL;
     void* buf = NULL;
     int ret = 0;
 
@@ -794,20 +1141,21 @@ int _vroute_dht_find_service_rsp(struct vroute* route, vnodeConn* conn, vtoken*
     vassert(srvc);
     retS((!(route->props & PROP_FIND_SERVICE_R)));
 
+    codec = _aux_route_codec(route, &conn->remote);
     buf = vdht_buf_alloc();
     retE((!buf));
 
-    ret = route->enc_ops->find_service_rsp(token, &route->myid, srvc, buf, vdht_buf_len());
+    ret = codec->enc_ops->find_service_rsp(token, &route->myid, srvc, buf, vdht_buf_len());
     ret1E((ret < 0), vdht_buf_free(buf));
     {
         struct vmsg_usr msg = {
             .addr  = to_vsockaddr_from_sin(&conn->remote),
             .spec  = to_vsockaddr_from_sin(&conn->local),
-            .msgId = VMSG_DHT,
+            .msgId = codec->msgId,
             .data  = buf,
             .len   = ret
         };
-        ret = route->msger->ops->push(route->msger, &msg);
+        ret = _aux_route_push(route, &msg);
         ret1E((ret < 0), vdht_buf_free(buf));
     }
     vlogD("send @find_service_rsp");
@@ -831,14 +1179,31 @@ struct vroute_dht_ops route_dht_ops = {
     .find_service_rsp       = _vroute_dht_find_service_rsp
 };
 
+/*
+ * to send @find_closest_nodes_rsp with nodes closest to @targetId in routing
+ * table, or nothing if no such nodes.
+ */
 static
-void _aux_vnodeInfo_free(void* item, void* cookie)
+int _aux_route_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, vtoken* token, vnodeId* targetId)
 {
-    vnodeInfo_relax* nodei = (vnodeInfo_relax*)item;
-    vassert(nodei);
+    struct vroute_node_space* node_space = &route->node_space;
+    vnodeInfo_relax nodes[MAX_CAPC];
+    struct varray closest;
+    int ret = 0;
+    int i = 0;
 
-    vnodeInfo_relax_free(nodei);
-    return ;
+    ret = node_space->ops->get_neighbors(node_space, targetId, nodes, MAX_CAPC);
+    retE((ret < 0));
+    retS((ret == 0)); // not response if no closest nodes found.
+
+    varray_init(&closest, MAX_CAPC);
+    for (i = 0; i < ret; i++) {
+        varray_add_tail(&closest, &nodes[i]);
+    }
+    ret = route->dht_ops->find_closest_nodes_rsp(route, conn, token, &closest);
+    varray_deinit(&closest);
+    retE((ret < 0));
+    return 0;
 }
 
 /* the routine to call when receiving a @ping query.
@@ -861,7 +1226,7 @@ int _vroute_cb_ping(struct vroute* route, vnodeConn* conn, void* ctxt)
     vassert(conn);
     vassert(ctxt);
 
-    ret =route->dec_ops->ping(ctxt, &token, &fromId);
+    ret = route_rcv_codec->dec_ops->ping(ctxt, &token, &fromId);
     retE((ret < 0));
 
     vnodeInfo_relax_init(&nodei_relax, &fromId, vnodeVer_unknown(), 0);
@@ -888,15 +1253,21 @@ int _vroute_cb_ping_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
     struct vroute_node_space* node_space = &route->node_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     vnodeInfo_relax nodei;
+    vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken  token;
     int ret = 0;
+    int rtt = 0;
 
-    ret = route->dec_ops->ping_rsp(ctxt, &token, (vnodeInfo*)&nodei);
+    ret = route_rcv_codec->dec_ops->ping_rsp(ctxt, &token, &fromId, (vnodeInfo*)&nodei);
     retE((ret < 0));
-    retE((!recr_space->ops->check(recr_space, &token))); // skip vicious response.
+    retE((!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_PING_R, &dest, &rtt))); // skip vicious response.
+    // a peer downgraded is forgotten, and gets bencode again.
+    _aux_route_learn_bin(route, &conn->remote, _aux_route_ver_bin(route, &nodei.ver));
 
     ret = node_space->ops->add_node(node_space, (vnodeInfo*)&nodei, 1);
     retE((ret < 0));
+    node_space->ops->sample_rtt(node_space, &fromId, &dest, rtt);
     route->ops->inspect(route, &token, VROUTE_INSP_RCV_PING_RSP);
     return 0;
 }
@@ -913,7 +1284,6 @@ int _vroute_cb_find_node(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
     struct vroute_node_space* node_space = &route->node_space;
     vnodeInfo_relax nodei;
-    struct varray closest;
     vnodeId targetId;
     vnodeId fromId;
     vtoken token;
@@ -923,8 +1293,13 @@ int _vroute_cb_find_node(struct vroute* route, vnodeConn* conn, void* ctxt)
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->find_node(ctxt, &token, &fromId, &targetId);
+    ret = route_rcv_codec->dec_ops->find_node(ctxt, &token, &fromId, &targetId);
     retE((ret < 0));
+    if (vtoken_equal(&targetId, &route->myid)) {
+        ret = route->dht_ops->find_node_rsp(route, conn, &token, (vnodeInfo*)&route->node->nodei);
+        retE((ret < 0));
+        return 0;
+    }
     ret = node_space->ops->get_node(node_space, &targetId, (vnodeInfo*)&nodei);
     retE((ret < 0));
     if (ret == 1) { //means found
@@ -934,16 +1309,7 @@ int _vroute_cb_find_node(struct vroute* route, vnodeConn* conn, void* ctxt)
     }
 
     // otherwise, send @find_closest_nodes_rsp response instead.
-    varray_init(&closest, MAX_CAPC);
-    ret = node_space->ops->get_neighbors(node_space, &targetId, &closest, MAX_CAPC);
-    ret1E((ret < 0), varray_deinit(&closest));
-    if (ret == 0) { //means no closest nodes.
-        varray_deinit(&closest);
-        return 0;
-    }
-    ret = route->dht_ops->find_closest_nodes_rsp(route, conn, &token, &closest);
-    varray_zero(&closest, _aux_vnodeInfo_free, NULL);
-    varray_deinit(&closest);
+    ret = _aux_route_closest_nodes_rsp(route, conn, &token, &targetId);
     retE((ret < 0));
     return 0;
 }
@@ -958,23 +1324,28 @@ int _vroute_cb_find_node(struct vroute* route, vnodeConn* conn, void* ctxt)
 static
 int _vroute_cb_find_node_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     struct vroute_node_space* node_space = &route->node_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     vnodeInfo_relax nodei;
     vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken  token;
     int ret = 0;
+    int rtt = 0;
 
     vassert(route);
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->find_node_rsp(ctxt, &token, &fromId, (vnodeInfo*)&nodei);
+    ret = route_rcv_codec->dec_ops->find_node_rsp(ctxt, &token, &fromId, (vnodeInfo*)&nodei);
     retE((ret < 0));
-    retE((!recr_space->ops->check(recr_space, &token)));
+    retE((!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_FIND_NODE_R, &dest, &rtt)));
+    node_space->ops->sample_rtt(node_space, &fromId, &dest, rtt);
 
     ret = node_space->ops->add_node(node_space, (vnodeInfo*)&nodei, 0);
     retE((ret < 0));
+    lookup_space->ops->found(lookup_space, &token, &nodei);
 
     route->ops->inspect(route, &token, VROUTE_INSP_RCV_FIND_NODE_RSP);
     return 0;
@@ -990,8 +1361,6 @@ int _vroute_cb_find_node_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
 static
 int _vroute_cb_find_closest_nodes(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
-    struct vroute_node_space* node_space = &route->node_space;
-    struct varray closest;
     vnodeId targetId;
     vnodeId fromId;
     vtoken  token;
@@ -1001,20 +1370,10 @@ int _vroute_cb_find_closest_nodes(struct vroute* route, vnodeConn* conn, void* c
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->find_closest_nodes(ctxt, &token, &fromId, &targetId);
+    ret = route_rcv_codec->dec_ops->find_closest_nodes(ctxt, &token, &fromId, &targetId);
     retE((ret < 0));
 
-    varray_init(&closest, MAX_CAPC);
-    ret = node_space->ops->get_neighbors(node_space, &targetId, &closest, MAX_CAPC);
-    ret1E((ret < 0), varray_deinit(&closest));
-    if (ret == 0) {
-        varray_deinit(&closest);
-        return 0; // not response if no closest nodes found.
-    }
-
-    ret = route->dht_ops->find_closest_nodes_rsp(route, conn, &token, &closest);
-    varray_zero(&closest, _aux_vnodeInfo_free, NULL);
-    varray_deinit(&closest);
+    ret = _aux_route_closest_nodes_rsp(route, conn, &token, &targetId);
     retE((ret < 0));
     return 0;
 }
@@ -1029,12 +1388,15 @@ int _vroute_cb_find_closest_nodes(struct vroute* route, vnodeConn* conn, void* c
 static
 int _vroute_cb_find_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     struct vroute_node_space* node_space = &route->node_space;
     struct varray closest;
     vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken  token;
     int ret = 0;
+    int rtt = 0;
     int i = 0;
 
     vassert(route);
@@ -1042,18 +1404,19 @@ int _vroute_cb_find_closest_nodes_rsp(struct vroute* route, vnodeConn* conn, voi
     vassert(ctxt);
 
     varray_init(&closest, MAX_CAPC);
-    ret = route->dec_ops->find_closest_nodes_rsp(ctxt, &token, &fromId, &closest);
+    // decoded nodes are owned by decoder till dec_done.
+    ret = route_rcv_codec->dec_ops->find_closest_nodes_rsp(ctxt, &token, &fromId, &closest);
     ret1E((ret < 0), varray_deinit(&closest));
-    if (!recr_space->ops->check(recr_space, &token)) {
-        varray_zero(&closest, _aux_vnodeInfo_free, NULL);
+    if (!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_FIND_CLOSEST_NODES_R, &dest, &rtt)) {
         varray_deinit(&closest);
         return -1;
     }
+    node_space->ops->sample_rtt(node_space, &fromId, &dest, rtt);
 
     for (i = 0; i < varray_size(&closest); i++) {
         node_space->ops->add_node(node_space, (vnodeInfo*)varray_get(&closest, i), 0);
     }
-    varray_zero(&closest, _aux_vnodeInfo_free, NULL);
+    lookup_space->ops->closest(lookup_space, &token, &closest);
     varray_deinit(&closest);
 
     route->ops->inspect(route, &token, VROUTE_INSP_RCV_FIND_CLOSEST_NODES_RSP);
@@ -1077,7 +1440,7 @@ int _vroute_cb_reflex(struct vroute* route, vnodeConn* conn, void* ctxt)
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->reflex(ctxt, &token, &fromId);
+    ret = route_rcv_codec->dec_ops->reflex(ctxt, &token, &fromId);
     retE((ret < 0));
 
     ret = route->dht_ops->reflex_rsp(route, conn, &token, &conn->remote);
@@ -1095,19 +1458,23 @@ static
 int _vroute_cb_reflex_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
     struct vroute_recr_space* recr_space = &route->recr_space;
+    struct vroute_node_space* node_space = &route->node_space;
     struct vnode* node = route->node;
     struct sockaddr_in reflexive_addr;
     vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken  token;
     int ret = 0;
+    int rtt = 0;
 
     vassert(route);
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->reflex_rsp(ctxt, &token, &fromId, &reflexive_addr);
+    ret = route_rcv_codec->dec_ops->reflex_rsp(ctxt, &token, &fromId, &reflexive_addr);
     retE((ret < 0));
-    retE((!recr_space->ops->check(recr_space, &token)));
+    retE((!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_REFLEX_R, &dest, &rtt)));
+    node_space->ops->sample_rtt(node_space, &fromId, &dest, rtt);
 
     ret = node->ops->reflex_addr(node, &conn->local, &reflexive_addr);
     retE((ret < 0));
@@ -1133,7 +1500,7 @@ int _vroute_cb_probe(struct vroute* route, vnodeConn* conn, void* ctxt)
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->probe(ctxt, &token, &fromId, &targetId);
+    ret = route_rcv_codec->dec_ops->probe(ctxt, &token, &fromId, &targetId);
     retE((ret < 0));
     retE((!vtoken_equal(&targetId, &route->myid)));
 
@@ -1154,16 +1521,19 @@ int _vroute_cb_probe_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
     struct vroute_recr_space* recr_space = &route->recr_space;
     struct vroute_node_space* node_space = &route->node_space;
     vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken  token;
     int ret = 0;
+    int rtt = 0;
 
     vassert(route);
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->probe_rsp(ctxt, &token, &fromId);
+    ret = route_rcv_codec->dec_ops->probe_rsp(ctxt, &token, &fromId);
     retE((ret < 0));
-    retE((!recr_space->ops->check(recr_space, &token)));
+    retE((!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_PROBE_R, &dest, &rtt)));
+    // no rtt sampled, since probe may go by other address than usual one.
 
     ret = node_space->ops->adjust_connectivity(node_space, &fromId, conn);
     retE((ret < 0));
@@ -1191,7 +1561,7 @@ int _vroute_cb_post_service(struct vroute* route, vnodeConn* conn, void* ctxt)
     vassert(conn);
     vassert(ctxt);
 
-    ret = route->dec_ops->post_service(ctxt, &token, &fromId, (vsrvcInfo*)&srvci);
+    ret = route_rcv_codec->dec_ops->post_service(ctxt, &token, &fromId, (vsrvcInfo*)&srvci);
     retE((ret < 0));
     ret = srvc_space->ops->add_service(srvc_space, (vsrvcInfo*)&srvci);
     retE((ret < 0));
@@ -1223,12 +1593,19 @@ int _vroute_cb_find_service(struct vroute* route, vnodeConn* conn, void* ctxt)
     memset(&srvci, 0, sizeof(srvci));
     srvci.capc = VSRVCINFO_MAX_ADDRS;
 
-    ret = route->dec_ops->find_service(ctxt, &token, &fromId, &srvcHash);
+    ret = route_rcv_codec->dec_ops->find_service(ctxt, &token, &fromId, &srvcHash);
     retE((ret < 0));
     ret = srvc_space->ops->get_service(srvc_space, &srvcHash, (vsrvcInfo*)&srvci);
     retE((ret < 0));
-    retS((ret == 0));
-    ret = route->dht_ops->find_service_rsp(route, conn, &token, (vsrvcInfo*)&srvci);
+    if (ret == 1) {
+        ret = route->dht_ops->find_service_rsp(route, conn, &token, (vsrvcInfo*)&srvci);
+        retE((ret < 0));
+        return 0;
+    }
+
+    // otherwise, send @find_closest_nodes_rsp response with nodes closer
+    // to service hash, so that lookup goes on with them.
+    ret = _aux_route_closest_nodes_rsp(route, conn, &token, &srvcHash);
     retE((ret < 0));
     return 0;
 }
@@ -1243,31 +1620,34 @@ int _vroute_cb_find_service(struct vroute* route, vnodeConn* conn, void* ctxt)
 static
 int _vroute_cb_find_service_rsp(struct vroute* route, vnodeConn* conn, void* ctxt)
 {
-    struct vroute_srvc_probe_helper* probe_helper = &route->probe_helper;
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
     struct vroute_srvc_space* srvc_space = &route->srvc_space;
     struct vroute_recr_space* recr_space = &route->recr_space;
     struct vroute_node_space* node_space = &route->node_space;
     vsrvcInfo_relax srvci;
     vnodeId fromId;
+    struct sockaddr_in dest;
     vtoken token;
     int ret = 0;
+    int rtt = 0;
 
     vassert(route);
     vassert(ctxt);
     vassert(conn);
 
-    ret = route->dec_ops->find_service_rsp(ctxt, &token, &fromId, (vsrvcInfo*)&srvci);
+    ret = route_rcv_codec->dec_ops->find_service_rsp(ctxt, &token, &fromId, (vsrvcInfo*)&srvci);
     retE((ret < 0));
-    retE((!recr_space->ops->check(recr_space, &token)));
+    retE((!recr_space->ops->check(recr_space, &token, &conn->remote, VDHT_FIND_SERVICE_R, &dest, &rtt)));
+    node_space->ops->sample_rtt(node_space, &fromId, &dest, rtt);
 
     ret = srvc_space->ops->add_service(srvc_space, (vsrvcInfo*)&srvci);
     retE((ret < 0));
 
     //try to add info of node hosting that service.
-    ret = node_space->ops->probe_node(node_space, &srvci.hostid);
+    ret = lookup_space->ops->start(lookup_space, VLOOKUP_NODE, &srvci.hostid, NULL, NULL);
     retE((ret < 0));
     route->ops->inspect(route, &token, VROUTE_INSP_RCV_FIND_SERVICE_RSP);
-    probe_helper->ops->invoke(probe_helper, &srvci.hash, (vsrvcInfo*)&srvci);
+    lookup_space->ops->found(lookup_space, &token, &srvci);
     return 0;
 }
 
@@ -1292,7 +1672,9 @@ vroute_dht_cb_t route_cb_ops[] = {
 static
 int _aux_route_msg_cb(void* cookie, struct vmsg_usr* mu)
 {
-    struct vroute* route = (struct vroute*)cookie;
+    struct vroute_shard* shard = (struct vroute_shard*)cookie;
+    struct vroute* route = shard->route;
+    struct vroute_codec* codec = NULL;
     vnodeConn conn;
     void* ctxt = NULL;
     int   ret  = 0;
@@ -1300,16 +1682,20 @@ int _aux_route_msg_cb(void* cookie, struct vmsg_usr* mu)
     vassert(route);
     vassert(mu);
 
-    ret = route->dec_ops->dec_begin(mu->data, mu->len, &ctxt);
+    codec = (mu->msgId == VMSG_DHT_BIN) ? &route->bin_codec : &route->codec;
+
+    ret = codec->dec_ops->dec_begin(mu->data, mu->len, &ctxt);
     retE((ret >= VDHT_UNKNOWN));
     retE((ret < 0));
     vlogD("received @%s", vdht_get_desc(ret));
 
     vnodeConn_set(&conn, to_sockaddr_sin(mu->spec), to_sockaddr_sin(mu->addr));
-    vlock_enter(&route->lock);
+    route_shard_msger = shard->msger;
+    route_rcv_codec = codec;
     ret = route->cb_ops[ret](route, &conn, ctxt);
-    vlock_leave(&route->lock);
-    route->dec_ops->dec_done(ctxt);
+    route_rcv_codec = NULL;
+    route_shard_msger = NULL;
+    codec->dec_ops->dec_done(ctxt);
     retE((ret < 0));
     return 0;
 }
@@ -1344,35 +1730,186 @@ int _aux_route_load_proto_caps(struct vconfig* cfg, uint32_t* props)
     return 0;
 }
 
+static
+void _aux_route_codec_init(struct vroute_codec* codec, int msgId, struct vdht_enc_ops* enc_ops, struct vdht_dec_ops* dec_ops)
+{
+    vassert(codec);
+
+    codec->msgId   = msgId;
+    codec->enc_ops = enc_ops;
+    codec->dec_ops = dec_ops;
+
+    vlock_init(&codec->ping_rsp.lock);
+    codec->ping_rsp.gen = 0;
+    codec->ping_rsp.len = 0;
+    vlock_init(&codec->find_node_rsp.lock);
+    codec->find_node_rsp.gen = 0;
+    codec->find_node_rsp.len = 0;
+    return ;
+}
+
+static
+void _aux_route_codec_deinit(struct vroute_codec* codec)
+{
+    vassert(codec);
+
+    vlock_deinit(&codec->ping_rsp.lock);
+    vlock_deinit(&codec->find_node_rsp.lock);
+    return ;
+}
+
+/*
+ * entry of rto thread, which retransmits pings and gives up queries of
+ * lookups that have timed out, and then sleeps till the earliest deadline
+ * of those still outstanding.
+ */
+static
+int _aux_route_rto_entry(void* cookie)
+{
+    struct vroute* route = (struct vroute*)cookie;
+    struct vroute_node_space* node_space = &route->node_space;
+    struct vroute_lookup_space* lookup_space = &route->lookup_space;
+    uint64_t expires = 0;
+    uint64_t next = 0;
+    uint64_t due  = 0;
+    int ret = 0;
+    vassert(route);
+
+    while (1) {
+        ret = read(route->rto_fd, &expires, sizeof(expires));
+        if ((ret < 0) && (errno == EINTR)) {
+            continue;
+        }
+        vlogEv((ret < 0), elog_read);
+        if (route->rto_quit || (ret < 0)) {
+            break;
+        }
+        // deadlines of queries sent from now on are armed again.
+        vlock_enter(&route->rto_lock);
+        route->rto_due = 0;
+        vlock_leave(&route->rto_lock);
+
+        next = node_space->ops->retry(node_space);
+        due  = lookup_space->ops->timed_reap(lookup_space);
+        next = (due && (!next || (due < next))) ? due : next;
+        if (next) {
+            route->ops->arm_rto(route, next);
+        }
+    }
+    return 0;
+}
+
+static
+int _aux_route_rto_init(struct vroute* route)
+{
+    int ret = 0;
+    vassert(route);
+
+    route->rto_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    vlogEv((route->rto_fd < 0), elog_timerfd_create);
+    retE((route->rto_fd < 0));
+    route->rto_due  = 0;
+    route->rto_quit = 0;
+    vlock_init(&route->rto_lock);
+
+    ret = vthread_init(&route->rto_thread, _aux_route_rto_entry, route);
+    vlogEv((ret < 0), elog_vthread_init);
+    if (ret < 0) {
+        vlock_deinit(&route->rto_lock);
+        close(route->rto_fd);
+        route->rto_fd = -1;
+        return -1;
+    }
+    vthread_start(&route->rto_thread);
+    return 0;
+}
+
+static
+void _aux_route_rto_deinit(struct vroute* route)
+{
+    int quit_code = 0;
+    vassert(route);
+
+    if (route->rto_fd < 0) {
+        return ;
+    }
+    route->rto_quit = 1;
+    route->ops->arm_rto(route, 1); // to wake it up at once.
+    vthread_join(&route->rto_thread, &quit_code);
+    vthread_deinit(&route->rto_thread);
+    vlock_deinit(&route->rto_lock);
+    close(route->rto_fd);
+    route->rto_fd = -1;
+    return ;
+}
+
+/*
+ * to release all set up by vroute_init() except rto thread.
+ */
+static
+void _aux_route_deinit(struct vroute* route)
+{
+    vassert(route);
+
+    vroute_lookup_space_deinit(&route->lookup_space);
+    vroute_srvc_probe_helper_deinit (&route->probe_helper);
+    vroute_recr_space_deinit(&route->recr_space);
+    vroute_node_space_deinit(&route->node_space);
+    vroute_srvc_space_deinit(&route->srvc_space);
+    while (varray_size(&route->shards) > 0) {
+        free(varray_pop_tail(&route->shards));
+    }
+    varray_deinit(&route->shards);
+    _aux_route_codec_deinit(&route->codec);
+    _aux_route_codec_deinit(&route->bin_codec);
+    vlock_deinit(&route->lock);
+    return ;
+}
+
 int vroute_init(struct vroute* route, struct vconfig* cfg, struct vhost* host, vnodeId* myid)
 {
+    int ret = 0;
     vassert(route);
     vassert(host);
     vassert(myid);
 
+    route->rto_fd = -1;
+    ret = vroute_recr_space_init(&route->recr_space, cfg);
+    retE((ret < 0));
+
     vtoken_copy(&route->myid, myid);
     _aux_route_load_proto_caps(cfg, &route->props);
 
     vlock_init(&route->lock);
+    varray_init(&route->shards, 4);
     vroute_node_space_init(&route->node_space, route, cfg, myid);
     vroute_srvc_space_init(&route->srvc_space, cfg);
-    vroute_recr_space_init(&route->recr_space);
     vroute_srvc_probe_helper_init(&route->probe_helper);
+    vroute_lookup_space_init(&route->lookup_space, route);
 
     route->ops     = &route_ops;
     route->dht_ops = &route_dht_ops;
     route->cb_ops  = route_cb_ops;
-    route->enc_ops = &dht_enc_ops;
-    route->dec_ops = &dht_dec_ops;
+
+    _aux_route_codec_init(&route->codec, VMSG_DHT, &dht_enc_ops, &dht_dec_ops);
+    _aux_route_codec_init(&route->bin_codec, VMSG_DHT_BIN, &dht_bin_enc_ops, &dht_bin_dec_ops);
+    route->bin_on = cfg->ext_ops->get_dht_bin(cfg);
+    vnodeVer_unstrlize(VDHT_BIN_VER, &route->bin_ver);
+    memset(route->bin_peers, 0, sizeof(route->bin_peers));
+    memset(route->bin_seen,  0, sizeof(route->bin_seen));
 
     route->cfg   = cfg;
     route->msger = &host->msger;
+    route->tcp_msger = NULL;
     route->node  = &host->node;
 
     route->insp_cb = NULL;
     route->insp_cookie = NULL;
 
-    route->msger->ops->add_cb(route->msger, route, _aux_route_msg_cb, VMSG_DHT);
+    route->ops->add_shard(route, route->msger);
+
+    ret = _aux_route_rto_init(route);
+    ret1E((ret < 0), _aux_route_deinit(route));
     return 0;
 }
 
@@ -1380,11 +1917,8 @@ void vroute_deinit(struct vroute* route)
 {
     vassert(route);
 
-    vroute_srvc_probe_helper_deinit (&route->probe_helper);
-    vroute_recr_space_deinit(&route->recr_space);
-    vroute_node_space_deinit(&route->node_space);
-    vroute_srvc_space_deinit(&route->srvc_space);
-    vlock_deinit(&route->lock);
+    _aux_route_rto_deinit(route);
+    _aux_route_deinit(route);
     return ;
 }
 
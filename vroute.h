@@ -39,31 +39,70 @@ struct vhost;
 struct vroute;
 struct vroute_recr_space;
 struct vroute_recr_space_ops {
-    int  (*make)         (struct vroute_recr_space*, vtoken*);
-    int  (*check)        (struct vroute_recr_space*, vtoken*);
+    int  (*make)         (struct vroute_recr_space*, vtoken*, struct sockaddr_in*, int);
+    void (*drop)         (struct vroute_recr_space*, vtoken*);
+    int  (*check)        (struct vroute_recr_space*, vtoken*, struct sockaddr_in*, int, struct sockaddr_in*, int*);
     void (*timed_reap)   (struct vroute_recr_space*);
     void (*clear)        (struct vroute_recr_space*);
     void (*dump)         (struct vroute_recr_space*);
 };
 
+#define VRECR_CAPC    ((int)4096)  // max records of queries outstanding.
+#define VRECR_NSLOTS  ((int)8)     // slots of timing wheel, one per second.
+#define VRECR_KEY_PERIOD ((int)60) // seconds of each key for mac tokens.
+
+struct vrecord;
 struct vroute_recr_space {
     int max_recr_period;
-    struct varray records; //has all dht query(but not received rsp yet) records;
+    struct vrecord* records; //pool of dht query(but not received rsp yet) records;
+    int*   table;            //open-addressing table of records by token.
+    int    free_idx;
+    int    wheel[VRECR_NSLOTS];
+    time_t wheel_ts[VRECR_NSLOTS];
+    struct vlock lock;
+
+    // with "dht.mac_token" on, token of query is mac of its peer, dhtId
+    // and time, so nothing is recorded.
+    int      mac_on;
+    uint64_t keys[2][2];     // keys of current and previous epoch.
+    uint32_t key_epoch;
+    uint64_t nonce;
+
+    int      nrecords;       // outstanding.
+    uint32_t nmatched;
+    uint32_t nexpired;
+    uint32_t nrejected;
+    uint32_t nfulls;         // queries not sent for pool used up.
 
     struct vroute_recr_space_ops* ops;
 };
 
-int  vroute_recr_space_init  (struct vroute_recr_space*);
+int  vroute_recr_space_init  (struct vroute_recr_space*, struct vconfig*);
 void vroute_recr_space_deinit(struct vroute_recr_space*);
 
 /*
  * for node space
  */
+/*
+ * round trip time of each peer is estimated from responses to queries sent
+ * to it as rfc6298, in microseconds, and retransmission timeout of pings to
+ * it is derived from the estimate. retransmitted queries are never sampled,
+ * since each has a token of its own.
+ */
+#define VPEER_RTO_INIT   ((int)1000000)  // before first sample.
+#define VPEER_RTO_MIN    ((int)50000)
+#define VPEER_RTO_MAX    ((int)5000000)
+#define VPEER_RTT_SLOW   ((int)500000)   // slower peers are ranked behind.
+
 struct vpeer {
     vnodeConn  conn;
     vnodeInfo* nodei;
     time_t snd_ts;
     time_t rcv_ts;
+    uint64_t snd_us;    // monotonic time of last ping.
+    int srtt;
+    int rttvar;
+    int rto;
     int ntries;
     int nprobes;
 };
@@ -73,16 +112,17 @@ struct vroute_node_space;
 struct vroute_node_space_ops {
     int  (*add_node)     (struct vroute_node_space*, vnodeInfo*, int);
     int  (*get_node)     (struct vroute_node_space*, vnodeId*, vnodeInfo*);
-    int  (*get_neighbors)(struct vroute_node_space*, vnodeId*, struct varray*, int);
-    int  (*probe_node)   (struct vroute_node_space*, vnodeId*);
+    int  (*get_neighbors)(struct vroute_node_space*, vnodeId*, vnodeInfo_relax*, int);
+    void (*sample_rtt)   (struct vroute_node_space*, vnodeId*, struct sockaddr_in*, int);
+    int  (*get_rto)      (struct vroute_node_space*, vnodeId*);
     int  (*air_service)  (struct vroute_node_space*, void*);
-    int  (*probe_service)(struct vroute_node_space*, vsrvcHash*);
     int  (*reflex_addr)  (struct vroute_node_space*, struct sockaddr_in*);
     int  (*adjust_connectivity)
                          (struct vroute_node_space*, vnodeId*, vnodeConn*);
     int  (*probe_connectivity)
                          (struct vroute_node_space*, struct sockaddr_in*);
     int  (*tick)         (struct vroute_node_space*);
+    uint64_t (*retry)    (struct vroute_node_space*);
     int  (*load)         (struct vroute_node_space*);
     int  (*store)        (struct vroute_node_space*);
     void (*clear)        (struct vroute_node_space*);
@@ -102,8 +142,12 @@ struct vroute_node_space {
     struct vroute* route;
     struct vroute_node_space_bucket {
         struct varray peers;
+        struct vlock  lock;
         time_t ts;
     } bucket[NBUCKETS];
+    // bitmap of buckets with pings outstanding, for @retry to visit only.
+    // bits are set and cleared with lock of bucket held.
+    uint32_t pending[(NBUCKETS + 31) / 32];
     struct vroute_node_space_ops* ops;
 };
 
@@ -132,6 +176,7 @@ struct vroute_srvc_space {
     int bucket_sz;
     struct vroute_srvc_space_bucket {
         struct varray srvcs;
+        struct vlock  lock;
     } bucket[NBUCKETS];
     struct vroute_srvc_space_ops* ops;
 };
@@ -152,12 +197,58 @@ struct vroute_srvc_probe_helper_ops {
 
 struct vroute_srvc_probe_helper {
     struct varray items;
+    struct vlock  lock;
     struct vroute_srvc_probe_helper_ops* ops;
 };
 
 int  vroute_srvc_probe_helper_init  (struct vroute_srvc_probe_helper*);
 void vroute_srvc_probe_helper_deinit(struct vroute_srvc_probe_helper*);
 
+/*
+ * for lookup space, where iterative lookups of nodes or services run. each
+ * lookup keeps a shortlist of nodes closest to target known so far, and has
+ * at most VLOOKUP_ALPHA queries outstanding, narrowing toward target with
+ * nodes from each @find_closest_nodes_rsp. it ends when target is found, or
+ * VLOOKUP_K closest nodes in shortlist have all answered or timed out. a
+ * query times out after retransmission timeout of peer queried.
+ */
+#define VLOOKUP_K        ((int)8)
+#define VLOOKUP_ALPHA    ((int)3)
+#define VLOOKUP_CANDS    ((int)(2*VLOOKUP_K))
+#define VLOOKUP_MAX_QRYS ((int)(4*VLOOKUP_K))
+
+enum {
+    VLOOKUP_NODE,   // by @find_node, for info of node.
+    VLOOKUP_SRVC    // by @find_service, for info of service.
+};
+
+/*
+ * callback to call when lookup ends, with vnodeInfo or vsrvcInfo found,
+ * or NULL if not found.
+ */
+typedef void (*vroute_lookup_t)(struct vroute*, vtoken*, void*, void*);
+
+struct vroute_lookup_space;
+struct vroute_lookup_space_ops {
+    int  (*start)        (struct vroute_lookup_space*, int, vtoken*, vroute_lookup_t, void*);
+    int  (*found)        (struct vroute_lookup_space*, vtoken*, void*);
+    int  (*closest)      (struct vroute_lookup_space*, vtoken*, struct varray*);
+    uint64_t (*timed_reap)(struct vroute_lookup_space*);
+    void (*clear)        (struct vroute_lookup_space*);
+    void (*dump)         (struct vroute_lookup_space*);
+};
+
+struct vroute_lookup_space {
+    struct vroute* route;
+    struct varray  lookups;
+    struct vlock   lock;
+
+    struct vroute_lookup_space_ops* ops;
+};
+
+int  vroute_lookup_space_init  (struct vroute_lookup_space*, struct vroute*);
+void vroute_lookup_space_deinit(struct vroute_lookup_space*);
+
 /*
  * for inspection
  */
@@ -209,6 +300,9 @@ struct vroute_ops {
     int  (*load)         (struct vroute*);
     int  (*store)        (struct vroute*);
     int  (*tick)         (struct vroute*);
+    int  (*add_shard)    (struct vroute*, struct vmsger*);
+    int  (*add_tcp)      (struct vroute*, struct vmsger*);
+    void (*arm_rto)      (struct vroute*, uint64_t);
     void (*clear)        (struct vroute*);
     void (*dump)         (struct vroute*);
 };
@@ -216,7 +310,7 @@ struct vroute_ops {
 struct vroute_dht_ops {
     int (*ping)          (struct vroute*, vnodeConn*);
     int (*ping_rsp)      (struct vroute*, vnodeConn*, vtoken*, vnodeInfo*);
-    int (*find_node)     (struct vroute*, vnodeConn*, vnodeId*);
+    int (*find_node)     (struct vroute*, vnodeConn*, vnodeId*, vtoken*);
     int (*find_node_rsp) (struct vroute*, vnodeConn*, vtoken*, vnodeInfo*);
     int (*find_closest_nodes)
                          (struct vroute*, vnodeConn*, vnodeId*);
@@ -227,11 +321,42 @@ struct vroute_dht_ops {
     int (*probe)         (struct vroute*, vnodeConn*, vnodeId*);
     int (*probe_rsp)     (struct vroute*, vnodeConn*, vtoken*);
     int (*post_service)  (struct vroute*, vnodeConn*, vsrvcInfo*);
-    int (*find_service)  (struct vroute*, vnodeConn*, vsrvcHash*);
+    int (*find_service)  (struct vroute*, vnodeConn*, vsrvcHash*, vtoken*);
     int (*find_service_rsp)
                          (struct vroute*, vnodeConn*, vtoken*, vsrvcInfo*);
 };
 
+/*
+ * response carrying info of local node, encoded once as template and then
+ * copied with token set for each msg. it's rebuilt only when @nodei_gen
+ * of vnode moves.
+ */
+#define VROUTE_TMPL_SZ ((int)BUF_SZ)
+struct vroute_tmpl {
+    struct vlock lock;
+    uint32_t gen;
+    int  len;   // 0 means not built yet.
+    char data[VROUTE_TMPL_SZ];
+};
+
+/*
+ * codec of dht msgs, either bencode understood by every node, or compact
+ * binary one spoken by nodes of VDHT_BIN_VER or later.
+ */
+struct vroute_codec {
+    int msgId;
+    struct vdht_enc_ops* enc_ops;
+    struct vdht_dec_ops* dec_ops;
+
+    struct vroute_tmpl ping_rsp;
+    struct vroute_tmpl find_node_rsp;
+};
+
+#define VROUTE_RTO_GRAN   ((int)20)   // milliseconds, clock granularity of rfc6298.
+#define VROUTE_BIN_PEERS  ((int)1024)
+#define VROUTE_BIN_PROBES ((int)16)
+#define VROUTE_BIN_TMO    ((int)600)  // seconds, refreshed by ping_rsp.
+
 typedef int (*vroute_dht_cb_t)(struct vroute*, vnodeConn*, void*);
 struct vroute {
     vnodeId  myid;
@@ -241,17 +366,47 @@ struct vroute {
     struct vroute_srvc_space srvc_space;
     struct vroute_recr_space recr_space;
     struct vroute_srvc_probe_helper probe_helper;
+    struct vroute_lookup_space lookup_space;
 
-    struct vlock lock;
+    /*
+     * each space is guarded by its own locks (per bucket for node and
+     * service spaces), so that dht messages from different shards can be
+     * processed in parallel. @lock only guards inspection callback.
+     */
+    struct vlock  lock;
+    struct varray shards;
+
+    /*
+     * thread to retransmit pings and give up lookup queries timed out. it
+     * sleeps on a monotonic timerfd, which is armed at earliest deadline of
+     * queries outstanding, and left disarmed when there is none.
+     */
+    struct vthread rto_thread;
+    struct vlock rto_lock;
+    int rto_fd;
+    int rto_quit;
+    uint64_t rto_due;   // monotonic microseconds armed at, 0 if disarmed.
 
     struct vroute_ops*     ops;
     struct vroute_dht_ops* dht_ops;
     vroute_dht_cb_t*       cb_ops;
-    struct vdht_enc_ops*   enc_ops;
-    struct vdht_dec_ops*   dec_ops;
+    struct vroute_codec    codec;
+    struct vroute_codec    bin_codec;
+
+    /*
+     * addresses of peers known to speak binary msgs, learned from versions
+     * in their verified ping responses. slots are only ever taken by CAS,
+     * so lookups are lock-free. entries expire unless refreshed, and peers
+     * beyond capacity of live ones stay bencode.
+     */
+    int bin_on;
+    vnodeVer bin_ver;
+    uint64_t bin_peers[VROUTE_BIN_PEERS];
+    uint32_t bin_seen [VROUTE_BIN_PEERS]; // when learned, 0 if forgotten.
 
     struct vconfig* cfg;
     struct vmsger*  msger;
+    struct vmsger*  tcp_msger; // for msgs too large for datagram, maybe NULL.
     struct vnode*   node;
 
     /*
@@ -64,6 +64,7 @@ int _vroute_srvc_probe_helper_add(struct vroute_srvc_probe_helper* probe_helper,
     vassert(hash);
     vassert(ncb);
 
+    vlock_enter(&probe_helper->lock);
     for (i = 0; i < varray_size(&probe_helper->items); i++) {
         probe_item = (struct vroute_srvc_probe_item*)varray_get(&probe_helper->items, i);
         if (vtoken_equal(&probe_item->hash, hash) &&
@@ -76,11 +77,13 @@ int _vroute_srvc_probe_helper_add(struct vroute_srvc_probe_helper* probe_helper,
     if (!found) {
         probe_item = vroute_srvc_probe_item_alloc();
         if (!probe_item) {
+            vlock_leave(&probe_helper->lock);
             return -1;
         }
         vroute_srvc_probe_item_init(probe_item, hash, ncb, icb, cookie);
         varray_add_tail(&probe_helper->items, probe_item);
     }
+    vlock_leave(&probe_helper->lock);
     return 0;
 }
 
@@ -95,16 +98,22 @@ int _vroute_srvc_probe_helper_invoke(struct vroute_srvc_probe_helper* probe_help
     vassert(hash);
     vassert(srvci);
 
-    for (i = 0; i < varray_size(&probe_helper->items); i++) {
+    vlock_enter(&probe_helper->lock);
+    for (i = 0; i < varray_size(&probe_helper->items);) {
         probe_item = (struct vroute_srvc_probe_item*)varray_get(&probe_helper->items, i);
-        if (vtoken_equal(&probe_item->hash, hash)) {
-            probe_item->ncb(hash, srvci->naddrs, VPROTO_UDP, probe_item->cookie);
-            for (j = 0; j < srvci->naddrs; j++) {
-                probe_item->icb(hash, &srvci->addrs[j], (j+1)== srvci->naddrs, probe_item->cookie);
-            }
-            varray_del(&probe_helper->items, i);
+        if (!vtoken_equal(&probe_item->hash, hash)) {
+            i++;
+            continue;
+        }
+        // no address passed if service not found.
+        probe_item->ncb(hash, srvci->naddrs, srvci->naddrs ? VPROTO_UDP : VPROTO_UNKNOWN, probe_item->cookie);
+        for (j = 0; j < srvci->naddrs; j++) {
+            probe_item->icb(hash, &srvci->addrs[j], (j+1)== srvci->naddrs, probe_item->cookie);
         }
+        varray_del(&probe_helper->items, i);
+        vroute_srvc_probe_item_free(probe_item);
     }
+    vlock_leave(&probe_helper->lock);
     return 0;
 }
 
@@ -114,10 +123,12 @@ void _vroute_srvc_probe_helper_clear(struct vroute_srvc_probe_helper* probe_help
     struct vroute_srvc_probe_item* probe_item = NULL;
     vassert(probe_helper);
 
+    vlock_enter(&probe_helper->lock);
     while (varray_size(&probe_helper->items)) {
         probe_item = (struct vroute_srvc_probe_item*)varray_pop_tail(&probe_helper->items);
         vroute_srvc_probe_item_free(probe_item);
     }
+    vlock_leave(&probe_helper->lock);
     return ;
 }
 
@@ -143,6 +154,7 @@ int vroute_srvc_probe_helper_init(struct vroute_srvc_probe_helper* probe_helper)
     vassert(probe_helper);
 
     varray_init(&probe_helper->items, 4);
+    vlock_init(&probe_helper->lock);
     probe_helper->ops = &route_srvc_probe_helper_ops;
     return 0;
 }
@@ -152,6 +164,8 @@ void vroute_srvc_probe_helper_deinit(struct vroute_srvc_probe_helper* probe_help
     vassert(probe_helper);
 
     probe_helper->ops->clear(probe_helper);
+    varray_deinit(&probe_helper->items);
+    vlock_deinit(&probe_helper->lock);
     return;
 }
 
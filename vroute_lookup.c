@@ -0,0 +1,664 @@
+#include "vglobal.h"
+#include "vroute.h"
+
+enum {
+    VLOOKUP_CAND_NEW,
+    VLOOKUP_CAND_WAIT,      // queried, waiting for response.
+    VLOOKUP_CAND_DONE,      // responded.
+    VLOOKUP_CAND_FAILED     // timed out, or failed to query.
+};
+
+struct vlookup_cand {
+    vnodeId     id;
+    vnodeMetric dist;       // distance to target.
+    vnodeConn   conn;
+    vtoken      token;      // token of query sent to it.
+    uint64_t    snd_us;
+    int         rto;        // microseconds to wait for response.
+    int         state;
+};
+
+struct vlookup {
+    int    kind;
+    vtoken target;
+    vroute_lookup_t cb;
+    void*  cookie;
+    uint32_t serial;        // to tell it from lookup reusing its memory.
+
+    int    nqueries;
+    int    ncands;
+    struct vlookup_cand cands[VLOOKUP_CANDS]; // in ascending order of distance.
+};
+
+/*
+ * query decided by stepping lookup with lock of space held, which is sent
+ * after leaving the lock.
+ */
+struct vlookup_qry {
+    struct vlookup* lookup;
+    uint32_t  serial;
+    int       kind;
+    vtoken    target;
+    vnodeId   id;
+    vnodeConn conn;
+};
+
+static uint32_t lookup_serial = 0;
+
+static MEM_AUX_INIT(lookup_cache, sizeof(struct vlookup), 0);
+static
+struct vlookup* vlookup_alloc(void)
+{
+    struct vlookup* lookup = NULL;
+
+    lookup = (struct vlookup*)vmem_aux_alloc(&lookup_cache);
+    vlogEv((!lookup), elog_vmem_aux_alloc);
+    retE_p((!lookup));
+    memset(lookup, 0, sizeof(*lookup));
+    return lookup;
+}
+
+static
+void vlookup_free(struct vlookup* lookup)
+{
+    vassert(lookup);
+    vmem_aux_free(&lookup_cache, lookup);
+    return ;
+}
+
+static
+void vlookup_init(struct vlookup* lookup, int kind, vtoken* target, vroute_lookup_t cb, void* cookie)
+{
+    vassert(lookup);
+    vassert(target);
+
+    lookup->kind = kind;
+    vtoken_copy(&lookup->target, target);
+    lookup->cb = cb;
+    lookup->cookie = cookie;
+    lookup->serial = __atomic_add_fetch(&lookup_serial, 1, __ATOMIC_RELAXED);
+    lookup->nqueries = 0;
+    lookup->ncands = 0;
+    return ;
+}
+
+static MEM_AUX_INIT(qry_cache, sizeof(struct vlookup_qry), 0);
+static
+struct vlookup_qry* vlookup_qry_alloc(void)
+{
+    struct vlookup_qry* qry = NULL;
+
+    qry = (struct vlookup_qry*)vmem_aux_alloc(&qry_cache);
+    vlogEv((!qry), elog_vmem_aux_alloc);
+    retE_p((!qry));
+    return qry;
+}
+
+static
+void vlookup_qry_free(struct vlookup_qry* qry)
+{
+    vassert(qry);
+    vmem_aux_free(&qry_cache, qry);
+    return ;
+}
+
+static
+void vlookup_dump(struct vlookup* lookup)
+{
+    int nwaits = 0;
+    int i = 0;
+    vassert(lookup);
+
+    for (i = 0; i < lookup->ncands; i++) {
+        nwaits += (lookup->cands[i].state == VLOOKUP_CAND_WAIT);
+    }
+    vtoken_dump(&lookup->target);
+    printf(" kind:%s, candidates:%d, waiting:%d, queries:%d",
+            (lookup->kind == VLOOKUP_NODE) ? "node" : "service",
+            lookup->ncands, nwaits, lookup->nqueries);
+    return ;
+}
+
+/*
+ * to add node to shortlist of lookup in order of distance to target. when
+ * shortlist is full, it replaces the farthest one unless it's the farthest
+ * or the farthest one is still being waited for.
+ *
+ * @space:
+ * @lookup:
+ * @nodei:
+ */
+static
+void _aux_lookup_add_cand(struct vroute_lookup_space* space, struct vlookup* lookup, vnodeInfo* nodei)
+{
+    struct vroute* route = space->route;
+    struct vlookup_cand* cand = NULL;
+    vnodeMetric dist;
+    int pos = 0;
+    int i = 0;
+
+    if ((nodei->naddrs <= 0) || vtoken_equal(&nodei->id, &route->myid)) {
+        return ;
+    }
+    if (vtoken_equal(&nodei->ver, vnodeVer_unknown())) {
+        return ;
+    }
+    for (i = 0; i < lookup->ncands; i++) {
+        if (vtoken_equal(&lookup->cands[i].id, &nodei->id)) {
+            return ;
+        }
+    }
+
+    vnodeId_dist(&nodei->id, &lookup->target, &dist);
+    for (pos = 0; pos < lookup->ncands; pos++) {
+        if (vnodeMetric_cmp(&dist, &lookup->cands[pos].dist) > 0) {
+            break;
+        }
+    }
+    if (lookup->ncands >= VLOOKUP_CANDS) {
+        if ((pos >= lookup->ncands) ||
+            (lookup->cands[lookup->ncands-1].state == VLOOKUP_CAND_WAIT)) {
+            return ;
+        }
+        lookup->ncands--;
+    }
+    memmove(&lookup->cands[pos+1], &lookup->cands[pos], (lookup->ncands - pos) * sizeof(*cand));
+    lookup->ncands++;
+
+    cand = &lookup->cands[pos];
+    memset(cand, 0, sizeof(*cand));
+    vtoken_copy(&cand->id, &nodei->id);
+    vtoken_copy(&cand->dist, &dist);
+    vnodeConn_set(&cand->conn, &route->node_space.zaddr, &nodei->addrs[nodei->naddrs-1]);
+    cand->state = VLOOKUP_CAND_NEW;
+    return ;
+}
+
+static
+int _aux_lookup_query(struct vroute_lookup_space* space, struct vlookup_qry* qry, vtoken* token)
+{
+    struct vroute* route = space->route;
+    int ret = 0;
+
+    if (qry->kind == VLOOKUP_NODE) {
+        retE((!(route->props & PROP_FIND_NODE)));
+        ret = route->dht_ops->find_node(route, &qry->conn, &qry->target, token);
+    } else {
+        retE((!(route->props & PROP_FIND_SERVICE)));
+        ret = route->dht_ops->find_service(route, &qry->conn, &qry->target, token);
+    }
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * to advance lookup: queries that timed out are given up, and then closest
+ * nodes not queried yet are picked to query, keeping at most VLOOKUP_ALPHA
+ * queries outstanding. it must be called with lock of space held, and the
+ * queries picked are added to @qrys, to be sent by _aux_lookup_send() after
+ * leaving the lock.
+ *
+ * @space:
+ * @lookup:
+ * @now: monotonic time in microseconds.
+ * @qrys: [out] queries to send.
+ *
+ * return 1 if lookup ends, for VLOOKUP_K closest nodes having all answered
+ * or too many queries sent.
+ */
+static
+int _aux_lookup_step(struct vroute_lookup_space* space, struct vlookup* lookup, uint64_t now, struct varray* qrys)
+{
+    struct vlookup_cand* cand = NULL;
+    struct vlookup_qry*  qry  = NULL;
+    int nclosest = 0;
+    int nwaits = 0;
+    int i = 0;
+
+    vassert(space);
+
+    for (i = 0; i < lookup->ncands; i++) {
+        cand = &lookup->cands[i];
+        if ((cand->state == VLOOKUP_CAND_WAIT) && ((now - cand->snd_us) > (uint64_t)cand->rto)) {
+            cand->state = VLOOKUP_CAND_FAILED;
+        }
+        nwaits += (cand->state == VLOOKUP_CAND_WAIT);
+    }
+
+    for (i = 0; (i < lookup->ncands) && (nclosest < VLOOKUP_K); i++) {
+        cand = &lookup->cands[i];
+        if (cand->state == VLOOKUP_CAND_FAILED) {
+            continue;
+        }
+        nclosest++;
+        if ((cand->state != VLOOKUP_CAND_NEW) ||
+            (nwaits >= VLOOKUP_ALPHA) ||
+            (lookup->nqueries >= VLOOKUP_MAX_QRYS)) {
+            continue;
+        }
+        qry = vlookup_qry_alloc();
+        if (!qry) {
+            cand->state = VLOOKUP_CAND_FAILED;
+            nclosest--;
+            continue;
+        }
+        qry->lookup = lookup;
+        qry->serial = lookup->serial;
+        qry->kind   = lookup->kind;
+        vtoken_copy(&qry->target, &lookup->target);
+        vtoken_copy(&qry->id, &cand->id);
+        qry->conn   = cand->conn;
+        varray_add_tail(qrys, qry);
+
+        // token and rto are known once it's sent.
+        cand->state  = VLOOKUP_CAND_WAIT;
+        cand->snd_us = now;
+        cand->rto    = VPEER_RTO_MAX;
+        memset(&cand->token, 0, sizeof(cand->token));
+        lookup->nqueries++;
+        nwaits++;
+    }
+    return (nwaits == 0);
+}
+
+/*
+ * to send queries picked by _aux_lookup_step(), and then to record token
+ * and rto of each query to its candidate, if lookup is still going on. a
+ * response can hardly arrive before its token is recorded; if it does,
+ * it's taken as one not for lookup, and the candidate times out. rto thread
+ * is armed at deadline of each query, or at once if it failed to be sent.
+ * it must be called without lock of space held.
+ *
+ * @space:
+ * @qrys: queries to send, which are freed.
+ */
+static
+void _aux_lookup_send(struct vroute_lookup_space* space, struct varray* qrys)
+{
+    struct vroute_node_space* node_space = &space->route->node_space;
+    struct vroute* route = space->route;
+    struct vlookup_cand* cand = NULL;
+    struct vlookup_qry*  qry  = NULL;
+    struct vlookup* lookup = NULL;
+    uint64_t due = 0;
+    vtoken token;
+    int rto = 0;
+    int ret = 0;
+    int i = 0;
+    int j = 0;
+
+    while (varray_size(qrys) > 0) {
+        qry = (struct vlookup_qry*)varray_pop_tail(qrys);
+        ret = _aux_lookup_query(space, qry, &token);
+        rto = (ret < 0) ? 0 : node_space->ops->get_rto(node_space, &qry->id);
+        due = 0;
+
+        vlock_enter(&space->lock);
+        for (i = 0; i < varray_size(&space->lookups); i++) {
+            lookup = (struct vlookup*)varray_get(&space->lookups, i);
+            if ((lookup != qry->lookup) || (lookup->serial != qry->serial)) {
+                continue;
+            }
+            for (j = 0; j < lookup->ncands; j++) {
+                cand = &lookup->cands[j];
+                if ((cand->state != VLOOKUP_CAND_WAIT) || !vtoken_equal(&cand->id, &qry->id)) {
+                    continue;
+                }
+                // if failed, lookup is ended by reaping when nothing to wait.
+                cand->state = (ret < 0) ? VLOOKUP_CAND_FAILED : VLOOKUP_CAND_WAIT;
+                vtoken_copy(&cand->token, &token);
+                cand->rto = rto;
+                due = cand->snd_us + rto;
+                break;
+            }
+            break;
+        }
+        vlock_leave(&space->lock);
+        vlookup_qry_free(qry);
+
+        if (due) {
+            route->ops->arm_rto(route, (ret < 0) ? vtime_now_us() : due);
+        }
+    }
+    return ;
+}
+
+/*
+ * to take out lookup with outstanding query of @token, whose candidate
+ * queried is marked as responded. it must be called with lock of space held.
+ */
+static
+struct vlookup* _aux_lookup_match(struct vroute_lookup_space* space, vtoken* token, int* idx)
+{
+    struct vlookup* lookup = NULL;
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < varray_size(&space->lookups); i++) {
+        lookup = (struct vlookup*)varray_get(&space->lookups, i);
+        for (j = 0; j < lookup->ncands; j++) {
+            if ((lookup->cands[j].state == VLOOKUP_CAND_WAIT) &&
+                vtoken_equal(&lookup->cands[j].token, token)) {
+                lookup->cands[j].state = VLOOKUP_CAND_DONE;
+                *idx = i;
+                return lookup;
+            }
+        }
+    }
+    return NULL;
+}
+
+static
+void _aux_lookup_done(struct vroute_lookup_space* space, struct vlookup* lookup, void* result)
+{
+    if (lookup->cb) {
+        lookup->cb(space->route, &lookup->target, result, lookup->cookie);
+    }
+    vlookup_free(lookup);
+    return ;
+}
+
+/*
+ * the routine to start a lookup for node or service, with shortlist seeded
+ * from closest nodes in routing table. callback is called when it ends,
+ * maybe before the routine returns.
+ *
+ * @space:
+ * @kind: VLOOKUP_NODE or VLOOKUP_SRVC.
+ * @target: node ID or service hash.
+ * @cb: callback to call when lookup ends, maybe NULL.
+ * @cookie:
+ */
+static
+int _vroute_lookup_space_start(struct vroute_lookup_space* space, int kind, vtoken* target, vroute_lookup_t cb, void* cookie)
+{
+    struct vroute_node_space* node_space = &space->route->node_space;
+    struct vlookup* lookup = NULL;
+    struct vlookup* item = NULL;
+    struct varray qrys;
+    vnodeInfo_relax closest[VLOOKUP_K];
+    vnodeInfo_relax nodei;
+    int found = 0;
+    int done  = 0;
+    int ret = 0;
+    int i = 0;
+
+    vassert(space);
+    vassert(target);
+
+    if (kind == VLOOKUP_NODE) {
+        ret = node_space->ops->get_node(node_space, target, (vnodeInfo*)&nodei);
+        retE((ret < 0));
+        if (ret == 1) { // known already.
+            if (cb) {
+                cb(space->route, target, &nodei, cookie);
+            }
+            return 0;
+        }
+    }
+
+    lookup = vlookup_alloc();
+    retE((!lookup));
+    vlookup_init(lookup, kind, target, cb, cookie);
+
+    ret = node_space->ops->get_neighbors(node_space, target, closest, VLOOKUP_K);
+    ret1E((ret < 0), vlookup_free(lookup));
+    for (i = 0; i < ret; i++) {
+        _aux_lookup_add_cand(space, lookup, (vnodeInfo*)&closest[i]);
+    }
+
+    varray_init(&qrys, VLOOKUP_ALPHA);
+    vlock_enter(&space->lock);
+    for (i = 0; i < varray_size(&space->lookups); i++) {
+        item = (struct vlookup*)varray_get(&space->lookups, i);
+        if ((item->kind == kind) && vtoken_equal(&item->target, target) &&
+            (item->cb == cb) && (item->cookie == cookie)) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        done = _aux_lookup_step(space, lookup, vtime_now_us(), &qrys);
+        if (!done) {
+            varray_add_tail(&space->lookups, lookup);
+        }
+    }
+    vlock_leave(&space->lock);
+
+    _aux_lookup_send(space, &qrys);
+    varray_deinit(&qrys);
+    if (found) { // same lookup is going on.
+        vlookup_free(lookup);
+    } else if (done) { // no node to query.
+        _aux_lookup_done(space, lookup, NULL);
+    }
+    return 0;
+}
+
+/*
+ * the routine to call when receiving a response carrying target, which is
+ * @find_node_rsp or @find_service_rsp.
+ *
+ * @space:
+ * @token: token of response.
+ * @result: vnodeInfo or vsrvcInfo.
+ *
+ * return 1 if it answers a lookup, otherwise 0.
+ */
+static
+int _vroute_lookup_space_found(struct vroute_lookup_space* space, vtoken* token, void* result)
+{
+    struct vlookup* lookup = NULL;
+    struct varray qrys;
+    vtoken* id = NULL;
+    int done = 0;
+    int idx  = 0;
+
+    vassert(space);
+    vassert(token);
+    vassert(result);
+
+    varray_init(&qrys, VLOOKUP_ALPHA);
+    vlock_enter(&space->lock);
+    lookup = _aux_lookup_match(space, token, &idx);
+    if (!lookup) {
+        vlock_leave(&space->lock);
+        varray_deinit(&qrys);
+        return 0;
+    }
+    if (lookup->kind == VLOOKUP_NODE) {
+        id = &((vnodeInfo*)result)->id;
+    } else {
+        id = &((vsrvcInfo*)result)->hash;
+    }
+    done = vtoken_equal(id, &lookup->target);
+    if (!done) {
+        if (lookup->kind == VLOOKUP_NODE) {
+            // not target, but node closer to it maybe.
+            _aux_lookup_add_cand(space, lookup, (vnodeInfo*)result);
+        }
+        done = _aux_lookup_step(space, lookup, vtime_now_us(), &qrys);
+        result = NULL;
+    }
+    if (done) {
+        varray_del(&space->lookups, idx);
+    }
+    vlock_leave(&space->lock);
+
+    _aux_lookup_send(space, &qrys);
+    varray_deinit(&qrys);
+    if (done) {
+        _aux_lookup_done(space, lookup, result);
+    }
+    return 1;
+}
+
+/*
+ * the routine to call when receiving a @find_closest_nodes_rsp, whose nodes
+ * are merged into shortlist of lookup that the response answers.
+ *
+ * @space:
+ * @token: token of response.
+ * @closest: nodes in response.
+ *
+ * return 1 if it answers a lookup, otherwise 0.
+ */
+static
+int _vroute_lookup_space_closest(struct vroute_lookup_space* space, vtoken* token, struct varray* closest)
+{
+    struct vlookup* lookup = NULL;
+    struct varray qrys;
+    int done = 0;
+    int idx  = 0;
+    int i = 0;
+
+    vassert(space);
+    vassert(token);
+    vassert(closest);
+
+    varray_init(&qrys, VLOOKUP_ALPHA);
+    vlock_enter(&space->lock);
+    lookup = _aux_lookup_match(space, token, &idx);
+    if (!lookup) {
+        vlock_leave(&space->lock);
+        varray_deinit(&qrys);
+        return 0;
+    }
+    for (i = 0; i < varray_size(closest); i++) {
+        _aux_lookup_add_cand(space, lookup, (vnodeInfo*)varray_get(closest, i));
+    }
+    done = _aux_lookup_step(space, lookup, vtime_now_us(), &qrys);
+    if (done) {
+        varray_del(&space->lookups, idx);
+    }
+    vlock_leave(&space->lock);
+
+    _aux_lookup_send(space, &qrys);
+    varray_deinit(&qrys);
+
+    if (done) {
+        _aux_lookup_done(space, lookup, NULL);
+    }
+    return 1;
+}
+
+/*
+ * the routine to give up queries timed out, and to end lookups that have
+ * nothing left to wait for.
+ *
+ * @space:
+ *
+ * return monotonic microseconds when a query still waited for times out
+ * next, or 0 if none. queries sent here arm rto thread by themselves.
+ */
+static
+uint64_t _vroute_lookup_space_timed_reap(struct vroute_lookup_space* space)
+{
+    struct vlookup_cand* cand = NULL;
+    struct vlookup* lookup = NULL;
+    struct varray done;
+    struct varray qrys;
+    uint64_t now = vtime_now_us();
+    uint64_t next = 0;
+    int i = 0;
+    int j = 0;
+    vassert(space);
+
+    varray_init(&done, 4);
+    varray_init(&qrys, 4);
+    vlock_enter(&space->lock);
+    for (i = 0; i < varray_size(&space->lookups);) {
+        lookup = (struct vlookup*)varray_get(&space->lookups, i);
+        if (_aux_lookup_step(space, lookup, now, &qrys)) {
+            varray_del(&space->lookups, i);
+            varray_add_tail(&done, lookup);
+            continue;
+        }
+        for (j = 0; j < lookup->ncands; j++) {
+            cand = &lookup->cands[j];
+            if ((cand->state == VLOOKUP_CAND_WAIT) && (cand->snd_us != now) &&
+                (!next || (cand->snd_us + cand->rto < next))) {
+                next = cand->snd_us + cand->rto;
+            }
+        }
+        i++;
+    }
+    vlock_leave(&space->lock);
+
+    _aux_lookup_send(space, &qrys);
+    varray_deinit(&qrys);
+    while (varray_size(&done) > 0) {
+        _aux_lookup_done(space, (struct vlookup*)varray_pop_tail(&done), NULL);
+    }
+    varray_deinit(&done);
+    return next;
+}
+
+/*
+ * the routine to drop all lookups without calling back.
+ * @space:
+ */
+static
+void _vroute_lookup_space_clear(struct vroute_lookup_space* space)
+{
+    vassert(space);
+
+    vlock_enter(&space->lock);
+    while (varray_size(&space->lookups) > 0) {
+        vlookup_free((struct vlookup*)varray_pop_tail(&space->lookups));
+    }
+    vlock_leave(&space->lock);
+    return ;
+}
+
+static
+void _vroute_lookup_space_dump(struct vroute_lookup_space* space)
+{
+    int i = 0;
+    vassert(space);
+
+    vlock_enter(&space->lock);
+    for (i = 0; i < varray_size(&space->lookups); i++) {
+        if (!i) {
+            vdump(printf("-> list of lookups:"));
+        }
+        printf("{ ");
+        vlookup_dump((struct vlookup*)varray_get(&space->lookups, i));
+        printf(" }\n");
+    }
+    vlock_leave(&space->lock);
+    return ;
+}
+
+static
+struct vroute_lookup_space_ops route_lookup_space_ops = {
+    .start       = _vroute_lookup_space_start,
+    .found       = _vroute_lookup_space_found,
+    .closest     = _vroute_lookup_space_closest,
+    .timed_reap  = _vroute_lookup_space_timed_reap,
+    .clear       = _vroute_lookup_space_clear,
+    .dump        = _vroute_lookup_space_dump
+};
+
+int vroute_lookup_space_init(struct vroute_lookup_space* space, struct vroute* route)
+{
+    vassert(space);
+    vassert(route);
+
+    space->route = route;
+    varray_init(&space->lookups, 4);
+    vlock_init(&space->lock);
+
+    space->ops = &route_lookup_space_ops;
+    return 0;
+}
+
+void vroute_lookup_space_deinit(struct vroute_lookup_space* space)
+{
+    vassert(space);
+
+    space->ops->clear(space);
+    varray_deinit(&space->lookups);
+    vlock_deinit(&space->lock);
+    return ;
+}
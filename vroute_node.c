@@ -2,6 +2,7 @@
 #include "vroute.h"
 
 #define VPEER_TB ((const char*)"dht_peer")
+#define MAX_NEIGHBORS ((int)32)
 /*
  * for vpeer
  */
@@ -48,6 +49,9 @@ int vpeer_init(struct vpeer* peer, struct sockaddr_in* local, vnodeInfo* nodei,
     peer->rcv_ts = direct ? rcv_ts : 0;
     peer->ntries = direct ? 0 : peer->ntries;
     peer->nprobes = 0;
+    peer->srtt   = 0;
+    peer->rttvar = 0;
+    peer->rto    = VPEER_RTO_INIT;
     return 0;
 }
 
@@ -69,6 +73,32 @@ int vpeer_update(struct vpeer* peer, vnodeInfo* nodei, time_t rcv_ts, int direct
     return ret;
 }
 
+/*
+ * to take a sample of round trip time of @peer as rfc6298, where clock
+ * granularity is VROUTE_RTO_GRAN.
+ */
+static
+void vpeer_sample_rtt(struct vpeer* peer, int rtt)
+{
+    int delta = 0;
+    vassert(peer);
+
+    rtt = (rtt > 0) ? rtt : 1;
+    if (!peer->srtt) {
+        peer->srtt   = rtt;
+        peer->rttvar = rtt / 2;
+    } else {
+        delta = abs(peer->srtt - rtt);
+        peer->rttvar += (delta - peer->rttvar) / 4;
+        peer->srtt   += (rtt - peer->srtt) / 8;
+    }
+    peer->rto  = peer->srtt;
+    peer->rto += (4 * peer->rttvar > VROUTE_RTO_GRAN * 1000) ? (4 * peer->rttvar) : (VROUTE_RTO_GRAN * 1000);
+    peer->rto  = (peer->rto < VPEER_RTO_MIN) ? VPEER_RTO_MIN : peer->rto;
+    peer->rto  = (peer->rto > VPEER_RTO_MAX) ? VPEER_RTO_MAX : peer->rto;
+    return ;
+}
+
 static
 void vpeer_dump(struct vpeer* peer)
 {
@@ -78,7 +108,47 @@ void vpeer_dump(struct vpeer* peer)
     printf("timestamp[snd]: %s",  peer->snd_ts ? ctime(&peer->snd_ts): "not yet ");
     printf("timestamp[rcv]: %s",  ctime(&peer->rcv_ts));
     printf("tried send times:%d ", peer->ntries);
-    printf("probed times:%d", peer->nprobes);
+    printf("probed times:%d ", peer->nprobes);
+    printf("rtt:%dus(var:%dus) rto:%dus", peer->srtt, peer->rttvar, peer->rto);
+    return ;
+}
+
+/*
+ * peers to send msgs to. they are collected from bucket under its lock,
+ * and msgs are pushed only after the lock is released.
+ */
+struct vpeer_snds {
+    int num;
+    int capc;
+    struct vpeer_snd {
+        vnodeConn conn;
+        vnodeId   id;
+    } snds[];
+};
+
+static
+struct vpeer_snds* _aux_space_snds_alloc(struct vroute_node_space* space)
+{
+    struct vpeer_snds* snds = NULL;
+    int capc = space->bucket_sz * VNODEINFO_MAX_ADDRS + 1;
+
+    snds = (struct vpeer_snds*)malloc(sizeof(*snds) + capc * sizeof(struct vpeer_snd));
+    vlogEv((!snds), elog_malloc);
+    retE_p((!snds));
+    snds->num  = 0;
+    snds->capc = capc;
+    return snds;
+}
+
+static
+void _aux_space_snds_add(struct vpeer_snds* snds, vnodeConn* conn, vnodeId* id)
+{
+    if (snds->num >= snds->capc) {
+        return ;
+    }
+    memcpy(&snds->snds[snds->num].conn, conn, sizeof(*conn));
+    memcpy(&snds->snds[snds->num].id, id, sizeof(*id));
+    snds->num++;
     return ;
 }
 
@@ -109,41 +179,15 @@ int _aux_space_add_node_cb(void* item, void* cookie)
     return 0;
 }
 
-static
-int _aux_space_probe_node_cb(void* item, void* cookie)
-{
-    varg_decl(cookie, 0, struct vroute_node_space*, space);
-    varg_decl(cookie, 1, vnodeId*, targetId);
-    struct vroute* route = space->route;
-    struct vpeer*  peer  = (struct vpeer*)item;
-    int ret = 0;
-
-    vassert(space);
-    vassert(targetId);
-    vassert(peer);
-
-    if (peer->ntries >=  space->max_snd_tms) {
-        return 0;
-    }
-    if (vtoken_equal(&peer->nodei->ver, vnodeVer_unknown())) {
-        return 0;
-    }
-    ret = route->dht_ops->find_node(route, &peer->conn, targetId);
-    retE((ret < 0));
-    return 0;
-}
-
 static
 int _aux_space_air_service_cb(void* item, void* cookie)
 {
     varg_decl(cookie, 0, struct vroute_node_space*, space);
-    varg_decl(cookie, 1, vsrvcInfo*, srvci);
+    varg_decl(cookie, 1, struct vpeer_snds*, snds);
     struct vpeer* peer = (struct vpeer*)item;
-    struct vroute* route = space->route;
-    int ret = 0;
 
     vassert(space);
-    vassert(srvci);
+    vassert(snds);
     vassert(peer);
 
     if (peer->ntries >= space->max_snd_tms) {
@@ -152,32 +196,7 @@ int _aux_space_air_service_cb(void* item, void* cookie)
     if (vtoken_equal(&peer->nodei->ver, vnodeVer_unknown())) {
         return 0;
     }
-    ret = route->dht_ops->post_service(route, &peer->conn, srvci);
-    retE((ret < 0));
-    return 0;
-}
-
-static
-int _aux_space_probe_service_cb(void* item, void* cookie)
-{
-    varg_decl(cookie, 0, struct vroute_node_space*, space);
-    varg_decl(cookie, 1, vsrvcHash*, hash);
-    struct vpeer*  peer  = (struct vpeer*)item;
-    struct vroute* route = space->route;
-    int ret = 0;
-
-    vassert(space);
-    vassert(hash);
-    vassert(peer);
-
-    if (peer->ntries >= space->max_snd_tms) {
-        return 0; // unreachable.
-    }
-    if (vtoken_equal(&peer->nodei->ver, vnodeVer_unknown())) {
-        return 0;
-    }
-    ret = route->dht_ops->find_service(route, &peer->conn, hash);
-    retE((ret < 0));
+    _aux_space_snds_add(snds, &peer->conn, &peer->nodei->id);
     return 0;
 }
 
@@ -186,10 +205,9 @@ int _aux_space_reflex_addr_cb(void* item, void* cookie)
 {
     varg_decl(cookie, 0, struct vroute_node_space*, space);
     varg_decl(cookie, 1, struct sockaddr_in*, addr);
-    struct vpeer*  peer  = (struct vpeer*)item;
-    struct vroute* route = space->route;
+    varg_decl(cookie, 2, struct vpeer_snds*, snds);
+    struct vpeer* peer = (struct vpeer*)item;
     vnodeConn conn;
-    int ret = 0;
 
     vassert(space);
     vassert(addr);
@@ -205,8 +223,7 @@ int _aux_space_reflex_addr_cb(void* item, void* cookie)
         return 0;
     }
     vnodeConn_set(&conn, addr, &peer->conn.remote);
-    ret = route->dht_ops->reflex(route, &conn);
-    retE((ret < 0));
+    _aux_space_snds_add(snds, &conn, &peer->nodei->id);
     return 0;
 }
 
@@ -215,9 +232,8 @@ int _aux_space_probe_connectivity_cb(void* item, void* cookie)
 {
     varg_decl(cookie, 0, struct vroute_node_space*, space);
     varg_decl(cookie, 1, struct sockaddr_in*, laddr);
-    struct vpeer*  peer  = (struct vpeer*)item;
-    struct vroute* route = space->route;
-    int i = 0;
+    varg_decl(cookie, 2, struct vpeer_snds*, snds);
+    struct vpeer* peer = (struct vpeer*)item;
     int j = 0;
 
     vassert(peer);
@@ -235,8 +251,8 @@ int _aux_space_probe_connectivity_cb(void* item, void* cookie)
     }
     for (j = 0; j < peer->nodei->naddrs; j++) {
         vnodeConn conn;
-        vnodeConn_set(&conn, laddr, &peer->nodei->addrs[i]);
-        route->dht_ops->probe(route, &conn, &peer->nodei->id);
+        vnodeConn_set(&conn, laddr, &peer->nodei->addrs[j]);
+        _aux_space_snds_add(snds, &conn, &peer->nodei->id);
     }
     peer->nprobes++;
     return 0;
@@ -247,8 +263,9 @@ int _aux_space_tick_cb(void* item, void* cookie)
 {
     struct vpeer*  peer  = (struct vpeer*)item;
     varg_decl(cookie, 0, struct vroute_node_space*, space);
-    varg_decl(cookie, 1, struct vroute*, route);
+    varg_decl(cookie, 1, struct vpeer_snds*, snds);
     varg_decl(cookie, 2, time_t*, now);
+    varg_decl(cookie, 3, uint64_t*, due);
 
     vassert(peer);
     vassert(space);
@@ -257,11 +274,54 @@ int _aux_space_tick_cb(void* item, void* cookie)
     if (peer->ntries >=  space->max_snd_tms) { //unreachable.
         return 0;
     }
+    if (peer->ntries > 0) {
+        return 0; // ping outstanding is retried by rto thread.
+    }
     if ((!peer->snd_ts) ||
         (*now - peer->rcv_ts > space->max_rcv_tmo)) {
-        route->dht_ops->ping(route, &peer->conn);
+        _aux_space_snds_add(snds, &peer->conn, &peer->nodei->id);
         peer->snd_ts = *now;
+        peer->snd_us = vtime_now_us();
+        peer->ntries++;
+        if (!*due || (peer->snd_us + peer->rto < *due)) {
+            *due = peer->snd_us + peer->rto;
+        }
+    }
+    return 0;
+}
+
+/*
+ * to collect ping outstanding to retransmit if its rto has passed, with rto
+ * backed off. @due is updated to earliest deadline of pings still to retry.
+ */
+static
+int _aux_space_retry_cb(void* item, void* cookie)
+{
+    struct vpeer*  peer  = (struct vpeer*)item;
+    varg_decl(cookie, 0, struct vroute_node_space*, space);
+    varg_decl(cookie, 1, struct vpeer_snds*, snds);
+    varg_decl(cookie, 2, uint64_t*, now);
+    varg_decl(cookie, 3, uint64_t*, due);
+
+    vassert(peer);
+    vassert(space);
+    vassert(now);
+
+    if ((peer->ntries <= 0) || (peer->ntries >= space->max_snd_tms)) {
+        return 0;
+    }
+    if (*now - peer->snd_us >= (uint64_t)peer->rto) {
+        _aux_space_snds_add(snds, &peer->conn, &peer->nodei->id);
+        peer->snd_ts = time(NULL);
+        peer->snd_us = *now;
         peer->ntries++;
+        peer->rto = (peer->rto < VPEER_RTO_MAX / 2) ? (peer->rto * 2) : VPEER_RTO_MAX; // back off.
+        if (peer->ntries >= space->max_snd_tms) {
+            return 0;
+        }
+    }
+    if (!*due || (peer->snd_us + peer->rto < *due)) {
+        *due = peer->snd_us + peer->rto;
     }
     return 0;
 }
@@ -359,32 +419,6 @@ int _aux_space_store_cb(void* item, void* cookie)
     return 0;
 }
 
-static
-int _aux_space_weight_cmp_cb(void* item, void* new, void* cookie)
-{
-    struct vpeer* peer = (struct vpeer*)item;
-    struct vpeer* tgt  = (struct vpeer*)new;
-    vnodeId* targetId  = (vnodeId*)cookie;
-    vnodeMetric pm, tm;
-
-    if (tgt->ntries > 0) {
-        // try to not use node that may be unreachable.
-        return -1;
-    }
-    if (!vtoken_equal(&tgt->nodei->ver, &peer->nodei->ver)) {
-        // if mismatch for version, try not use the node.
-        return -1;
-    }
-    if (tgt->nodei->weight > peer->nodei->weight) {
-        // prefer to use node with hight weight
-        return 1;
-    }
-
-    vnodeId_dist(&peer->nodei->id, targetId, &pm);
-    vnodeId_dist(&tgt->nodei->id,  targetId, &tm);
-    return vnodeMetric_cmp(&tm, &pm);
-}
-
 /*
  * the routine to add a node to routing table.
  * @route: routing table.
@@ -415,6 +449,8 @@ int _vroute_node_space_add_node(struct vroute_node_space* space, vnodeInfo* node
     min_weight = nodei->weight;
     idx = vnodeId_bucket(&space->myid, &nodei->id);
     peers = &space->bucket[idx].peers;
+
+    vlock_enter(&space->bucket[idx].lock);
     {
         void* argv[] = {
             nodei,
@@ -435,7 +471,7 @@ int _vroute_node_space_add_node(struct vroute_node_space* space, vnodeInfo* node
             // insert new one.
             to = vpeer_alloc();
             vlogEv((!to), elog_vpeer_alloc);
-            retE((!to));
+            ret1E((!to), vlock_leave(&space->bucket[idx].lock));
             vpeer_init(to, &space->zaddr, nodei, now, direct);
             varray_add_tail(peers, to);
             updt = 1;
@@ -446,6 +482,7 @@ int _vroute_node_space_add_node(struct vroute_node_space* space, vnodeInfo* node
             space->bucket[idx].ts = now;
         }
     }
+    vlock_leave(&space->bucket[idx].lock);
     return 0;
 }
 
@@ -470,6 +507,8 @@ int _vroute_node_space_get_node(struct vroute_node_space* space, vnodeId* target
 
     idx = vnodeId_bucket(&space->myid, targetId);
     peers = &space->bucket[idx].peers;
+
+    vlock_enter(&space->bucket[idx].lock);
     for (i = 0; i < varray_size(peers); i++) {
         peer = (struct vpeer*)varray_get(peers, i);
         if (vtoken_equal(&peer->nodei->id, targetId)) {
@@ -484,84 +523,292 @@ int _vroute_node_space_get_node(struct vroute_node_space* space, vnodeId* target
             break;
         }
     }
+    vlock_leave(&space->bucket[idx].lock);
     return found;
 }
 
 /*
+ * the routine to take a sample of round trip time of query sent to @dest.
+ * the sample goes only to peer at @dest, which is looked up by @id that
+ * response claims, so that a response can't skew rto of another peer.
  *
+ * @space:
+ * @id:   id of node that answered.
+ * @dest: address that query was sent to, from its record.
+ * @rtt:  in microseconds.
  */
 static
-int _vroute_node_space_get_neighbors(struct vroute_node_space* space, vnodeId* targetId, struct varray* closest, int num)
+void _vroute_node_space_sample_rtt(struct vroute_node_space* space, vnodeId* id, struct sockaddr_in* dest, int rtt)
 {
-    struct vsorted_array sarray;
+    struct varray* peers = NULL;
+    struct vpeer*  peer  = NULL;
+    int idx = 0;
     int i = 0;
-    int j = 0;
 
     vassert(space);
-    vassert(targetId);
-    vassert(closest);
-    vassert(num > 0);
+    vassert(id);
+    vassert(dest);
 
-    vsorted_array_init(&sarray, 0, _aux_space_weight_cmp_cb, targetId);
+    idx = vnodeId_bucket(&space->myid, id);
+    peers = &space->bucket[idx].peers;
 
-    for (i = 0; i < NBUCKETS; i++) {
-        struct varray* peers = &space->bucket[i].peers;
-        for (j = 0; j < varray_size(peers); j++) {
-            struct vpeer* peer = (struct vpeer*)varray_get(peers, j);
-            if (vtoken_equal(&peer->nodei->id, targetId)) {
-                continue;
-            }
-            if (vtoken_equal(&peer->nodei->ver, vnodeVer_unknown())) {
-                continue;
-            }
-            if (peer->ntries >= space->max_snd_tms) {
-                continue;
+    vlock_enter(&space->bucket[idx].lock);
+    for (i = 0; i < varray_size(peers); i++) {
+        peer = (struct vpeer*)varray_get(peers, i);
+        if (vtoken_equal(&peer->nodei->id, id)) {
+            if (vsockaddr_equal(&peer->conn.remote, dest)) {
+                vpeer_sample_rtt(peer, rtt);
             }
-            vsorted_array_add(&sarray, peer);
+            break;
+        }
+    }
+    vlock_leave(&space->bucket[idx].lock);
+    return ;
+}
+
+/*
+ * the routine to get retransmission timeout of node @id in microseconds,
+ * which is VPEER_RTO_INIT for nodes not in routing table.
+ *
+ * @space:
+ * @id:
+ */
+static
+int _vroute_node_space_get_rto(struct vroute_node_space* space, vnodeId* id)
+{
+    struct varray* peers = NULL;
+    struct vpeer*  peer  = NULL;
+    int rto = VPEER_RTO_INIT;
+    int idx = 0;
+    int i = 0;
+
+    vassert(space);
+    vassert(id);
+
+    idx = vnodeId_bucket(&space->myid, id);
+    peers = &space->bucket[idx].peers;
+
+    vlock_enter(&space->bucket[idx].lock);
+    for (i = 0; i < varray_size(peers); i++) {
+        peer = (struct vpeer*)varray_get(peers, i);
+        if (vtoken_equal(&peer->nodei->id, id)) {
+            rto = peer->rto;
+            break;
         }
     }
-    for (i = 0; i < vsorted_array_size(&sarray); i++) {
-        struct vpeer* item = (struct vpeer*)vsorted_array_get(&sarray, i);
-        vnodeInfo* nodei = NULL;
+    vlock_leave(&space->bucket[idx].lock);
+    return rto;
+}
+
+/*
+ * rank of peer as candidate of closest neighbors to target: peers that have
+ * been tried without answer, or being slow, or of other version, rank behind
+ * the others, and then peers closer to target rank first.
+ */
+struct vpeer_rank {
+    int class;
+    vnodeMetric dist;
+    int idx;        // where its nodei is copied in output.
+};
+
+static
+int _aux_rank_cmp(struct vpeer_rank* a, struct vpeer_rank* b)
+{
+    if (a->class != b->class) {
+        return a->class - b->class;
+    }
+    return vnodeMetric_cmp(&b->dist, &a->dist); // positive if @a farther.
+}
 
-        if (i >= num) {
+/*
+ * max-heap of ranks, with worst one on top.
+ */
+static
+void _aux_rank_heap_up(struct vpeer_rank* heap, int i)
+{
+    struct vpeer_rank tmp;
+    int parent = 0;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (_aux_rank_cmp(&heap[i], &heap[parent]) <= 0) {
             break;
         }
-        nodei = (vnodeInfo*)vnodeInfo_relax_alloc();
-        if ((!nodei)) {
+        tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+    return ;
+}
+
+static
+void _aux_rank_heap_down(struct vpeer_rank* heap, int n, int i)
+{
+    struct vpeer_rank tmp;
+    int worst = 0;
+    int child = 0;
+
+    while (1) {
+        worst = i;
+        child = 2 * i + 1;
+        if ((child < n) && (_aux_rank_cmp(&heap[child], &heap[worst]) > 0)) {
+            worst = child;
+        }
+        child++;
+        if ((child < n) && (_aux_rank_cmp(&heap[child], &heap[worst]) > 0)) {
+            worst = child;
+        }
+        if (worst == i) {
             break;
         }
-        vnodeInfo_copy(nodei, item->nodei);
-        if (vtoken_equal(&nodei->ver, &space->myver)) {
-            nodei->weight--;
+        tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+    return ;
+}
+
+static
+void _aux_space_copy_nodei(struct vroute_node_space* space, vnodeInfo_relax* dest, vnodeInfo* src)
+{
+    memset(dest, 0, sizeof(*dest));
+    dest->capc = VNODEINFO_MAX_ADDRS;
+    vnodeInfo_copy((vnodeInfo*)dest, src);
+    if (vtoken_equal(&dest->ver, &space->myver)) {
+        //minus because uncareness of version as to other nodes.
+        dest->weight--;
+    }
+    return ;
+}
+
+/*
+ * to rank peers of bucket @idx into heap of @num best ones so far, whose
+ * infos are copied into @closest when taken in.
+ */
+static
+void _aux_space_rank_bucket(struct vroute_node_space* space, int idx, vnodeId* targetId, struct vpeer_rank* heap, int* n, vnodeInfo_relax* closest, int num)
+{
+    struct varray* peers = &space->bucket[idx].peers;
+    struct vpeer* peer = NULL;
+    struct vpeer_rank rank;
+    int i = 0;
+
+    vlock_enter(&space->bucket[idx].lock);
+    for (i = 0; i < varray_size(peers); i++) {
+        peer = (struct vpeer*)varray_get(peers, i);
+        if (vtoken_equal(&peer->nodei->id, targetId)) {
+            continue;
         }
-        varray_add_tail(closest, nodei);
+        if (vtoken_equal(&peer->nodei->ver, vnodeVer_unknown())) {
+            continue;
+        }
+        if (peer->ntries >= space->max_snd_tms) {
+            continue;
+        }
+        rank.class  = (peer->ntries > 0) ? 4 : 0;
+        rank.class += (peer->srtt > VPEER_RTT_SLOW) ? 2 : 0;
+        rank.class += !vtoken_equal(&peer->nodei->ver, &space->myver);
+        vnodeId_dist(&peer->nodei->id, targetId, &rank.dist);
+
+        if (*n < num) {
+            rank.idx = *n;
+            heap[*n] = rank;
+            _aux_rank_heap_up(heap, (*n)++);
+        } else if (_aux_rank_cmp(&rank, &heap[0]) < 0) {
+            rank.idx = heap[0].idx;
+            heap[0] = rank;
+            _aux_rank_heap_down(heap, *n, 0);
+        } else {
+            continue;
+        }
+        _aux_space_copy_nodei(space, &closest[rank.idx], peer->nodei);
     }
-    vsorted_array_deinit(&sarray);
-    return i;
+    vlock_leave(&space->bucket[idx].lock);
+    return ;
 }
 
 /*
- * the routine to probe a node with given ID
+ * the routine to get at most @num nodes closest to target, in order of
+ * rank, which are copied into @closest provided by caller.
+ *
+ * buckets are visited in order of distance to target: bucket of target
+ * first, then buckets below it as a group, and buckets above it one by one.
+ * nodes of each group are all farther to target than ones of former groups,
+ * so it stops once @num best-ranked nodes are found that no later one can
+ * outrank.
+ *
  * @space:
  * @targetId:
+ * @closest: [out] array of at least @num entries.
+ * @num:
+ *
+ * return number of nodes got.
  */
 static
-int _vroute_node_space_probe_node(struct vroute_node_space* space, vnodeId* targetId)
+int _vroute_node_space_get_neighbors(struct vroute_node_space* space, vnodeId* targetId, vnodeInfo_relax* closest, int num)
 {
-    int i = 0;
+    struct vpeer_rank heap[MAX_NEIGHBORS];
+    vnodeInfo_relax tmp;
+    int order[MAX_NEIGHBORS];
+    int lo = 0;
+    int hi = 0;
+    int tb = 0;
+    int n  = 0;
+    int i  = 0;
+    int j  = 0;
 
     vassert(space);
     vassert(targetId);
+    vassert(closest);
+    vassert(num > 0);
 
-    for (i = 0; i < NBUCKETS; i++) {
-        void* argv[] = {
-            space,
-            targetId
-        };
-        varray_iterate(&space->bucket[i].peers, _aux_space_probe_node_cb, argv);
+    num = (num > MAX_NEIGHBORS) ? MAX_NEIGHBORS : num;
+    tb  = vnodeId_bucket(&space->myid, targetId);
+
+    for (i = 0; ; i++) {
+        if (i == 0) {
+            lo = hi = tb;
+        } else if (i == 1) {
+            lo = 0;
+            hi = tb - 1;
+        } else {
+            lo = hi = tb + i - 1;
+        }
+        if (lo >= NBUCKETS) {
+            break;
+        }
+        for (j = lo; j <= hi; j++) {
+            _aux_space_rank_bucket(space, j, targetId, heap, &n, closest, num);
+        }
+        if ((n >= num) && (heap[0].class == 0)) {
+            break;
+        }
     }
-    return 0;
+
+    // take ranks out of heap from worst one, and then move nodes to
+    // their places in order.
+    for (i = n - 1; i >= 0; i--) {
+        order[i] = heap[0].idx;
+        heap[0] = heap[i];
+        _aux_rank_heap_down(heap, i, 0);
+    }
+    for (i = 0; i < n; i++) {
+        if (order[i] == i) {
+            continue;
+        }
+        memcpy(&tmp, &closest[i], sizeof(tmp));
+        for (j = i; order[j] != i; ) {
+            int from = order[j];
+            memcpy(&closest[j], &closest[from], sizeof(tmp));
+            order[j] = j;
+            j = from;
+        }
+        memcpy(&closest[j], &tmp, sizeof(tmp));
+        order[j] = j;
+    }
+    return n;
 }
 
 /*
@@ -574,50 +821,60 @@ int _vroute_node_space_probe_node(struct vroute_node_space* space, vnodeId* targ
 static
 int _vroute_node_space_air_service(struct vroute_node_space* space, void* srvci)
 {
+    struct vroute* route = space->route;
+    struct vpeer_snds* snds = NULL;
     int i = 0;
+    int j = 0;
     vassert(space);
     vassert(srvci);
 
+    snds = _aux_space_snds_alloc(space);
+    retE((!snds));
     for (i = 0; i < NBUCKETS; i++) {
         void* argv[] = {
             space,
-            srvci
+            snds
         };
+        snds->num = 0;
+        vlock_enter(&space->bucket[i].lock);
         varray_iterate(&space->bucket[i].peers, _aux_space_air_service_cb, argv);
-    }
-    return 0;
-}
-
-static
-int _vroute_node_space_probe_service(struct vroute_node_space* space, vsrvcHash* hash)
-{
-    int i = 0;
-    vassert(space);
-    vassert(hash);
+        vlock_leave(&space->bucket[i].lock);
 
-    for (i = 0;  i < NBUCKETS; i++) {
-        void* argv[] = {
-            space,
-            hash
-        };
-        varray_iterate(&space->bucket[i].peers, _aux_space_probe_service_cb, argv);
+        for (j = 0; j < snds->num; j++) {
+            route->dht_ops->post_service(route, &snds->snds[j].conn, (vsrvcInfo*)srvci);
+        }
     }
+    free(snds);
     return 0;
 }
 
 static
 int _vroute_node_space_reflex_addr(struct vroute_node_space* space, struct sockaddr_in* addr)
 {
+    struct vroute* route = space->route;
+    struct vpeer_snds* snds = NULL;
     int i = 0;
+    int j = 0;
     vassert(space);
 
+    snds = _aux_space_snds_alloc(space);
+    retE((!snds));
     for (i = 0; i < NBUCKETS; i++) {
         void* argv[] = {
             space,
-            addr
+            addr,
+            snds
         };
+        snds->num = 0;
+        vlock_enter(&space->bucket[i].lock);
         varray_iterate(&space->bucket[i].peers, _aux_space_reflex_addr_cb, argv);
+        vlock_leave(&space->bucket[i].lock);
+
+        for (j = 0; j < snds->num; j++) {
+            route->dht_ops->reflex(route, &snds->snds[j].conn);
+        }
     }
+    free(snds);
     return 0;
 }
 
@@ -635,6 +892,7 @@ int _vroute_node_space_adjust_connectivity(struct vroute_node_space* space, vnod
     idx = vnodeId_bucket(&space->myid, targetId);
     peers = &space->bucket[idx].peers;
 
+    vlock_enter(&space->bucket[idx].lock);
     for (i = 0; i < varray_size(peers); i++) {
         peer = (struct vpeer*)varray_get(peers, i);
         if (vtoken_equal(&peer->nodei->id, targetId)) {
@@ -642,26 +900,39 @@ int _vroute_node_space_adjust_connectivity(struct vroute_node_space* space, vnod
             break;
         }
     }
+    vlock_leave(&space->bucket[idx].lock);
     return 0;
 }
 
 static
 int _vroute_node_space_probe_connectivity(struct vroute_node_space* space, struct sockaddr_in* laddr)
 {
-    struct varray* peers = NULL;
+    struct vroute* route = space->route;
+    struct vpeer_snds* snds = NULL;
     int i = 0;
+    int j = 0;
 
     vassert(space);
     vassert(laddr);
 
+    snds = _aux_space_snds_alloc(space);
+    retE((!snds));
     for (i = 0; i < NBUCKETS; i++) {
         void* argv[] = {
             space,
-            laddr
+            laddr,
+            snds
         };
-        peers = &space->bucket[i].peers;
-        varray_iterate(peers, _aux_space_probe_connectivity_cb, argv);
+        snds->num = 0;
+        vlock_enter(&space->bucket[i].lock);
+        varray_iterate(&space->bucket[i].peers, _aux_space_probe_connectivity_cb, argv);
+        vlock_leave(&space->bucket[i].lock);
+
+        for (j = 0; j < snds->num; j++) {
+            route->dht_ops->probe(route, &snds->snds[j].conn, &snds->snds[j].id);
+        }
     }
+    free(snds);
     return 0;
 }
 
@@ -677,37 +948,120 @@ static
 int _vroute_node_space_tick(struct vroute_node_space* space)
 {
     struct vroute* route = space->route;
+    struct vpeer_snds* snds = NULL;
     struct varray* peers = NULL;
     struct vpeer*  peer  = NULL;
     time_t now = time(NULL);
+    uint64_t next = 0;
+    uint64_t due  = 0;
+    int refresh = 0;
     int i  = 0;
+    int j  = 0;
     vassert(space);
 
+    snds = _aux_space_snds_alloc(space);
+    retE((!snds));
     for (i = 0; i < NBUCKETS; i++) {
         void* argv[] = {
             space,
-            space->route,
-            &now
+            snds,
+            &now,
+            &due
         };
 
+        snds->num = 0;
+        refresh = 0;
+        due = 0;
         peers = &space->bucket[i].peers;
+        vlock_enter(&space->bucket[i].lock);
         varray_iterate(peers, _aux_space_tick_cb, argv);
+        if (due) {
+            __atomic_or_fetch(&space->pending[i / 32], (1u << (i % 32)), __ATOMIC_RELEASE);
+            next = (!next || (due < next)) ? due : next;
+        }
 
-        if (varray_size(peers) <= 0) {
-            continue;
+        if ((varray_size(peers) > 0) &&
+            ((space->bucket[i].ts + space->max_rcv_tmo) < now)) {
+            peer = (struct vpeer*)varray_get_rand(peers);
+            if (peer->ntries < space->max_snd_tms) {
+                _aux_space_snds_add(snds, &peer->conn, &peer->nodei->id);
+                refresh = 1; // last one is to refresh bucket.
+            }
         }
-        if ((space->bucket[i].ts + space->max_rcv_tmo) >= now) {
-            continue;
+        vlock_leave(&space->bucket[i].lock);
+
+        for (j = 0; j < snds->num - refresh; j++) {
+            route->dht_ops->ping(route, &snds->snds[j].conn);
         }
-        peer = (struct vpeer*)varray_get_rand(peers);
-        if (peer->ntries >= space->max_snd_tms) {
-            continue;
+        if (refresh) {
+            route->dht_ops->find_closest_nodes(route, &snds->snds[j].conn, &space->myid);
         }
-        route->dht_ops->find_closest_nodes(route, &peer->conn, &space->myid);
+    }
+    free(snds);
+    if (next) {
+        route->ops->arm_rto(route, next);
     }
     return 0;
 }
 
+/*
+ * the routine to resend pings that have timed out, with timeout backed off
+ * each time, till node is taken as unreachable. only buckets with pings
+ * outstanding are visited, and pings are sent after leaving bucket lock.
+ *
+ * @space:
+ *
+ * return monotonic microseconds when a ping outstanding times out next, or
+ * 0 if none.
+ */
+static
+uint64_t _vroute_node_space_retry(struct vroute_node_space* space)
+{
+    struct vroute* route = space->route;
+    struct vpeer_snds* snds = NULL;
+    uint64_t now  = vtime_now_us();
+    uint64_t next = 0;
+    uint64_t due  = 0;
+    uint32_t bits = 0;
+    int i = 0;
+    int j = 0;
+    int w = 0;
+    vassert(space);
+
+    snds = _aux_space_snds_alloc(space);
+    if (!snds) {
+        return now + VROUTE_RTO_GRAN * 1000; // try later.
+    }
+    for (w = 0; w < (int)(sizeof(space->pending) / sizeof(uint32_t)); w++) {
+        bits = __atomic_load_n(&space->pending[w], __ATOMIC_ACQUIRE);
+        for (; bits; bits &= bits - 1) {
+            void* argv[] = {
+                space,
+                snds,
+                &now,
+                &due
+            };
+
+            i = w * 32 + __builtin_ctz(bits);
+            snds->num = 0;
+            due = 0;
+            vlock_enter(&space->bucket[i].lock);
+            varray_iterate(&space->bucket[i].peers, _aux_space_retry_cb, argv);
+            if (!due) {
+                __atomic_and_fetch(&space->pending[w], ~(1u << (i % 32)), __ATOMIC_RELEASE);
+            }
+            vlock_leave(&space->bucket[i].lock);
+
+            for (j = 0; j < snds->num; j++) {
+                route->dht_ops->ping(route, &snds->snds[j].conn);
+            }
+            next = (due && (!next || (due < next))) ? due : next;
+        }
+    }
+    free(snds);
+    return next;
+}
+
 /*
  * to load all nodes info from db file to routing table
  * @route:
@@ -757,7 +1111,9 @@ int _vroute_node_space_store(struct vroute_node_space* space)
 
     for (i = 0; i < NBUCKETS; i++) {
         peers = &space->bucket[i].peers;
+        vlock_enter(&space->bucket[i].lock);
         varray_iterate(peers, _aux_space_store_cb, db);
+        vlock_leave(&space->bucket[i].lock);
     }
     sqlite3_close(db);
     vlogI("writeback route infos");
@@ -777,9 +1133,11 @@ void _vroute_node_space_clear(struct vroute_node_space* space)
 
     for (i = 0; i < NBUCKETS; i++) {
         peers = &space->bucket[i].peers;
+        vlock_enter(&space->bucket[i].lock);
         while(varray_size(peers) > 0) {
             vpeer_free((struct vpeer*)varray_pop_tail(peers));
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return ;
 }
@@ -799,9 +1157,11 @@ void _vroute_node_space_inspect(struct vroute_node_space* space, vroute_node_spa
 
     for (i = 0; i < NBUCKETS; i++) {
         peers = &space->bucket[i].peers;
+        vlock_enter(&space->bucket[i].lock);
         for (j = 0; j < varray_size(peers); j++) {
             cb((struct vpeer*)varray_get(peers, j), cookie, token, insp_id);
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return ;
 }
@@ -821,6 +1181,7 @@ void _vroute_node_space_dump(struct vroute_node_space* space)
 
     for (i = 0; i < NBUCKETS; i++) {
         peers = &space->bucket[i].peers;
+        vlock_enter(&space->bucket[i].lock);
         for (j = 0; j < varray_size(peers); j++) {
             if (!titled) {
                 vdump(printf("-> list of peers in node routing space:"));
@@ -830,6 +1191,7 @@ void _vroute_node_space_dump(struct vroute_node_space* space)
             vpeer_dump((struct vpeer*)varray_get(peers, j));
             printf(" }\n");
         }
+        vlock_leave(&space->bucket[i].lock);
     }
 
     return ;
@@ -839,13 +1201,14 @@ struct vroute_node_space_ops route_space_ops = {
     .add_node      = _vroute_node_space_add_node,
     .get_node      = _vroute_node_space_get_node,
     .get_neighbors = _vroute_node_space_get_neighbors,
-    .probe_node    = _vroute_node_space_probe_node,
+    .sample_rtt    = _vroute_node_space_sample_rtt,
+    .get_rto       = _vroute_node_space_get_rto,
     .air_service   = _vroute_node_space_air_service,
-    .probe_service = _vroute_node_space_probe_service,
     .reflex_addr   = _vroute_node_space_reflex_addr,
     .adjust_connectivity = _vroute_node_space_adjust_connectivity,
     .probe_connectivity  = _vroute_node_space_probe_connectivity,
     .tick          = _vroute_node_space_tick,
+    .retry         = _vroute_node_space_retry,
     .load          = _vroute_node_space_load,
     .store         = _vroute_node_space_store,
     .clear         = _vroute_node_space_clear,
@@ -906,8 +1269,10 @@ int vroute_node_space_init(struct vroute_node_space* space, struct vroute* route
 
     for (i = 0; i < NBUCKETS; i++) {
         varray_init(&space->bucket[i].peers, 8);
+        vlock_init(&space->bucket[i].lock);
         space->bucket[i].ts = 0;
     }
+    memset(space->pending, 0, sizeof(space->pending));
 
     vnodeVer_unstrlize(vhost_get_version(), &myver);
     vtoken_copy(&space->myver, &myver);
@@ -925,6 +1290,7 @@ void vroute_node_space_deinit(struct vroute_node_space* space)
     space->ops->clear(space);
     for (i = 0; i < NBUCKETS; i++) {
         varray_deinit(&space->bucket[i].peers);
+        vlock_deinit(&space->bucket[i].lock);
     }
     return ;
 }
@@ -1,103 +1,297 @@
 #include "vglobal.h"
 #include "vroute.h"
 
+/*
+ * records are kept in a pool of fixed size, indexed by an open-addressing
+ * hash table of pool indices keyed by token, and linked into slots of a
+ * timing wheel by second of sending. so that @check is a probe of table
+ * and expiry costs nothing more than unlinking records of stale slots.
+ */
+#define VRECR_TB_SZ   ((int)(2*VRECR_CAPC))   // keep load factor under 1/2.
+#define VRECR_NIL     ((int)-1)
+
 struct vrecord {
     vtoken token;
-    time_t snd_ts;
+    uint64_t snd_us;    // monotonic time of sending.
+    struct sockaddr_in dest; // of peer query sent to.
+    int dhtId;          // of query.
+    int prev;       // neighbors in slot of timing wheel.
+    int next;
+    int slot;
 };
 
-static MEM_AUX_INIT(record_cache, sizeof(struct vrecord), 4);
 static
-struct vrecord* vrecord_alloc(void)
+uint32_t _aux_recr_hash(vtoken* token)
 {
-    struct vrecord* record = NULL;
+    uint32_t h = 0;
+    int i = 0;
 
-    record = (struct vrecord*)vmem_aux_alloc(&record_cache);
-    vlogEv((!record), elog_vmem_aux_alloc);
-    retE_p((!record));
-    memset(record, 0, sizeof(*record));
-    return record;
+    for (i = 0; i < VTOKEN_LEN; i += sizeof(uint32_t)) {
+        h ^= get_uint32(token->data + i);
+    }
+    return (h * 2654435761u) & (VRECR_TB_SZ - 1);
 }
 
+/*
+ * to find position in table of record with @token, or VRECR_NIL.
+ */
 static
-void vrecord_free(struct vrecord* record)
+int _aux_recr_find(struct vroute_recr_space* space, vtoken* token)
 {
-    vassert(record);
-    vmem_aux_free(&record_cache, record);
+    int pos = _aux_recr_hash(token);
+
+    while (space->table[pos] != VRECR_NIL) {
+        if (vtoken_equal(&space->records[space->table[pos]].token, token)) {
+            return pos;
+        }
+        pos = (pos + 1) & (VRECR_TB_SZ - 1);
+    }
+    return VRECR_NIL;
+}
+
+/*
+ * to remove entry at @pos of table, with entries after it in same cluster
+ * shifted backward, so that no tombstone is left.
+ */
+static
+void _aux_recr_tb_del(struct vroute_recr_space* space, int pos)
+{
+    int next = pos;
+    int home = 0;
+
+    while (1) {
+        space->table[pos] = VRECR_NIL;
+        while (1) {
+            next = (next + 1) & (VRECR_TB_SZ - 1);
+            if (space->table[next] == VRECR_NIL) {
+                return;
+            }
+            // entry at @next can move to @pos only if its home position
+            // is not within (pos, next].
+            home = _aux_recr_hash(&space->records[space->table[next]].token);
+            if (((next - home) & (VRECR_TB_SZ - 1)) >= ((next - pos) & (VRECR_TB_SZ - 1))) {
+                break;
+            }
+        }
+        space->table[pos] = space->table[next];
+        pos = next;
+    }
     return ;
 }
 
 static
-void vrecord_init(struct vrecord* record, vtoken* token)
+void _aux_recr_wheel_unlink(struct vroute_recr_space* space, int idx)
 {
-    vassert(record);
-    vassert(token);
+    struct vrecord* record = &space->records[idx];
 
-    vtoken_copy(&record->token, token);
-    record->snd_ts = time(NULL);
+    if (record->prev != VRECR_NIL) {
+        space->records[record->prev].next = record->next;
+    } else {
+        space->wheel[record->slot] = record->next;
+    }
+    if (record->next != VRECR_NIL) {
+        space->records[record->next].prev = record->prev;
+    }
+    return ;
+}
+
+/*
+ * to drop record at @pos of table, and return it back to pool.
+ */
+static
+void _aux_recr_drop(struct vroute_recr_space* space, int pos)
+{
+    int idx = space->table[pos];
+
+    _aux_recr_tb_del(space, pos);
+    _aux_recr_wheel_unlink(space, idx);
+    space->records[idx].next = space->free_idx;
+    space->free_idx = idx;
+    space->nrecords--;
     return ;
 }
 
+/*
+ * to expire all records in @slot of timing wheel.
+ */
 static
-void vrecord_dump(struct vrecord* record)
+void _aux_recr_expire_slot(struct vroute_recr_space* space, int slot)
 {
-    vassert(record);
-    vtoken_dump(&record->token);
-    vdump(printf("timestamp[snd]: %s",  ctime(&record->snd_ts)));
+    while (space->wheel[slot] != VRECR_NIL) {
+        _aux_recr_drop(space, _aux_recr_find(space, &space->records[space->wheel[slot]].token));
+        space->nexpired++;
+    }
     return ;
 }
 
 /*
- * the routine to make a record after sending a dht query msg.
- * in case to check the rightness of response message.
+ * to tell whether response of @rspId can answer query of @qryId.
+ */
+static
+int _aux_recr_answers(int qryId, int rspId)
+{
+    switch(rspId) {
+    case VDHT_PING_R:
+        return (qryId == VDHT_PING);
+    case VDHT_FIND_NODE_R:
+        return (qryId == VDHT_FIND_NODE);
+    case VDHT_FIND_CLOSEST_NODES_R:
+        // closest nodes are also answered to @find_node and @find_service
+        // that peer has no result for.
+        return ((qryId == VDHT_FIND_CLOSEST_NODES) ||
+                (qryId == VDHT_FIND_NODE) ||
+                (qryId == VDHT_FIND_SERVICE));
+    case VDHT_REFLEX_R:
+        return (qryId == VDHT_REFLEX);
+    case VDHT_PROBE_R:
+        return (qryId == VDHT_PROBE);
+    case VDHT_FIND_SERVICE_R:
+        return (qryId == VDHT_FIND_SERVICE);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * the routine to make token for a dht query msg before sending it, and
+ * a record of the token in case to check the rightness of response message.
+ * when pool is used up, records timed out but not reaped yet are expired,
+ * and if still no room, the query is rejected rather than to take room of
+ * queries still waiting for responses.
  *
  * @space:
- * @token:
+ * @token: [out]
+ * @addr:  address of peer to send query to.
+ * @dhtId: dhtId of query.
  */
 static
-int _vroute_recr_space_make(struct vroute_recr_space* space, vtoken* token)
+int _vroute_recr_space_make(struct vroute_recr_space* space, vtoken* token, struct sockaddr_in* addr, int dhtId)
 {
     struct vrecord* record = NULL;
+    time_t now = time(NULL);
+    int slot = (int)(now % VRECR_NSLOTS);
+    int pos = 0;
+    int idx = 0;
+    int i = 0;
 
     vassert(space);
     vassert(token);
+    vassert(addr);
+
+    vtoken_make(token);
+    vlock_enter(&space->lock);
+    if (space->wheel_ts[slot] != now) {
+        // records left in slot were sent VRECR_NSLOTS seconds ago at least.
+        _aux_recr_expire_slot(space, slot);
+        space->wheel_ts[slot] = now;
+    }
+    for (i = 0; (space->free_idx == VRECR_NIL) && (i < VRECR_NSLOTS); i++) {
+        // only those timed out but not reaped yet.
+        if ((now - space->wheel_ts[i]) > space->max_recr_period) {
+            _aux_recr_expire_slot(space, i);
+        }
+    }
+    if ((space->free_idx == VRECR_NIL) || (_aux_recr_find(space, token) != VRECR_NIL)) {
+        space->nfulls += (space->free_idx == VRECR_NIL);
+        vlock_leave(&space->lock);
+        return -1;
+    }
 
-    record = vrecord_alloc();
-    vlogEv((!record), elog_vrecord_alloc);
-    retE((!record));
+    idx = space->free_idx;
+    record = &space->records[idx];
+    space->free_idx = record->next;
 
-    vrecord_init(record, token);
-    varray_add_tail(&space->records, record);
+    vtoken_copy(&record->token, token);
+    record->snd_us = vtime_now_us();
+    record->dest   = *addr;
+    record->dhtId  = dhtId;
+    record->slot = slot;
+    record->prev = VRECR_NIL;
+    record->next = space->wheel[slot];
+    if (record->next != VRECR_NIL) {
+        space->records[record->next].prev = idx;
+    }
+    space->wheel[slot] = idx;
 
+    pos = _aux_recr_hash(token);
+    while (space->table[pos] != VRECR_NIL) {
+        pos = (pos + 1) & (VRECR_TB_SZ - 1);
+    }
+    space->table[pos] = idx;
+    space->nrecords++;
+    vlock_leave(&space->lock);
     return 0;
 }
 
+/*
+ * the routine to drop record of query failed to send.
+ *
+ * @space:
+ * @token:
+ */
+static
+void _vroute_recr_space_drop(struct vroute_recr_space* space, vtoken* token)
+{
+    int pos = 0;
+
+    vassert(space);
+    vassert(token);
+
+    vlock_enter(&space->lock);
+    pos = _aux_recr_find(space, token);
+    if (pos != VRECR_NIL) {
+        _aux_recr_drop(space, pos);
+    }
+    vlock_leave(&space->lock);
+    return ;
+}
+
 /*
  * the routine to check the dht message( always response message) with given
- * token is in the messages record that sent before.
+ * token is in the messages record that sent before. a response taken must
+ * come from host that query was sent to, and answer the kind of query;
+ * otherwise it's rejected with record kept for the real response. port of
+ * peer is not matched, for the same reason as mac token below.
  *
  * @space:
  * @token:
+ * @addr:  address of peer response is from.
+ * @dhtId: dhtId of response.
+ * @dest:  [out] address of peer query was sent to.
+ * @rtt:   [out] round trip time of query in microseconds.
  */
 static
-int _vroute_recr_space_check(struct vroute_recr_space* space, vtoken* token)
+int _vroute_recr_space_check(struct vroute_recr_space* space, vtoken* token, struct sockaddr_in* addr, int dhtId, struct sockaddr_in* dest, int* rtt)
 {
     struct vrecord* record = NULL;
     int found = 0;
-    int i = 0;
+    int pos = 0;
 
     vassert(space);
     vassert(token);
+    vassert(addr);
+    vassert(dest);
+    vassert(rtt);
 
-    for (i = 0; i < varray_size(&space->records); i++) {
-        record = (struct vrecord*)varray_get(&space->records, i);
-        if (vtoken_equal(&record->token, token)) {
-            varray_del(&space->records, i);
-            vrecord_free(record);
-            found = 1;
-            break;
+    vlock_enter(&space->lock);
+    pos = _aux_recr_find(space, token);
+    if (pos != VRECR_NIL) {
+        record = &space->records[space->table[pos]];
+        if ((record->dest.sin_addr.s_addr != addr->sin_addr.s_addr) ||
+            !_aux_recr_answers(record->dhtId, dhtId)) {
+            pos = VRECR_NIL;
         }
     }
+    if (pos != VRECR_NIL) {
+        *rtt  = (int)(vtime_now_us() - record->snd_us);
+        *dest = record->dest;
+        _aux_recr_drop(space, pos);
+        space->nmatched++;
+        found = 1;
+    } else {
+        space->nrejected++;
+    }
+    vlock_leave(&space->lock);
     return found;
 }
 
@@ -110,20 +304,17 @@ int _vroute_recr_space_check(struct vroute_recr_space* space, vtoken* token)
 static
 void _vroute_recr_space_timed_reap(struct vroute_recr_space* space)
 {
-    struct vrecord* record = NULL;
     time_t now = time(NULL);
     int i = 0;
     vassert(space);
 
-    for (i = 0; i < varray_size(&space->records);) {
-        record = (struct vrecord*)varray_get(&space->records, i);
-        if ((now - record->snd_ts) > space->max_recr_period) {
-            varray_del(&space->records, i);
-            vrecord_free(record);
-        } else {
-            i++;
+    vlock_enter(&space->lock);
+    for (i = 0; i < VRECR_NSLOTS; i++) {
+        if ((now - space->wheel_ts[i]) > space->max_recr_period) {
+            _aux_recr_expire_slot(space, i);
         }
     }
+    vlock_leave(&space->lock);
     return ;
 }
 
@@ -134,13 +325,23 @@ void _vroute_recr_space_timed_reap(struct vroute_recr_space* space)
 static
 void _vroute_recr_space_clear(struct vroute_recr_space* space)
 {
-    struct vrecord* record = NULL;
+    int i = 0;
     vassert(space);
 
-    while (varray_size(&space->records)) {
-        record = (struct vrecord*)varray_pop_tail(&space->records);
-        vrecord_free(record);
+    vlock_enter(&space->lock);
+    for (i = 0; i < VRECR_TB_SZ; i++) {
+        space->table[i] = VRECR_NIL;
+    }
+    for (i = 0; i < VRECR_CAPC; i++) {
+        space->records[i].next = (i + 1 < VRECR_CAPC) ? (i + 1) : VRECR_NIL;
+    }
+    for (i = 0; i < VRECR_NSLOTS; i++) {
+        space->wheel[i] = VRECR_NIL;
+        space->wheel_ts[i] = 0;
     }
+    space->free_idx = 0;
+    space->nrecords = 0;
+    vlock_leave(&space->lock);
     return ;
 }
 
@@ -152,34 +353,331 @@ void _vroute_recr_space_clear(struct vroute_recr_space* space)
 static
 void _vroute_recr_space_dump(struct vroute_recr_space* space)
 {
-    struct vrecord* record = NULL;
-    int i = 0;
     vassert(space);
 
-    for (i = 0; i < varray_size(&space->records); i++) {
-        record = (struct vrecord*)varray_get(&space->records, i);
-        vrecord_dump(record);
-    }
+    vlock_enter(&space->lock);
+    vdump(printf("-> RECORDS: { outstanding:%d, matched:%u, expired:%u, rejected:%u, full:%u }",
+            space->nrecords, space->nmatched, space->nexpired, space->nrejected, space->nfulls));
+    vlock_leave(&space->lock);
     return ;
 }
 
 static
 struct vroute_recr_space_ops route_record_space_ops = {
     .make        = _vroute_recr_space_make,
+    .drop        = _vroute_recr_space_drop,
     .check       = _vroute_recr_space_check,
     .timed_reap  = _vroute_recr_space_timed_reap,
     .clear       = _vroute_recr_space_clear,
     .dump        = _vroute_recr_space_dump
 };
 
-int vroute_recr_space_init(struct vroute_recr_space* space)
+/*
+ * with mac token, nothing is recorded for a query. instead its token is
+ * made of a nonce, dhtId of query and time of sending, followed by mac of
+ * them and address of peer with key of current epoch. the nonce is made
+ * of low 48 bits of monotonic microseconds of sending, for rtt of query,
+ * and a counter to tell queries sent in same microsecond. a response is taken
+ * only if mac of its token can be recomputed with key of either current
+ * or previous epoch, and it's not older than max_recr_period. keys are
+ * rotated every VRECR_KEY_PERIOD seconds.
+ *
+ * port of peer is not covered by mac, since response to a large query
+ * can come over tcp connection from an ephemeral port of peer. neither is
+ * a token taken only once, so a response replayed in time is taken again,
+ * which route tolerates as a duplicate.
+ */
+#define VRECR_TK_TYPE  ((int)7)    // bytes of nonce before it.
+#define VRECR_TK_TS    ((int)8)
+#define VRECR_TK_MAC   ((int)12)
+#define VRECR_US_MASK  ((uint64_t)0xffffffffffffULL)
+
+#define VRECR_ROTL(x, b) ((uint64_t)(((x) << (b)) | ((x) >> (64 - (b)))))
+#define VRECR_SIPROUND(v0, v1, v2, v3) do { \
+        v0 += v1; v1 = VRECR_ROTL(v1, 13); v1 ^= v0; v0 = VRECR_ROTL(v0, 32); \
+        v2 += v3; v3 = VRECR_ROTL(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = VRECR_ROTL(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = VRECR_ROTL(v1, 17); v1 ^= v2; v2 = VRECR_ROTL(v2, 32); \
+    } while (0)
+
+/*
+ * siphash-2-4 of @data with 128-bit @key.
+ */
+static
+uint64_t _aux_recr_siphash(uint64_t* key, uint8_t* data, int len)
 {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+    uint64_t last = ((uint64_t)len) << 56;
+    uint64_t m = 0;
+    int i = 0;
+    int k = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        for (m = 0, k = 0; k < 8; k++) {
+            m |= ((uint64_t)data[i + k]) << (8 * k);
+        }
+        v3 ^= m;
+        VRECR_SIPROUND(v0, v1, v2, v3);
+        VRECR_SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    for (k = 0; i + k < len; k++) {
+        last |= ((uint64_t)data[i + k]) << (8 * k);
+    }
+    v3 ^= last;
+    VRECR_SIPROUND(v0, v1, v2, v3);
+    VRECR_SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    for (k = 0; k < 4; k++) {
+        VRECR_SIPROUND(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static
+uint64_t _aux_recr_mac(uint64_t* key, vtoken* token, struct sockaddr_in* addr)
+{
+    uint8_t data[VRECR_TK_MAC + sizeof(addr->sin_addr)];
+
+    memcpy(data, token->data, VRECR_TK_MAC);
+    memcpy(data + VRECR_TK_MAC, &addr->sin_addr, sizeof(addr->sin_addr));
+    return _aux_recr_siphash(key, data, sizeof(data));
+}
+
+static
+void _aux_recr_mac_key(uint64_t* key)
+{
+    vtoken token;
+    int fd = 0;
+    int ret = 0;
+
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        ret = read(fd, key, 2 * sizeof(uint64_t));
+        close(fd);
+    }
+    if (ret != 2 * sizeof(uint64_t)) {
+        vtoken_make(&token);
+        memcpy(key, token.data, 2 * sizeof(uint64_t));
+    }
+    return ;
+}
+
+/*
+ * to rotate keys when epoch of @now comes, where key of current epoch
+ * becomes previous one unless epochs are skipped.
+ */
+static
+void _aux_recr_mac_rotate(struct vroute_recr_space* space, time_t now)
+{
+    uint32_t epoch = (uint32_t)(now / VRECR_KEY_PERIOD);
+
+    if (epoch == space->key_epoch) {
+        return ;
+    }
+    if (epoch == space->key_epoch + 1) {
+        memcpy(space->keys[1], space->keys[0], sizeof(space->keys[0]));
+    } else {
+        _aux_recr_mac_key(space->keys[1]);
+    }
+    _aux_recr_mac_key(space->keys[0]);
+    space->key_epoch = epoch;
+    return ;
+}
+
+/*
+ * the routine to make mac token for a dht query msg before sending it.
+ *
+ * @space:
+ * @token: [out]
+ * @addr:  address of peer to send query to.
+ * @dhtId: dhtId of query.
+ */
+static
+int _vroute_recr_space_mac_make(struct vroute_recr_space* space, vtoken* token, struct sockaddr_in* addr, int dhtId)
+{
+    time_t now = time(NULL);
+    uint64_t nonce = 0;
+    uint64_t mac = 0;
+    int i = 0;
+
     vassert(space);
+    vassert(token);
+    vassert(addr);
+
+    vlock_enter(&space->lock);
+    _aux_recr_mac_rotate(space, now);
+    nonce = ((vtime_now_us() & VRECR_US_MASK) << 8) | (space->nonce++ & 0xff);
+    for (i = 0; i < VRECR_TK_TYPE; i++) {
+        token->data[i] = (uint8_t)(nonce >> (8 * i));
+    }
+    token->data[VRECR_TK_TYPE] = (uint8_t)dhtId;
+    set_uint32(token->data + VRECR_TK_TS, (uint32_t)now);
+    mac = _aux_recr_mac(space->keys[0], token, addr);
+    vlock_leave(&space->lock);
+
+    memcpy(token->data + VRECR_TK_MAC, &mac, sizeof(mac));
+    return 0;
+}
+
+/*
+ * nothing to drop, since nothing is recorded.
+ */
+static
+void _vroute_recr_space_mac_drop(struct vroute_recr_space* space, vtoken* token)
+{
+    vassert(space);
+    vassert(token);
+    return ;
+}
+
+/*
+ * the routine to check token of response by recomputing its mac.
+ *
+ * @space:
+ * @token:
+ * @addr:  address of peer response is from.
+ * @dhtId: dhtId of response.
+ * @dest:  [out] address of peer query was sent to, which is @addr, since
+ *         host of it is covered by mac.
+ * @rtt:   [out] round trip time of query in microseconds.
+ */
+static
+int _vroute_recr_space_mac_check(struct vroute_recr_space* space, vtoken* token, struct sockaddr_in* addr, int dhtId, struct sockaddr_in* dest, int* rtt)
+{
+    time_t now = time(NULL);
+    uint32_t ts = get_uint32(token->data + VRECR_TK_TS);
+    uint32_t epoch = ts / VRECR_KEY_PERIOD;
+    uint64_t* key = NULL;
+    uint64_t snd_us = 0;
+    uint64_t mac = 0;
+    int found = 0;
+    int i = 0;
+
+    vassert(space);
+    vassert(token);
+    vassert(addr);
+    vassert(dest);
+    vassert(rtt);
+
+    memcpy(&mac, token->data + VRECR_TK_MAC, sizeof(mac));
+
+    vlock_enter(&space->lock);
+    _aux_recr_mac_rotate(space, now);
+    if (epoch == space->key_epoch) {
+        key = space->keys[0];
+    } else if (epoch + 1 == space->key_epoch) {
+        key = space->keys[1];
+    }
+    if (!key || !_aux_recr_answers(token->data[VRECR_TK_TYPE], dhtId) ||
+        (_aux_recr_mac(key, token, addr) != mac)) {
+        space->nrejected++;
+    } else if ((ts > (uint32_t)now) || ((uint32_t)now - ts > (uint32_t)space->max_recr_period)) {
+        space->nexpired++;
+    } else {
+        space->nmatched++;
+        found = 1;
+    }
+    vlock_leave(&space->lock);
+
+    if (found) {
+        for (i = 1; i < VRECR_TK_TYPE; i++) {
+            snd_us |= ((uint64_t)token->data[i]) << (8 * (i - 1));
+        }
+        *rtt  = (int)((vtime_now_us() - snd_us) & VRECR_US_MASK);
+        *dest = *addr;
+    }
+    return found;
+}
+
+static
+void _vroute_recr_space_mac_timed_reap(struct vroute_recr_space* space)
+{
+    vassert(space);
+
+    vlock_enter(&space->lock);
+    _aux_recr_mac_rotate(space, time(NULL));
+    vlock_leave(&space->lock);
+    return ;
+}
+
+/*
+ * tokens made before are all invalidated by fresh keys.
+ */
+static
+void _vroute_recr_space_mac_clear(struct vroute_recr_space* space)
+{
+    vassert(space);
+
+    vlock_enter(&space->lock);
+    _aux_recr_mac_key(space->keys[0]);
+    _aux_recr_mac_key(space->keys[1]);
+    space->key_epoch = (uint32_t)(time(NULL) / VRECR_KEY_PERIOD);
+    vlock_leave(&space->lock);
+    return ;
+}
+
+static
+void _vroute_recr_space_mac_dump(struct vroute_recr_space* space)
+{
+    vassert(space);
+
+    vlock_enter(&space->lock);
+    vdump(printf("-> RECORDS: { mac token, epoch:%u, matched:%u, expired:%u, rejected:%u }",
+            space->key_epoch, space->nmatched, space->nexpired, space->nrejected));
+    vlock_leave(&space->lock);
+    return ;
+}
+
+static
+struct vroute_recr_space_ops route_record_space_mac_ops = {
+    .make        = _vroute_recr_space_mac_make,
+    .drop        = _vroute_recr_space_mac_drop,
+    .check       = _vroute_recr_space_mac_check,
+    .timed_reap  = _vroute_recr_space_mac_timed_reap,
+    .clear       = _vroute_recr_space_mac_clear,
+    .dump        = _vroute_recr_space_mac_dump
+};
+
+int vroute_recr_space_init(struct vroute_recr_space* space, struct vconfig* cfg)
+{
+    vassert(space);
+    vassert(cfg);
 
     space->max_recr_period = 5; //5s;
-    varray_init(&space->records, 8);
+    vassert(space->max_recr_period < VRECR_NSLOTS - 1);
+    vassert(space->max_recr_period < VRECR_KEY_PERIOD);
+    space->nmatched  = 0;
+    space->nexpired  = 0;
+    space->nrejected = 0;
+    space->nfulls    = 0;
+    space->records = NULL;
+    space->table   = NULL;
+    space->nonce   = 0;
+
+    space->mac_on = cfg->ext_ops->get_dht_mac_token(cfg);
+    if (space->mac_on) {
+        vlock_init(&space->lock);
+        space->ops = &route_record_space_mac_ops;
+        space->ops->clear(space);
+        return 0;
+    }
+
+    space->records = (struct vrecord*)malloc(VRECR_CAPC * sizeof(struct vrecord));
+    vlogEv((!space->records), elog_malloc);
+    retE((!space->records));
+    space->table = (int*)malloc(VRECR_TB_SZ * sizeof(int));
+    vlogEv((!space->table), elog_malloc);
+    ret1E((!space->table), free(space->records));
+    vlock_init(&space->lock);
 
     space->ops = &route_record_space_ops;
+    space->ops->clear(space);
     return 0;
 }
 
@@ -188,7 +686,9 @@ void vroute_recr_space_deinit(struct vroute_recr_space* space)
     vassert(space);
 
     space->ops->clear(space);
-    varray_deinit(&space->records);
+    free(space->table);
+    free(space->records);
+    vlock_deinit(&space->lock);
 
     return ;
 }
@@ -109,6 +109,7 @@ int _aux_srvc_get_service_cb(void* item, void* cookie)
 static
 int _vroute_srvc_space_add_service(struct vroute_srvc_space* space, vsrvcInfo* srvci)
 {
+    struct vroute_srvc_space_bucket* bucket = NULL;
     struct varray* srvcs = NULL;
     struct vservice*  to = NULL;
     time_t now = time(NULL);
@@ -118,7 +119,10 @@ int _vroute_srvc_space_add_service(struct vroute_srvc_space* space, vsrvcInfo* s
     vassert(space);
     vassert(srvci);
 
-    srvcs = &space->bucket[vsrvcId_bucket(&srvci->hostid)].srvcs;
+    bucket = &space->bucket[vsrvcId_bucket(&srvci->hostid)];
+    srvcs  = &bucket->srvcs;
+
+    vlock_enter(&bucket->lock);
     {
         void* argv[] = {
             &to,
@@ -134,13 +138,14 @@ int _vroute_srvc_space_add_service(struct vroute_srvc_space* space, vsrvcInfo* s
             vservice_init(to, srvci, now);
         } else if (varray_size(srvcs) < space->bucket_sz) {
             to = vservice_alloc();
-            retE((!to));
+            ret1E((!to), vlock_leave(&bucket->lock));
             vservice_init(to, srvci, now);
             varray_add_tail(srvcs, to);
         } else {
             //bucket is full, discard it (worst one).
         }
     }
+    vlock_leave(&bucket->lock);
     return 0;
 }
 
@@ -173,11 +178,14 @@ int _vroute_srvc_space_get_service(struct vroute_srvc_space* space, vsrvcHash* h
         };
 
         srvcs = &space->bucket[i].srvcs;
+        vlock_enter(&space->bucket[i].lock);
         varray_iterate(srvcs, _aux_srvc_get_service_cb, argv);
         if (to) {
             vsrvcInfo_copy(srvci, to->srvci);
+            to = NULL;
             found = 1;
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return found;
 }
@@ -196,9 +204,11 @@ void _vroute_srvc_space_clear(struct vroute_srvc_space* space)
 
     for (i = 0; i < NBUCKETS; i++) {
         svcs = &space->bucket[i].srvcs;
+        vlock_enter(&space->bucket[i].lock);
         while(varray_size(svcs) > 0) {
             vservice_free((struct vservice*)varray_del(svcs, 0));
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return;
 }
@@ -218,9 +228,11 @@ void _vroute_srvc_space_inspect(struct vroute_srvc_space* space, vroute_srvc_spa
 
     for (i = 0; i < NBUCKETS; i++) {
         services = &space->bucket[i].srvcs;
+        vlock_enter(&space->bucket[i].lock);
         for (j = 0; j < varray_size(services); j++) {
             cb((struct vservice*)varray_get(services, j), cookie, token, insp_id);
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return ;
 }
@@ -242,6 +254,7 @@ void _vroute_srvc_space_dump(struct vroute_srvc_space* space)
 
     for (i = 0; i < NBUCKETS; i++) {
         svcs = &space->bucket[i].srvcs;
+        vlock_enter(&space->bucket[i].lock);
         for (j = 0; j < varray_size(svcs); j++) {
             if (!titled) {
                 vdump(printf("-> list of services in service routing space:"));
@@ -251,6 +264,7 @@ void _vroute_srvc_space_dump(struct vroute_srvc_space* space)
             vservice_dump((struct vservice*)varray_get(svcs, j));
             printf(" }\n");
         }
+        vlock_leave(&space->bucket[i].lock);
     }
     return;
 }
@@ -272,6 +286,7 @@ int vroute_srvc_space_init(struct vroute_srvc_space* space, struct vconfig* cfg)
 
     for (i = 0; i < NBUCKETS; i++) {
         varray_init(&space->bucket[i].srvcs, 8);
+        vlock_init(&space->bucket[i].lock);
     }
     space->bucket_sz = cfg->ext_ops->get_route_bucket_sz(cfg);
     space->ops = &route_srvc_space_ops;
@@ -286,6 +301,7 @@ void vroute_srvc_space_deinit(struct vroute_srvc_space* space)
     space->ops->clear(space);
     for (i = 0; i < NBUCKETS; i++) {
         varray_deinit(&space->bucket[i].srvcs);
+        vlock_deinit(&space->bucket[i].lock);
     }
     return ;
 }
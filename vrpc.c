@@ -15,6 +15,7 @@ void* _vrpc_unix_open(struct vsockaddr* addr)
 {
     struct sockaddr_un* saddr = to_sockaddr_sun(addr);
     struct vunix_domain* unx = NULL;
+    int flags = 0;
     int ret = 0;
     int fd  = 0;
     vassert(addr);
@@ -38,6 +39,15 @@ void* _vrpc_unix_open(struct vsockaddr* addr)
         retE_p((1));
     }
 
+    flags = fcntl(fd, F_GETFL, 0);
+    ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    vlogEv((ret < 0), elog_fcntl);
+    if (ret < 0) {
+        free(unx);
+        close(fd);
+        retE_p((1));
+    }
+
     unx->sock_fd = fd;
     return unx;
 }
@@ -63,6 +73,9 @@ int _vrpc_unix_sndto(void* impl, struct vmsg_sys* msg)
                  0,
                 (struct sockaddr*)&msg->addr.vsun_addr,
                 sizeof(struct sockaddr_un));
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // not writable, keep errno for caller.
+    }
     vlogEv((ret < 0), elog_sendto);
     retE((ret < 0));
     return ret;
@@ -89,6 +102,9 @@ int _vrpc_unix_rcvfrom(void* impl, struct vmsg_sys* msg)
                 0,
                (struct sockaddr*)&msg->addr.vsun_addr,
                (socklen_t*)&len);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // no more msg, keep errno for caller.
+    }
     vlogEv((ret < 0), elog_recvfrom);
     retE((ret < 0));
     msg->len = ret;
@@ -146,9 +162,12 @@ static
 struct vrpc_base_ops unix_base_ops = {
     .open    = _vrpc_unix_open,
     .sndto   = _vrpc_unix_sndto,
+    .sndmto  = NULL,
     .rcvfrom = _vrpc_unix_rcvfrom,
+    .rcvmfrom= NULL,
     .close   = _vrpc_unix_close,
     .getfd   = _vrpc_unix_getfd,
+    .sndable = NULL,
     .dump    = _vrpc_unix_dump
 };
 
@@ -162,14 +181,58 @@ struct vudp {
     uint16_t pad;
     int sock_fd;
     int ttl;
+
+    // for batched receiving.
+    struct mmsghdr rmsgs[VRPC_RCV_BATCH];
+    struct iovec   riovs[VRPC_RCV_BATCH];
+    char rctrls[VRPC_RCV_BATCH][VRPC_CTRL_SZ];
+
+    // for batched sending, control headers are prebuilt.
+    struct mmsghdr smsgs[VRPC_SND_BATCH];
+    struct iovec   siovs[VRPC_SND_BATCH];
+    struct in_pktinfo* spis[VRPC_SND_BATCH];
+    char sctrls[VRPC_SND_BATCH][VRPC_CTRL_SZ];
 };
 
+/*
+ * to prebuild msg headers with IP_PKTINFO control msg for batched
+ * sending, only address, spec address and data need to be filled
+ * before sending.
+ * @udp:
+ */
+static
+void _aux_udp_prebuild(struct vudp* udp)
+{
+    struct msghdr*  mhdr = NULL;
+    struct cmsghdr* cmsg = NULL;
+    int i = 0;
+    vassert(udp);
+
+    for (i = 0; i < VRPC_SND_BATCH; i++) {
+        mhdr = &udp->smsgs[i].msg_hdr;
+        mhdr->msg_namelen = sizeof(struct sockaddr_in);
+        mhdr->msg_iov     = &udp->siovs[i];
+        mhdr->msg_iovlen  = 1;
+        mhdr->msg_control = udp->sctrls[i];
+        mhdr->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+        mhdr->msg_flags   = 0;
+
+        cmsg = CMSG_FIRSTHDR(mhdr);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type  = IP_PKTINFO;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(struct in_pktinfo));
+        udp->spis[i] = (struct in_pktinfo*)CMSG_DATA(cmsg);
+    }
+    return ;
+}
+
 /*
  * to open a udp socket for rpc.
  * @addr:
+ * @reuseport: whether the socket shares its port with sibling sockets.
  */
 static
-void* _vrpc_udp_open(struct vsockaddr* addr)
+void* _aux_udp_open(struct vsockaddr* addr, int reuseport)
 {
     struct sockaddr_in* saddr = to_sockaddr_sin(addr);
     struct vudp* udp = NULL;
@@ -191,6 +254,15 @@ void* _vrpc_udp_open(struct vsockaddr* addr)
     ret1E_p((fd < 0), free(udp));
 
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reuseport) {
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        vlogEv((ret < 0), elog_setsockopt);
+        if (ret < 0) {
+            close(fd);
+            free(udp);
+            retE_p((1));
+        }
+    }
     setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on));
     setsockopt(fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(int));
 
@@ -214,9 +286,27 @@ void* _vrpc_udp_open(struct vsockaddr* addr)
 
     udp->port = saddr->sin_port;
     udp->sock_fd   = fd;
+    _aux_udp_prebuild(udp);
     return udp;
 }
 
+static
+void* _vrpc_udp_open(struct vsockaddr* addr)
+{
+    return _aux_udp_open(addr, 0);
+}
+
+/*
+ * to open one of udp sockets bound to the same port with SO_REUSEPORT,
+ * kernel then balances incoming datagrams among them.
+ * @addr:
+ */
+static
+void* _vrpc_udp_shard_open(struct vsockaddr* addr)
+{
+    return _aux_udp_open(addr, 1);
+}
+
 /*
  *  to send a msg for rpc.
  *
@@ -230,7 +320,7 @@ int _vrpc_udp_sndto(void* impl, struct vmsg_sys* msg)
     struct sockaddr_in* spec_addr = to_sockaddr_sin(&msg->spec);
     struct in_pktinfo* pi = NULL;
     struct cmsghdr*  cmsg = NULL;
-    char msg_control[BUF_SZ];
+    char msg_control[VRPC_CTRL_SZ];
     struct iovec iovec[1];
     struct msghdr mhdr;
     int ret = 0;
@@ -238,7 +328,7 @@ int _vrpc_udp_sndto(void* impl, struct vmsg_sys* msg)
     vassert(udp);
     vassert(msg);
 
-    memset(msg_control, 0, BUF_SZ);
+    memset(msg_control, 0, VRPC_CTRL_SZ);
     memset(iovec, 0, sizeof(iovec));
     memset(&mhdr, 0, sizeof(mhdr));
 
@@ -249,7 +339,7 @@ int _vrpc_udp_sndto(void* impl, struct vmsg_sys* msg)
     mhdr.msg_iov      = iovec;
     mhdr.msg_iovlen   = sizeof(iovec)/sizeof(struct iovec);
     mhdr.msg_control  = msg_control;
-    mhdr.msg_controllen = BUF_SZ;
+    mhdr.msg_controllen = VRPC_CTRL_SZ;
     mhdr.msg_flags    = 0;
 
     cmsg = CMSG_FIRSTHDR(&mhdr);
@@ -261,6 +351,9 @@ int _vrpc_udp_sndto(void* impl, struct vmsg_sys* msg)
     mhdr.msg_controllen = CMSG_SPACE(sizeof(*pi));
 
     ret = sendmsg(udp->sock_fd, &mhdr, 0);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // not writable, keep errno for caller.
+    }
     vlogEv((ret < 0), elog_sendmsg);
     //vlogEv((ret < 0), vsockaddr_dump(to_sockaddr_sin(&msg->addr)));
     //vlogEv((ret < 0), vsockaddr_dump(to_sockaddr_sin(&msg->spec)));
@@ -270,6 +363,68 @@ int _vrpc_udp_sndto(void* impl, struct vmsg_sys* msg)
     return ret;
 }
 
+/*
+ * to send a batch of msgs with one syscall.
+ *
+ * @impl:
+ * @msgs:
+ * @num:
+ * return: number of msgs sent, which might be less than @num.
+ */
+static
+int _vrpc_udp_sndmto(void* impl, struct vmsg_sys** msgs, int num)
+{
+    struct vudp* udp = (struct vudp*)impl;
+    int ret = 0;
+    int i = 0;
+
+    vassert(udp);
+    vassert(msgs);
+    vassert((num > 0) && (num <= VRPC_SND_BATCH));
+
+    for (i = 0; i < num; i++) {
+        udp->siovs[i].iov_base = msgs[i]->data;
+        udp->siovs[i].iov_len  = msgs[i]->len;
+        udp->smsgs[i].msg_hdr.msg_name = to_sockaddr_sin(&msgs[i]->addr);
+        udp->spis[i]->ipi_spec_dst = to_sockaddr_sin(&msgs[i]->spec)->sin_addr;
+    }
+
+    ret = sendmmsg(udp->sock_fd, udp->smsgs, num, 0);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // not writable, keep errno for caller.
+    }
+    vlogEv((ret < 0), elog_sendmmsg);
+    retE((ret < 0));
+    return ret;
+}
+
+/*
+ * to get the local address which the msg was sent to from pktinfo.
+ * @udp:
+ * @mhdr:
+ * @msg:
+ */
+static
+void _aux_udp_get_spec(struct vudp* udp, struct msghdr* mhdr, struct vmsg_sys* msg)
+{
+    struct sockaddr_in* spec_addr = to_sockaddr_sin(&msg->spec);
+    struct cmsghdr* cmsg = NULL;
+
+    for (cmsg = CMSG_FIRSTHDR(mhdr); cmsg != NULL; cmsg = CMSG_NXTHDR(mhdr, cmsg)) {
+        struct in_pktinfo* pi = NULL;
+
+        if ((cmsg->cmsg_level != IPPROTO_IP)
+            || (cmsg->cmsg_type != IP_PKTINFO)) {
+            continue;
+        }
+        pi = (struct in_pktinfo*)CMSG_DATA(cmsg);
+        spec_addr->sin_family = AF_INET;
+        spec_addr->sin_port   = udp->port;
+        spec_addr->sin_addr   = pi->ipi_spec_dst;
+    }
+    return ;
+}
+
 /* to receive a msg, including from where.
  *
  * @impl:
@@ -279,8 +434,6 @@ static
 int _vrpc_udp_rcvfrom(void* impl, struct vmsg_sys* msg)
 {
     struct vudp* udp = (struct vudp*)impl;
-    struct sockaddr_in* spec_addr = to_sockaddr_sin(&msg->spec);
-    struct cmsghdr* cmsg = NULL;
     char msg_control[BUF_SZ];
     struct iovec iovec[1];
     struct msghdr mhdr;
@@ -303,24 +456,63 @@ int _vrpc_udp_rcvfrom(void* impl, struct vmsg_sys* msg)
     mhdr.msg_flags    = 0;
 
     ret = recvmsg(udp->sock_fd, &mhdr, 0);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // no more msg, keep errno for caller.
+    }
     vlogEv((ret < 0), elog_recvmsg);
     //vlogEv((ret < 0), vsockaddr_dump(to_sockaddr_sin(&msg->addr)));
     //vlogEv((ret < 0), vsockaddr_dump(to_sockaddr_sin(&msg->spec)));
     retE((ret < 0));
 
-    for (cmsg = CMSG_FIRSTHDR(&mhdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&mhdr, cmsg)) {
-        struct in_pktinfo* pi = NULL;
+    _aux_udp_get_spec(udp, &mhdr, msg);
+    msg->len = ret;
+    return ret;
+}
 
-        if ((cmsg->cmsg_level != IPPROTO_IP)
-            || (cmsg->cmsg_type != IP_PKTINFO)) {
-            continue;
-        }
-        pi = (struct in_pktinfo*)CMSG_DATA(cmsg);
-        spec_addr->sin_family = AF_INET;
-        spec_addr->sin_port   = udp->port;
-        spec_addr->sin_addr   = pi->ipi_spec_dst;
+/* to receive a batch of msgs with one syscall.
+ *
+ * @impl:
+ * @msgs: msgs with receiving buffer.
+ * @num:  number of msgs.
+ */
+static
+int _vrpc_udp_rcvmfrom(void* impl, struct vmsg_sys** msgs, int num)
+{
+    struct vudp* udp = (struct vudp*)impl;
+    struct msghdr* mhdr = NULL;
+    int ret = 0;
+    int i = 0;
+
+    vassert(udp);
+    vassert(msgs);
+    vassert((num > 0) && (num <= VRPC_RCV_BATCH));
+
+    for (i = 0; i < num; i++) {
+        udp->riovs[i].iov_base = msgs[i]->data;
+        udp->riovs[i].iov_len  = msgs[i]->len;
+
+        mhdr = &udp->rmsgs[i].msg_hdr;
+        mhdr->msg_name    = to_sockaddr_sin(&msgs[i]->addr);
+        mhdr->msg_namelen = sizeof(struct sockaddr_in);
+        mhdr->msg_iov     = &udp->riovs[i];
+        mhdr->msg_iovlen  = 1;
+        mhdr->msg_control = udp->rctrls[i];
+        mhdr->msg_controllen = VRPC_CTRL_SZ;
+        mhdr->msg_flags   = 0;
+        udp->rmsgs[i].msg_len = 0;
+    }
+
+    ret = recvmmsg(udp->sock_fd, udp->rmsgs, num, MSG_DONTWAIT, NULL);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return -1; // no more msg, keep errno for caller.
+    }
+    vlogEv((ret < 0), elog_recvmmsg);
+    retE((ret < 0));
+
+    for (i = 0; i < ret; i++) {
+        _aux_udp_get_spec(udp, &udp->rmsgs[i].msg_hdr, msgs[i]);
+        msgs[i]->len = udp->rmsgs[i].msg_len;
     }
-    msg->len = ret;
     return ret;
 }
 
@@ -379,179 +571,1881 @@ static
 struct vrpc_base_ops udp_base_ops = {
     .open    = _vrpc_udp_open,
     .sndto   = _vrpc_udp_sndto,
+    .sndmto  = _vrpc_udp_sndmto,
     .rcvfrom = _vrpc_udp_rcvfrom,
+    .rcvmfrom= _vrpc_udp_rcvmfrom,
     .close   = _vrpc_udp_close,
     .getfd   = _vrpc_udp_getfd,
+    .sndable = NULL,
     .dump    = _vrpc_udp_dump
 };
 
 /*
- *
+ * downword method set for sharded udp mode.
  */
 static
-struct vrpc_base_ops* rpc_base_ops[VRPC_MODE_BUTT] = {
-    &unix_base_ops,
-    &udp_base_ops,
-    NULL
+struct vrpc_base_ops udp_shard_base_ops = {
+    .open    = _vrpc_udp_shard_open,
+    .sndto   = _vrpc_udp_sndto,
+    .sndmto  = _vrpc_udp_sndmto,
+    .rcvfrom = _vrpc_udp_rcvfrom,
+    .rcvmfrom= _vrpc_udp_rcvmfrom,
+    .close   = _vrpc_udp_close,
+    .getfd   = _vrpc_udp_getfd,
+    .sndable = NULL,
+    .dump    = _vrpc_udp_dump
 };
 
+#ifdef _VRPC_URING
 /*
- * for rpc upword methods
+ * for udp rpc backed by io_uring (built with URING=1). datagrams are
+ * received by a multishot recvmsg with buffers provided to kernel, and fd
+ * of receiving ring, which is readable when completions are posted, is the
+ * one exposed to waiter. batch of msgs are sent as sendmsg sqes with one
+ * syscall on a separate ring, so that send completions never mix with
+ * receiving ones.
  */
-static
-int _vrpc_snd(struct vrpc* rpc)
-{
-    int ret = 0;
-    vassert(rpc);
-    vassert(rpc->impl);
-    vassert(rpc->msger);
+struct vuring {
+    int fd;
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int* sq_mask;
+    unsigned int* sq_array;
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+
+    void*  sq_ptr;
+    void*  cq_ptr;
+    size_t sq_sz;
+    size_t cq_sz;
+    size_t sqes_sz;
+};
 
-    if (rpc->sndm) {
-        // previous sys msg must have been sending over.
-        vmsg_sys_free(rpc->sndm);
-        rpc->sndm = NULL;
-    }
+struct vudp_uring {
+    struct vudp* udp;
+    struct vuring rring;
+    struct vuring sring;
 
-    ret = rpc->msger->ops->pop(rpc->msger, &rpc->sndm);
-    retE((ret < 0));
+    struct io_uring_buf_ring* bring;    // ring of provided buffers.
+    char*  bufs;
+    struct msghdr rmhdr;                // template for multishot recvmsg.
+    int    armed;
+};
 
-    ret = rpc->base_ops->sndto(rpc->impl, rpc->sndm);
-    if (ret < 0) {
-        rpc->stat.nerrs++;
-        retE((1));
-    }
-    rpc->stat.snd_bytes += ret;
-    rpc->stat.nsnds++;
-    return 0;
-}
+#define VRPC_URING_HDR_SZ   ((int)(sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + VRPC_CTRL_SZ))
+#define VRPC_URING_BUF_SZ   ((int)(VRPC_URING_HDR_SZ + VRPC_SLOT_SZ))
 
 static
-int _vrpc_rcv(struct vrpc* rpc)
+int _aux_uring_setup(struct vuring* ur, int entries, int cq_entries)
 {
-    int ret = 0;
+    struct io_uring_params params;
+    vassert(ur);
+
+    memset(ur, 0, sizeof(*ur));
+    memset(&params, 0, sizeof(params));
+    if (cq_entries > 0) {
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
 
-    vassert(rpc);
-    vassert(rpc->impl);
-    vassert(rpc->msger);
+    ur->fd = syscall(__NR_io_uring_setup, entries, &params);
+    vlogEv((ur->fd < 0), elog_io_uring_setup);
+    retE((ur->fd < 0));
 
-    vmsg_sys_refresh(rpc->rcvm, 8*BUF_SZ); //refresh the receving buf.
-    ret = rpc->base_ops->rcvfrom(rpc->impl, rpc->rcvm);
-    if (ret < 0) {
-        rpc->stat.nerrs++;
-        retE((1));
+    ur->sq_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ur->cq_sz = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ur->sq_sz = (ur->cq_sz > ur->sq_sz) ? ur->cq_sz : ur->sq_sz;
+        ur->cq_sz = ur->sq_sz;
+    }
+    ur->sq_ptr = mmap(NULL, ur->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ur->fd, IORING_OFF_SQ_RING);
+    vlogEv((ur->sq_ptr == MAP_FAILED), elog_mmap);
+    ret1E((ur->sq_ptr == MAP_FAILED), close(ur->fd));
+
+    ur->cq_ptr = ur->sq_ptr;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ur->cq_ptr = mmap(NULL, ur->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ur->fd, IORING_OFF_CQ_RING);
+        vlogEv((ur->cq_ptr == MAP_FAILED), elog_mmap);
+        ret2E((ur->cq_ptr == MAP_FAILED), munmap(ur->sq_ptr, ur->sq_sz), close(ur->fd));
     }
-    rpc->stat.rcv_bytes += ret;
-    rpc->stat.nrcvs++;
 
-    ret = rpc->msger->ops->dsptch(rpc->msger, rpc->rcvm);
-    retE((ret < 0));
+    ur->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ur->fd, IORING_OFF_SQES);
+    vlogEv((ur->sqes == MAP_FAILED), elog_mmap);
+    if (ur->sqes == MAP_FAILED) {
+        if (ur->cq_ptr != ur->sq_ptr) {
+            munmap(ur->cq_ptr, ur->cq_sz);
+        }
+        munmap(ur->sq_ptr, ur->sq_sz);
+        close(ur->fd);
+        retE((1));
+    }
 
+    ur->sq_head  = (unsigned int*)((char*)ur->sq_ptr + params.sq_off.head);
+    ur->sq_tail  = (unsigned int*)((char*)ur->sq_ptr + params.sq_off.tail);
+    ur->sq_mask  = (unsigned int*)((char*)ur->sq_ptr + params.sq_off.ring_mask);
+    ur->sq_array = (unsigned int*)((char*)ur->sq_ptr + params.sq_off.array);
+    ur->cq_head  = (unsigned int*)((char*)ur->cq_ptr + params.cq_off.head);
+    ur->cq_tail  = (unsigned int*)((char*)ur->cq_ptr + params.cq_off.tail);
+    ur->cq_mask  = (unsigned int*)((char*)ur->cq_ptr + params.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe*)((char*)ur->cq_ptr + params.cq_off.cqes);
     return 0;
 }
 
 static
-int _vrpc_err(struct vrpc* rpc)
+void _aux_uring_teardown(struct vuring* ur)
 {
-    vassert(rpc);
-    vassert(rpc->impl);
+    vassert(ur);
 
-    rpc->base_ops->close(rpc->impl);
-    rpc->impl = rpc->base_ops->open(&rpc->addr);
-    retE((!rpc->impl));
+    munmap(ur->sqes, ur->sqes_sz);
+    if (ur->cq_ptr != ur->sq_ptr) {
+        munmap(ur->cq_ptr, ur->cq_sz);
+    }
+    munmap(ur->sq_ptr, ur->sq_sz);
+    close(ur->fd);
+    return ;
+}
 
-    return 0;
+/*
+ * to get a zeroed sqe at tail of submission queue, which is published
+ * by @_aux_uring_enter.
+ * @ur:
+ */
+static
+struct io_uring_sqe* _aux_uring_get_sqe(struct vuring* ur)
+{
+    struct io_uring_sqe* sqe = NULL;
+    unsigned int head = 0;
+    unsigned int tail = 0;
+    vassert(ur);
+
+    head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+    tail = *ur->sq_tail;
+    retE_p((tail - head > *ur->sq_mask));
+
+    sqe = &ur->sqes[tail & *ur->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ur->sq_array[tail & *ur->sq_mask] = tail & *ur->sq_mask;
+    __atomic_store_n(ur->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
 }
 
 static
-int _vrpc_getId(struct vrpc* rpc)
+int _aux_uring_enter(struct vuring* ur, int to_submit, int min_complete)
 {
-    vassert(rpc);
-    vassert(rpc->impl);
+    int ret = 0;
+    vassert(ur);
 
-    return rpc->base_ops->getfd(rpc->impl);
+    do {
+        ret = syscall(__NR_io_uring_enter, ur->fd, to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while ((ret < 0) && (errno == EINTR));
+    vlogEv((ret < 0), elog_io_uring_enter);
+    retE((ret < 0));
+    return ret;
 }
 
 static
-void _vrpc_stat(struct vrpc* rpc, struct vrpc_stat* buf)
+struct io_uring_cqe* _aux_uring_peek_cqe(struct vuring* ur)
 {
-    vassert(rpc);
-    vassert(buf);
+    unsigned int head = 0;
+    vassert(ur);
 
-    memcpy(buf, &rpc->stat, sizeof(*buf));
-    return ;
+    head = *ur->cq_head;
+    if (head == __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ur->cqes[head & *ur->cq_mask];
 }
 
 static
-void _vrpc_dump(struct vrpc* rpc)
+void _aux_uring_cqe_seen(struct vuring* ur)
 {
-    vassert(rpc);
-    printf("{ ");
-    printf("nerrs:%d, ", rpc->stat.nerrs);
-    printf("nsnds:%d, ", rpc->stat.nsnds);
-    printf("nrcvs:%d, ", rpc->stat.nrcvs);
-    printf("send bytes:%d,", rpc->stat.snd_bytes);
-    printf("rcved bytes:%d,", rpc->stat.rcv_bytes);
-    rpc->base_ops->dump(rpc->impl);
-    printf(" }\n");
+    vassert(ur);
+    __atomic_store_n(ur->cq_head, *ur->cq_head + 1, __ATOMIC_RELEASE);
     return ;
 }
 
 /*
- * generic rpc method set with user torwareds. it encapusulated socket
- * details from user.
+ * to give buffer back to kernel for receiving.
+ * @uu:
+ * @bid: buffer id.
  */
 static
-struct vrpc_ops rpc_ops = {
-    .snd   = _vrpc_snd,
-    .rcv   = _vrpc_rcv,
-    .err   = _vrpc_err,
-    .getId = _vrpc_getId,
-    .stat  = _vrpc_stat,
-    .dump  = _vrpc_dump
-};
+void _aux_uring_recycle(struct vudp_uring* uu, int bid)
+{
+    struct io_uring_buf* buf = NULL;
+    unsigned short tail = 0;
+    vassert(uu);
+
+    tail = uu->bring->tail;
+    buf  = &uu->bring->bufs[tail & (VRPC_URING_NBUFS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(uu->bufs + bid * VRPC_URING_BUF_SZ);
+    buf->len  = VRPC_URING_BUF_SZ;
+    buf->bid  = bid;
+    __atomic_store_n(&uu->bring->tail, tail + 1, __ATOMIC_RELEASE);
+    return ;
+}
 
 /*
- * each rpc channel must has one msger, and only one msger to deal with
- * upwords user.
- * user only need to be aware of msg format.DO NOT need details of rpc.
- *
- * @rpc:  [in, out]
- * @msger:[in];
- * @mode :[in];
- * @addr :[in]
+ * to post multishot recvmsg, which keeps receiving into provided buffers
+ * until it's terminated (say, running out of buffers).
+ * @uu:
  */
-int vrpc_init(struct vrpc* rpc, struct vmsger* msger, int mode, struct vsockaddr* addr)
+static
+int _aux_uring_arm_recv(struct vudp_uring* uu)
 {
-    struct vmsg_sys* sm = NULL;
-    vassert(rpc);
+    struct io_uring_sqe* sqe = NULL;
+    int ret = 0;
+    vassert(uu);
+
+    sqe = _aux_uring_get_sqe(&uu->rring);
+    retE((!sqe));
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd     = uu->udp->sock_fd;
+    sqe->addr   = (uint64_t)(uintptr_t)&uu->rmhdr;
+    sqe->len    = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags  = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = 1;
+
+    ret = _aux_uring_enter(&uu->rring, 1, 0);
+    retE((ret < 0));
+    uu->armed = 1;
+    return 0;
+}
+
+static
+void* _aux_udp_uring_open(struct vsockaddr* addr, int reuseport)
+{
+    struct vudp_uring* uu = NULL;
+    struct io_uring_buf_reg reg;
+    int ret = 0;
+    int i = 0;
+
     vassert(addr);
-    vassert(vrpc_mode_ok(mode));
 
-    memset(rpc, 0, sizeof(*rpc));
-    memcpy(&rpc->addr, addr, sizeof(*addr));
-    rpc->mode = mode;
-    rpc->msger= msger;
-    rpc->impl = NULL;
-    rpc->ops  = &rpc_ops;
-    rpc->base_ops = rpc_base_ops[mode];
+    uu = (struct vudp_uring*)malloc(sizeof(*uu));
+    vlogEv((!uu), elog_malloc);
+    retE_p((!uu));
+    memset(uu, 0, sizeof(*uu));
 
-    sm = vmsg_sys_alloc(8*BUF_SZ);
-    vlogEv((!sm), elog_vmsg_sys_alloc);
-    retE((!sm));
-    vlist_init(&sm->list);
+    uu->udp = (struct vudp*)_aux_udp_open(addr, reuseport);
+    ret1E_p((!uu->udp), free(uu));
 
-    rpc->rcvm = sm;
-    rpc->sndm = NULL;
+    ret = _aux_uring_setup(&uu->rring, 8, 4 * VRPC_URING_NBUFS);
+    if (ret < 0) {
+        goto error_exit;
+    }
+    ret = _aux_uring_setup(&uu->sring, VRPC_SND_BATCH, 0);
+    if (ret < 0) {
+        _aux_uring_teardown(&uu->rring);
+        goto error_exit;
+    }
 
-    rpc->stat.nerrs = 0;
-    rpc->stat.nsnds = 0;
-    rpc->stat.nrcvs = 0;
-    rpc->stat.snd_bytes = 0;
-    rpc->stat.rcv_bytes = 0;
+    ret  = posix_memalign((void**)&uu->bring, getpagesize(), VRPC_URING_NBUFS * sizeof(struct io_uring_buf));
+    ret |= posix_memalign((void**)&uu->bufs, VRPC_SLOT_ALIGN, VRPC_URING_NBUFS * VRPC_URING_BUF_SZ);
+    vlogEv((ret), elog_posix_memalign);
+    if (ret) {
+        goto error_exit2;
+    }
+    memset(uu->bring, 0, VRPC_URING_NBUFS * sizeof(struct io_uring_buf));
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)uu->bring;
+    reg.ring_entries = VRPC_URING_NBUFS;
+    reg.bgid = 0;
+    ret = syscall(__NR_io_uring_register, uu->rring.fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    vlogEv((ret < 0), elog_io_uring_register);
+    if (ret < 0) {
+        goto error_exit2;
+    }
+    for (i = 0; i < VRPC_URING_NBUFS; i++) {
+        _aux_uring_recycle(uu, i);
+    }
 
-    rpc->impl = rpc->base_ops->open(addr);
-    ret1E((!rpc->impl), vmsg_sys_free(sm));
-    return 0;
+    uu->rmhdr.msg_namelen    = sizeof(struct sockaddr_in);
+    uu->rmhdr.msg_controllen = VRPC_CTRL_SZ;
+    ret = _aux_uring_arm_recv(uu);
+    if (ret < 0) {
+        goto error_exit2;
+    }
+    return uu;
+
+error_exit2:
+    free(uu->bufs);
+    free(uu->bring);
+    _aux_uring_teardown(&uu->sring);
+    _aux_uring_teardown(&uu->rring);
+error_exit:
+    _vrpc_udp_close(uu->udp);
+    free(uu);
+    retE_p((1));
+}
+
+static
+void* _vrpc_udp_uring_open(struct vsockaddr* addr)
+{
+    return _aux_udp_uring_open(addr, 0);
+}
+
+static
+void* _vrpc_udp_shard_uring_open(struct vsockaddr* addr)
+{
+    return _aux_udp_uring_open(addr, 1);
+}
+
+static
+int _vrpc_udp_uring_sndto(void* impl, struct vmsg_sys* msg)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    vassert(uu);
+    return _vrpc_udp_sndto(uu->udp, msg);
+}
+
+/*
+ * to send a batch of msgs as sendmsg sqes, submitted and waited for with
+ * one syscall. sqes are linked, so that ones after a failed send are
+ * cancelled, and as sendmmsg, only the prefix of msgs sent is taken.
+ * @impl:
+ * @msgs:
+ * @num:
+ * return: number of msgs sent, or -1 with errno if the first one failed
+ *         (EAGAIN if socket would block).
+ */
+static
+int _vrpc_udp_uring_sndmto(void* impl, struct vmsg_sys** msgs, int num)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    struct vudp* udp = NULL;
+    struct io_uring_sqe* sqe = NULL;
+    struct io_uring_cqe* cqe = NULL;
+    int nsnds = num;
+    int err = 0;
+    int ret = 0;
+    int i = 0;
+
+    vassert(uu);
+    vassert(msgs);
+    vassert((num > 0) && (num <= VRPC_SND_BATCH));
+
+    udp = uu->udp;
+    for (i = 0; i < num; i++) {
+        udp->siovs[i].iov_base = msgs[i]->data;
+        udp->siovs[i].iov_len  = msgs[i]->len;
+        udp->smsgs[i].msg_hdr.msg_name = to_sockaddr_sin(&msgs[i]->addr);
+        udp->spis[i]->ipi_spec_dst = to_sockaddr_sin(&msgs[i]->spec)->sin_addr;
+
+        sqe = _aux_uring_get_sqe(&uu->sring);
+        vassert(sqe); // ring is as large as send batch.
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd     = udp->sock_fd;
+        sqe->addr   = (uint64_t)(uintptr_t)&udp->smsgs[i].msg_hdr;
+        sqe->len    = 1;
+        sqe->flags  = (i < num - 1) ? IOSQE_IO_LINK : 0;
+        sqe->user_data = i;
+    }
+
+    ret = _aux_uring_enter(&uu->sring, num, num);
+    retE((ret < 0));
+
+    // msgs are released by caller after return, so wait for all of them.
+    for (i = 0; i < num;) {
+        cqe = _aux_uring_peek_cqe(&uu->sring);
+        if (!cqe) {
+            ret = _aux_uring_enter(&uu->sring, 0, num - i);
+            retE((ret < 0));
+            continue;
+        }
+        if ((cqe->res < 0) && ((int)cqe->user_data < nsnds)) {
+            nsnds = (int)cqe->user_data;
+            err = -cqe->res;
+        }
+        _aux_uring_cqe_seen(&uu->sring);
+        i++;
+    }
+
+    if (!nsnds) {
+        vlogEv((err != EAGAIN), "%s", strerror(err));
+        errno = err;
+        return -1;
+    }
+    return nsnds;
+}
+
+/*
+ * to reap completions of multishot recvmsg and copy received datagrams
+ * into @msgs. multishot recvmsg is posted again once it's terminated.
+ * @impl:
+ * @msgs:
+ * @num:
+ */
+static
+int _vrpc_udp_uring_rcvmfrom(void* impl, struct vmsg_sys** msgs, int num)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    struct io_uring_recvmsg_out* out = NULL;
+    struct io_uring_cqe* cqe = NULL;
+    struct vmsg_sys* msg = NULL;
+    struct msghdr mhdr;
+    char* buf = NULL;
+    int len = 0;
+    int bid = 0;
+    int n = 0;
+
+    vassert(uu);
+    vassert(msgs);
+    vassert((num > 0) && (num <= VRPC_RCV_BATCH));
+
+    while ((n < num) && ((cqe = _aux_uring_peek_cqe(&uu->rring)) != NULL)) {
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            uu->armed = 0;
+        }
+        if ((cqe->res < 0) || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+            vlogEv((cqe->res != -ENOBUFS), "%s", strerror(-cqe->res));
+            _aux_uring_cqe_seen(&uu->rring);
+            continue;
+        }
+
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        buf = uu->bufs + bid * VRPC_URING_BUF_SZ;
+        out = (struct io_uring_recvmsg_out*)buf;
+        msg = msgs[n];
+
+        len = out->payloadlen;
+        len = (len > cqe->res - VRPC_URING_HDR_SZ) ? cqe->res - VRPC_URING_HDR_SZ : len;
+        len = (len > msg->len) ? msg->len : len;
+        memcpy(to_sockaddr_sin(&msg->addr), buf + sizeof(*out), sizeof(struct sockaddr_in));
+        memcpy(msg->data, buf + VRPC_URING_HDR_SZ, len);
+        msg->len = len;
+
+        memset(&mhdr, 0, sizeof(mhdr));
+        mhdr.msg_control    = buf + sizeof(*out) + sizeof(struct sockaddr_in);
+        mhdr.msg_controllen = out->controllen;
+        _aux_udp_get_spec(uu->udp, &mhdr, msg);
+
+        _aux_uring_recycle(uu, bid);
+        _aux_uring_cqe_seen(&uu->rring);
+        n++;
+    }
+    if (!uu->armed) {
+        _aux_uring_arm_recv(uu);
+    }
+    if (!n) {
+        errno = EAGAIN;
+        return -1; // no more msg, keep errno for caller.
+    }
+    return n;
+}
+
+static
+int _vrpc_udp_uring_rcvfrom(void* impl, struct vmsg_sys* msg)
+{
+    int ret = 0;
+    vassert(msg);
+
+    ret = _vrpc_udp_uring_rcvmfrom(impl, &msg, 1);
+    return (ret < 0) ? ret : msg->len;
+}
+
+static
+void _vrpc_udp_uring_close(void* impl)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    vassert(uu);
+
+    // rings are closed before buffers are freed, so no more receiving.
+    _aux_uring_teardown(&uu->sring);
+    _aux_uring_teardown(&uu->rring);
+    free(uu->bufs);
+    free(uu->bring);
+    _vrpc_udp_close(uu->udp);
+    free(uu);
+    return ;
+}
+
+/*
+ * to get fd of receiving ring, which is readable if any completion is
+ * posted, and writable as long as its submission queue is not full.
+ * @impl:
+ */
+static
+int _vrpc_udp_uring_getfd(void* impl)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    vassert(uu);
+    return uu->rring.fd;
+}
+
+static
+void _vrpc_udp_uring_dump(void* impl)
+{
+    struct vudp_uring* uu = (struct vudp_uring*)impl;
+    vassert(uu);
+
+    printf("io_uring,");
+    _vrpc_udp_dump(uu->udp);
+    return ;
+}
+
+/*
+ * downword method set for udp mode with io_uring.
+ */
+static
+struct vrpc_base_ops udp_uring_base_ops = {
+    .open    = _vrpc_udp_uring_open,
+    .sndto   = _vrpc_udp_uring_sndto,
+    .sndmto  = _vrpc_udp_uring_sndmto,
+    .rcvfrom = _vrpc_udp_uring_rcvfrom,
+    .rcvmfrom= _vrpc_udp_uring_rcvmfrom,
+    .close   = _vrpc_udp_uring_close,
+    .getfd   = _vrpc_udp_uring_getfd,
+    .sndable = NULL,
+    .dump    = _vrpc_udp_uring_dump
+};
+
+/*
+ * downword method set for sharded udp mode with io_uring.
+ */
+static
+struct vrpc_base_ops udp_shard_uring_base_ops = {
+    .open    = _vrpc_udp_shard_uring_open,
+    .sndto   = _vrpc_udp_uring_sndto,
+    .sndmto  = _vrpc_udp_uring_sndmto,
+    .rcvfrom = _vrpc_udp_uring_rcvfrom,
+    .rcvmfrom= _vrpc_udp_uring_rcvmfrom,
+    .close   = _vrpc_udp_uring_close,
+    .getfd   = _vrpc_udp_uring_getfd,
+    .sndable = NULL,
+    .dump    = _vrpc_udp_uring_dump
+};
+
+/*
+ * io_uring variants, tried first and fall back to plain ones if io_uring
+ * is unavailable on running kernel.
+ */
+static
+struct vrpc_base_ops* rpc_uring_base_ops[VRPC_MODE_BUTT] = {
+    [VRPC_UDP]       = &udp_uring_base_ops,
+    [VRPC_UDP_SHARD] = &udp_shard_uring_base_ops
+};
+#endif
+
+/*
+ * for tcp rpc. connections are pooled per remote address, kept persistent,
+ * and reaped after being idle for a while. both listening socket and
+ * outgoing sockets are bound to the local dht address with SO_REUSEPORT,
+ * so peers see the same address as the one used for udp. all sockets are
+ * watched by an inner epoll, whose fd is the one exposed to waiter.
+ */
+struct vtcp_conn {
+    struct sockaddr_in addr;    // remote address, key in pool.
+    struct sockaddr_in local;
+    int fd;
+    int connecting;
+    int eof;
+    int dead;       // closed, to be freed after events being handled.
+    time_t since;   // when connection was made.
+    time_t last;
+
+    int  rlen;
+    int  wlen;
+    char rbuf[sizeof(uint32_t) + VRPC_TCP_FRAME_SZ];
+    char wbuf[VRPC_TCP_WBUF_SZ];
+};
+
+struct vtcp {
+    struct sockaddr_in addr;
+    int lsn_fd;
+    int ep_fd;
+    int tm_fd;      // timer to reap idle or hung connections.
+    int nwbytes;    // bytes pending in all write buffers.
+    int naccepts;
+    int nconnects;
+    int nreaps;
+    int nfallbacks; // frames handed over to udp instead.
+    struct varray conns;
+    struct vmsger* fallback; // msger of udp rpc, maybe NULL.
+
+    /*
+     * peers failing to be connected, say older nodes or those having tcp
+     * off. msgs to them go by udp right away until the entry expires.
+     */
+    struct vtcp_deny {
+        struct sockaddr_in addr;
+        time_t since;
+    } denies[VRPC_TCP_MAX_DENIES];
+};
+
+/*
+ * to create a non-blocking tcp socket bound to local dht address.
+ * @tcp:
+ * @bound: whether to bind to local dht address or not.
+ */
+static
+int _aux_tcp_socket(struct vtcp* tcp, int bound)
+{
+    int flags = 0;
+    int on  = 1;
+    int ret = 0;
+    int fd  = 0;
+
+    vassert(tcp);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    vlogEv((fd < 0), elog_socket);
+    retE((fd < 0));
+
+    if (bound) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        vlogEv((ret < 0), elog_setsockopt);
+        ret1E((ret < 0), close(fd));
+
+        ret = bind(fd, (struct sockaddr*)&tcp->addr, sizeof(tcp->addr));
+        vlogEv((ret < 0), elog_bind);
+        ret1E((ret < 0), close(fd));
+    }
+
+    flags = fcntl(fd, F_GETFL, 0);
+    ret = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    vlogEv((ret < 0), elog_fcntl);
+    ret1E((ret < 0), close(fd));
+    return fd;
+}
+
+static
+int _aux_tcp_epoll_ctl(struct vtcp* tcp, int op, int fd, uint32_t events, void* ptr)
+{
+    struct epoll_event ev;
+    int ret = 0;
+    vassert(tcp);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = ptr;
+    ret = epoll_ctl(tcp->ep_fd, op, fd, &ev);
+    vlogEv((ret < 0), elog_epoll_ctl);
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * to hand a frame tcp fails to deliver over to udp rpc, which sends it
+ * as datagram instead.
+ * @tcp:
+ * @addr: destination.
+ * @data:
+ * @len:
+ */
+static
+int _aux_tcp_fallback(struct vtcp* tcp, struct sockaddr_in* addr, void* data, int len)
+{
+    struct vmsg_sys* ms = NULL;
+    int ret = 0;
+    vassert(tcp);
+    vassert(addr);
+
+    retE((!tcp->fallback));
+    ms = vmsg_sys_alloc(len);
+    vlogEv((!ms), elog_vmsg_sys_alloc);
+    retE((!ms));
+    memcpy(ms->data, data, len);
+    memcpy(to_sockaddr_sin(&ms->addr), addr, sizeof(*addr));
+
+    ret = tcp->fallback->ops->push_sys(tcp->fallback, ms);
+    retE((ret < 0));
+    tcp->nfallbacks++;
+    return 0;
+}
+
+/*
+ * to remember that peer with @addr can't be reached by tcp, replacing the
+ * oldest entry if full.
+ * @tcp:
+ * @addr:
+ */
+static
+void _aux_tcp_deny(struct vtcp* tcp, struct sockaddr_in* addr)
+{
+    struct vtcp_deny* oldest = &tcp->denies[0];
+    struct vtcp_deny* deny = NULL;
+    int i = 0;
+    vassert(tcp);
+    vassert(addr);
+
+    for (i = 0; i < VRPC_TCP_MAX_DENIES; i++) {
+        deny = &tcp->denies[i];
+        if ((deny->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+            && (deny->addr.sin_port == addr->sin_port)) {
+            oldest = deny;
+            break;
+        }
+        if (deny->since < oldest->since) {
+            oldest = deny;
+        }
+    }
+    memcpy(&oldest->addr, addr, sizeof(*addr));
+    oldest->since = time(NULL);
+    return ;
+}
+
+static
+int _aux_tcp_denied(struct vtcp* tcp, struct sockaddr_in* addr)
+{
+    struct vtcp_deny* deny = NULL;
+    time_t now = time(NULL);
+    int i = 0;
+    vassert(tcp);
+    vassert(addr);
+
+    for (i = 0; i < VRPC_TCP_MAX_DENIES; i++) {
+        deny = &tcp->denies[i];
+        if ((deny->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+            && (deny->addr.sin_port == addr->sin_port)) {
+            return (now - deny->since < VRPC_TCP_DENY_TMO);
+        }
+    }
+    return 0;
+}
+
+/*
+ * to close connection. it's only marked dead and stays in pool, since
+ * events fetched from inner epoll might still refer to it. frames of
+ * connection never connected go by udp instead.
+ * @tcp:
+ * @conn:
+ */
+static
+void _aux_tcp_conn_kill(struct vtcp* tcp, struct vtcp_conn* conn)
+{
+    uint32_t flen = 0;
+    int sz = sizeof(uint32_t);
+    int off = 0;
+
+    vassert(tcp);
+    vassert(conn);
+
+    if (conn->dead) {
+        return ;
+    }
+    while (tcp->fallback && conn->connecting && (off + sz <= conn->wlen)) {
+        memcpy(&flen, conn->wbuf + off, sz);
+        flen = ntohl(flen);
+        _aux_tcp_fallback(tcp, &conn->addr, conn->wbuf + off + sz, (int)flen);
+        off += sz + (int)flen;
+    }
+    epoll_ctl(tcp->ep_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    tcp->nwbytes -= conn->wlen;
+    conn->wlen = 0;
+    conn->rlen = 0;
+    conn->dead = 1;
+    return ;
+}
+
+/*
+ * to free dead connections and remove them from pool.
+ * @tcp:
+ */
+static
+void _aux_tcp_conn_sweep(struct vtcp* tcp)
+{
+    struct vtcp_conn* conn = NULL;
+    int i = 0;
+    vassert(tcp);
+
+    for (i = 0; i < varray_size(&tcp->conns);) {
+        conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+        if (conn->dead) {
+            varray_del(&tcp->conns, i);
+            free(conn);
+            continue;
+        }
+        i++;
+    }
+    return ;
+}
+
+/*
+ * to make room in pool by closing the connection idle for the longest time.
+ * @tcp:
+ */
+static
+void _aux_tcp_conn_evict(struct vtcp* tcp)
+{
+    struct vtcp_conn* oldest = NULL;
+    struct vtcp_conn* conn = NULL;
+    int nlives = 0;
+    int i = 0;
+    vassert(tcp);
+
+    for (i = 0; i < varray_size(&tcp->conns); i++) {
+        conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+        if (conn->dead) {
+            continue;
+        }
+        if (!oldest || (conn->last < oldest->last)) {
+            oldest = conn;
+        }
+        nlives++;
+    }
+    if (nlives >= VRPC_TCP_MAX_CONNS) {
+        _aux_tcp_conn_kill(tcp, oldest);
+        tcp->nreaps++;
+    }
+    return ;
+}
+
+/*
+ * to add a connected (or connecting) socket into pool.
+ * @tcp:
+ * @fd:
+ * @addr: remote address.
+ * @connecting:
+ */
+static
+struct vtcp_conn* _aux_tcp_conn_add(struct vtcp* tcp, int fd, struct sockaddr_in* addr, int connecting)
+{
+    struct vtcp_conn* conn = NULL;
+    uint32_t events = EPOLLIN;
+    socklen_t len = sizeof(struct sockaddr_in);
+    int ret = 0;
+
+    vassert(tcp);
+    vassert(fd >= 0);
+    vassert(addr);
+
+    _aux_tcp_conn_evict(tcp);
+
+    conn = (struct vtcp_conn*)malloc(sizeof(*conn));
+    vlogEv((!conn), elog_malloc);
+    ret1E_p((!conn), close(fd));
+    memset(conn, 0, sizeof(*conn));
+    memcpy(&conn->addr, addr, sizeof(*addr));
+    getsockname(fd, (struct sockaddr*)&conn->local, &len);
+    conn->fd   = fd;
+    conn->connecting = connecting;
+    conn->since = time(NULL);
+    conn->last  = conn->since;
+
+    events |= connecting ? EPOLLOUT : 0;
+    ret = _aux_tcp_epoll_ctl(tcp, EPOLL_CTL_ADD, fd, events, conn);
+    ret2E_p((ret < 0), close(fd), free(conn));
+    varray_add_tail(&tcp->conns, conn);
+    return conn;
+}
+
+/*
+ * to get pooled connection to given remote address, or set up a new one
+ * with non-blocking connect.
+ * @tcp:
+ * @addr:
+ */
+static
+struct vtcp_conn* _aux_tcp_conn_get(struct vtcp* tcp, struct sockaddr_in* addr)
+{
+    struct vtcp_conn* conn = NULL;
+    int bound = 1;
+    int ret = 0;
+    int fd  = 0;
+    int i = 0;
+
+    vassert(tcp);
+    vassert(addr);
+
+    for (i = 0; i < varray_size(&tcp->conns); i++) {
+        conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+        if ((conn->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+            && (conn->addr.sin_port == addr->sin_port)
+            && !conn->eof && !conn->dead) {
+            return conn;
+        }
+    }
+
+    while (1) {
+        fd = _aux_tcp_socket(tcp, bound);
+        retE_p((fd < 0));
+        ret = connect(fd, (struct sockaddr*)addr, sizeof(*addr));
+        if ((ret < 0) && (errno == EADDRNOTAVAIL) && bound) {
+            // same 4-tuple still in TIME_WAIT, use ephemeral port instead.
+            close(fd);
+            bound = 0;
+            continue;
+        }
+        break;
+    }
+    if ((ret < 0) && (errno != EINPROGRESS)) {
+        _aux_tcp_deny(tcp, addr);
+        close(fd);
+        return NULL; // peer takes no tcp.
+    }
+    conn = _aux_tcp_conn_add(tcp, fd, addr, (ret < 0));
+    retE_p((!conn));
+    tcp->nconnects++;
+    return conn;
+}
+
+/*
+ * to write out pending frames in connection as much as possible, and keep
+ * watching writable event only if there are still some left.
+ * @tcp:
+ * @conn:
+ */
+static
+int _aux_tcp_conn_flush(struct vtcp* tcp, struct vtcp_conn* conn)
+{
+    int off = 0;
+    int ret = 0;
+
+    vassert(tcp);
+    vassert(conn);
+
+    retS((conn->connecting));
+    while (off < conn->wlen) {
+        ret = send(conn->fd, conn->wbuf + off, conn->wlen - off, MSG_NOSIGNAL);
+        if ((ret < 0) && (errno == EAGAIN)) {
+            break;
+        }
+        vlogEv((ret < 0), elog_sendto);
+        retE((ret < 0));
+        off += ret;
+    }
+    if (off > 0) {
+        memmove(conn->wbuf, conn->wbuf + off, conn->wlen - off);
+        conn->wlen   -= off;
+        tcp->nwbytes -= off;
+    }
+
+    ret = _aux_tcp_epoll_ctl(tcp, EPOLL_CTL_MOD, conn->fd,
+                EPOLLIN | (conn->wlen ? EPOLLOUT : 0), conn);
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * to read from connection into its buffer until it would block, or the
+ * buffer is full.
+ * @tcp:
+ * @conn:
+ */
+static
+int _aux_tcp_conn_read(struct vtcp* tcp, struct vtcp_conn* conn)
+{
+    int ret = 0;
+    vassert(tcp);
+    vassert(conn);
+
+    while (conn->rlen < (int)sizeof(conn->rbuf)) {
+        ret = recv(conn->fd, conn->rbuf + conn->rlen, sizeof(conn->rbuf) - conn->rlen, 0);
+        if ((ret < 0) && (errno == EAGAIN)) {
+            break;
+        }
+        vlogEv((ret < 0), elog_recvfrom);
+        retE((ret < 0));
+        if (!ret) {
+            conn->eof = 1; // peer closed.
+            break;
+        }
+        conn->rlen += ret;
+    }
+    conn->last = time(NULL);
+    return 0;
+}
+
+/*
+ * to take one complete frame out of connection buffer.
+ * @conn:
+ * @msg:
+ * return: length of msg, 0 if no complete frame, -1 if the frame is bogus.
+ */
+static
+int _aux_tcp_conn_frame(struct vtcp_conn* conn, struct vmsg_sys* msg)
+{
+    uint32_t flen = 0;
+    int sz = sizeof(uint32_t);
+
+    vassert(conn);
+    vassert(msg);
+
+    retS((conn->rlen < sz));
+    memcpy(&flen, conn->rbuf, sz);
+    flen = ntohl(flen);
+    retE((!flen || (flen > (uint32_t)VRPC_TCP_FRAME_SZ) || (flen > (uint32_t)msg->len)));
+    retS((conn->rlen < sz + (int)flen));
+
+    memcpy(msg->data, conn->rbuf + sz, flen);
+    memcpy(to_sockaddr_sin(&msg->addr), &conn->addr,  sizeof(struct sockaddr_in));
+    memcpy(to_sockaddr_sin(&msg->spec), &conn->local, sizeof(struct sockaddr_in));
+    msg->len = flen;
+
+    conn->rlen -= sz + flen;
+    memmove(conn->rbuf, conn->rbuf + sz + flen, conn->rlen);
+    return (int)flen;
+}
+
+/*
+ * to accept all pending incoming connections.
+ * @tcp:
+ */
+static
+void _aux_tcp_accept(struct vtcp* tcp)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = 0;
+    vassert(tcp);
+
+    while (1) {
+        len = sizeof(addr);
+        fd = accept4(tcp->lsn_fd, (struct sockaddr*)&addr, &len, SOCK_NONBLOCK);
+        if ((fd < 0) && (errno == EAGAIN)) {
+            break;
+        }
+        vlogEv((fd < 0), elog_accept4);
+        retE_v((fd < 0));
+        if (_aux_tcp_conn_add(tcp, fd, &addr, 0)) {
+            tcp->naccepts++;
+        }
+    }
+    return ;
+}
+
+/*
+ * to close connections idle for too long, except those still having
+ * frames to send.
+ * @tcp:
+ */
+static
+void _aux_tcp_reap(struct vtcp* tcp)
+{
+    struct vtcp_conn* conn = NULL;
+    time_t now = time(NULL);
+    uint64_t val = 0;
+    int i = 0;
+    vassert(tcp);
+
+    if (read(tcp->tm_fd, &val, sizeof(val)) < 0) {
+        return ;
+    }
+    for (i = 0; i < varray_size(&tcp->conns); i++) {
+        conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+        if (!conn->dead && conn->connecting && (now - conn->since > VRPC_TCP_CONN_TMO)) {
+            _aux_tcp_deny(tcp, &conn->addr); // no answer, maybe dropped by firewall.
+            _aux_tcp_conn_kill(tcp, conn);
+            tcp->nreaps++;
+            continue;
+        }
+        if (!conn->dead && !conn->wlen && (now - conn->last > VRPC_TCP_IDLE_TMO)) {
+            _aux_tcp_conn_kill(tcp, conn);
+            tcp->nreaps++;
+        }
+    }
+    return ;
+}
+
+/*
+ * to handle an event on connection.
+ * @tcp:
+ * @conn:
+ * @events:
+ */
+static
+void _aux_tcp_conn_event(struct vtcp* tcp, struct vtcp_conn* conn, uint32_t events)
+{
+    int ret = 0;
+    vassert(tcp);
+    vassert(conn);
+
+    if (conn->dead) {
+        return ;
+    }
+    if (conn->connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        socklen_t len = sizeof(ret);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &ret, &len);
+        if (ret) {
+            _aux_tcp_deny(tcp, &conn->addr);
+            _aux_tcp_conn_kill(tcp, conn);
+            return ; // peer is unreachable by tcp, frames go by udp.
+        }
+        len = sizeof(conn->local);
+        getsockname(conn->fd, (struct sockaddr*)&conn->local, &len);
+        conn->connecting = 0;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        ret = _aux_tcp_conn_read(tcp, conn);
+        if (ret < 0) {
+            _aux_tcp_conn_kill(tcp, conn);
+            return ;
+        }
+    }
+    if (conn->eof && !conn->rlen) {
+        _aux_tcp_conn_kill(tcp, conn);
+        return ;
+    }
+    ret = _aux_tcp_conn_flush(tcp, conn);
+    if (ret < 0) {
+        _aux_tcp_conn_kill(tcp, conn);
+    }
+    return ;
+}
+
+/*
+ * to open tcp rpc, which listens on given address.
+ * @addr:
+ */
+static
+void* _vrpc_tcp_open(struct vsockaddr* addr)
+{
+    struct itimerspec its;
+    struct vtcp* tcp = NULL;
+    int ret = 0;
+
+    vassert(addr);
+
+    tcp = (struct vtcp*)malloc(sizeof(*tcp));
+    vlogEv((!tcp), elog_malloc);
+    retE_p((!tcp));
+    memset(tcp, 0, sizeof(*tcp));
+    memcpy(&tcp->addr, to_sockaddr_sin(addr), sizeof(tcp->addr));
+    varray_init(&tcp->conns, 8);
+    tcp->lsn_fd = -1;
+    tcp->tm_fd  = -1;
+
+    tcp->ep_fd = epoll_create1(EPOLL_CLOEXEC);
+    vlogEv((tcp->ep_fd < 0), elog_epoll_create1);
+    if (tcp->ep_fd < 0) {
+        goto error_exit;
+    }
+
+    tcp->lsn_fd = _aux_tcp_socket(tcp, 1);
+    if (tcp->lsn_fd < 0) {
+        goto error_exit;
+    }
+    ret = listen(tcp->lsn_fd, SOMAXCONN);
+    vlogEv((ret < 0), elog_listen);
+    if (ret < 0) {
+        goto error_exit;
+    }
+    ret = _aux_tcp_epoll_ctl(tcp, EPOLL_CTL_ADD, tcp->lsn_fd, EPOLLIN, &tcp->lsn_fd);
+    if (ret < 0) {
+        goto error_exit;
+    }
+
+    tcp->tm_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    vlogEv((tcp->tm_fd < 0), elog_timerfd_create);
+    if (tcp->tm_fd < 0) {
+        goto error_exit;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec    = VRPC_TCP_REAP_TMO;
+    its.it_interval.tv_sec = VRPC_TCP_REAP_TMO;
+    ret = timerfd_settime(tcp->tm_fd, 0, &its, NULL);
+    vlogEv((ret < 0), elog_timer_settime);
+    if (ret < 0) {
+        goto error_exit;
+    }
+    ret = _aux_tcp_epoll_ctl(tcp, EPOLL_CTL_ADD, tcp->tm_fd, EPOLLIN, &tcp->tm_fd);
+    if (ret < 0) {
+        goto error_exit;
+    }
+    return tcp;
+
+error_exit:
+    if (tcp->tm_fd >= 0) {
+        close(tcp->tm_fd);
+    }
+    if (tcp->lsn_fd >= 0) {
+        close(tcp->lsn_fd);
+    }
+    if (tcp->ep_fd >= 0) {
+        close(tcp->ep_fd);
+    }
+    varray_deinit(&tcp->conns);
+    free(tcp);
+    retE_p((1));
+}
+
+/*
+ * to put a msg as frame into write buffer of connection to its destination,
+ * and write it out if possible. msgs to peer not taking tcp go by udp, and
+ * so do those overflowing write buffer of slow connection, so that it
+ * never blocks msgs to other peers.
+ * @impl:
+ * @msg:
+ */
+static
+int _vrpc_tcp_sndto(void* impl, struct vmsg_sys* msg)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    struct vtcp_conn* conn = NULL;
+    uint32_t flen = 0;
+    int sz = sizeof(uint32_t);
+    int ret = 0;
+
+    vassert(tcp);
+    vassert(msg);
+
+    if ((msg->len <= 0) || (msg->len > VRPC_TCP_FRAME_SZ)) {
+        vlogE("tcp frame too large (%d bytes)", msg->len);
+        retE((1));
+    }
+
+    _aux_tcp_conn_sweep(tcp);
+    conn = NULL;
+    if (!_aux_tcp_denied(tcp, to_sockaddr_sin(&msg->addr))) {
+        conn = _aux_tcp_conn_get(tcp, to_sockaddr_sin(&msg->addr));
+    }
+    if (!conn || (conn->wlen + sz + msg->len > VRPC_TCP_WBUF_SZ)) {
+        ret = _aux_tcp_fallback(tcp, to_sockaddr_sin(&msg->addr), msg->data, msg->len);
+        retE((ret < 0));
+        return msg->len;
+    }
+
+    flen = htonl((uint32_t)msg->len);
+    memcpy(conn->wbuf + conn->wlen, &flen, sz);
+    memcpy(conn->wbuf + conn->wlen + sz, msg->data, msg->len);
+    conn->wlen   += sz + msg->len;
+    tcp->nwbytes += sz + msg->len;
+    conn->last = time(NULL);
+
+    ret = _aux_tcp_conn_flush(tcp, conn);
+    ret1E((ret < 0), _aux_tcp_conn_kill(tcp, conn));
+    return msg->len;
+}
+
+/*
+ * to receive one msg from any of connections. buffered frames are taken
+ * first, then events of inner epoll are handled until there comes one.
+ * @impl:
+ * @msg:
+ */
+static
+int _vrpc_tcp_rcvfrom(void* impl, struct vmsg_sys* msg)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    struct epoll_event evs[VWAITER_MAX_EVENTS];
+    struct vtcp_conn* conn = NULL;
+    int ret = 0;
+    int i = 0;
+
+    vassert(tcp);
+    vassert(msg);
+
+    while (1) {
+        for (i = 0; i < varray_size(&tcp->conns); i++) {
+            conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+            ret = _aux_tcp_conn_frame(conn, msg);
+            if (ret > 0) {
+                return ret;
+            }
+            if ((ret < 0) || conn->eof) {
+                _aux_tcp_conn_kill(tcp, conn); // bogus frame, or peer closed.
+            }
+        }
+        _aux_tcp_conn_sweep(tcp);
+
+        ret = epoll_wait(tcp->ep_fd, evs, VWAITER_MAX_EVENTS, 0);
+        if ((ret < 0) && (errno == EINTR)) {
+            ret = 0;
+        }
+        vlogEv((ret < 0), elog_epoll_wait);
+        retE((ret < 0));
+        if (!ret) {
+            errno = EAGAIN;
+            return -1; // no more msg, keep errno for caller.
+        }
+
+        for (i = 0; i < ret; i++) {
+            void* ptr = evs[i].data.ptr;
+            if (ptr == (void*)&tcp->lsn_fd) {
+                _aux_tcp_accept(tcp);
+            } else if (ptr == (void*)&tcp->tm_fd) {
+                _aux_tcp_reap(tcp);
+            } else {
+                _aux_tcp_conn_event(tcp, (struct vtcp_conn*)ptr, evs[i].events);
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * to close all connections and listening socket.
+ * @impl:
+ */
+static
+void _vrpc_tcp_close(void* impl)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    struct vtcp_conn* conn = NULL;
+    int i = 0;
+    vassert(tcp);
+
+    tcp->fallback = NULL; // udp rpc might have gone.
+    for (i = 0; i < varray_size(&tcp->conns); i++) {
+        conn = (struct vtcp_conn*)varray_get(&tcp->conns, i);
+        _aux_tcp_conn_kill(tcp, conn);
+    }
+    _aux_tcp_conn_sweep(tcp);
+    varray_deinit(&tcp->conns);
+    close(tcp->tm_fd);
+    close(tcp->lsn_fd);
+    close(tcp->ep_fd);
+    free(tcp);
+    return ;
+}
+
+/*
+ * to get fd of inner epoll, which is readable when any of sockets has
+ * events.
+ * @impl:
+ */
+static
+int _vrpc_tcp_getfd(void* impl)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    vassert(tcp);
+    return tcp->ep_fd;
+}
+
+/*
+ * to check whether msgs could be taken. it's always the case, since each
+ * connection has its own write buffer, and msgs overflowing it go by udp.
+ * @impl:
+ */
+static
+int _vrpc_tcp_sndable(void* impl)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    vassert(tcp);
+    return 1;
+}
+
+/*
+ * to dump
+ * @impl
+ */
+static
+void _vrpc_tcp_dump(void* impl)
+{
+    struct vtcp* tcp = (struct vtcp*)impl;
+    char buf[64];
+    int  port = 0;
+    vassert(tcp);
+
+    vsockaddr_unconvert(&tcp->addr, buf, 64, (uint16_t*)&port);
+    printf("tcp,");
+    printf("address: %s:%d,", buf, port);
+    printf("conns:%d,", varray_size(&tcp->conns));
+    printf("connects:%d,", tcp->nconnects);
+    printf("accepts:%d,", tcp->naccepts);
+    printf("reaps:%d,", tcp->nreaps);
+    printf("fallbacks:%d,", tcp->nfallbacks);
+    printf("wbytes:%d,", tcp->nwbytes);
+    printf("fd:%d ", tcp->ep_fd);
+    return ;
+}
+
+/*
+ * downword method set for tcp mode.
+ */
+static
+struct vrpc_base_ops tcp_base_ops = {
+    .open    = _vrpc_tcp_open,
+    .sndto   = _vrpc_tcp_sndto,
+    .sndmto  = NULL,
+    .rcvfrom = _vrpc_tcp_rcvfrom,
+    .rcvmfrom= NULL,
+    .close   = _vrpc_tcp_close,
+    .getfd   = _vrpc_tcp_getfd,
+    .sndable = _vrpc_tcp_sndable,
+    .dump    = _vrpc_tcp_dump
+};
+
+/*
+ *
+ */
+static
+struct vrpc_base_ops* rpc_base_ops[VRPC_MODE_BUTT] = {
+    [VRPC_UNIX]      = &unix_base_ops,
+    [VRPC_UDP]       = &udp_base_ops,
+    [VRPC_TCP]       = &tcp_base_ops,
+    [VRPC_UDP_SHARD] = &udp_shard_base_ops
+};
+
+/*
+ * for rpc upword methods
+ */
+
+/*
+ * to send a batch of msgs fetched from msger. msgs not sent yet, because
+ * of partial sending or EAGAIN, are kept pending at front of the batch
+ * and will be resent firstly next time.
+ * @rpc:
+ */
+static
+int _aux_rpc_snd_batch(struct vrpc* rpc)
+{
+    int ret = 0;
+    int i = 0;
+    vassert(rpc);
+
+    while (rpc->nsndms < VRPC_SND_BATCH) {
+        ret = rpc->msger->ops->pop(rpc->msger, &rpc->sndms[rpc->nsndms]);
+        if (ret < 0) {
+            break;
+        }
+        rpc->nsndms++;
+    }
+    retS((!rpc->nsndms));
+
+    ret = rpc->base_ops->sndmto(rpc->impl, rpc->sndms, rpc->nsndms);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return 0;
+    }
+    if (ret < 0) {
+        // drop the first msg that failed, the rest go on next time.
+        rpc->stat.nerrs++;
+        vmsg_sys_free(rpc->sndms[0]);
+        rpc->nsndms--;
+        memmove(rpc->sndms, rpc->sndms + 1, rpc->nsndms * sizeof(rpc->sndms[0]));
+        retE((1));
+    }
+
+    for (i = 0; i < ret; i++) {
+        rpc->stat.snd_bytes += rpc->sndms[i]->len;
+        rpc->stat.nsnds++;
+        vmsg_sys_free(rpc->sndms[i]);
+    }
+    rpc->nsndms -= ret;
+    memmove(rpc->sndms, rpc->sndms + ret, rpc->nsndms * sizeof(rpc->sndms[0]));
+    return ret;
+}
+
+/*
+ * to send msgs fetched from msger.
+ * @rpc:
+ * return: number of msgs sent, 0 if nothing to send or socket would
+ *         block (the msgs are kept pending), -1 if a msg was dropped.
+ */
+static
+int _vrpc_snd(struct vrpc* rpc)
+{
+    int ret = 0;
+    vassert(rpc);
+    vassert(rpc->impl);
+    vassert(rpc->msger);
+
+    if (rpc->base_ops->sndmto) {
+        return _aux_rpc_snd_batch(rpc);
+    }
+
+    if (!rpc->sndm) {
+        ret = rpc->msger->ops->pop(rpc->msger, &rpc->sndm);
+        retS((ret < 0));
+    }
+
+    ret = rpc->base_ops->sndto(rpc->impl, rpc->sndm);
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return 0; // resend it when rpc turns to be writable again.
+    }
+    vmsg_sys_free(rpc->sndm);
+    rpc->sndm = NULL;
+    if (ret < 0) {
+        rpc->stat.nerrs++;
+        retE((1));
+    }
+    rpc->stat.snd_bytes += ret;
+    rpc->stat.nsnds++;
+    return 1;
+}
+
+static
+int _aux_ring_init(struct vrpc_ring* ring, int nslots)
+{
+    struct vmsg_sys* ms = NULL;
+    int ret = 0;
+    int i = 0;
+
+    vassert(ring);
+    vassert(nslots > 0);
+
+    memset(ring, 0, sizeof(*ring));
+    ret = posix_memalign((void**)&ring->base, VRPC_SLOT_ALIGN, nslots * VRPC_SLOT_SZ);
+    vlogEv((ret), elog_posix_memalign);
+    retE((ret));
+
+    ring->slots = (struct vmsg_sys*)malloc(nslots * sizeof(struct vmsg_sys));
+    vlogEv((!ring->slots), elog_malloc);
+    ret1E((!ring->slots), free(ring->base));
+
+    ring->busy = (int*)malloc(nslots * sizeof(int));
+    vlogEv((!ring->busy), elog_malloc);
+    ret2E((!ring->busy), free(ring->slots), free(ring->base));
+
+    for (i = 0; i < nslots; i++) {
+        ms = &ring->slots[i];
+        memset(ms, 0, sizeof(*ms));
+        vlist_init(&ms->list);
+        ms->data = ring->base + i * VRPC_SLOT_SZ;
+        ms->len  = VRPC_SLOT_SZ - 1;
+        ring->busy[i] = 0;
+    }
+    ring->nslots = nslots;
+    ring->head   = 0;
+    return 0;
+}
+
+static
+void _aux_ring_deinit(struct vrpc_ring* ring)
+{
+    vassert(ring);
+
+    if (ring->base) {
+        free(ring->busy);
+        free(ring->slots);
+        free(ring->base);
+        ring->base = NULL;
+    }
+    return ;
+}
+
+/*
+ * to grab at most @num free slots in ring order for receiving. only
+ * addresses and length of slot are reset, but never its buffer.
+ * @ring:
+ * @slots: [out]
+ * @num:
+ */
+static
+int _aux_ring_grab(struct vrpc_ring* ring, struct vmsg_sys** slots, int num)
+{
+    struct vmsg_sys* ms = NULL;
+    int idx = 0;
+    int n = 0;
+    int i = 0;
+
+    vassert(ring);
+    vassert(slots);
+
+    for (i = 0; (i < ring->nslots) && (n < num); i++) {
+        idx = ring->head;
+        ring->head = (ring->head + 1) % ring->nslots;
+        if (__sync_lock_test_and_set(&ring->busy[idx], 1)) {
+            continue; // still held by consumer.
+        }
+        ms = &ring->slots[idx];
+        memset(&ms->addr, 0, sizeof(ms->addr));
+        memset(&ms->spec, 0, sizeof(ms->spec));
+        ms->len = VRPC_SLOT_SZ - 1;
+        slots[n++] = ms;
+    }
+    return n;
+}
+
+/*
+ * to recycle slot after msg in it has been dispatched.
+ * @ring:
+ * @ms:
+ */
+static
+void _aux_ring_put(struct vrpc_ring* ring, struct vmsg_sys* ms)
+{
+    vassert(ring);
+    vassert(ms);
+
+    __sync_lock_release(&ring->busy[ms - ring->slots]);
+    return ;
+}
+
+/*
+ * to give back slots grabbed but not received into, and rewind ring
+ * so that they are the first ones to grab next time (still hot in cache).
+ * @ring:
+ * @slots:
+ * @num:
+ */
+static
+void _aux_ring_unget(struct vrpc_ring* ring, struct vmsg_sys** slots, int num)
+{
+    int i = 0;
+    vassert(ring);
+    vassert(slots);
+
+    if (num <= 0) {
+        return ; // nothing left to give back.
+    }
+    ring->head = slots[0] - ring->slots;
+    for (i = 0; i < num; i++) {
+        _aux_ring_put(ring, slots[i]);
+    }
+    return ;
+}
+
+/*
+ * to receive a batch of msgs from socket into ring slots and dispatch them
+ * one by one. each msg received is terminated with '\0' instead of zeroing
+ * the whole slot. slots are recycled right after dispatching, that is after
+ * the msg has been decoded (dec_done) by upper layer.
+ * @rpc:
+ */
+static
+int _aux_rpc_rcv_batch(struct vrpc* rpc)
+{
+    struct vmsg_sys* slots[VRPC_RCV_BATCH];
+    struct vmsg_sys* ms = NULL;
+    int num = 0;
+    int ret = 0;
+    int i = 0;
+    int n = 0;
+
+    vassert(rpc);
+
+    num = _aux_ring_grab(&rpc->ring, slots, VRPC_RCV_BATCH);
+    retS((num <= 0));
+
+    ret = rpc->base_ops->rcvmfrom(rpc->impl, slots, num);
+    if (ret < 0) {
+        _aux_ring_unget(&rpc->ring, slots, num);
+    }
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return 0;
+    }
+    if (ret < 0) {
+        rpc->stat.nerrs++;
+        retE((1));
+    }
+    _aux_ring_unget(&rpc->ring, slots + ret, num - ret);
+
+    // histogram slot n for batch size in [2^n, 2^(n+1)).
+    for (n = 0; ((1 << (n+1)) <= ret) && (n < VRPC_BATCH_HIST - 1); n++);
+    rpc->stat.rcv_batches[n]++;
+
+    for (i = 0; i < ret; i++) {
+        ms = slots[i];
+        ((char*)ms->data)[ms->len] = '\0';
+        rpc->stat.rcv_bytes += ms->len;
+        rpc->stat.nrcvs++;
+        rpc->msger->ops->dsptch(rpc->msger, ms);
+        _aux_ring_put(&rpc->ring, ms);
+    }
+    return ret;
+}
+
+/*
+ * to receive msg from socket and dispatch it.
+ * @rpc:
+ * return: number of msgs received, 0 if no more msg pending, and -1
+ *         for socket error.
+ */
+static
+int _vrpc_rcv(struct vrpc* rpc)
+{
+    struct vmsg_sys* ms = NULL;
+    int ret = 0;
+
+    vassert(rpc);
+    vassert(rpc->impl);
+    vassert(rpc->msger);
+
+    if (rpc->base_ops->rcvmfrom) {
+        return _aux_rpc_rcv_batch(rpc);
+    }
+
+    retS((_aux_ring_grab(&rpc->ring, &ms, 1) <= 0));
+    ret = rpc->base_ops->rcvfrom(rpc->impl, ms);
+    if (ret < 0) {
+        _aux_ring_unget(&rpc->ring, &ms, 1);
+    }
+    if ((ret < 0) && (errno == EAGAIN)) {
+        return 0;
+    }
+    if (ret < 0) {
+        rpc->stat.nerrs++;
+        retE((1));
+    }
+    ((char*)ms->data)[ms->len] = '\0';
+    rpc->stat.rcv_bytes += ret;
+    rpc->stat.nrcvs++;
+
+    // bogus msg would be dropped, go ahead to receive next one.
+    rpc->msger->ops->dsptch(rpc->msger, ms);
+    _aux_ring_put(&rpc->ring, ms);
+    return 1;
+}
+
+/*
+ * to check whether rpc has msg to send, including the one pending.
+ * @rpc:
+ */
+static
+int _aux_rpc_sndable(struct vrpc* rpc)
+{
+    vassert(rpc);
+    return (rpc->sndm || rpc->nsndms || rpc->msger->ops->popable(rpc->msger));
+}
+
+/*
+ * to check whether waiter has to watch fd of rpc being writable, which is
+ * not the case for rpc buffering msgs on its own.
+ * @rpc:
+ */
+static
+int _aux_rpc_wait_wr(struct vrpc* rpc)
+{
+    vassert(rpc);
+    return (!rpc->base_ops->sndable && _aux_rpc_sndable(rpc));
+}
+
+/*
+ * to hand msgs over to rpc buffering msgs on its own as many as it could
+ * take, without waiting for its fd.
+ * @rpc:
+ */
+static
+void _aux_rpc_flush(struct vrpc* rpc)
+{
+    vassert(rpc);
+
+    if (!rpc->base_ops->sndable) {
+        return ;
+    }
+    while (rpc->base_ops->sndable(rpc->impl) && (rpc->ops->snd(rpc) != 0));
+    return ;
+}
+
+static
+int _vrpc_err(struct vrpc* rpc)
+{
+    vassert(rpc);
+    vassert(rpc->impl);
+
+    rpc->base_ops->close(rpc->impl);
+    rpc->impl = rpc->base_ops->open(&rpc->addr);
+    retE((!rpc->impl));
+
+    return 0;
+}
+
+static
+int _vrpc_getId(struct vrpc* rpc)
+{
+    vassert(rpc);
+    vassert(rpc->impl);
+
+    return rpc->base_ops->getfd(rpc->impl);
+}
+
+static
+void _vrpc_stat(struct vrpc* rpc, struct vrpc_stat* buf)
+{
+    vassert(rpc);
+    vassert(buf);
+
+    memcpy(buf, &rpc->stat, sizeof(*buf));
+    return ;
+}
+
+static
+void _vrpc_dump(struct vrpc* rpc)
+{
+    vassert(rpc);
+    printf("{ ");
+    printf("nerrs:%d, ", rpc->stat.nerrs);
+    printf("nsnds:%d, ", rpc->stat.nsnds);
+    printf("nrcvs:%d, ", rpc->stat.nrcvs);
+    printf("send bytes:%d,", rpc->stat.snd_bytes);
+    printf("rcved bytes:%d,", rpc->stat.rcv_bytes);
+    if (rpc->base_ops->rcvmfrom) {
+        int i = 0;
+        printf("rcv batches:");
+        for (i = 0; i < VRPC_BATCH_HIST; i++) {
+            printf("[%d]%d%s", (1 << i), rpc->stat.rcv_batches[i],
+                   (i < VRPC_BATCH_HIST - 1) ? "/" : ",");
+        }
+    }
+    rpc->base_ops->dump(rpc->impl);
+    printf(" }\n");
+    return ;
+}
+
+/*
+ * generic rpc method set with user torwareds. it encapusulated socket
+ * details from user.
+ */
+static
+struct vrpc_ops rpc_ops = {
+    .snd   = _vrpc_snd,
+    .rcv   = _vrpc_rcv,
+    .err   = _vrpc_err,
+    .getId = _vrpc_getId,
+    .stat  = _vrpc_stat,
+    .dump  = _vrpc_dump
+};
+
+/*
+ * each rpc channel must has one msger, and only one msger to deal with
+ * upwords user.
+ * user only need to be aware of msg format.DO NOT need details of rpc.
+ *
+ * @rpc:  [in, out]
+ * @msger:[in];
+ * @mode :[in];
+ * @addr :[in]
+ */
+int vrpc_init(struct vrpc* rpc, struct vmsger* msger, int mode, struct vsockaddr* addr)
+{
+    int nslots = 2;
+    int ret = 0;
+    vassert(rpc);
+    vassert(addr);
+    vassert(vrpc_mode_ok(mode));
+
+    memset(rpc, 0, sizeof(*rpc));
+    memcpy(&rpc->addr, addr, sizeof(*addr));
+    rpc->mode = mode;
+    rpc->msger= msger;
+    rpc->impl = NULL;
+    rpc->ops  = &rpc_ops;
+    rpc->base_ops = rpc_base_ops[mode];
+
+    rpc->sndm = NULL;
+
+    rpc->stat.nerrs = 0;
+    rpc->stat.nsnds = 0;
+    rpc->stat.nrcvs = 0;
+    rpc->stat.snd_bytes = 0;
+    rpc->stat.rcv_bytes = 0;
+
+    // twice the batch size, so that slots still held by consumers
+    // would not stall receiving.
+    if (rpc->base_ops->rcvmfrom) {
+        nslots = 2 * VRPC_RCV_BATCH;
+    }
+    ret = _aux_ring_init(&rpc->ring, nslots);
+    retE((ret < 0));
+
+#ifdef _VRPC_URING
+    if (rpc_uring_base_ops[mode]) {
+        rpc->impl = rpc_uring_base_ops[mode]->open(addr);
+        if (rpc->impl) {
+            rpc->base_ops = rpc_uring_base_ops[mode];
+            return 0;
+        }
+        vlogI("io_uring unavailable, fall back to udp socket");
+    }
+#endif
+    rpc->impl = rpc->base_ops->open(addr);
+    ret1E((!rpc->impl), _aux_ring_deinit(&rpc->ring));
+    return 0;
 }
 
 /*
@@ -566,14 +2460,65 @@ void vrpc_deinit(struct vrpc* rpc)
         vmsg_sys_free(rpc->sndm);
         rpc->sndm = NULL;
     }
-    if (rpc->rcvm) {
-        vmsg_sys_free(rpc->rcvm);
-        rpc->sndm = NULL;
+    while (rpc->nsndms > 0) {
+        vmsg_sys_free(rpc->sndms[--rpc->nsndms]);
     }
+    _aux_ring_deinit(&rpc->ring);
     rpc->base_ops->close(rpc->impl);
     return ;
 }
 
+/*
+ * to register msger of udp rpc to tcp rpc, so that msgs to peer not
+ * reachable by tcp go by udp instead of being dropped.
+ * @rpc: tcp rpc.
+ * @msger:
+ */
+void vrpc_reg_fallback(struct vrpc* rpc, struct vmsger* msger)
+{
+    vassert(rpc);
+    vassert(rpc->impl);
+    vassert(rpc->mode == VRPC_TCP);
+
+    ((struct vtcp*)rpc->impl)->fallback = msger;
+    return ;
+}
+
+/*
+ * callback from msger when its msg queue turns to be non-empty, which
+ * might be called on any thread. it wakes up waiter blocked in waiting
+ * so that the msg could be sent right away.
+ * @cookie: waiter.
+ */
+static
+void _aux_waiter_notify_cb(void* cookie)
+{
+    struct vwaiter* wt = (struct vwaiter*)cookie;
+    uint64_t val = 1;
+    int ret = 0;
+    vassert(wt);
+
+    ret = write(wt->evfd, &val, sizeof(val));
+    vlogEv((ret < 0), elog_write);
+    return ;
+}
+
+/*
+ * to consume the wakeup signals.
+ * @wt:
+ */
+static
+void _aux_waiter_drain(struct vwaiter* wt)
+{
+    uint64_t val = 0;
+    int ret = 0;
+    vassert(wt);
+
+    ret = read(wt->evfd, &val, sizeof(val));
+    vlogEv(((ret < 0) && (errno != EAGAIN)), elog_read);
+    return ;
+}
+
 /*
  * @wt:
  * @rpc:
@@ -587,6 +2532,7 @@ int _vwaiter_add(struct vwaiter* wt, struct vrpc* rpc)
 
     vlock_enter(&wt->lock);
     varray_add_tail(&wt->rpcs, rpc);
+    vmsger_reg_notify_cb(rpc->msger, _aux_waiter_notify_cb, wt);
     wt->reset = 1;
     vlock_leave(&wt->lock);
     return 0;
@@ -610,6 +2556,7 @@ int _vwaiter_remove(struct vwaiter* wt, struct vrpc* rpc)
         }
     }
     if (i < varray_size(&wt->rpcs)) {
+        vmsger_reg_notify_cb(rpc->msger, NULL, wt);
         varray_del(&wt->rpcs, i);
         wt->reset = 1;
     }
@@ -632,7 +2579,7 @@ int _aux_fdsets_cb(void* item, void* cookie)
 
     FD_SET(fd, &wt->rfds);
     FD_SET(fd, &wt->efds);
-    if (rpc->msger->ops->popable(rpc->msger)) {
+    if (_aux_rpc_wait_wr(rpc)) {
         FD_SET(fd, &wt->wfds);
     }
     return 0;
@@ -658,6 +2605,7 @@ int _aux_laundry_cb(void* item, void* cookie)
     if (FD_ISSET(fd, &wt->efds)) {
         rpc->ops->err(rpc);
     }
+    _aux_rpc_flush(rpc);
     return 0;
 }
 
@@ -675,6 +2623,8 @@ int _vwaiter_laundry(struct vwaiter* wt)
     FD_ZERO(&wt->rfds);
     FD_ZERO(&wt->wfds);
     FD_ZERO(&wt->efds);
+    FD_SET(wt->evfd, &wt->rfds);
+    wt->maxfd = (wt->evfd >= wt->maxfd) ? wt->evfd + 1 : wt->maxfd;
     varray_iterate(&wt->rpcs, _aux_fdsets_cb, wt);
     vlock_leave(&wt->lock);
 
@@ -693,6 +2643,9 @@ int _vwaiter_laundry(struct vwaiter* wt)
         retS((!ret)); //timeout.
     }
 
+    if (FD_ISSET(wt->evfd, &wt->rfds)) {
+        _aux_waiter_drain(wt); // fd sets would be rebuilt next round.
+    }
     vlock_enter(&wt->lock);
     varray_iterate(&wt->rpcs, _aux_laundry_cb, wt);
     vlock_leave(&wt->lock);
@@ -716,7 +2669,7 @@ int _vwaiter_dump(struct vwaiter* wt)
 {
     vassert(wt);
 
-    vdump(printf("-> rpc list: "));
+    vdump(printf("-> rpc list (%s): ", (wt->mode == VWAITER_EPOLL) ? "epoll" : "select"));
     vlock_enter(&wt->lock);
     varray_iterate(&wt->rpcs, _aux_dump_cb, wt);
     vlock_leave(&wt->lock);
@@ -724,25 +2677,253 @@ int _vwaiter_dump(struct vwaiter* wt)
 }
 
 static
-struct vwaiter_ops waiter_ops = {
+struct vwaiter_ops select_waiter_ops = {
     .add     = _vwaiter_add,
     .remove  = _vwaiter_remove,
     .laundry = _vwaiter_laundry,
     .dump    = _vwaiter_dump
 };
 
+/*
+ * for epoll waiter. each rpc is registered only once in edge-triggered
+ * mode when it's added. writable interest is armed only after waiter is
+ * woken up by msger whose queue turns to be non-empty, and disarmed after
+ * the queue is drained.
+ */
+struct vwaiter_item {
+    struct vwaiter* wt;
+    struct vrpc* rpc;
+    int fd;
+    int armed;
+};
+
+static MEM_AUX_INIT(witem_cache, sizeof(struct vwaiter_item), 0);
+
+static
+int _aux_epoll_ctl(struct vwaiter_item* item, int op, uint32_t events)
+{
+    struct epoll_event ev;
+    int ret = 0;
+    vassert(item);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = events;
+    ev.data.ptr = item;
+    ret = epoll_ctl(item->wt->epfd, op, item->fd, &ev);
+    vlogEv((ret < 0), elog_epoll_ctl);
+    retE((ret < 0));
+    return 0;
+}
+
+static
+int _aux_epoll_arm_cb(void* item, void* cookie)
+{
+    struct vwaiter_item* witem = (struct vwaiter_item*)item;
+    vassert(witem);
+
+    _aux_rpc_flush(witem->rpc);
+    if (!witem->armed && _aux_rpc_wait_wr(witem->rpc)) {
+        witem->armed = 1;
+        _aux_epoll_ctl(witem, EPOLL_CTL_MOD, EPOLLIN | EPOLLOUT | EPOLLET);
+    }
+    return 0;
+}
+
+/*
+ * to reopen socket of rpc and register it again.
+ * @item:
+ */
+static
+int _aux_epoll_reset(struct vwaiter_item* item)
+{
+    uint32_t events = EPOLLIN | EPOLLET;
+    int ret = 0;
+    vassert(item);
+
+    ret = item->rpc->ops->err(item->rpc);
+    retE((ret < 0));
+
+    item->fd = item->rpc->ops->getId(item->rpc);
+    item->armed = _aux_rpc_wait_wr(item->rpc);
+    events |= item->armed ? EPOLLOUT : 0;
+    ret = _aux_epoll_ctl(item, EPOLL_CTL_ADD, events);
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * @wt:
+ * @rpc:
+ */
+static
+int _vwaiter_epoll_add(struct vwaiter* wt, struct vrpc* rpc)
+{
+    struct vwaiter_item* item = NULL;
+    uint32_t events = EPOLLIN | EPOLLET;
+    int ret = 0;
+
+    vassert(wt);
+    vassert(rpc);
+
+    item = (struct vwaiter_item*)vmem_aux_alloc(&witem_cache);
+    vlogEv((!item), elog_vmem_aux_alloc);
+    retE((!item));
+    memset(item, 0, sizeof(*item));
+    item->wt  = wt;
+    item->rpc = rpc;
+    item->fd  = rpc->ops->getId(rpc);
+    item->armed = _aux_rpc_wait_wr(rpc);
+    events |= item->armed ? EPOLLOUT : 0;
+
+    vlock_enter(&wt->lock);
+    ret = _aux_epoll_ctl(item, EPOLL_CTL_ADD, events);
+    if (ret < 0) {
+        vlock_leave(&wt->lock);
+        vmem_aux_free(&witem_cache, item);
+        retE((1));
+    }
+    varray_add_tail(&wt->items, item);
+    _vwaiter_add(wt, rpc);
+    vlock_leave(&wt->lock);
+    return 0;
+}
+
+/*
+ * @wt:
+ * @rpc:
+ */
+static
+int _vwaiter_epoll_remove(struct vwaiter* wt, struct vrpc* rpc)
+{
+    struct vwaiter_item* item = NULL;
+    int i = 0;
+
+    vassert(wt);
+    vassert(rpc);
+
+    vlock_enter(&wt->lock);
+    for (; i < varray_size(&wt->items); i++) {
+        item = (struct vwaiter_item*)varray_get(&wt->items, i);
+        if (item->rpc == rpc) {
+            break;
+        }
+    }
+    if (i < varray_size(&wt->items)) {
+        // socket might have been closed, which deregistered it already.
+        epoll_ctl(wt->epfd, EPOLL_CTL_DEL, item->fd, NULL);
+        varray_del(&wt->items, i);
+        vmem_aux_free(&witem_cache, item);
+    }
+    _vwaiter_remove(wt, rpc);
+    vlock_leave(&wt->lock);
+    return 0;
+}
+
+/*
+ * @wt:
+ */
+static
+int _vwaiter_epoll_laundry(struct vwaiter* wt)
+{
+    struct epoll_event evs[VWAITER_MAX_EVENTS];
+    sigset_t sigmask;
+    int ret = 0;
+    int i = 0;
+
+    vassert(wt);
+
+    sigemptyset(&sigmask);
+    ret = epoll_pwait(wt->epfd, evs, VWAITER_MAX_EVENTS, 500, &sigmask);
+    retS(((ret < 0) && (errno == EINTR)));
+    vlogEv((ret < 0), elog_epoll_wait);
+    retE((ret < 0));
+    retS((!ret)); //timeout.
+
+    vlock_enter(&wt->lock);
+    for (i = 0; i < ret; i++) {
+        struct vwaiter_item* item = (struct vwaiter_item*)evs[i].data.ptr;
+        struct vrpc* rpc = NULL;
+
+        if (!item) { // woken up by msger.
+            _aux_waiter_drain(wt);
+            varray_iterate(&wt->items, _aux_epoll_arm_cb, wt);
+            continue;
+        }
+        rpc = item->rpc;
+        if (evs[i].events & (EPOLLERR | EPOLLHUP)) {
+            _aux_epoll_reset(item);
+            continue;
+        }
+        if (evs[i].events & EPOLLIN) {
+            // edge-triggered, have to drain it until it would block.
+            while (rpc->ops->rcv(rpc) > 0);
+            _aux_rpc_flush(rpc);
+        }
+        if (evs[i].events & EPOLLOUT) {
+            while (rpc->ops->snd(rpc) != 0);
+            if (!_aux_rpc_sndable(rpc)) {
+                // msg pushed after here would wake up waiter again.
+                item->armed = 0;
+                _aux_epoll_ctl(item, EPOLL_CTL_MOD, EPOLLIN | EPOLLET);
+            }
+        }
+    }
+    vlock_leave(&wt->lock);
+    return 0;
+}
+
+static
+struct vwaiter_ops epoll_waiter_ops = {
+    .add     = _vwaiter_epoll_add,
+    .remove  = _vwaiter_epoll_remove,
+    .laundry = _vwaiter_epoll_laundry,
+    .dump    = _vwaiter_dump
+};
+
 /*
  * @wt:
+ * @mode: epoll or select. it would fall back to select mode if epoll is
+ *        unavailable.
  */
-int vwaiter_init(struct vwaiter* wt)
+int vwaiter_init(struct vwaiter* wt, int mode)
 {
     vassert(wt);
+    vassert((mode >= VWAITER_SELECT) && (mode < VWAITER_BUTT));
 
     wt->reset = 1;
     wt->maxfd = 0;
+    wt->epfd  = -1;
+    wt->mode  = VWAITER_SELECT;
+    wt->ops   = &select_waiter_ops;
     vlock_init(&wt->lock);
     varray_init(&wt->rpcs, 8);
-    wt->ops = &waiter_ops;
+    varray_init(&wt->items, 8);
+
+    wt->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    vlogEv((wt->evfd < 0), elog_eventfd);
+    retE((wt->evfd < 0));
+
+    if (mode == VWAITER_EPOLL) {
+        wt->epfd = epoll_create1(EPOLL_CLOEXEC);
+        vlogEv((wt->epfd < 0), elog_epoll_create1);
+    }
+    if (wt->epfd >= 0) {
+        struct epoll_event ev;
+        int ret = 0;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events   = EPOLLIN;
+        ev.data.ptr = NULL;
+        ret = epoll_ctl(wt->epfd, EPOLL_CTL_ADD, wt->evfd, &ev);
+        vlogEv((ret < 0), elog_epoll_ctl);
+        if (ret < 0) {
+            close(wt->epfd);
+            wt->epfd = -1;
+        } else {
+            wt->mode = VWAITER_EPOLL;
+            wt->ops  = &epoll_waiter_ops;
+        }
+    }
     return 0;
 }
 
@@ -751,8 +2932,20 @@ int vwaiter_init(struct vwaiter* wt)
  */
 void vwaiter_deinit(struct vwaiter* wt)
 {
+    struct vwaiter_item* item = NULL;
     vassert(wt);
 
+    while (varray_size(&wt->items) > 0) {
+        item = (struct vwaiter_item*)varray_pop_tail(&wt->items);
+        vmem_aux_free(&witem_cache, item);
+    }
+    if (wt->epfd >= 0) {
+        close(wt->epfd);
+    }
+    if (wt->evfd >= 0) {
+        close(wt->evfd);
+    }
+    varray_deinit(&wt->items);
     varray_deinit(&wt->rpcs);
     vlock_deinit(&wt->lock);
     return ;
@@ -3,8 +3,16 @@
 
 #include <sys/types.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#ifdef _VRPC_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 #include "vmsger.h"
 
 enum {
@@ -13,6 +21,7 @@ enum {
     VRPC_TCP,
     VRPC_SUDP,
     VRPC_STCP,
+    VRPC_UDP_SHARD,
     VRPC_MODE_BUTT
 };
 #define vrpc_mode_ok(mode) ((mode >= VRPC_UNIX) && (mode < VRPC_MODE_BUTT))
@@ -20,12 +29,40 @@ enum {
 /*
  * for rpc
  */
+#define VRPC_RCV_BATCH      ((int)16)
+#define VRPC_SND_BATCH      ((int)16)
+#define VRPC_BATCH_HIST     ((int)5)   // batch size: 1, 2-3, 4-7, 8-15, 16.
+#define VRPC_CTRL_SZ        ((int)64)
+#define VRPC_SLOT_SZ        ((int)(8*BUF_SZ))
+#define VRPC_SLOT_ALIGN     ((int)64)
+#define VRPC_DGRAM_SZ       ((int)1400) // larger datagram is prone to be fragmented.
+
+/*
+ * for tcp rpc, each msg is framed with 4 bytes length in network order.
+ */
+#define VRPC_TCP_FRAME_SZ   ((int)(VRPC_SLOT_SZ - 1))
+#define VRPC_TCP_WBUF_SZ    ((int)(4*VRPC_SLOT_SZ))
+#define VRPC_TCP_MAX_CONNS  ((int)64)
+#define VRPC_TCP_IDLE_TMO   ((int)60)   // seconds
+#define VRPC_TCP_REAP_TMO   ((int)2)    // seconds
+#define VRPC_TCP_CONN_TMO   ((int)3)    // seconds
+#define VRPC_TCP_DENY_TMO   ((int)600)  // seconds
+#define VRPC_TCP_MAX_DENIES ((int)64)
+#define VRPC_URING_NBUFS    ((int)64)   // provided buffers, power of 2.
+
+/*
+ * @sndable is only for rpc buffering msgs on its own (say tcp), whose fd
+ * never turns to be writable. NULL for others.
+ */
 struct vrpc_base_ops {
-    void* (*open)   (struct vsockaddr*);
-    int   (*sndto)  (void*, struct vmsg_sys*);
-    int   (*rcvfrom)(void*, struct vmsg_sys*);
+    void* (*open)    (struct vsockaddr*);
+    int   (*sndto)   (void*, struct vmsg_sys*);
+    int   (*sndmto)  (void*, struct vmsg_sys**, int);
+    int   (*rcvfrom) (void*, struct vmsg_sys*);
+    int   (*rcvmfrom)(void*, struct vmsg_sys**, int);
     void  (*close)  (void*);
     int   (*getfd)  (void*);
+    int   (*sndable)(void*);
     void  (*dump)   (void*);
 };
 
@@ -35,6 +72,7 @@ struct vrpc_stat {
     int nerrs;
     int snd_bytes;
     int rcv_bytes;
+    int rcv_batches[VRPC_BATCH_HIST];
 };
 
 struct vrpc;
@@ -47,12 +85,27 @@ struct vrpc_ops {
     void (*dump) (struct vrpc*);
 };
 
+/*
+ * ring of receiving slots carved from one cache-aligned block, which are
+ * never zeroed. a slot is busy from being received into until the msg in
+ * it has been dispatched, and could be released on any thread.
+ */
+struct vrpc_ring {
+    char* base;
+    struct vmsg_sys* slots;
+    int* busy;
+    int  nslots;
+    int  head;
+};
+
 struct vrpc {
     int mode;
     struct vsockaddr addr;
 
-    struct vmsg_sys* rcvm;
+    struct vrpc_ring ring;
     struct vmsg_sys* sndm;
+    struct vmsg_sys* sndms[VRPC_SND_BATCH];
+    int nsndms;
     struct vmsger*   msger;
 
     struct vrpc_ops* ops;           //upword   methods
@@ -64,10 +117,18 @@ struct vrpc {
 
 int  vrpc_init  (struct vrpc*, struct vmsger*, int, struct vsockaddr*);
 void vrpc_deinit(struct vrpc*);
+void vrpc_reg_fallback(struct vrpc*, struct vmsger*);
 
 /*
  * for rpc_waiter.
  */
+enum {
+    VWAITER_SELECT,
+    VWAITER_EPOLL,
+    VWAITER_BUTT
+};
+#define VWAITER_MAX_EVENTS  ((int)16)
+
 struct vwaiter;
 struct vwaiter_ops {
     int (*add)    (struct vwaiter*, struct vrpc*);
@@ -80,15 +141,22 @@ struct vwaiter {
     struct vlock  lock;
     struct varray rpcs;
     int reset;
+    int mode;
+    int evfd;   // wakeup channel signaled by msgers.
 
+    // for select mode.
     int maxfd;
     fd_set rfds;
     fd_set wfds;
     fd_set efds;
 
+    // for epoll mode.
+    int epfd;
+    struct varray items;
+
     struct vwaiter_ops* ops;
 };
-int  vwaiter_init  (struct vwaiter*);
+int  vwaiter_init  (struct vwaiter*, int);
 void vwaiter_deinit(struct vwaiter*);
 
 #endif
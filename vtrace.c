@@ -0,0 +1,268 @@
+#include "vglobal.h"
+#include "vtrace.h"
+
+#define VTRACE_ADDR_SZ ((int)(sizeof(uint32_t) + sizeof(uint16_t)))
+#define VTRACE_HDR_SZ  ((int)(sizeof(uint32_t) + 2*VTRACE_ADDR_SZ))
+
+/*
+ * buffer of calling thread for trace being captured. @gen tells whether
+ * it belongs to the trace currently opened, not to a closed one.
+ */
+static __thread struct vtrace_buf* trace_buf = NULL;
+static __thread struct vtrace*     trace_buf_owner = NULL;
+static __thread uint32_t           trace_buf_gen = 0;
+static uint32_t trace_gen = 0;
+
+static
+void _aux_trace_put_addr(char* buf, struct vsockaddr* addr)
+{
+    struct sockaddr_in* sin = to_sockaddr_sin(addr);
+
+    memcpy(buf, &sin->sin_addr.s_addr, sizeof(uint32_t));
+    memcpy(buf + sizeof(uint32_t), &sin->sin_port, sizeof(uint16_t));
+    return ;
+}
+
+static
+void _aux_trace_get_addr(char* buf, struct vsockaddr* addr)
+{
+    struct sockaddr_in* sin = to_sockaddr_sin(addr);
+
+    memset(addr, 0, sizeof(*addr));
+    sin->sin_family = AF_INET;
+    memcpy(&sin->sin_addr.s_addr, buf, sizeof(uint32_t));
+    memcpy(&sin->sin_port, buf + sizeof(uint32_t), sizeof(uint16_t));
+    return ;
+}
+
+/*
+ * the routine to open trace file for capturing or replaying.
+ * @trace:
+ * @path: trace file.
+ * @wr: non-zero to create it for capturing, otherwise to read it.
+ */
+int vtrace_open(struct vtrace* trace, const char* path, int wr)
+{
+    uint32_t hdr[2] = {VTRACE_MAGIC, VTRACE_VER};
+    int ret = 0;
+
+    vassert(trace);
+    vassert(path);
+
+    memset(trace, 0, sizeof(*trace));
+    trace->fp = fopen(path, wr ? "wb" : "rb");
+    vlogEv((!trace->fp), "open trace %s (%s)", path, strerror(errno));
+    retE((!trace->fp));
+
+    if (wr) {
+        ret = fwrite(hdr, sizeof(hdr), 1, trace->fp);
+    } else {
+        ret = fread(hdr, sizeof(hdr), 1, trace->fp);
+        ret = (hdr[0] == VTRACE_MAGIC && hdr[1] == VTRACE_VER) ? ret : 0;
+    }
+    if (ret != 1) {
+        vlogE("bad trace %s", path);
+        fclose(trace->fp);
+        trace->fp = NULL;
+        return -1;
+    }
+    trace->gen = __atomic_add_fetch(&trace_gen, 1, __ATOMIC_RELAXED);
+    vlock_init(&trace->lock);
+    return 0;
+}
+
+/*
+ * to write out records gathered in @buf. called with buf->lock held.
+ */
+static
+int _aux_trace_spill(struct vtrace* trace, struct vtrace_buf* buf)
+{
+    int ret = 1;
+
+    if (!buf->len) {
+        return 0;
+    }
+    vlock_enter(&trace->lock);
+    ret = fwrite(buf->data, buf->len, 1, trace->fp);
+    vlock_leave(&trace->lock);
+    buf->len = 0;
+    retE((ret != 1));
+    return 0;
+}
+
+/*
+ * to get buffer of calling thread, which is allocated on its first write.
+ * return NULL if too many threads are capturing, then records are written
+ * to file directly.
+ */
+static
+struct vtrace_buf* _aux_trace_get_buf(struct vtrace* trace)
+{
+    struct vtrace_buf* buf = NULL;
+
+    if ((trace_buf_owner == trace) && (trace_buf_gen == trace->gen)) {
+        return trace_buf;
+    }
+
+    vlock_enter(&trace->lock);
+    if (trace->nbufs < VTRACE_MAX_BUFS) {
+        buf = (struct vtrace_buf*)malloc(sizeof(*buf));
+        vlogEv((!buf), elog_malloc);
+    }
+    if (buf) {
+        buf->len = 0;
+        vlock_init(&buf->lock);
+        trace->bufs[trace->nbufs++] = buf;
+    }
+    vlock_leave(&trace->lock);
+
+    trace_buf = buf;
+    trace_buf_owner = trace;
+    trace_buf_gen = trace->gen;
+    return buf;
+}
+
+/*
+ * the routine to append msg received to trace. it's called by waiter
+ * threads of host and all workers, each appending to its own buffer.
+ * @trace:
+ * @sm: sys msg with datagram on wire.
+ */
+int vtrace_write(struct vtrace* trace, struct vmsg_sys* sm)
+{
+    struct vtrace_buf* buf = NULL;
+    char hdr[VTRACE_HDR_SZ];
+    uint32_t len = 0;
+    int ret = 0;
+
+    vassert(trace);
+    vassert(sm);
+    retE((!trace->fp));
+
+    len = (uint32_t)sm->len;
+    memcpy(hdr, &len, sizeof(uint32_t));
+    _aux_trace_put_addr(hdr + sizeof(uint32_t), &sm->addr);
+    _aux_trace_put_addr(hdr + sizeof(uint32_t) + VTRACE_ADDR_SZ, &sm->spec);
+    __atomic_add_fetch(&trace->nrecs, 1, __ATOMIC_RELAXED);
+
+    buf = _aux_trace_get_buf(trace);
+    if (!buf || (sizeof(hdr) + sm->len > VTRACE_BUF_SZ)) {
+        vlock_enter(&trace->lock);
+        ret  = fwrite(hdr, sizeof(hdr), 1, trace->fp);
+        ret += fwrite(sm->data, sm->len, 1, trace->fp);
+        vlock_leave(&trace->lock);
+        retE((ret != 2));
+        return 0;
+    }
+
+    vlock_enter(&buf->lock);
+    if (buf->len + sizeof(hdr) + sm->len > VTRACE_BUF_SZ) {
+        ret = _aux_trace_spill(trace, buf);
+    }
+    memcpy(buf->data + buf->len, hdr, sizeof(hdr));
+    memcpy(buf->data + buf->len + sizeof(hdr), sm->data, sm->len);
+    buf->len += sizeof(hdr) + sm->len;
+    vlock_leave(&buf->lock);
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * the routine to write out records gathered by all threads and flush file.
+ * it's called periodically by ticker of host, so records captured reach
+ * file in bounded interval even if capturing threads go idle.
+ * @trace:
+ */
+int vtrace_flush(struct vtrace* trace)
+{
+    struct vtrace_buf* buf = NULL;
+    int nbufs = 0;
+    int ret = 0;
+    int i = 0;
+
+    vassert(trace);
+    retE((!trace->fp));
+
+    vlock_enter(&trace->lock);
+    nbufs = trace->nbufs;
+    vlock_leave(&trace->lock);
+
+    // buffers are only appended until trace is closed.
+    for (i = 0; i < nbufs; i++) {
+        buf = trace->bufs[i];
+        vlock_enter(&buf->lock);
+        ret += _aux_trace_spill(trace, buf);
+        vlock_leave(&buf->lock);
+    }
+    vlock_enter(&trace->lock);
+    ret += fflush(trace->fp);
+    vlock_leave(&trace->lock);
+    retE((ret < 0));
+    return 0;
+}
+
+/*
+ * the routine to read next msg of trace into @buf.
+ * @trace:
+ * @sm: [out] sys msg referring to @buf.
+ * @buf:
+ * @sz: size of @buf.
+ *
+ * return length of datagram, 0 at end of trace, or -1 on error.
+ */
+int vtrace_read(struct vtrace* trace, struct vmsg_sys* sm, void* buf, int sz)
+{
+    struct vsockaddr addr;
+    struct vsockaddr spec;
+    char hdr[VTRACE_HDR_SZ];
+    uint32_t len = 0;
+    int ret = 0;
+
+    vassert(trace);
+    vassert(sm);
+    vassert(buf);
+    retE((!trace->fp));
+
+    ret = fread(hdr, sizeof(hdr), 1, trace->fp);
+    if (ret != 1) {
+        return 0;
+    }
+    memcpy(&len, hdr, sizeof(uint32_t));
+    retE((!len || len > (uint32_t)sz));
+    ret = fread(buf, len, 1, trace->fp);
+    retE((ret != 1));
+
+    _aux_trace_get_addr(hdr + sizeof(uint32_t), &addr);
+    _aux_trace_get_addr(hdr + sizeof(uint32_t) + VTRACE_ADDR_SZ, &spec);
+    vmsg_sys_init(sm, &addr, &spec, (int)len, buf);
+    trace->nrecs++;
+    return (int)len;
+}
+
+/*
+ * the routine to close trace. records still in buffers are written out,
+ * so capturing threads must have stopped.
+ * @trace:
+ */
+void vtrace_close(struct vtrace* trace)
+{
+    int i = 0;
+    vassert(trace);
+
+    if (trace->fp && trace->nbufs) {
+        vtrace_flush(trace);
+    }
+    for (i = 0; i < trace->nbufs; i++) {
+        vlock_deinit(&trace->bufs[i]->lock);
+        free(trace->bufs[i]);
+        trace->bufs[i] = NULL;
+    }
+    trace->nbufs = 0;
+
+    if (trace->fp) {
+        fclose(trace->fp);
+        trace->fp = NULL;
+        vlock_deinit(&trace->lock);
+    }
+    return ;
+}
@@ -0,0 +1,55 @@
+#ifndef __VTRACE_H__
+#define __VTRACE_H__
+
+#include <stdio.h>
+#include "vsys.h"
+#include "vmsger.h"
+
+/*
+ * trace of dht msgs received, which is captured by running host and
+ * replayed offline.
+ *
+ * file format (in host byte order, except for addresses):
+ * -----------------------------------------------
+ * |<- magic ->|<- version ->|<- record ->|......|
+ * -----------------------------------------------
+ *
+ * record format:
+ * -----------------------------------------------------------------------
+ * |<- len ->|<- addr ip,port ->|<- spec ip,port ->|<- datagram (len) ->|
+ * -----------------------------------------------------------------------
+ * where datagram is the one on wire, led by its magic and msgId.
+ */
+#define VTRACE_MAGIC ((uint32_t)0x56545243)
+#define VTRACE_VER   ((uint32_t)1)
+
+#define VTRACE_BUF_SZ   ((int)(64*1024))
+#define VTRACE_MAX_BUFS ((int)32)
+
+/*
+ * records are gathered in buffer of each capturing thread, and written out
+ * to file only when the buffer is full or trace is flushed, so that shards
+ * do not serialize on file for each datagram.
+ */
+struct vtrace_buf {
+    struct vlock lock;
+    int  len;
+    char data[VTRACE_BUF_SZ];
+};
+
+struct vtrace {
+    FILE* fp;
+    int   nrecs;
+    uint32_t gen;
+    int   nbufs;
+    struct vtrace_buf* bufs[VTRACE_MAX_BUFS];
+    struct vlock lock;
+};
+
+int  vtrace_open (struct vtrace*, const char*, int);
+int  vtrace_write(struct vtrace*, struct vmsg_sys*);
+int  vtrace_flush(struct vtrace*);
+int  vtrace_read (struct vtrace*, struct vmsg_sys*, void*, int);
+void vtrace_close(struct vtrace*);
+
+#endif